@@ -79,17 +79,34 @@ vec2 loadR16G16(uint bufferIndex, uint bufferOffset, uint index)
     return unpackHalf2x16(packed);
 }
 
-vec3 loadR16G16B16A16(uint bufferIndex, uint bufferOffset, uint index)
+// Positions are tightly packed r16g16b16_snorm relative to the mesh AABB
+vec3 loadPosition(GeometryMetadata metadata, uint index)
 {
-    if (bufferOffset == 0xFFFFFFFF)
+    if (metadata.positionsOffset == 0xFFFFFFFF)
         return vec3(0);
 
-    uvec2 packed = uvec2(
-        GET_GEOMETRY_BUFFER_U32(bufferIndex).data[bufferOffset + index * 2],
-        GET_GEOMETRY_BUFFER_U32(bufferIndex)
-            .data[bufferOffset + index * 2 + 1]);
+    // Offset is for u32
+    uint offsetU16 = metadata.positionsOffset * 2 + index * 3;
+    uvec3 packed = uvec3(
+        uint(GET_GEOMETRY_BUFFER_U16(metadata.bufferIndex).data[offsetU16]),
+        uint(GET_GEOMETRY_BUFFER_U16(metadata.bufferIndex).data[offsetU16 + 1]),
+        uint(
+            GET_GEOMETRY_BUFFER_U16(metadata.bufferIndex).data[offsetU16 + 2]));
+
+    // Leverage sign extension in GLSL right shift to unpack the components
+    ivec3 signExtended = ivec3(packed << 16) >> 16;
+
+    // 3.10.1. Conversion From Normalized Fixed-Point to Floating-Point
+    vec3 normalized = max(vec3(signExtended) / 32767., -1);
+
+    vec3 center = vec3(
+        metadata.positionsCenterX, metadata.positionsCenterY,
+        metadata.positionsCenterZ);
+    vec3 halfExtent = vec3(
+        metadata.positionsHalfExtentX, metadata.positionsHalfExtentY,
+        metadata.positionsHalfExtentZ);
 
-    return vec3(unpackHalf2x16(packed.x), unpackHalf2x16(packed.y));
+    return normalized * halfExtent + center;
 }
 
 vec3 unpackSnormR10G10B10(uint packed)
@@ -190,6 +207,39 @@ MeshletBounds loadMeshletBounds(GeometryMetadata metadata, uint index)
     return ret;
 }
 
+struct MeshLod
+{
+    // Bounding sphere of the level
+    vec3 center;
+    float radius;
+    uint meshletOffset;
+    uint meshletCount;
+    // Object space simplification error, 0 for LOD0
+    float error;
+};
+#define MESH_LOD_U32_COUNT 8
+
+MeshLod loadMeshLod(GeometryMetadata metadata, uint index)
+{
+    uint offset = index * MESH_LOD_U32_COUNT;
+
+    MeshLod ret;
+    ret.center = vec3(
+        loadFloat(metadata.bufferIndex, metadata.lodsOffset, offset),
+        loadFloat(metadata.bufferIndex, metadata.lodsOffset, offset + 1),
+        loadFloat(metadata.bufferIndex, metadata.lodsOffset, offset + 2));
+    ret.radius =
+        loadFloat(metadata.bufferIndex, metadata.lodsOffset, offset + 3);
+    ret.meshletOffset = GET_GEOMETRY_BUFFER_U32(metadata.bufferIndex)
+                            .data[metadata.lodsOffset + offset + 4];
+    ret.meshletCount = GET_GEOMETRY_BUFFER_U32(metadata.bufferIndex)
+                           .data[metadata.lodsOffset + offset + 5];
+    ret.error =
+        loadFloat(metadata.bufferIndex, metadata.lodsOffset, offset + 6);
+
+    return ret;
+}
+
 uint loadMeshletVertexIndex(
     GeometryMetadata metadata, MeshletInfo info, uint index)
 {
@@ -221,9 +271,7 @@ Vertex loadVertex(GeometryMetadata metadata, uint index)
 {
     Vertex ret;
 
-    ret.Position =
-        loadR16G16B16A16(metadata.bufferIndex, metadata.positionsOffset, index)
-            .xyz;
+    ret.Position = loadPosition(metadata, index);
     ret.Normal =
         loadR10G10B10Snorm(metadata.bufferIndex, metadata.normalsOffset, index);
     ret.Tangent = loadTangentWithSign(
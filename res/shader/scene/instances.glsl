@@ -5,26 +5,30 @@
 #include "../shared/shader_structs/scene/model_instance_transforms.h"
 #include "vertex.glsl"
 
+// Dynamic instances are written into a ring every frame while static ones are
+// uploaded once and again when they move. DrawInstance::transformIndex points
+// into one or the other.
+
 layout(std430, set = SCENE_INSTANCES_SET, binding = 0) readonly buffer
     ModelInstanceTransformsDSB
 {
     ModelInstanceTransforms instance[];
 }
-modelInstanceTransforms;
+dynamicModelInstanceTransforms;
 
 layout(std430, set = SCENE_INSTANCES_SET, binding = 1) readonly buffer
     PreviousModelInstanceTransformsDSB
 {
     ModelInstanceTransforms instance[];
 }
-previousModelInstanceTransforms;
+previousDynamicModelInstanceTransforms;
 
 layout(std430, set = SCENE_INSTANCES_SET, binding = 2) readonly buffer
     ModelInstanceScalesDSB
 {
     float instance[];
 }
-modelInstanceScales;
+dynamicModelInstanceScales;
 
 layout(std430, set = SCENE_INSTANCES_SET, binding = 3) readonly buffer
     DrawInstances
@@ -33,6 +37,58 @@ layout(std430, set = SCENE_INSTANCES_SET, binding = 3) readonly buffer
 }
 drawInstances;
 
+layout(std430, set = SCENE_INSTANCES_SET, binding = 4) readonly buffer
+    StaticModelInstanceTransforms
+{
+    ModelInstanceTransforms instance[];
+}
+staticModelInstanceTransforms;
+
+layout(std430, set = SCENE_INSTANCES_SET, binding = 5) readonly buffer
+    StaticModelInstanceScales
+{
+    float instance[];
+}
+staticModelInstanceScales;
+
+layout(std430, set = SCENE_INSTANCES_SET, binding = 6) readonly buffer
+    PreviousStaticModelInstanceTransforms
+{
+    ModelInstanceTransforms instance[];
+}
+previousStaticModelInstanceTransforms;
+
+bool hasDynamicTransform(DrawInstance instance)
+{
+    return (instance.transformIndex & DynamicTransformBit) != 0;
+}
+
+ModelInstanceTransforms modelInstanceTransforms(DrawInstance instance)
+{
+    uint index = instance.transformIndex & ~DynamicTransformBit;
+    if (hasDynamicTransform(instance))
+        return dynamicModelInstanceTransforms.instance[index];
+    return staticModelInstanceTransforms.instance[index];
+}
+
+ModelInstanceTransforms previousModelInstanceTransforms(DrawInstance instance)
+{
+    uint index = instance.transformIndex & ~DynamicTransformBit;
+    if (hasDynamicTransform(instance))
+        return previousDynamicModelInstanceTransforms.instance[index];
+    // Matches the current transforms unless the instance moved this frame
+    return previousStaticModelInstanceTransforms.instance[index];
+}
+
+// Zero scale indicates that the scale is non-uniform
+float modelInstanceScale(DrawInstance instance)
+{
+    uint index = instance.transformIndex & ~DynamicTransformBit;
+    if (hasDynamicTransform(instance))
+        return dynamicModelInstanceScales.instance[index];
+    return staticModelInstanceScales.instance[index];
+}
+
 Vertex transform(Vertex v, ModelInstanceTransforms t)
 {
     Vertex ret;
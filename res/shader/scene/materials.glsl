@@ -103,14 +103,17 @@ Material sampleMaterial(uint index, vec2 uv)
     uint normalTextureSampler = data.normalTextureSampler >> 24;
     if (normalTextureTex > 0)
     {
-        vec3 texture_normal =
+        vec2 texture_normal =
             sampleMaterialTexture(
                 sampler2D(
                     GET_MATERIAL_TEXTURE(normalTextureTex),
                     GET_MATERIAL_SAMPLER(normalTextureSampler)),
                 uv)
-                .xyz;
-        ret.normal = texture_normal * 2 - 1;
+                .xy;
+        // Normal maps are BC5 so z is reconstructed
+        vec2 normalXY = texture_normal * 2 - 1;
+        ret.normal =
+            vec3(normalXY, sqrt(max(1 - dot(normalXY, normalXY), 0)));
     }
     else
         ret.normal = vec3(-2); // -2 to signal no material normal
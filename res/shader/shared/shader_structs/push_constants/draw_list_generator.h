@@ -6,6 +6,9 @@
 struct DrawListGeneratorPC
 {
     STRUCT_FIELD_GLM(uint, matchTransparents, 0);
+    // The coarsest LOD with a projected simplification error below this is
+    // drawn. 0 forces LOD0.
+    STRUCT_FIELD(float, lodErrorThresholdPx, 1.f);
 };
 
 #endif // SHADER_STRUCTS_PUSH_CONSTANTS_DRAW_LIST_GENERATOR_H
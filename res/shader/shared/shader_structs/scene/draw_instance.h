@@ -6,6 +6,15 @@
 #ifdef __cplusplus
 namespace scene::shader_structs
 {
+
+// Set in transformIndex for instances whose transforms are written into the
+// per-frame ring instead of the static buffers
+const uint32_t DynamicTransformBit = 0x8000'0000;
+
+#else // !__cplusplus
+
+const uint DynamicTransformBit = 0x80000000u;
+
 #endif // __cplusplus
 
 struct DrawInstance
@@ -13,6 +22,8 @@ struct DrawInstance
     STRUCT_FIELD_GLM(uint, modelInstanceIndex, 0);
     STRUCT_FIELD_GLM(uint, meshIndex, 0xFFFF'FFFF);
     STRUCT_FIELD_GLM(uint, materialIndex, 0xFFFF'FFFF);
+    // Index into either the static or the dynamic transforms and scales
+    STRUCT_FIELD_GLM(uint, transformIndex, 0);
 };
 
 #ifdef __cplusplus
@@ -26,6 +26,18 @@ struct GeometryMetadata
     // This addresses U8.
     STRUCT_FIELD_GLM(uint, meshletTrianglesByteOffset, 0xFFFF'FFFF);
     STRUCT_FIELD_GLM(uint, usesShortIndices, 0);
+    // Levels of detail, LOD0 first. Meshlets of all levels are in the same
+    // meshlet buffers.
+    STRUCT_FIELD_GLM(uint, lodsOffset, 0xFFFF'FFFF);
+    STRUCT_FIELD_GLM(uint, lodCount, 0);
+    // Positions are snorm relative to the object space AABB. These are scalars
+    // as vec3 would be padded in std430.
+    STRUCT_FIELD(float, positionsCenterX, 0.f);
+    STRUCT_FIELD(float, positionsCenterY, 0.f);
+    STRUCT_FIELD(float, positionsCenterZ, 0.f);
+    STRUCT_FIELD(float, positionsHalfExtentX, 0.f);
+    STRUCT_FIELD(float, positionsHalfExtentY, 0.f);
+    STRUCT_FIELD(float, positionsHalfExtentZ, 0.f);
 };
 
 #ifdef __cplusplus
@@ -32,6 +32,7 @@ struct Texture2DSampler
     };
 
     [[nodiscard]] uint32_t texture() const { return packed & sMaxTextureIndex; }
+    [[nodiscard]] uint32_t sampler() const { return packed >> 24; }
 };
 static_assert(sizeof(Texture2DSampler) == sizeof(uint32_t));
 
@@ -13,9 +13,8 @@ struct Allocators
     static const size_t sGeneralAllocatorSize = wheels::megabytes(512);
     static const size_t sWorldAllocatorSize = wheels::megabytes(128);
 
-    // Enough for 4K textures, it seems. Should also be plenty for meshes as we
-    // have a hard limit of 64MB for a single mesh from the default geometry
-    // buffer size.
+    // Enough for 4K textures, it seems. Should also be plenty for processing
+    // meshes that are sensible to have in a real-time scene.
     static const size_t sLoadingScratchSize = wheels::megabytes(256);
     // Extra mem for things outside the ctx loading loop
     static const size_t sLoadingAllocatorSize =
@@ -50,9 +50,11 @@ StaticArray<vk::CommandBuffer, MAX_FRAMES_IN_FLIGHT> allocateCommandBuffers()
 
 } // namespace
 
-App::App(std::filesystem::path scenePath) noexcept
+App::App(
+    std::filesystem::path scenePath, size_t textureBudgetByteCount) noexcept
 : m_fileChangePollingAlloc{megabytes(1)}
 , m_scenePath{WHEELS_MOV(scenePath)}
+, m_textureBudgetByteCount{textureBudgetByteCount}
 , m_swapchain{OwningPtr<gfx::Swapchain>{gAllocators.general}}
 , m_cam{OwningPtr<scene::Camera>{gAllocators.general}}
 , m_world{OwningPtr<scene::World>{gAllocators.general}}
@@ -99,7 +101,9 @@ void App::init(ScopedScratch scopeAlloc)
 
     m_cam->init(scopeAlloc.child_scope(), m_constantsRing);
 
-    m_world->init(scopeAlloc.child_scope(), m_constantsRing, m_scenePath);
+    m_world->init(
+        scopeAlloc.child_scope(), m_constantsRing, m_scenePath,
+        m_textureBudgetByteCount);
 
     m_renderer->init(
         scopeAlloc.child_scope(), m_swapchain->config(),
@@ -555,11 +559,6 @@ void App::drawFrame(
         "Camera update assumes no render offset");
     m_cam->updateBuffer(m_debugFrustum);
 
-    {
-        PROFILER_CPU_SCOPE("World::updateBuffers");
-        m_world->updateBuffers(scopeAlloc.child_scope());
-    }
-
     updateDebugLines(m_world->currentScene(), nextFrame);
 
     const auto cb = m_commandBuffers[nextFrame];
@@ -570,6 +569,11 @@ void App::drawFrame(
             .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
         });
 
+    {
+        PROFILER_CPU_SCOPE("World::updateBuffers");
+        m_world->updateBuffers(scopeAlloc.child_scope(), cb);
+    }
+
     if (m_renderer->rtInUse() || m_world->unbuiltBlases())
     {
         PROFILER_CPU_GPU_SCOPE(cb, "BuildTLAS");
@@ -598,7 +602,7 @@ void App::drawFrame(
         scopeAlloc.child_scope(), cb, *m_cam, *m_world, renderArea, swapImage,
         deltaTimeS, nextFrame, renderOptions);
 
-    m_newSceneDataLoaded = m_world->handleDeferredLoading(cb);
+    m_newSceneDataLoaded = m_world->handleDeferredLoading(cb, *m_cam);
 
     utils::gProfiler.endGpuFrame(cb);
 
@@ -25,9 +25,18 @@ class App
     {
         std::filesystem::path scene;
         gfx::Device::Settings device;
+        // Resident glTF texture data is streamed to fit in this
+        size_t textureBudgetByteCount{0};
+        // Texture caches are shared between scenes in here if it's not empty
+        std::filesystem::path textureCacheDir;
+        size_t textureCacheMaxByteCount{0};
+        // Build default if empty
+        std::string textureCacheQuality;
+        bool compressMeshCaches{true};
     };
 
-    App(std::filesystem::path scenePath) noexcept;
+    App(std::filesystem::path scenePath,
+        size_t textureBudgetByteCount) noexcept;
     ~App();
 
     App(const App &other) = delete;
@@ -95,6 +104,7 @@ class App
     // Separate allocator for async polling as TlsfAllocator is not thread safe
     wheels::TlsfAllocator m_fileChangePollingAlloc;
     std::filesystem::path m_scenePath;
+    size_t m_textureBudgetByteCount{0};
 
     wheels::OwningPtr<gfx::Swapchain> m_swapchain;
     wheels::StaticArray<vk::CommandBuffer, MAX_FRAMES_IN_FLIGHT>
@@ -0,0 +1,361 @@
+#include "Allocators.hpp"
+#include "gfx/ShaderCompiler.hpp"
+#include "scene/DeferredLoadingContext.hpp"
+#include "scene/SceneSnapshot.hpp"
+#include "scene/Texture.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Timer.hpp"
+#include "utils/Utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cgltf.h>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <thread>
+#include <wheels/allocators/linear_allocator.hpp>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/hash_map.hpp>
+#include <wheels/containers/hash_set.hpp>
+
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif // _CRTDBG_MAP_ALLOC
+
+// Fills the scene snapshot and the mesh, texture and shader caches without a
+// device so that the first launch of prosper doesn't have to. Each cache type
+// is baked on its own set of threads as they don't depend on each other.
+
+using namespace wheels;
+
+namespace
+{
+
+const char *const s_default_scene_path =
+    "glTF/FlightHelmet/glTF/FlightHelmet.gltf";
+
+const char *const sSceneFileArg = "sceneFile"; // string, path
+const char *const sWorkersArg = "workers";     // uint32_t
+const char *const sSkipShadersArg = "skipShaders";
+const char *const sTextureCacheDirArg = "textureCacheDir";    // string, path
+const char *const sTextureCacheMaxArg = "textureCacheMaxMiB"; // uint32_t
+const char *const sTextureQualityArg = "textureCacheQuality"; // string
+const char *const sUncompressedMeshCachesArg = "uncompressedMeshCaches";
+
+// Shader sources and the expanded includes are small
+constexpr size_t sShaderScratchSize = megabytes(16);
+// Scene snapshot only gathers small per animation arrays into scratch
+constexpr size_t sSnapshotScratchSize = megabytes(1);
+// Each texture thread holds a scratch that fits the largest texture so their
+// count is bounded by this. Block compression of each image is shared between
+// the texture threads.
+constexpr size_t sTextureScratchBudget = megabytes(1024);
+// Cache checks need scratch even if the source can't be read
+constexpr size_t sMinTextureScratchSize = megabytes(16);
+
+struct Settings
+{
+    std::filesystem::path scene;
+    uint32_t workerCount{0};
+    bool skipShaders{false};
+    std::filesystem::path textureCacheDir;
+    uint32_t textureCacheMaxMiB{0};
+    // Build default if empty
+    std::string textureCacheQuality;
+    bool compressMeshCaches{true};
+};
+
+// NOLINTNEXTLINE(*-avoid-c-arrays): Mandatory
+Settings parseCli(int argc, char *argv[])
+{
+    cxxopts::Options options(
+        "prosper_bake", "Fills the prosper caches for a scene offline");
+    // clang-format off
+        options.add_options()
+            (sWorkersArg, "Worker threads per cache type (default: hardware threads)",
+             cxxopts::value<uint32_t>()->default_value("0"))
+            (sSkipShadersArg, "Don't compile the recorded shader variants")
+            (sTextureCacheDirArg, "Directory for texture caches shared between scenes (default: next to the scene)",
+             cxxopts::value<std::string>()->default_value(""))
+            (sTextureCacheMaxArg, "Size limit of the shared texture caches in MiB",
+             cxxopts::value<uint32_t>()->default_value("16384"))
+            (sTextureQualityArg, "BC6H and BC7 encoder profile: ultrafast, fast, basic or slow (default: ultrafast in debug, basic in release)",
+             cxxopts::value<std::string>()->default_value(""))
+            (sUncompressedMeshCachesArg, "Write mesh caches without meshopt encoding")
+            (sSceneFileArg, std::string{"Scene to bake (default: '"} + s_default_scene_path +"')",
+             cxxopts::value<std::string>()->default_value(""));
+    // clang-format on
+    options.parse_positional({"sceneFile"});
+    const cxxopts::ParseResult args = options.parse(argc, argv);
+
+    Settings ret{
+        .scene = args[sSceneFileArg].as<std::string>(),
+        .workerCount = args[sWorkersArg].as<uint32_t>(),
+        .skipShaders = args.count(sSkipShadersArg) > 0,
+        .textureCacheDir = args[sTextureCacheDirArg].as<std::string>(),
+        .textureCacheMaxMiB = args[sTextureCacheMaxArg].as<uint32_t>(),
+        .textureCacheQuality = args[sTextureQualityArg].as<std::string>(),
+        .compressMeshCaches = args.count(sUncompressedMeshCachesArg) == 0,
+    };
+
+    if (ret.scene.empty())
+        ret.scene = s_default_scene_path;
+
+    if (ret.workerCount == 0)
+        ret.workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    return ret;
+}
+
+// Spreads item indices [0, count) over workerCount threads. The threads are
+// appended to threads and have to be joined by the caller. failureCount is
+// incremented for each item that throws.
+template <typename Fn>
+void launchWorkers(
+    Array<std::thread> &threads, const char *name, uint32_t workerCount,
+    uint32_t count, std::atomic<uint32_t> &nextItem,
+    std::atomic<uint32_t> &failureCount, const Fn &fn)
+{
+    const uint32_t threadCount = std::min(workerCount, count);
+    for (uint32_t i = 0; i < threadCount; ++i)
+        // fn is copied as the callers pass in temporaries
+        threads.emplace_back(
+            [name, i, count, &nextItem, &failureCount, fn]
+            {
+                const std::string threadName =
+                    std::string{name} + " " + std::to_string(i);
+                setCurrentThreadName(threadName.c_str());
+
+                while (true)
+                {
+                    const uint32_t item = nextItem++;
+                    if (item >= count)
+                        break;
+
+                    try
+                    {
+                        fn(item);
+                    }
+                    catch (std::exception &e)
+                    {
+                        LOG_ERR("{}", e.what());
+                        failureCount++;
+                    }
+                }
+            });
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+#ifdef _CRTDBG_MAP_ALLOC
+    _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif // _CRTDBG_MAP_ALLOC
+
+    setCurrentThreadName("prosper bake");
+
+    std::atomic<uint32_t> failureCount{0};
+    try
+    {
+        const utils::Timer t;
+
+        const Settings settings = parseCli(argc, argv);
+
+        // Globals
+        // Only the mesh bake uses the loading worker allocator and the general
+        // one is only used on this thread
+        gAllocators.init();
+        defer { gAllocators.destroy(); };
+
+        scene::setSharedTextureCache(
+            settings.textureCacheDir, megabytes(settings.textureCacheMaxMiB));
+        if (!settings.textureCacheQuality.empty())
+            scene::setTextureCacheQuality(scene::textureCacheQualityFromName(
+                settings.textureCacheQuality));
+        scene::setMeshCacheCompression(settings.compressMeshCaches);
+
+        const std::filesystem::path scenePath = resPath(settings.scene);
+        const std::filesystem::path sceneDir = scenePath.parent_path();
+
+        // The mesh context owns the glTF data and frees it when it's destroyed
+        scene::DeferredLoadingContext meshContext;
+        meshContext.meshWorkerCount = settings.workerCount;
+        // Default malloc as the data is read from all the worker threads
+        cgltf_data *gltfData = scene::loadGltf(scenePath, nullptr);
+        meshContext.gltfData = gltfData;
+
+        HashSet<uint32_t> sRgbImages{gAllocators.general};
+        HashSet<uint32_t> linearImages{gAllocators.general};
+        HashMap<uint32_t, scene::TextureChannelUsage> channelUsages{
+            gAllocators.general};
+        scene::collectImageUsages(
+            gAllocators.general, *gltfData, sRgbImages, linearImages,
+            channelUsages);
+
+        // prosper sets the world up from this instead of parsing the glTF
+        {
+            scene::SceneSnapshot snapshot{gAllocators.general};
+            LinearAllocator scopeBacking{sSnapshotScratchSize};
+            scene::gatherSceneSnapshot(
+                ScopedScratch{scopeBacking}, *gltfData, snapshot);
+            scene::writeSceneSnapshot(scenePath, *gltfData, snapshot);
+        }
+
+        gfx::ShaderCompiler shaderCompiler;
+        shaderCompiler.init(false);
+        defer { shaderCompiler.destroy(); };
+
+        // Variants are read from the committed manifest in res/shader that
+        // prosper appends new variants into as it compiles them
+        Array<gfx::ShaderVariant> shaderVariants{gAllocators.general};
+        if (!settings.skipShaders)
+        {
+            Array<gfx::ShaderVariant> recordedVariants =
+                gfx::readRecordedShaderVariants(gAllocators.general);
+            const size_t recordedCount = recordedVariants.size();
+
+            // Variants of removed shaders would never compile again so drop
+            // them from the recorded set
+            shaderVariants.reserve(recordedCount);
+            for (gfx::ShaderVariant &variant : recordedVariants)
+            {
+                if (std::filesystem::exists(resPath(variant.relPath)))
+                    shaderVariants.push_back(WHEELS_MOV(variant));
+            }
+            // Only rewrite when needed to not touch the committed manifest
+            if (shaderVariants.size() < recordedCount)
+            {
+                gfx::rewriteRecordedShaderVariants(shaderVariants.span());
+                LOG_INFO(
+                    "Dropped {} stale shader variants",
+                    recordedCount - shaderVariants.size());
+            }
+            if (shaderVariants.empty())
+                LOG_WARN(
+                    "No shader variants in res/shader/variants.txt to compile");
+        }
+
+        Array<std::thread> threads{gAllocators.general};
+        threads.reserve((settings.workerCount * 2) + 1);
+
+        // Mesh bake spreads the work on its own workers
+        threads.emplace_back(
+            [&meshContext, &sceneDir, gltfData, &failureCount]
+            {
+                setCurrentThreadName("bake meshes");
+                try
+                {
+                    meshContext.bakeMeshCaches(sceneDir, *gltfData);
+                }
+                catch (std::exception &e)
+                {
+                    LOG_ERR("{}", e.what());
+                    failureCount++;
+                }
+            });
+
+        std::atomic<uint32_t> nextImage{0};
+        const uint32_t imageCount =
+            asserted_cast<uint32_t>(gltfData->images_count);
+
+        // Only the image headers are read here, the threads report the images
+        // that can't be read
+        size_t textureScratchSize = sMinTextureScratchSize;
+        for (uint32_t i = 0; i < imageCount; ++i)
+        {
+            const cgltf_image &image = gltfData->images[i];
+            if (image.uri == nullptr)
+                continue;
+            try
+            {
+                textureScratchSize = std::max(
+                    textureScratchSize,
+                    scene::textureCacheScratchByteCount(sceneDir / image.uri));
+            }
+            catch (std::exception &)
+            {
+                // Handled by the thread that picks the image
+            }
+        }
+        const uint32_t textureThreadCount = std::min(
+            settings.workerCount,
+            std::max(
+                asserted_cast<uint32_t>(
+                    sTextureScratchBudget / textureScratchSize),
+                1u));
+
+        launchWorkers(
+            threads, "bake tex", textureThreadCount, imageCount, nextImage,
+            failureCount,
+            [&](uint32_t imageIndex)
+            {
+                const cgltf_image &image = gltfData->images[imageIndex];
+                if (image.uri == nullptr)
+                    throw std::runtime_error(
+                        "Embedded glTF textures aren't supported. "
+                        "Scene should be glTF + bin + textures.");
+
+                // Like in the loader, everything that isn't linear is sRGB
+                const scene::TextureColorSpace colorSpace =
+                    linearImages.contains(imageIndex)
+                        ? scene::TextureColorSpace::Linear
+                        : scene::TextureColorSpace::sRgb;
+                const scene::TextureChannelUsage *channelUsage =
+                    channelUsages.find(imageIndex);
+
+                // Malloc backed as the global allocators aren't thread-safe
+                LinearAllocator scopeBacking{textureScratchSize};
+                scene::updateTextureCache(
+                    ScopedScratch{scopeBacking}, sceneDir / image.uri,
+                    scene::Texture2DOptions{
+                        .generateMipMaps = true,
+                        .colorSpace = colorSpace,
+                        .channelUsage =
+                            channelUsage != nullptr
+                                ? *channelUsage
+                                : scene::TextureChannelUsage::Color,
+                    });
+            });
+
+        std::atomic<uint32_t> nextShader{0};
+        const uint32_t shaderCount =
+            asserted_cast<uint32_t>(shaderVariants.size());
+        launchWorkers(
+            threads, "bake shader", settings.workerCount, shaderCount,
+            nextShader, failureCount,
+            [&](uint32_t variantIndex)
+            {
+                LinearAllocator scopeBacking{sShaderScratchSize};
+                const std::filesystem::path cachePath =
+                    shaderCompiler.updateCache(
+                        scopeBacking, shaderVariants[variantIndex]);
+                if (cachePath.empty())
+                    throw std::runtime_error(
+                        "Failed to compile '" +
+                        shaderVariants[variantIndex].relPath.string() + "'");
+            });
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        LOG_INFO(
+            "Baked {} meshes, {} textures and {} shader variants in {:.2f}s",
+            meshContext.meshes.size(), imageCount, shaderCount,
+            t.getSeconds());
+    }
+    catch (std::exception &e)
+    {
+        LOG_ERR("Exception thrown: {}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (failureCount > 0)
+    {
+        LOG_ERR("{} caches failed to bake", failureCount.load());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
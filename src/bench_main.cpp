@@ -0,0 +1,566 @@
+#include "Allocators.hpp"
+#include "scene/Accessors.hpp"
+#include "scene/Animations.hpp"
+#include "scene/Scene.hpp"
+#include "utils/Downsample.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Utils.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <limits>
+#include <random>
+#include <stb_image_resize2.h>
+#include <string_view>
+#include <wheels/allocators/linear_allocator.hpp>
+#include <wheels/allocators/scoped_scratch.hpp>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/span.hpp>
+#include <wheels/containers/static_array.hpp>
+#include <wheels/containers/string.hpp>
+
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif // _CRTDBG_MAP_ALLOC
+
+// Micro-benchmarks for the CPU hot paths that can be exercised without a
+// device. Each case reports the fastest of its runs as that is the least
+// disturbed by the rest of the system.
+
+using namespace glm;
+using namespace wheels;
+
+namespace
+{
+
+const char *const sFilterArg = "filter"; // string
+const char *const sRunsArg = "runs";     // uint32_t
+
+struct Settings
+{
+    std::string filter;
+    uint32_t runs{0};
+};
+
+// NOLINTNEXTLINE(*-avoid-c-arrays): Mandatory
+Settings parseCli(int argc, char *argv[])
+{
+    cxxopts::Options options(
+        "prosper_bench", "Times the CPU hot paths of prosper");
+    // clang-format off
+        options.add_options()
+            (sFilterArg, "Only run the benchmarks whose name contains this",
+             cxxopts::value<std::string>()->default_value(""))
+            (sRunsArg, "Timed runs per case",
+             cxxopts::value<uint32_t>()->default_value("5"));
+    // clang-format on
+    options.parse_positional({sFilterArg});
+    const cxxopts::ParseResult args = options.parse(argc, argv);
+
+    return Settings{
+        .filter = args[sFilterArg].as<std::string>(),
+        .runs = std::max(args[sRunsArg].as<uint32_t>(), 1u),
+    };
+}
+
+// Returns the fastest of the runs in milliseconds
+template <typename Fn> double fastestRunMs(uint32_t runs, const Fn &fn)
+{
+    double ret = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < runs; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        ret = std::min(
+            ret,
+            std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return ret;
+}
+
+// Keeps the result alive so that the timed work can't be optimized out
+void consume(uint32_t value)
+{
+    static volatile uint32_t sSink = 0;
+    sSink = sSink + value;
+}
+
+// Halves a random 4K RGBA8 image like the texture mip generation does and
+// compares against the stbir path it replaced
+void benchDownsample(uint32_t runs)
+{
+    const uint32_t srcSize = 4096;
+    const uint32_t dstSize = srcSize / 2;
+
+    Array<uint8_t> src{gAllocators.general};
+    src.resize(static_cast<size_t>(srcSize) * srcSize * 4);
+    Array<uint8_t> dst{gAllocators.general};
+    dst.resize(static_cast<size_t>(dstSize) * dstSize * 4);
+
+    std::mt19937 gen{0x5EED};
+    std::uniform_int_distribution<uint32_t> dist{0, 255};
+    for (uint8_t &v : src)
+        v = static_cast<uint8_t>(dist(gen));
+
+    for (const bool sRgb : {false, true})
+    {
+        const double downsampleMs = fastestRunMs(
+            runs,
+            [&]
+            {
+                utils::downsample2xRgba8(
+                    src.data(), srcSize, srcSize, dst.data(), sRgb);
+            });
+        const double stbirMs = fastestRunMs(
+            runs,
+            [&]
+            {
+                const auto srcSizeI = asserted_cast<int>(srcSize);
+                const auto dstSizeI = asserted_cast<int>(dstSize);
+                if (sRgb)
+                    stbir_resize_uint8_srgb(
+                        src.data(), srcSizeI, srcSizeI, 0, dst.data(),
+                        dstSizeI, dstSizeI, 0, STBIR_RGBA);
+                else
+                    stbir_resize_uint8_linear(
+                        src.data(), srcSizeI, srcSizeI, 0, dst.data(),
+                        dstSizeI, dstSizeI, 0, STBIR_RGBA);
+            });
+
+        LOG_INFO(
+            "downsample {}: downsample2xRgba8 {:.2f}ms, stbir {:.2f}ms",
+            sRgb ? "sRGB" : "linear", downsampleMs, stbirMs);
+    }
+}
+
+// The keyframe search that TimeAccessor did before it cached the cursor.
+// Expects timeS to be after the first keyframe and before the last one.
+uint32_t scanFirstFrame(Span<const float> times, float timeS)
+{
+    const auto lastFrame = asserted_cast<uint32_t>(times.size() - 1);
+    uint32_t ret = 0;
+    while (ret < lastFrame && times[ret] <= timeS)
+        ret++;
+    return ret - 1;
+}
+
+// Times keyframe lookups for a single animated channel as the track grows.
+// Forward playback steps at 60fps and loops, seeks jump to random times.
+void benchKeyframeLookup(uint32_t runs)
+{
+    const float keyIntervalS = 1.f / 30.f;
+    const float frameIntervalS = 1.f / 60.f;
+    const uint32_t queryCount = 8192;
+
+    std::mt19937 gen{0x5EED};
+    for (const uint32_t keyCount : {16u, 256u, 4096u, 32768u})
+    {
+        Array<float> times{gAllocators.general};
+        times.resize(keyCount);
+        for (uint32_t i = 0; i < keyCount; ++i)
+            times[i] = static_cast<float>(i) * keyIntervalS;
+        const float endTimeS = times.back();
+
+        Array<float> forwardTimes{gAllocators.general};
+        forwardTimes.resize(queryCount);
+        for (uint32_t i = 0; i < queryCount; ++i)
+            forwardTimes[i] =
+                std::fmod(static_cast<float>(i) * frameIntervalS, endTimeS);
+
+        Array<float> seekTimes{gAllocators.general};
+        seekTimes.resize(queryCount);
+        std::uniform_real_distribution<float> dist{0.f, endTimeS};
+        for (float &t : seekTimes)
+            t = dist(gen);
+
+        // Summed so that the lookups can't be optimized out
+        uint32_t frameSum = 0;
+        for (const bool seek : {false, true})
+        {
+            const Span<const float> queryTimes =
+                seek ? seekTimes.span() : forwardTimes.span();
+
+            scene::TimeAccessor accessor{
+                times.data(), keyCount,
+                scene::TimeAccessor::Interval{
+                    .startTimeS = 0.f,
+                    .endTimeS = endTimeS,
+                }};
+            const double cursorMs = fastestRunMs(
+                runs,
+                [&]
+                {
+                    for (const float t : queryTimes)
+                        frameSum += accessor.interpolation(t).firstFrame;
+                });
+            const double scanMs = fastestRunMs(
+                runs,
+                [&]
+                {
+                    for (const float t : queryTimes)
+                    {
+                        if (t > 0.f)
+                            frameSum += scanFirstFrame(times.span(), t);
+                    }
+                });
+
+            const double nsPerQuery = 1e6 / static_cast<double>(queryCount);
+            LOG_INFO(
+                "keyframes {} keys {}: cursor {:.1f}ns, scan {:.1f}ns per "
+                "lookup",
+                keyCount, seek ? "random seeks" : "forward playback",
+                cursorMs * nsPerQuery, scanMs * nsPerQuery);
+        }
+        consume(frameSum);
+    }
+}
+
+// Evaluates an animation one at a time like Animation::update() did before
+// the animations were batched
+template <typename T>
+T evaluateAnimation(
+    scene::InterpolationType interpolation, scene::TimeAccessor &timeFrames,
+    const scene::ValueAccessor<T> &valueFrames, float timeS)
+{
+    const scene::KeyFrameInterpolation interp =
+        timeFrames.interpolation(timeS);
+
+    if (interp.t == 0.f || interpolation == scene::InterpolationType::Step)
+    {
+        if (interpolation == scene::InterpolationType::CubicSpline)
+            return valueFrames.read((interp.firstFrame * 3) + 1);
+        return valueFrames.read(interp.firstFrame);
+    }
+
+    if (interpolation == scene::InterpolationType::Linear)
+    {
+        const T firstValue = valueFrames.read(interp.firstFrame);
+        const T secondValue = valueFrames.read(interp.firstFrame + 1);
+        if constexpr (SameAs<T, quat>)
+            return slerp(firstValue, secondValue, interp.t);
+        else
+            return mix(firstValue, secondValue, interp.t);
+    }
+
+    const uint32_t firstIndex = interp.firstFrame * 3;
+    const T vk = valueFrames.read(firstIndex + 1);
+    const T bk = valueFrames.read(firstIndex + 2);
+    const T vk1 = valueFrames.read(firstIndex + 3 + 1);
+    const T ak1 = valueFrames.read(firstIndex + 3);
+
+    const float t = interp.t;
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    const float td = interp.stepDuration;
+    const T value = (((2.f * t3) - (3.f * t2) + 1.f) * vk) +
+                    (td * (t3 - (2.f * t2) + t) * bk) +
+                    (((-2.f * t3) + (3.f * t2)) * vk1) + (td * (t3 - t2) * ak1);
+    if constexpr (SameAs<T, quat>)
+        return normalize(value);
+    else
+        return value;
+}
+
+// Adds count animations that alternate between the interpolation modes. The
+// keyframes are at 30fps, tracks are 8 to 60 keyframes long and start at
+// staggered times.
+template <typename T>
+void addAnimations(
+    std::mt19937 &gen, uint32_t count, Array<float> &rawData,
+    Array<scene::Animation<T>> &animationsOut)
+{
+    const uint32_t componentCount = sizeof(T) / sizeof(float);
+    std::uniform_int_distribution<uint32_t> keyDist{8, 60};
+    std::uniform_real_distribution<float> valueDist{-1.f, 1.f};
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const auto interpolation = static_cast<scene::InterpolationType>(i % 3);
+        const uint32_t keyCount = keyDist(gen);
+        const uint32_t valueCount =
+            interpolation == scene::InterpolationType::CubicSpline
+                ? keyCount * 3
+                : keyCount;
+        const float startTimeS = 0.1f * static_cast<float>(i % 5);
+
+        const size_t timesOffset = rawData.size();
+        for (uint32_t k = 0; k < keyCount; ++k)
+            rawData.push_back(startTimeS + (static_cast<float>(k) / 30.f));
+        const size_t valuesOffset = rawData.size();
+        for (uint32_t v = 0; v < valueCount; ++v)
+        {
+            T value{};
+            float *components = value_ptr(value);
+            for (uint32_t c = 0; c < componentCount; ++c)
+                components[c] = valueDist(gen);
+            if constexpr (SameAs<T, quat>)
+                value = normalize(value);
+            for (uint32_t c = 0; c < componentCount; ++c)
+                rawData.push_back(components[c]);
+        }
+
+        const float *times = rawData.data() + timesOffset;
+        animationsOut.emplace_back(
+            interpolation,
+            scene::TimeAccessor{
+                times, keyCount,
+                scene::TimeAccessor::Interval{
+                    .startTimeS = times[0],
+                    .endTimeS = times[keyCount - 1],
+                }},
+            scene::ValueAccessor<T>{
+                reinterpret_cast<const uint8_t *>(
+                    rawData.data() + valuesOffset),
+                valueCount});
+    }
+}
+
+// Plays back a few thousand animations at 60fps and compares the batched
+// update against evaluating the animations one at a time
+void benchAnimations(uint32_t runs)
+{
+    const uint32_t animationCount = 3000;
+    const uint32_t frameCount = 600;
+    const float loopS = 2.f;
+
+    // The animations point to the raw data so it can't reallocate. At most 60
+    // times and 180 values of four floats per animation.
+    Array<float> rawData{gAllocators.general};
+    rawData.reserve(
+        static_cast<size_t>(animationCount) * 2 * (60 + (180 * 4)));
+    scene::Animations animations;
+    animations.vec3.reserve(animationCount);
+    animations.quat.reserve(animationCount);
+    std::mt19937 gen{0x5EED};
+    addAnimations(gen, animationCount, rawData, animations.vec3);
+    addAnimations(gen, animationCount, rawData, animations.quat);
+
+    Array<vec3> vec3Targets{gAllocators.general};
+    vec3Targets.resize(animationCount);
+    Array<quat> quatTargets{gAllocators.general};
+    quatTargets.resize(animationCount);
+    for (uint32_t i = 0; i < animationCount; ++i)
+    {
+        animations.vec3[i].registerTarget(vec3Targets[i]);
+        animations.quat[i].registerTarget(quatTargets[i]);
+    }
+    animations.createBatches();
+
+    // Separate accessors so that the cursors of the two paths don't mix
+    Array<scene::TimeAccessor> vec3Times{gAllocators.general};
+    vec3Times.reserve(animationCount);
+    Array<scene::TimeAccessor> quatTimes{gAllocators.general};
+    quatTimes.reserve(animationCount);
+    for (uint32_t i = 0; i < animationCount; ++i)
+    {
+        vec3Times.push_back(animations.vec3[i].timeFrames());
+        quatTimes.push_back(animations.quat[i].timeFrames());
+    }
+
+    const auto frameTimeS = [&](uint32_t frame)
+    { return std::fmod(static_cast<float>(frame) / 60.f, loopS); };
+
+    const double batchedMs = fastestRunMs(
+        runs,
+        [&]
+        {
+            for (uint32_t frame = 0; frame < frameCount; ++frame)
+                animations.update(frameTimeS(frame));
+        });
+    const double singleMs = fastestRunMs(
+        runs,
+        [&]
+        {
+            for (uint32_t frame = 0; frame < frameCount; ++frame)
+            {
+                const float timeS = frameTimeS(frame);
+                for (uint32_t i = 0; i < animationCount; ++i)
+                {
+                    const scene::Animation<vec3> &animation =
+                        animations.vec3[i];
+                    animation.writeTargets(evaluateAnimation(
+                        animation.interpolation(), vec3Times[i],
+                        animation.valueFrames(), timeS));
+                }
+                for (uint32_t i = 0; i < animationCount; ++i)
+                {
+                    const scene::Animation<quat> &animation =
+                        animations.quat[i];
+                    animation.writeTargets(evaluateAnimation(
+                        animation.interpolation(), quatTimes[i],
+                        animation.valueFrames(), timeS));
+                }
+            }
+        });
+    consume(std::bit_cast<uint32_t>(vec3Targets[0].x + quatTargets[0].x));
+
+    const double usPerFrame = 1e3 / static_cast<double>(frameCount);
+    LOG_INFO(
+        "animations {} vec3 + {} quat: batched {:.1f}us, one at a time "
+        "{:.1f}us per frame",
+        animationCount, animationCount, batchedMs * usPerFrame,
+        singleMs * usPerFrame);
+}
+
+// Fills a complete 8-ary tree with an instance on every fourth node and a few
+// hundred lights. About 1% of the nodes are animated leaves.
+void fillScene(std::mt19937 &gen, uint32_t nodeCount, scene::Scene &sceneOut)
+{
+    const uint32_t lightCount = 256;
+    const uint32_t firstLeaf = (nodeCount - 2) / 8 + 1;
+
+    std::uniform_real_distribution<float> positionDist{-10.f, 10.f};
+    std::uniform_int_distribution<uint32_t> leafDist{firstLeaf, nodeCount - 1};
+
+    scene::Scene::Nodes &nodes = sceneOut.nodes;
+    nodes.reserve(nodeCount);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        const uint32_t parent = i == 0 ? scene::Scene::sNoNode : (i - 1) / 8;
+        const uint32_t node =
+            nodes.push_back(parent, i, String{gAllocators.general});
+        nodes.flags[node] = scene::Scene::NodeFlags_Translation |
+                            scene::Scene::NodeFlags_Rotation;
+        nodes.translations[node] =
+            vec3{positionDist(gen), positionDist(gen), positionDist(gen)};
+        nodes.rotations[node] =
+            angleAxis(positionDist(gen), vec3{0.f, 1.f, 0.f});
+    }
+    sceneOut.rootNodes.push_back(0);
+
+    for (uint32_t i = 0; i < nodeCount / 100; ++i)
+        nodes.flags[leafDist(gen)] |= scene::Scene::NodeFlags_DynamicTransform;
+
+    sceneOut.modelInstances.reserve(nodeCount / 4);
+    sceneOut.modelInstanceNodes.reserve(nodeCount / 4);
+    for (uint32_t node = 0; node < nodeCount; node += 4)
+    {
+        sceneOut.modelInstances.push_back(
+            scene::ModelInstance{
+                .id = asserted_cast<uint32_t>(sceneOut.modelInstances.size()),
+                .modelIndex = 0,
+            });
+        sceneOut.modelInstanceNodes.push_back(node);
+    }
+
+    sceneOut.directionalLightNode = leafDist(gen);
+    sceneOut.pointLightNodes.reserve(lightCount);
+    sceneOut.spotLightNodes.reserve(lightCount);
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        sceneOut.pointLightNodes.push_back(leafDist(gen));
+        sceneOut.lights.pointLights.data.emplace_back();
+        sceneOut.spotLightNodes.push_back(leafDist(gen));
+        sceneOut.lights.spotLights.data.emplace_back();
+    }
+
+    sceneOut.initTransforms();
+}
+
+// Times the per-frame scene update as the node count grows. Frames without
+// dirty nodes only touch the dynamic nodes, instances and lights while a dirty
+// root takes the full pass.
+void benchSceneUpdate(uint32_t runs)
+{
+    const uint32_t updateCount = 100;
+
+    LinearAllocator scopeBacking{megabytes(16)};
+    ScopedScratch scopeAlloc{scopeBacking};
+
+    std::mt19937 gen{0x5EED};
+    for (const uint32_t nodeCount : {10'000u, 100'000u, 1'000'000u})
+    {
+        // The world allocator is linear so each scene gets a fresh one. A
+        // million nodes don't fit in the default size.
+        gAllocators.world.destroy();
+        gAllocators.world.init(megabytes(512));
+
+        scene::Scene benchScene;
+        fillScene(gen, nodeCount, benchScene);
+
+        const double dynamicMs = fastestRunMs(
+            runs,
+            [&]
+            {
+                for (uint32_t i = 0; i < updateCount; ++i)
+                    benchScene.updateTransforms(scopeAlloc.child_scope());
+            });
+        const double fullMs = fastestRunMs(
+            runs,
+            [&]
+            {
+                for (uint32_t i = 0; i < updateCount; ++i)
+                {
+                    benchScene.dirtyNodes.push_back(0);
+                    benchScene.updateTransforms(scopeAlloc.child_scope());
+                }
+            });
+        consume(std::bit_cast<uint32_t>(
+            benchScene.modelInstances.back().transforms.modelToWorld[0].w));
+
+        const double usPerUpdate = 1e3 / static_cast<double>(updateCount);
+        LOG_INFO(
+            "scene update {} nodes, {} dynamic: dynamic only {:.1f}us, full "
+            "pass {:.1f}us per update",
+            nodeCount, benchScene.dynamicNodes.size(), dynamicMs * usPerUpdate,
+            fullMs * usPerUpdate);
+    }
+
+    gAllocators.world.destroy();
+    gAllocators.world.init(Allocators::sWorldAllocatorSize);
+}
+
+struct Benchmark
+{
+    const char *name{nullptr};
+    void (*fn)(uint32_t runs){nullptr};
+};
+
+const StaticArray sBenchmarks{{
+    Benchmark{.name = "downsample", .fn = benchDownsample},
+    Benchmark{.name = "keyframes", .fn = benchKeyframeLookup},
+    Benchmark{.name = "animations", .fn = benchAnimations},
+    Benchmark{.name = "scene_update", .fn = benchSceneUpdate},
+}};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+#ifdef _CRTDBG_MAP_ALLOC
+    _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif // _CRTDBG_MAP_ALLOC
+
+    setCurrentThreadName("prosper bench");
+
+    try
+    {
+        const Settings settings = parseCli(argc, argv);
+
+        gAllocators.init();
+        defer { gAllocators.destroy(); };
+
+        for (const Benchmark &benchmark : sBenchmarks)
+        {
+            if (std::string_view{benchmark.name}.find(settings.filter) ==
+                std::string_view::npos)
+                continue;
+
+            benchmark.fn(settings.runs);
+        }
+    }
+    catch (std::exception &e)
+    {
+        LOG_ERR("Exception thrown: {}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,5 @@
 #include "Device.hpp"
 
-#include <cinttypes>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
@@ -12,7 +11,6 @@
 
 #include "Allocators.hpp"
 #include "Window.hpp"
-#include "gfx/ShaderIncludes.hpp"
 #include "gfx/ShaderReflection.hpp"
 #include "gfx/Swapchain.hpp"
 #include "gfx/VkUtils.hpp"
@@ -25,7 +23,6 @@
 #include <wheels/containers/inline_array.hpp>
 #include <wheels/containers/static_array.hpp>
 #include <wheels/containers/string.hpp>
-#include <wheels/owning_ptr.hpp>
 
 using namespace wheels;
 
@@ -57,6 +54,7 @@ using namespace wheels;
     vk::PhysicalDeviceVulkan12Features, hostQueryReset,                             \
     vk::PhysicalDeviceVulkan12Features, bufferDeviceAddress,                        \
     vk::PhysicalDeviceVulkan12Features, storageBuffer8BitAccess,                    \
+    vk::PhysicalDeviceVulkan12Features, timelineSemaphore,                          \
     vk::PhysicalDeviceVulkan13Features, synchronization2,                           \
     vk::PhysicalDeviceVulkan13Features, dynamicRendering,                           \
     vk::PhysicalDeviceVulkan13Features, maintenance4,                               \
@@ -71,15 +69,6 @@ namespace gfx
 namespace
 {
 
-const uint64_t sShaderCacheMagic = 0x4448'5352'5053'5250; // PRSPRSHD
-// This should be incremented when breaking changes are made to what's cached or
-// when the shader compiler is updated
-const uint32_t sShaderCacheVersion = 2;
-
-const char *const sCppStyleLineDirectiveCStr =
-    "#extension GL_GOOGLE_cpp_style_line_directive : require\n";
-const StrSpan sCppStyleLineDirective{sCppStyleLineDirectiveCStr};
-
 constexpr std::array validationLayers = {
     //"VK_LAYER_LUNARG_api_dump",
     "VK_LAYER_KHRONOS_validation",
@@ -340,141 +329,6 @@ void DestroyDebugUtilsMessengerEXT(
         func(vkInstance, vkDebugMessenger, vkpAllocator);
 }
 
-const char *statusString(shaderc_compilation_status status)
-{
-    switch (status)
-    {
-    case shaderc_compilation_status_success:
-        return "Success";
-    case shaderc_compilation_status_invalid_stage:
-        return "Stage deduction failed";
-    case shaderc_compilation_status_compilation_error:
-        return "Compilation error";
-    case shaderc_compilation_status_internal_error:
-        return "Internal error";
-    case shaderc_compilation_status_null_result_object:
-        return "Null result object";
-    case shaderc_compilation_status_invalid_assembly:
-        return "Invalid assembly";
-    case shaderc_compilation_status_validation_error:
-        return "Validation error";
-    case shaderc_compilation_status_transformation_error:
-        return "Transformation error";
-    case shaderc_compilation_status_configuration_error:
-        return "Configuration error";
-    default:
-        throw std::runtime_error("Unknown shaderc compilationstatus");
-    }
-}
-
-// Returns true if the cache is valid
-// No ScopedScratch because spvWords is already scoped in the upper scope and a
-// child scope would stomp it.
-bool readCache(
-    Allocator &alloc, const std::filesystem::path &cachePath,
-    Array<uint32_t> *spvWords = nullptr,
-    HashSet<std::filesystem::path> *uniqueIncludes = nullptr)
-{
-    if (!std::filesystem::exists(cachePath))
-        return false;
-
-    std::ifstream cacheFile{cachePath, std::ios_base::binary};
-
-    uint64_t magic{0};
-    static_assert(sizeof(magic) == sizeof(sShaderCacheMagic));
-
-    readRaw(cacheFile, magic);
-    if (magic != sShaderCacheMagic)
-        throw std::runtime_error(
-            "Expected a valid shader cache in file '" + cachePath.string() +
-            "'");
-
-    uint32_t version{0};
-    static_assert(sizeof(version) == sizeof(sShaderCacheVersion));
-    readRaw(cacheFile, version);
-    if (version != sShaderCacheVersion)
-        return false;
-
-    WHEELS_ASSERT(
-        (spvWords == nullptr && uniqueIncludes == nullptr) ||
-        (spvWords != nullptr && uniqueIncludes != nullptr));
-    if (spvWords == nullptr)
-        return true;
-
-    uint32_t includeCount{0};
-    readRaw(cacheFile, includeCount);
-    for (uint32_t i = 0; i < includeCount; ++i)
-    {
-        uint32_t includeLength{0};
-        readRaw(cacheFile, includeLength);
-
-        // Reserve room for null terminated but read without null
-        Array<char> include{alloc, includeLength + 1};
-        include.resize(includeLength);
-        readRawSpan(cacheFile, include.mut_span());
-        include.push_back('\0');
-
-        uniqueIncludes->insert(std::filesystem::path{include.data()});
-    }
-
-    uint32_t spvWordCount{0};
-    readRaw(cacheFile, spvWordCount);
-
-    spvWords->resize(spvWordCount);
-    readRawSpan(cacheFile, spvWords->mut_span());
-
-    return true;
-}
-
-void writeCache(
-    const std::filesystem::path &cachePath,
-    const shaderc::SpvCompilationResult &compilationResult,
-    const HashSet<std::filesystem::path> &uniqueIncludes)
-{
-    const std::filesystem::path parentFolder = cachePath.parent_path();
-    if (!std::filesystem::exists(parentFolder))
-        std::filesystem::create_directories(parentFolder);
-
-    std::filesystem::remove(cachePath);
-
-    // Write into a tmp file and rename when done to minimize the potential for
-    // corrupted files
-    std::filesystem::path cacheTmpPath = cachePath;
-    cacheTmpPath.replace_extension("prosper_shader_TMP");
-
-    std::ofstream cacheFile{cacheTmpPath, std::ios_base::binary};
-
-    writeRaw(cacheFile, sShaderCacheMagic);
-    writeRaw(cacheFile, sShaderCacheVersion);
-    writeRaw(cacheFile, asserted_cast<uint32_t>(uniqueIncludes.size()));
-    for (const std::filesystem::path &include : uniqueIncludes)
-    {
-        // This has to match what recompiles compare against because of how path
-        // hashing works
-        const std::string genericPath = include.lexically_normal().string();
-        writeRaw(cacheFile, asserted_cast<uint32_t>(genericPath.size()));
-        writeRawStrSpan(
-            cacheFile, StrSpan{genericPath.c_str(), genericPath.size()});
-    }
-    const size_t spvWordCount =
-        compilationResult.end() - compilationResult.begin();
-    writeRaw(cacheFile, asserted_cast<uint32_t>(spvWordCount));
-    writeRawSpan(cacheFile, Span{compilationResult.begin(), spvWordCount});
-
-    cacheFile.close();
-
-    // Make sure we have rw permissions for the user to be nice
-    const std::filesystem::perms initialPerms =
-        std::filesystem::status(cacheTmpPath).permissions();
-    std::filesystem::permissions(
-        cacheTmpPath, initialPerms | std::filesystem::perms::owner_read |
-                          std::filesystem::perms::owner_write);
-
-    // Rename when the file is done to minimize the potential of a corrupted
-    // file
-    std::filesystem::rename(cacheTmpPath, cachePath);
-}
-
 } // namespace
 
 // This used everywhere and init()/destroy() order relative to other similar
@@ -495,13 +349,7 @@ void Device::init(wheels::ScopedScratch scopeAlloc, Settings const &settings)
 
     m_settings = settings;
 
-    // No includer as we expand those ourselves
-    m_compilerOptions.SetGenerateDebugInfo();
-    m_compilerOptions.SetTargetSpirv(shaderc_spirv_version_1_6);
-    m_compilerOptions.SetTargetEnvironment(
-        shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
-
-    m_compiler = OwningPtr<shaderc::Compiler>(gAllocators.general);
+    m_shaderCompiler.init(m_settings.dumpShaderDisassembly);
 
     const vk::detail::DynamicLoader dl;
     auto vkGetInstanceProcAddr =
@@ -626,7 +474,7 @@ void Device::destroy()
         m_instance = vk::Instance{};
     }
 
-    m_compiler.reset();
+    m_shaderCompiler.destroy();
 }
 
 vk::Instance Device::instance() const
@@ -694,34 +542,22 @@ wheels::Optional<Device::ShaderCompileResult> Device::compileShaderModule(
 {
     WHEELS_ASSERT(m_initialized);
 
-    WHEELS_ASSERT(info.relPath.string().starts_with("shader/"));
-    const auto shaderPath = resPath(info.relPath);
-
-    // Prepend version, defines and reset line offset before the actual source
-    const String source = readFileString(scopeAlloc, shaderPath);
-
-    const StaticArray versionLine = "#version 460\n";
-    const StaticArray line1Tag = "#line 1\n";
-
-    const size_t fullSize = versionLine.size() - 1 + line1Tag.size() - 1 +
-                            info.defines.size() + source.size();
-    String topLevelSource{scopeAlloc, fullSize};
-    topLevelSource.extend(versionLine.data());
-    // The custom includer uses these to make errors work
-    topLevelSource.extend(sCppStyleLineDirective);
-    topLevelSource.extend(info.defines);
-    topLevelSource.extend(line1Tag.data());
-    topLevelSource.extend(source);
+    const ShaderVariant variant{
+        .relPath = info.relPath,
+        .defines = String{scopeAlloc, info.defines},
+    };
+    // Record the variant so that the offline baker can fill the cache for it
+    recordShaderVariant(variant);
 
     const std::filesystem::path cachePath =
-        updateShaderCache(scopeAlloc, shaderPath, topLevelSource, info.relPath);
+        m_shaderCompiler.updateCache(scopeAlloc, variant);
     if (cachePath.empty())
         return {};
 
     // Always read from the cache to make caching issues always visible
     HashSet<std::filesystem::path> uniqueIncludes{scopeAlloc};
     Array<uint32_t> spvWords{scopeAlloc};
-    readCache(scopeAlloc, cachePath, &spvWords, &uniqueIncludes);
+    readShaderCache(scopeAlloc, cachePath, &spvWords, &uniqueIncludes);
     WHEELS_ASSERT(!spvWords.empty());
 
     ShaderReflection reflection;
@@ -755,49 +591,20 @@ wheels::Optional<ShaderReflection> Device::reflectShader(
 
     LOG_INFO("Reflecting {}", info.relPath.string().c_str());
 
-    WHEELS_ASSERT(info.relPath.string().starts_with("shader/"));
-    const auto shaderPath = resPath(info.relPath);
-
-    // Prepend version, defines and reset line offset before the actual source
-    const String source = readFileString(scopeAlloc, shaderPath);
-
-    const StaticArray versionLine = "#version 460\n";
-    const StaticArray line1Tag = "#line 1\n";
-
-    const StaticArray computeBoilerplate1 = "#pragma shader_stage(compute)\n";
-    const StaticArray computeBoilerplate2 =
-        R"(
-layout(local_size_x = 16, local_size_y = 16) in;
-void main()
-{
-}
-)";
-
-    const size_t fullSize =
-        versionLine.size() - 1 + line1Tag.size() - 1 + info.defines.size() +
-        source.size() +
-        (add_dummy_compute_boilerplate
-             ? (computeBoilerplate1.size() + computeBoilerplate2.size() - 2)
-             : 0);
-    String topLevelSource{scopeAlloc, fullSize};
-    topLevelSource.extend(versionLine.data());
-    // The custom includer uses these to make errors work
-    topLevelSource.extend(sCppStyleLineDirective);
-    if (add_dummy_compute_boilerplate)
-        topLevelSource.extend(computeBoilerplate1.data());
-    topLevelSource.extend(info.defines);
-    topLevelSource.extend(line1Tag.data());
-    topLevelSource.extend(source);
-    if (add_dummy_compute_boilerplate)
-        topLevelSource.extend(computeBoilerplate2.data());
+    const ShaderVariant variant{
+        .relPath = info.relPath,
+        .defines = String{scopeAlloc, info.defines},
+        .addDummyComputeBoilerplate = add_dummy_compute_boilerplate,
+    };
+    recordShaderVariant(variant);
 
     const std::filesystem::path cachePath =
-        updateShaderCache(scopeAlloc, shaderPath, topLevelSource, info.relPath);
+        m_shaderCompiler.updateCache(scopeAlloc, variant);
 
     // Always read from the cache to make caching issues always visible
     HashSet<std::filesystem::path> uniqueIncludes{scopeAlloc};
     Array<uint32_t> spvWords{scopeAlloc};
-    readCache(scopeAlloc, cachePath, &spvWords, &uniqueIncludes);
+    readShaderCache(scopeAlloc, cachePath, &spvWords, &uniqueIncludes);
     WHEELS_ASSERT(!spvWords.empty());
 
     ShaderReflection reflection;
@@ -1135,6 +942,7 @@ Image Device::createImage(const ImageCreateInfo &info)
             .image = image.handle,
             .viewType = viewType,
             .format = desc.format,
+            .components = info.viewComponents,
             .subresourceRange = range,
         });
 
@@ -1712,97 +1520,4 @@ void Device::untrackImage(const Image &image)
     m_memoryAllocations.images -= info.size;
 }
 
-std::filesystem::path Device::updateShaderCache(
-    Allocator &alloc, const std::filesystem::path &sourcePath,
-    StrSpan topLevelSource, const std::filesystem::path &relPath)
-{
-    HashSet<std::filesystem::path> uniqueIncludes{alloc};
-    // Also push root file as reflection expects all sources to be included here
-    uniqueIncludes.insert(sourcePath.lexically_normal());
-
-    String fullSource{alloc};
-    try
-    {
-        expandIncludes(
-            alloc, sourcePath, topLevelSource, fullSource, uniqueIncludes, 0);
-    }
-    catch (const std::exception &e)
-    {
-        // Just log so that the calling code can skip without error on recompile
-        LOG_ERR("{}", e.what());
-        return {};
-    }
-
-    // wyhash should be fine here, it's effectively 62bit for collisions
-    // https://github.com/Cyan4973/xxHash/issues/236#issuecomment-522051621
-    const uint64_t sourceHash =
-        wyhash(fullSource.data(), fullSource.size(), 0, (uint64_t const *)_wyp);
-    StaticArray<char, (sizeof(uint64_t) * 2) + 1> hashStr;
-    snprintf(hashStr.data(), hashStr.size(), "%" PRIX64, sourceHash);
-
-    std::filesystem::path cachePath =
-        resPath(std::filesystem::path("shader") / "cache" / hashStr.data());
-    cachePath.replace_extension("prosper_shader");
-
-    const bool cacheValid = readCache(alloc, cachePath);
-    if (!cacheValid || m_settings.dumpShaderDisassembly)
-    {
-        LOG_INFO("Compiling {}", relPath.string().c_str());
-
-        const shaderc::SpvCompilationResult result =
-            m_compiler->CompileGlslToSpv(
-                fullSource.c_str(), fullSource.size(),
-                shaderc_glsl_infer_from_source, sourcePath.string().c_str(),
-                m_compilerOptions);
-
-        if (const auto status = result.GetCompilationStatus(); status)
-        {
-            const auto err = result.GetErrorMessage();
-            if (err.empty())
-                LOG_ERR(
-                    "Compilation of '{}' failed\n{}",
-                    sourcePath.string().c_str(), statusString(status));
-            else
-                LOG_ERR(
-                    "Compilation of '{}' failed\n{}\n{}",
-                    sourcePath.string().c_str(), statusString(status),
-                    err.c_str());
-            return {};
-        }
-
-        writeCache(cachePath, result, uniqueIncludes);
-
-        if (m_settings.dumpShaderDisassembly)
-        {
-            const shaderc::AssemblyCompilationResult resultAsm =
-                m_compiler->CompileGlslToSpvAssembly(
-                    fullSource.c_str(), fullSource.size(),
-                    shaderc_glsl_infer_from_source, sourcePath.string().c_str(),
-                    m_compilerOptions);
-            if (const shaderc_compilation_status status =
-                    result.GetCompilationStatus();
-                status == shaderc_compilation_status_success)
-                LOG_INFO("{}", resultAsm.begin());
-            else
-            {
-                const std::string err = result.GetErrorMessage();
-                if (err.empty())
-                    LOG_ERR(
-                        "Compilation of '{}' failed\n{}",
-                        sourcePath.string().c_str(), statusString(status));
-                else
-                    LOG_ERR(
-                        "Compilation of '{}' failed\n{}\n{}",
-                        sourcePath.string().c_str(), statusString(status),
-                        err.c_str());
-                return {};
-            }
-        }
-    }
-    else
-        LOG_INFO("Loading '{}' from cache", relPath.string().c_str());
-
-    return cachePath;
-}
-
 } // namespace gfx
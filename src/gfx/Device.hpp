@@ -2,17 +2,16 @@
 #define PROSPER_GFX_DEVICE_HPP
 
 #include "gfx/Resources.hpp"
+#include "gfx/ShaderCompiler.hpp"
 #include "gfx/ShaderReflection.hpp"
 #include "utils/Hashes.hpp"
 
 #include <atomic>
 #include <filesystem>
 #include <mutex>
-#include <shaderc/shaderc.hpp>
 #include <wheels/allocators/scoped_scratch.hpp>
 #include <wheels/containers/hash_set.hpp>
 #include <wheels/containers/optional.hpp>
-#include <wheels/owning_ptr.hpp>
 
 namespace gfx
 {
@@ -172,10 +171,6 @@ class Device
     void trackImage(const Image &image);
     void untrackImage(const Image &image);
 
-    std::filesystem::path updateShaderCache(
-        wheels::Allocator &alloc, const std::filesystem::path &sourcePath,
-        wheels::StrSpan topLevelSource, const std::filesystem::path &relPath);
-
     // All members should init (in ctor) without dynamic allocations or
     // exceptions because this class is used in a extern global.
 
@@ -190,10 +185,7 @@ class Device
     std::mutex m_allocatorMutex;
     VmaAllocator m_allocator{nullptr};
 
-    shaderc::CompileOptions m_compilerOptions;
-    // Put behind a ptr to control lifetime and make the leaky mutex visible in
-    // win crt debugging.
-    wheels::OwningPtr<shaderc::Compiler> m_compiler;
+    ShaderCompiler m_shaderCompiler;
 
     vk::SurfaceKHR m_surface;
 
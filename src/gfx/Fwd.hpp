@@ -29,6 +29,10 @@ struct TexelBufferDescription;
 // RingBuffer.hpp
 class RingBuffer;
 
+// ShaderCompiler.hpp
+class ShaderCompiler;
+struct ShaderVariant;
+
 // ShaderReflection.hpp
 class ShaderReflection;
 struct DescriptorSetMetadata;
@@ -299,6 +299,8 @@ struct ImageDescription
 struct ImageCreateInfo
 {
     ImageDescription desc;
+    // Swizzle for the default view
+    vk::ComponentMapping viewComponents;
 
     const char *debugName{nullptr};
 };
@@ -0,0 +1,539 @@
+#include "ShaderCompiler.hpp"
+
+#include "Allocators.hpp"
+#include "gfx/ShaderIncludes.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Utils.hpp"
+
+#include <cinttypes>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <wheels/containers/static_array.hpp>
+#include <wyhash.h>
+
+using namespace wheels;
+
+namespace gfx
+{
+
+namespace
+{
+
+const uint64_t sShaderCacheMagic = 0x4448'5352'5053'5250; // PRSPRSHD
+// This should be incremented when breaking changes are made to what's cached or
+// when the shader compiler is updated
+const uint32_t sShaderCacheVersion = 2;
+
+// First line of the variant manifest
+const char *const sShaderVariantsTag = "prosper_shader_variants";
+// This should be incremented when breaking changes are made to what's recorded
+const uint32_t sShaderVariantVersion = 2;
+
+// Recording happens from the threads that compile shaders
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::mutex gShaderVariantsMutex;
+
+const char *const sCppStyleLineDirectiveCStr =
+    "#extension GL_GOOGLE_cpp_style_line_directive : require\n";
+const StrSpan sCppStyleLineDirective{sCppStyleLineDirectiveCStr};
+
+const char *statusString(shaderc_compilation_status status)
+{
+    switch (status)
+    {
+    case shaderc_compilation_status_success:
+        return "Success";
+    case shaderc_compilation_status_invalid_stage:
+        return "Stage deduction failed";
+    case shaderc_compilation_status_compilation_error:
+        return "Compilation error";
+    case shaderc_compilation_status_internal_error:
+        return "Internal error";
+    case shaderc_compilation_status_null_result_object:
+        return "Null result object";
+    case shaderc_compilation_status_invalid_assembly:
+        return "Invalid assembly";
+    case shaderc_compilation_status_validation_error:
+        return "Validation error";
+    case shaderc_compilation_status_transformation_error:
+        return "Transformation error";
+    case shaderc_compilation_status_configuration_error:
+        return "Configuration error";
+    default:
+        throw std::runtime_error("Unknown shaderc compilationstatus");
+    }
+}
+
+// Prepends version, defines and resets line offset before the actual source
+String createTopLevelSource(
+    Allocator &alloc, StrSpan source, const ShaderVariant &variant)
+{
+    const StaticArray versionLine = "#version 460\n";
+    const StaticArray line1Tag = "#line 1\n";
+
+    const StaticArray computeBoilerplate1 = "#pragma shader_stage(compute)\n";
+    const StaticArray computeBoilerplate2 =
+        R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+void main()
+{
+}
+)";
+
+    const size_t fullSize =
+        versionLine.size() - 1 + line1Tag.size() - 1 +
+        variant.defines.size() + source.size() +
+        (variant.addDummyComputeBoilerplate
+             ? (computeBoilerplate1.size() + computeBoilerplate2.size() - 2)
+             : 0);
+    String ret{alloc, fullSize};
+    ret.extend(versionLine.data());
+    // The custom includer uses these to make errors work
+    ret.extend(sCppStyleLineDirective);
+    if (variant.addDummyComputeBoilerplate)
+        ret.extend(computeBoilerplate1.data());
+    ret.extend(variant.defines);
+    ret.extend(line1Tag.data());
+    ret.extend(source);
+    if (variant.addDummyComputeBoilerplate)
+        ret.extend(computeBoilerplate2.data());
+
+    return ret;
+}
+
+void writeCache(
+    const std::filesystem::path &cachePath,
+    const shaderc::SpvCompilationResult &compilationResult,
+    const HashSet<std::filesystem::path> &uniqueIncludes)
+{
+    const std::filesystem::path parentFolder = cachePath.parent_path();
+    if (!std::filesystem::exists(parentFolder))
+        std::filesystem::create_directories(parentFolder);
+
+    std::filesystem::remove(cachePath);
+
+    // Write into a tmp file and rename when done to minimize the potential for
+    // corrupted files
+    std::filesystem::path cacheTmpPath = cachePath;
+    cacheTmpPath.replace_extension("prosper_shader_TMP");
+
+    std::ofstream cacheFile{cacheTmpPath, std::ios_base::binary};
+
+    writeRaw(cacheFile, sShaderCacheMagic);
+    writeRaw(cacheFile, sShaderCacheVersion);
+    writeRaw(cacheFile, asserted_cast<uint32_t>(uniqueIncludes.size()));
+    for (const std::filesystem::path &include : uniqueIncludes)
+    {
+        // This has to match what recompiles compare against because of how path
+        // hashing works
+        const std::string genericPath = include.lexically_normal().string();
+        writeRaw(cacheFile, asserted_cast<uint32_t>(genericPath.size()));
+        writeRawStrSpan(
+            cacheFile, StrSpan{genericPath.c_str(), genericPath.size()});
+    }
+    const size_t spvWordCount =
+        compilationResult.end() - compilationResult.begin();
+    writeRaw(cacheFile, asserted_cast<uint32_t>(spvWordCount));
+    writeRawSpan(cacheFile, Span{compilationResult.begin(), spvWordCount});
+
+    cacheFile.close();
+
+    // Make sure we have rw permissions for the user to be nice
+    const std::filesystem::perms initialPerms =
+        std::filesystem::status(cacheTmpPath).permissions();
+    std::filesystem::permissions(
+        cacheTmpPath, initialPerms | std::filesystem::perms::owner_read |
+                          std::filesystem::perms::owner_write);
+
+    // Rename when the file is done to minimize the potential of a corrupted
+    // file
+    std::filesystem::rename(cacheTmpPath, cachePath);
+}
+
+std::filesystem::path variantsManifestPath()
+{
+    return resPath(std::filesystem::path("shader") / "variants.txt");
+}
+
+uint64_t variantHash(
+    const std::string &relPath, StrSpan defines,
+    bool addDummyComputeBoilerplate)
+{
+    const uint8_t boilerplate = addDummyComputeBoilerplate ? 1 : 0;
+
+    uint64_t hash =
+        wyhash(relPath.data(), relPath.size(), 0, (uint64_t const *)_wyp);
+    hash = wyhash(defines.data(), defines.size(), hash, (uint64_t const *)_wyp);
+    hash = wyhash(
+        &boilerplate, sizeof(boilerplate), hash, (uint64_t const *)_wyp);
+
+    return hash;
+}
+
+void writeManifestHeader(std::ofstream &file)
+{
+    file << sShaderVariantsTag << ' ' << sShaderVariantVersion << '\n';
+    file << "# Read by prosper_bake to fill the SPIR-V cache offline.\n"
+            "# prosper appends the variants it compiles that are missing,\n"
+            "# commit the changes after running it.\n";
+}
+
+// Records are line based so that the committed manifest diffs cleanly:
+//   variant <relPath>
+//   boilerplate <0|1>
+//   defines <byte count>
+//   <defines>
+// The defines are followed by a newline of their own.
+void writeVariant(std::ofstream &file, const ShaderVariant &variant)
+{
+    const std::string relPath = variant.relPath.generic_string();
+    file << "variant " << relPath << '\n';
+    file << "boilerplate " << (variant.addDummyComputeBoilerplate ? 1 : 0)
+         << '\n';
+    file << "defines " << variant.defines.size() << '\n';
+    writeRawStrSpan(file, variant.defines);
+    file << '\n';
+}
+
+struct RecordedVariant
+{
+    std::string relPath;
+    std::string defines;
+    bool addDummyComputeBoilerplate{false};
+};
+
+// Calls callback for each variant in the manifest. Returns false if the
+// manifest is missing, of an old version or malformed.
+template <typename Callback>
+bool forEachRecordedVariant(Callback &&callback)
+{
+    const std::filesystem::path path = variantsManifestPath();
+    std::ifstream file{path, std::ios_base::binary};
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    std::getline(file, line);
+    const std::string expectedHeader =
+        std::string{sShaderVariantsTag} + ' ' +
+        std::to_string(sShaderVariantVersion);
+    if (line != expectedHeader)
+    {
+        LOG_INFO("Old shader variant manifest {}", path.string().c_str());
+        return false;
+    }
+
+    const auto valueAfter = [&line](const char *prefix) -> const char *
+    {
+        if (!line.starts_with(prefix))
+            return nullptr;
+        return line.c_str() + strlen(prefix);
+    };
+
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        RecordedVariant variant;
+        const char *relPath = valueAfter("variant ");
+        if (relPath == nullptr)
+            break;
+        variant.relPath = relPath;
+
+        std::getline(file, line);
+        const char *boilerplate = valueAfter("boilerplate ");
+        if (boilerplate == nullptr)
+            break;
+        variant.addDummyComputeBoilerplate = strcmp(boilerplate, "1") == 0;
+
+        std::getline(file, line);
+        const char *definesByteCount = valueAfter("defines ");
+        if (definesByteCount == nullptr)
+            break;
+        variant.defines.resize(std::strtoull(definesByteCount, nullptr, 10));
+        file.read(
+            variant.defines.data(),
+            asserted_cast<std::streamsize>(variant.defines.size()));
+        // Newline after the defines
+        file.get();
+
+        if (!file || variant.relPath.empty())
+            break;
+
+        callback(variant);
+    }
+
+    if (!file.eof())
+    {
+        LOG_WARN("Malformed shader variant manifest {}", path.string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+void ShaderCompiler::init(bool dumpDisassembly)
+{
+    WHEELS_ASSERT(!m_initialized);
+
+    m_dumpDisassembly = dumpDisassembly;
+
+    // No includer as we expand those ourselves
+    m_options.SetGenerateDebugInfo();
+    m_options.SetTargetSpirv(shaderc_spirv_version_1_6);
+    m_options.SetTargetEnvironment(
+        shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+
+    m_compiler = OwningPtr<shaderc::Compiler>(gAllocators.general);
+
+    m_initialized = true;
+}
+
+void ShaderCompiler::destroy() { m_compiler.reset(); }
+
+std::filesystem::path ShaderCompiler::updateCache(
+    Allocator &alloc, const ShaderVariant &variant) const
+{
+    WHEELS_ASSERT(m_initialized);
+
+    const std::filesystem::path &relPath = variant.relPath;
+    WHEELS_ASSERT(relPath.string().starts_with("shader/"));
+    const std::filesystem::path sourcePath = resPath(relPath);
+
+    const String source = readFileString(alloc, sourcePath);
+    const String topLevelSource = createTopLevelSource(alloc, source, variant);
+
+    HashSet<std::filesystem::path> uniqueIncludes{alloc};
+    // Also push root file as reflection expects all sources to be included here
+    uniqueIncludes.insert(sourcePath.lexically_normal());
+
+    String fullSource{alloc};
+    try
+    {
+        expandIncludes(
+            alloc, sourcePath, topLevelSource, fullSource, uniqueIncludes, 0);
+    }
+    catch (const std::exception &e)
+    {
+        // Just log so that the calling code can skip without error on recompile
+        LOG_ERR("{}", e.what());
+        return {};
+    }
+
+    // wyhash should be fine here, it's effectively 62bit for collisions
+    // https://github.com/Cyan4973/xxHash/issues/236#issuecomment-522051621
+    const uint64_t sourceHash =
+        wyhash(fullSource.data(), fullSource.size(), 0, (uint64_t const *)_wyp);
+    StaticArray<char, (sizeof(uint64_t) * 2) + 1> hashStr;
+    snprintf(hashStr.data(), hashStr.size(), "%" PRIX64, sourceHash);
+
+    std::filesystem::path cachePath =
+        resPath(std::filesystem::path("shader") / "cache" / hashStr.data());
+    cachePath.replace_extension("prosper_shader");
+
+    const bool cacheValid = readShaderCache(alloc, cachePath);
+    if (!cacheValid || m_dumpDisassembly)
+    {
+        LOG_INFO("Compiling {}", relPath.string().c_str());
+
+        const shaderc::SpvCompilationResult result =
+            m_compiler->CompileGlslToSpv(
+                fullSource.c_str(), fullSource.size(),
+                shaderc_glsl_infer_from_source, sourcePath.string().c_str(),
+                m_options);
+
+        if (const auto status = result.GetCompilationStatus(); status)
+        {
+            const auto err = result.GetErrorMessage();
+            if (err.empty())
+                LOG_ERR(
+                    "Compilation of '{}' failed\n{}",
+                    sourcePath.string().c_str(), statusString(status));
+            else
+                LOG_ERR(
+                    "Compilation of '{}' failed\n{}\n{}",
+                    sourcePath.string().c_str(), statusString(status),
+                    err.c_str());
+            return {};
+        }
+
+        writeCache(cachePath, result, uniqueIncludes);
+
+        if (m_dumpDisassembly)
+        {
+            const shaderc::AssemblyCompilationResult resultAsm =
+                m_compiler->CompileGlslToSpvAssembly(
+                    fullSource.c_str(), fullSource.size(),
+                    shaderc_glsl_infer_from_source, sourcePath.string().c_str(),
+                    m_options);
+            if (const shaderc_compilation_status status =
+                    result.GetCompilationStatus();
+                status == shaderc_compilation_status_success)
+                LOG_INFO("{}", resultAsm.begin());
+            else
+            {
+                const std::string err = result.GetErrorMessage();
+                if (err.empty())
+                    LOG_ERR(
+                        "Compilation of '{}' failed\n{}",
+                        sourcePath.string().c_str(), statusString(status));
+                else
+                    LOG_ERR(
+                        "Compilation of '{}' failed\n{}\n{}",
+                        sourcePath.string().c_str(), statusString(status),
+                        err.c_str());
+                return {};
+            }
+        }
+    }
+    else
+        LOG_INFO("Loading '{}' from cache", relPath.string().c_str());
+
+    return cachePath;
+}
+
+bool readShaderCache(
+    Allocator &alloc, const std::filesystem::path &cachePath,
+    Array<uint32_t> *spvWords, HashSet<std::filesystem::path> *uniqueIncludes)
+{
+    if (!std::filesystem::exists(cachePath))
+        return false;
+
+    std::ifstream cacheFile{cachePath, std::ios_base::binary};
+
+    uint64_t magic{0};
+    static_assert(sizeof(magic) == sizeof(sShaderCacheMagic));
+
+    readRaw(cacheFile, magic);
+    if (magic != sShaderCacheMagic)
+        throw std::runtime_error(
+            "Expected a valid shader cache in file '" + cachePath.string() +
+            "'");
+
+    uint32_t version{0};
+    static_assert(sizeof(version) == sizeof(sShaderCacheVersion));
+    readRaw(cacheFile, version);
+    if (version != sShaderCacheVersion)
+        return false;
+
+    WHEELS_ASSERT(
+        (spvWords == nullptr && uniqueIncludes == nullptr) ||
+        (spvWords != nullptr && uniqueIncludes != nullptr));
+    if (spvWords == nullptr)
+        return true;
+
+    uint32_t includeCount{0};
+    readRaw(cacheFile, includeCount);
+    for (uint32_t i = 0; i < includeCount; ++i)
+    {
+        uint32_t includeLength{0};
+        readRaw(cacheFile, includeLength);
+
+        // Reserve room for null terminated but read without null
+        Array<char> include{alloc, includeLength + 1};
+        include.resize(includeLength);
+        readRawSpan(cacheFile, include.mut_span());
+        include.push_back('\0');
+
+        uniqueIncludes->insert(std::filesystem::path{include.data()});
+    }
+
+    uint32_t spvWordCount{0};
+    readRaw(cacheFile, spvWordCount);
+
+    spvWords->resize(spvWordCount);
+    readRawSpan(cacheFile, spvWords->mut_span());
+
+    return true;
+}
+
+void recordShaderVariant(const ShaderVariant &variant)
+{
+    const std::string relPath = variant.relPath.generic_string();
+    const uint64_t hash = variantHash(
+        relPath, variant.defines, variant.addDummyComputeBoilerplate);
+
+    const std::lock_guard lock{gShaderVariantsMutex};
+
+    bool recorded = false;
+    const bool manifestValid = forEachRecordedVariant(
+        [&](const RecordedVariant &recordedVariant)
+        {
+            recorded = recorded ||
+                       variantHash(
+                           recordedVariant.relPath,
+                           StrSpan{
+                               recordedVariant.defines.data(),
+                               recordedVariant.defines.size()},
+                           recordedVariant.addDummyComputeBoilerplate) == hash;
+        });
+    if (recorded)
+        return;
+
+    const std::filesystem::path path = variantsManifestPath();
+    if (manifestValid)
+    {
+        // Appending keeps the diffs of the committed manifest small
+        std::ofstream file{
+            path, std::ios_base::binary | std::ios_base::app};
+        writeVariant(file, variant);
+    }
+    else
+    {
+        // Old and malformed manifests are replaced
+        std::ofstream file{path, std::ios_base::binary};
+        writeManifestHeader(file);
+        writeVariant(file, variant);
+    }
+}
+
+Array<ShaderVariant> readRecordedShaderVariants(Allocator &alloc)
+{
+    Array<ShaderVariant> ret{alloc};
+
+    const std::lock_guard lock{gShaderVariantsMutex};
+
+    forEachRecordedVariant(
+        [&](const RecordedVariant &variant)
+        {
+            ret.push_back(
+                ShaderVariant{
+                    .relPath = std::filesystem::path{variant.relPath},
+                    .defines =
+                        String{
+                            alloc,
+                            StrSpan{
+                                variant.defines.data(),
+                                variant.defines.size()}},
+                    .addDummyComputeBoilerplate =
+                        variant.addDummyComputeBoilerplate,
+                });
+        });
+
+    return ret;
+}
+
+void rewriteRecordedShaderVariants(Span<const ShaderVariant> variants)
+{
+    const std::lock_guard lock{gShaderVariantsMutex};
+
+    // Write into a tmp file and rename when done to minimize the potential for
+    // corrupted files
+    const std::filesystem::path path = variantsManifestPath();
+    const std::filesystem::path tmpPath = uniqueTmpPath(path);
+    {
+        std::ofstream file{tmpPath, std::ios_base::binary};
+        writeManifestHeader(file);
+        for (const ShaderVariant &variant : variants)
+            writeVariant(file, variant);
+    }
+
+    std::filesystem::rename(tmpPath, path);
+}
+
+} // namespace gfx
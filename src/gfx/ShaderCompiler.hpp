@@ -0,0 +1,80 @@
+#ifndef PROSPER_GFX_SHADER_COMPILER_HPP
+#define PROSPER_GFX_SHADER_COMPILER_HPP
+
+#include <filesystem>
+#include <shaderc/shaderc.hpp>
+#include <wheels/allocators/allocator.hpp>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/hash_set.hpp>
+#include <wheels/containers/span.hpp>
+#include <wheels/containers/string.hpp>
+#include <wheels/owning_ptr.hpp>
+
+namespace gfx
+{
+
+struct ShaderVariant
+{
+    // Relative to the res folder, should be under shader/
+    std::filesystem::path relPath;
+    wheels::String defines;
+    bool addDummyComputeBoilerplate{false};
+};
+
+// Compiles shader variants into the SPIR-V cache in res/shader/cache. This
+// doesn't need a device so it can be used to fill the cache offline.
+// updateCache() can be called from multiple threads as shaderc only requires
+// synchronization for non-const calls on the same compiler.
+class ShaderCompiler
+{
+  public:
+    // All members should init (in ctor) without dynamic allocations or
+    // exceptions because this is a member of a extern global.
+    ShaderCompiler() noexcept = default;
+    ~ShaderCompiler() = default;
+
+    ShaderCompiler(const ShaderCompiler &other) = delete;
+    ShaderCompiler(ShaderCompiler &&other) = delete;
+    ShaderCompiler &operator=(const ShaderCompiler &other) = delete;
+    ShaderCompiler &operator=(ShaderCompiler &&other) = delete;
+
+    void init(bool dumpDisassembly);
+    void destroy();
+
+    // Returns the path to the up-to-date cache for the variant or an empty
+    // path if the compilation failed
+    [[nodiscard]] std::filesystem::path updateCache(
+        wheels::Allocator &alloc, const ShaderVariant &variant) const;
+
+  private:
+    bool m_initialized{false};
+    bool m_dumpDisassembly{false};
+    shaderc::CompileOptions m_options;
+    // Put behind a ptr to control lifetime and make the leaky mutex visible in
+    // win crt debugging.
+    wheels::OwningPtr<shaderc::Compiler> m_compiler;
+};
+
+// Returns true if the cache is valid. The includes and SPIR-V are read if
+// pointers to them are given.
+// No ScopedScratch because spvWords is typically scoped in the upper scope and
+// a child scope would stomp it.
+bool readShaderCache(
+    wheels::Allocator &alloc, const std::filesystem::path &cachePath,
+    wheels::Array<uint32_t> *spvWords = nullptr,
+    wheels::HashSet<std::filesystem::path> *uniqueIncludes = nullptr);
+
+// Variants are recorded into the committed manifest res/shader/variants.txt as
+// they are compiled because some defines are only known at runtime. Recording
+// an already recorded variant is a no-op.
+void recordShaderVariant(const ShaderVariant &variant);
+[[nodiscard]] wheels::Array<ShaderVariant> readRecordedShaderVariants(
+    wheels::Allocator &alloc);
+// Replaces all the recorded variants with the given ones so that stale ones
+// don't pile up
+void rewriteRecordedShaderVariants(
+    wheels::Span<const ShaderVariant> variants);
+
+} // namespace gfx
+
+#endif // PROSPER_GFX_SHADER_COMPILER_HPP
@@ -4,6 +4,7 @@
 #include "gfx/DescriptorAllocator.hpp"
 #include "gfx/Device.hpp"
 #include "render/RenderResources.hpp"
+#include "scene/Texture.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Profiler.hpp"
 #include "utils/Utils.hpp"
@@ -38,9 +39,18 @@ const char *const sDebugLayersArg = "debugLayers";                     // bool
 const char *const sShaderDisassemblyArg = "dumpShaderDisassembly";     // bool
 const char *const sBreakOnValidationErrArg = "breakOnValidationError"; // bool
 const char *const sBreakOnValidationWarnArg =
-    "breakOnValidationWarning";                      // bool
-const char *const sRobustAccessArg = "robustAccess"; // bool
-const char *const sSceneFileArg = "sceneFile";       // string, path
+    "breakOnValidationWarning";                               // bool
+const char *const sRobustAccessArg = "robustAccess";          // bool
+const char *const sSceneFileArg = "sceneFile";                // string, path
+const char *const sTextureBudgetArg = "textureBudgetMiB";     // uint32_t
+const char *const sTextureCacheDirArg = "textureCacheDir";    // string, path
+const char *const sTextureCacheMaxArg = "textureCacheMaxMiB"; // uint32_t
+const char *const sTextureQualityArg = "textureCacheQuality"; // string
+const char *const sUncompressedMeshCachesArg =
+    "uncompressedMeshCaches";                                 // bool
+
+const uint32_t sDefaultTextureBudgetMiB = 1024;
+const uint32_t sDefaultTextureCacheMaxMiB = 16384;
 
 // NOLINTNEXTLINE(*-avoid-c-arrays): Mandatory
 App::Settings parseCli(int argc, char *argv[])
@@ -54,6 +64,15 @@ App::Settings parseCli(int argc, char *argv[])
             (sShaderDisassemblyArg, "Dump shader disassembly to info log")
             (sBreakOnValidationErrArg, "Break debugger on Vulkan validation error")
             (sRobustAccessArg, "Enable VK_EXT_robustness2 for buffers and images")
+            (sTextureBudgetArg, "Memory budget for streamed scene textures in MiB (default: 1024)",
+             cxxopts::value<uint32_t>())
+            (sTextureCacheDirArg, "Directory for texture caches shared between scenes (default: next to each scene)",
+             cxxopts::value<std::string>())
+            (sTextureCacheMaxArg, "Size limit of the shared texture caches in MiB (default: 16384)",
+             cxxopts::value<uint32_t>())
+            (sTextureQualityArg, "BC6H and BC7 encoder profile: ultrafast, fast, basic or slow (default: ultrafast in debug, basic in release)",
+             cxxopts::value<std::string>())
+            (sUncompressedMeshCachesArg, "Write mesh caches without meshopt encoding")
             (sSceneFileArg, std::string{"Scene to open (default: '"} + s_default_scene_path +"')",
              cxxopts::value<std::string>()->default_value(""));
     // clang-format on
@@ -62,6 +81,11 @@ App::Settings parseCli(int argc, char *argv[])
 
     std::filesystem::path scenePath;
     gfx::Device::Settings deviceSettings;
+    uint32_t textureBudgetMiB = sDefaultTextureBudgetMiB;
+    std::filesystem::path textureCacheDir;
+    uint32_t textureCacheMaxMiB = sDefaultTextureCacheMaxMiB;
+    std::string textureCacheQuality;
+    bool uncompressedMeshCaches = false;
 
     // Try to parse toml first as we'll override any of its settings with values
     // given in the CLI
@@ -98,6 +122,29 @@ App::Settings parseCli(int argc, char *argv[])
                 deviceSettings.breakOnValidationWarning,
                 sBreakOnValidationWarnArg);
             tryGetFlag(deviceSettings.robustAccess, sRobustAccessArg);
+            tryGetFlag(uncompressedMeshCaches, sUncompressedMeshCachesArg);
+
+            {
+                auto [ok, budget] = result.table->getInt(sTextureBudgetArg);
+                if (ok)
+                    textureBudgetMiB = asserted_cast<uint32_t>(budget);
+            }
+            {
+                auto [ok, path] = result.table->getString(sTextureCacheDirArg);
+                if (ok)
+                    textureCacheDir = path;
+            }
+            {
+                auto [ok, limit] = result.table->getInt(sTextureCacheMaxArg);
+                if (ok)
+                    textureCacheMaxMiB = asserted_cast<uint32_t>(limit);
+            }
+            {
+                auto [ok, quality] =
+                    result.table->getString(sTextureQualityArg);
+                if (ok)
+                    textureCacheQuality = quality;
+            }
         }
     }
 
@@ -118,7 +165,16 @@ App::Settings parseCli(int argc, char *argv[])
         tryGetFlag(
             deviceSettings.breakOnValidationWarning, sBreakOnValidationWarnArg);
         tryGetFlag(deviceSettings.robustAccess, sRobustAccessArg);
+        tryGetFlag(uncompressedMeshCaches, sUncompressedMeshCachesArg);
     }
+    if (args.count(sTextureBudgetArg) > 0)
+        textureBudgetMiB = args[sTextureBudgetArg].as<uint32_t>();
+    if (args.count(sTextureCacheDirArg) > 0)
+        textureCacheDir = args[sTextureCacheDirArg].as<std::string>();
+    if (args.count(sTextureCacheMaxArg) > 0)
+        textureCacheMaxMiB = args[sTextureCacheMaxArg].as<uint32_t>();
+    if (args.count(sTextureQualityArg) > 0)
+        textureCacheQuality = args[sTextureQualityArg].as<std::string>();
 
     if (scenePath.empty())
         scenePath = s_default_scene_path;
@@ -126,6 +182,11 @@ App::Settings parseCli(int argc, char *argv[])
     return App::Settings{
         .scene = scenePath,
         .device = deviceSettings,
+        .textureBudgetByteCount = megabytes(textureBudgetMiB),
+        .textureCacheDir = textureCacheDir,
+        .textureCacheMaxByteCount = megabytes(textureCacheMaxMiB),
+        .textureCacheQuality = textureCacheQuality,
+        .compressMeshCaches = !uncompressedMeshCaches,
     };
 }
 
@@ -197,7 +258,14 @@ int main(int argc, char *argv[])
         utils::gProfiler.init();
         defer { utils::gProfiler.destroy(); };
 
-        App app{settings.scene};
+        scene::setSharedTextureCache(
+            settings.textureCacheDir, settings.textureCacheMaxByteCount);
+        if (!settings.textureCacheQuality.empty())
+            scene::setTextureCacheQuality(scene::textureCacheQualityFromName(
+                settings.textureCacheQuality));
+        scene::setMeshCacheCompression(settings.compressMeshCaches);
+
+        App app{settings.scene, settings.textureBudgetByteCount};
         app.init(WHEELS_MOV(scopeAlloc));
 
         app.setInitScratchHighWatermark(
@@ -35,8 +35,12 @@ const uint32_t sMaxRecordsPerFrame = 2;
 
 const uint32_t sMaxHierarchicalDepthMips = 12;
 
+// Mesh LODs are picked so that the simplification error stays under this
+const float sLodErrorThresholdPx = 1.f;
+
 enum GeneratorBindingSet : uint8_t
 {
+    GeneratorCameraBindingSet,
     GeneratorGeometryBindingSet,
     GeneratorSceneInstancesBindingSet,
     GeneratorMaterialDatasBindingSet,
@@ -57,8 +61,9 @@ enum CullerBindingSet : uint8_t
 ComputePass::Shader generatorDefinitionCallback(
     Allocator &alloc, const scene::WorldDSLayouts &worldDSLayouts)
 {
-    const size_t len = 168;
+    const size_t len = 190;
     String defines{alloc, len};
+    appendDefineStr(defines, "CAMERA_SET", GeneratorCameraBindingSet);
     appendDefineStr(defines, "GEOMETRY_SET", GeneratorGeometryBindingSet);
     appendDefineStr(
         defines, "SCENE_INSTANCES_SET", GeneratorSceneInstancesBindingSet);
@@ -80,10 +85,13 @@ ComputePass::Shader generatorDefinitionCallback(
 }
 
 StaticArray<vk::DescriptorSetLayout, GeneratorBindingSetCount - 1>
-generatorExternalDsLayouts(const scene::WorldDSLayouts &worldDsLayouts)
+generatorExternalDsLayouts(
+    const scene::WorldDSLayouts &worldDsLayouts,
+    vk::DescriptorSetLayout camDsLayout)
 {
     StaticArray<vk::DescriptorSetLayout, GeneratorBindingSetCount - 1>
         setLayouts{VK_NULL_HANDLE};
+    setLayouts[GeneratorCameraBindingSet] = camDsLayout;
     setLayouts[GeneratorGeometryBindingSet] = worldDsLayouts.geometry;
     setLayouts[GeneratorSceneInstancesBindingSet] =
         worldDsLayouts.sceneInstances;
@@ -155,7 +163,8 @@ void MeshletCuller::init(
         ComputePassOptions{
             .storageSetIndex = GeneratorStorageBindingSet,
             .storageSetInstanceCount = sMaxRecordsPerFrame,
-            .externalDsLayouts = generatorExternalDsLayouts(worldDsLayouts),
+            .externalDsLayouts =
+                generatorExternalDsLayouts(worldDsLayouts, camDsLayout),
         });
     m_cullerArgumentsWriter.init(
         scopeAlloc.child_scope(), argumentsWriterDefinitionCallback,
@@ -188,7 +197,7 @@ void MeshletCuller::recompileShaders(
         scopeAlloc.child_scope(), changedFiles,
         [&worldDsLayouts](Allocator &alloc)
         { return generatorDefinitionCallback(alloc, worldDsLayouts); },
-        generatorExternalDsLayouts(worldDsLayouts));
+        generatorExternalDsLayouts(worldDsLayouts, camDsLayout));
     m_cullerArgumentsWriter.recompileShader(
         scopeAlloc.child_scope(), changedFiles,
         argumentsWriterDefinitionCallback);
@@ -217,7 +226,7 @@ MeshletCullerFirstPhaseOutput MeshletCuller::recordFirstPhase(
     PROFILER_CPU_GPU_SCOPE(cb, "  DrawListFirstPhase");
 
     const BufferHandle initialList = recordGenerateList(
-        scopeAlloc.child_scope(), cb, mode, world, nextFrame, debugPrefix,
+        scopeAlloc.child_scope(), cb, mode, world, cam, nextFrame, debugPrefix,
         drawStats);
 
     const BufferHandle cullerArgs = recordWriteCullerArgs(
@@ -282,8 +291,8 @@ MeshletCullerSecondPhaseOutput MeshletCuller::recordSecondPhase(
 
 BufferHandle MeshletCuller::recordGenerateList(
     ScopedScratch scopeAlloc, vk::CommandBuffer cb, Mode mode,
-    const scene::World &world, uint32_t nextFrame, StrSpan debugPrefix,
-    DrawStats &drawStats)
+    const scene::World &world, const scene::Camera &cam, uint32_t nextFrame,
+    StrSpan debugPrefix, DrawStats &drawStats)
 {
     uint32_t meshletCountUpperBound = 0;
     {
@@ -373,6 +382,7 @@ BufferHandle MeshletCuller::recordGenerateList(
 
     const DrawListGeneratorPC pcBlock{
         .matchTransparents = mode == Mode::Transparent ? 1u : 0u,
+        .lodErrorThresholdPx = sLodErrorThresholdPx,
     };
 
     const scene::Scene &scene = world.currentScene();
@@ -381,6 +391,7 @@ BufferHandle MeshletCuller::recordGenerateList(
 
     StaticArray<vk::DescriptorSet, GeneratorBindingSetCount> descriptorSets{
         VK_NULL_HANDLE};
+    descriptorSets[GeneratorCameraBindingSet] = cam.descriptorSet();
     descriptorSets[GeneratorGeometryBindingSet] = worldDSes.geometry[nextFrame];
     descriptorSets[GeneratorSceneInstancesBindingSet] =
         scene.sceneInstancesDescriptorSet;
@@ -391,6 +402,7 @@ BufferHandle MeshletCuller::recordGenerateList(
     descriptorSets[GeneratorStorageBindingSet] = storageSet;
 
     const StaticArray dynamicOffsets{{
+        cam.bufferOffset(),
         worldByteOffsets.modelInstanceTransforms,
         worldByteOffsets.previousModelInstanceTransforms,
         worldByteOffsets.modelInstanceScales,
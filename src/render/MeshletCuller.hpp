@@ -74,10 +74,12 @@ class MeshletCuller
         wheels::StrSpan debugPrefix);
 
   private:
+    // Picks the LOD for each draw instance based on the projected
+    // simplification error
     [[nodiscard]] BufferHandle recordGenerateList(
         wheels::ScopedScratch scopeAlloc, vk::CommandBuffer cb, Mode mode,
-        const scene::World &world, uint32_t nextFrame,
-        wheels::StrSpan debugPrefix, DrawStats &drawStats);
+        const scene::World &world, const scene::Camera &cam,
+        uint32_t nextFrame, wheels::StrSpan debugPrefix, DrawStats &drawStats);
 
     [[nodiscard]] BufferHandle recordWriteCullerArgs(
         wheels::ScopedScratch scopeAlloc, vk::CommandBuffer cb,
@@ -2,6 +2,7 @@
 
 #include "utils/Utils.hpp"
 
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
@@ -22,7 +23,17 @@ TimeAccessor::TimeAccessor(
 
 float TimeAccessor::endTimeS() const { return m_interval.endTimeS; }
 
-KeyFrameInterpolation TimeAccessor::interpolation(float timeS) const
+const TimeAccessor::Interval &TimeAccessor::interval() const
+{
+    return m_interval;
+}
+
+wheels::Span<const float> TimeAccessor::times() const
+{
+    return wheels::Span{m_data, m_count};
+}
+
+KeyFrameInterpolation TimeAccessor::interpolation(float timeS)
 {
     if (timeS <= m_interval.startTimeS || timeS < m_data[0])
         return KeyFrameInterpolation{
@@ -36,26 +47,10 @@ KeyFrameInterpolation TimeAccessor::interpolation(float timeS) const
             .firstFrame = m_count - 1,
         };
 
-    // TODO:
-    // Cache previous first frame to speed up consequtive queries. Average case
-    // is within the same interval, next one if not. Random access still
-    // requires search. Need to be careful that the cache check works with
-    // random access. Profile well.
-
     KeyFrameInterpolation ret;
-    const uint32_t lastFrame = m_count - 1;
-    while (ret.firstFrame < lastFrame)
-    {
-        const float frameTimeS = m_data[ret.firstFrame];
-        // Time == first frame has an early out
-        if (frameTimeS > timeS)
-            break;
-
-        ret.firstFrame++;
-    }
-    // We went one over in the loop
-    ret.firstFrame--;
+    ret.firstFrame = findFirstFrame(timeS);
 
+    const uint32_t lastFrame = m_count - 1;
     if (ret.firstFrame < lastFrame)
     {
         const float firstTime = m_data[ret.firstFrame];
@@ -74,6 +69,36 @@ KeyFrameInterpolation TimeAccessor::interpolation(float timeS) const
     return ret;
 }
 
+uint32_t TimeAccessor::findFirstFrame(float timeS)
+{
+    WHEELS_ASSERT(m_count > 1);
+    WHEELS_ASSERT(m_data[0] <= timeS);
+
+    const uint32_t lastFrame = m_count - 1;
+    const auto startsInterval = [&](uint32_t frame)
+    {
+        return frame < lastFrame && m_data[frame] <= timeS &&
+               (frame + 1 == lastFrame || timeS < m_data[frame + 1]);
+    };
+
+    // Forward playback hits either of these so only seeks pay for the search
+    if (startsInterval(m_cursor))
+        return m_cursor;
+    if (startsInterval(m_cursor + 1))
+    {
+        m_cursor++;
+        return m_cursor;
+    }
+
+    // First frame after timeS, the last frame is never a first frame
+    const float *upper =
+        std::upper_bound(m_data + 1, m_data + lastFrame, timeS);
+    m_cursor = asserted_cast<uint32_t>(upper - m_data) - 1;
+    WHEELS_ASSERT(startsInterval(m_cursor));
+
+    return m_cursor;
+}
+
 template <>
 ValueAccessor<vec3>::ValueAccessor(const uint8_t *data, uint32_t count) noexcept
 : m_data{data}
@@ -83,6 +108,8 @@ ValueAccessor<vec3>::ValueAccessor(const uint8_t *data, uint32_t count) noexcept
     WHEELS_ASSERT(m_count > 0);
 }
 
+template <> uint32_t ValueAccessor<vec3>::count() const { return m_count; }
+
 template <> vec3 ValueAccessor<vec3>::read(uint32_t index) const
 {
     WHEELS_ASSERT(index < m_count);
@@ -99,6 +126,8 @@ ValueAccessor<quat>::ValueAccessor(const uint8_t *data, uint32_t count) noexcept
     WHEELS_ASSERT(m_count > 0);
 }
 
+template <> uint32_t ValueAccessor<quat>::count() const { return m_count; }
+
 template <> quat ValueAccessor<quat>::read(uint32_t index) const
 {
     WHEELS_ASSERT(index < m_count);
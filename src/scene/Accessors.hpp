@@ -2,6 +2,7 @@
 #define PROSPER_SCENE_ACCESSORS_HPP
 
 #include <cstdint>
+#include <wheels/containers/span.hpp>
 
 namespace scene
 {
@@ -28,12 +29,22 @@ class TimeAccessor
         const float *data, uint32_t count, const Interval &interval) noexcept;
 
     [[nodiscard]] float endTimeS() const;
-    [[nodiscard]] KeyFrameInterpolation interpolation(float timeS) const;
+    [[nodiscard]] const Interval &interval() const;
+    [[nodiscard]] wheels::Span<const float> times() const;
+    // Not const as the found frame is cached for the next query
+    [[nodiscard]] KeyFrameInterpolation interpolation(float timeS);
 
   private:
+    // Returns the last frame before the last one that starts at or before
+    // timeS. Expects timeS to be within the keyframes.
+    [[nodiscard]] uint32_t findFirstFrame(float timeS);
+
     const float *m_data{nullptr};
     uint32_t m_count{0};
     Interval m_interval;
+    // First frame of the previous query. Playback usually stays within the
+    // same interval or moves to the next one between frames.
+    uint32_t m_cursor{0};
 };
 
 // Templated so that Sampler can be templated on the read value type.
@@ -44,6 +55,7 @@ template <typename T> class ValueAccessor
     // Count is for vector elements, not individual float
     ValueAccessor(const uint8_t *data, uint32_t count) noexcept;
 
+    [[nodiscard]] uint32_t count() const;
     [[nodiscard]] T read(uint32_t index) const;
 
   private:
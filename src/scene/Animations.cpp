@@ -0,0 +1,699 @@
+#include "Animations.hpp"
+
+#include "utils/Utils.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <wheels/containers/static_array.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROSPER_ANIMATIONS_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// vdivq_f32 and vsqrtq_f32 are AArch64 only
+#include <arm_neon.h>
+#define PROSPER_ANIMATIONS_NEON
+#endif
+
+using namespace wheels;
+
+namespace scene
+{
+
+namespace
+{
+
+constexpr uint32_t sLaneWidth = 4;
+// Keyframe values are padded to four floats so that each lane loads its value
+// as a whole and the loaded values transpose into component lanes
+constexpr uint32_t sValueWidth = 4;
+// Clamped lanes and padding lanes read up to four values past their last value
+constexpr uint32_t sValuePadding = 5;
+
+// The few lane operations the blends need, one float per lane
+#if defined(PROSPER_ANIMATIONS_SSE2)
+
+using Lanes = __m128;
+using LaneMask = __m128;
+
+Lanes splat(float v) { return _mm_set1_ps(v); }
+Lanes load(const float *src) { return _mm_loadu_ps(src); }
+void store(float *dst, Lanes v) { _mm_storeu_ps(dst, v); }
+Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+Lanes div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+Lanes min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+Lanes sqrt(Lanes v) { return _mm_sqrt_ps(v); }
+LaneMask less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+LaneMask lessEqual(Lanes a, Lanes b) { return _mm_cmple_ps(a, b); }
+LaneMask equal(Lanes a, Lanes b) { return _mm_cmpeq_ps(a, b); }
+LaneMask both(LaneMask a, LaneMask b) { return _mm_and_ps(a, b); }
+LaneMask either(LaneMask a, LaneMask b) { return _mm_or_ps(a, b); }
+uint32_t bits(LaneMask mask)
+{
+    return static_cast<uint32_t>(_mm_movemask_ps(mask));
+}
+Lanes select(LaneMask mask, Lanes a, Lanes b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+void transpose(Lanes &a, Lanes &b, Lanes &c, Lanes &d)
+{
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+}
+
+#elif defined(PROSPER_ANIMATIONS_NEON)
+
+using Lanes = float32x4_t;
+using LaneMask = uint32x4_t;
+
+Lanes splat(float v) { return vdupq_n_f32(v); }
+Lanes load(const float *src) { return vld1q_f32(src); }
+void store(float *dst, Lanes v) { vst1q_f32(dst, v); }
+Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+Lanes div(Lanes a, Lanes b) { return vdivq_f32(a, b); }
+Lanes min(Lanes a, Lanes b) { return vminq_f32(a, b); }
+Lanes sqrt(Lanes v) { return vsqrtq_f32(v); }
+LaneMask less(Lanes a, Lanes b) { return vcltq_f32(a, b); }
+LaneMask lessEqual(Lanes a, Lanes b) { return vcleq_f32(a, b); }
+LaneMask equal(Lanes a, Lanes b) { return vceqq_f32(a, b); }
+LaneMask both(LaneMask a, LaneMask b) { return vandq_u32(a, b); }
+LaneMask either(LaneMask a, LaneMask b) { return vorrq_u32(a, b); }
+uint32_t bits(LaneMask mask)
+{
+    const uint32x4_t laneBits{1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(mask, laneBits));
+}
+Lanes select(LaneMask mask, Lanes a, Lanes b) { return vbslq_f32(mask, a, b); }
+void transpose(Lanes &a, Lanes &b, Lanes &c, Lanes &d)
+{
+    const auto pairs = [](Lanes v) { return vreinterpretq_f64_f32(v); };
+    const auto floats = [](float64x2_t v) { return vreinterpretq_f32_f64(v); };
+    // a0 b0 a2 b2, a1 b1 a3 b3 and the same for c and d
+    const Lanes ab0 = vtrn1q_f32(a, b);
+    const Lanes ab1 = vtrn2q_f32(a, b);
+    const Lanes cd0 = vtrn1q_f32(c, d);
+    const Lanes cd1 = vtrn2q_f32(c, d);
+    a = floats(vtrn1q_f64(pairs(ab0), pairs(cd0)));
+    b = floats(vtrn1q_f64(pairs(ab1), pairs(cd1)));
+    c = floats(vtrn2q_f64(pairs(ab0), pairs(cd0)));
+    d = floats(vtrn2q_f64(pairs(ab1), pairs(cd1)));
+}
+
+#else
+
+using Lanes = StaticArray<float, sLaneWidth>;
+using LaneMask = StaticArray<bool, sLaneWidth>;
+
+template <typename Fn> Lanes map(Lanes a, Lanes b, const Fn &fn)
+{
+    Lanes ret;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret[l] = fn(a[l], b[l]);
+    return ret;
+}
+
+template <typename Fn> LaneMask compare(Lanes a, Lanes b, const Fn &fn)
+{
+    LaneMask ret;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret[l] = fn(a[l], b[l]);
+    return ret;
+}
+
+Lanes splat(float v) { return Lanes{{v, v, v, v}}; }
+Lanes load(const float *src) { return Lanes{{src[0], src[1], src[2], src[3]}}; }
+void store(float *dst, Lanes v)
+{
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        dst[l] = v[l];
+}
+Lanes add(Lanes a, Lanes b)
+{
+    return map(a, b, [](float x, float y) { return x + y; });
+}
+Lanes sub(Lanes a, Lanes b)
+{
+    return map(a, b, [](float x, float y) { return x - y; });
+}
+Lanes mul(Lanes a, Lanes b)
+{
+    return map(a, b, [](float x, float y) { return x * y; });
+}
+Lanes div(Lanes a, Lanes b)
+{
+    return map(a, b, [](float x, float y) { return x / y; });
+}
+Lanes min(Lanes a, Lanes b)
+{
+    return map(a, b, [](float x, float y) { return std::min(x, y); });
+}
+Lanes sqrt(Lanes v)
+{
+    return map(v, v, [](float x, float /*unused*/) { return std::sqrt(x); });
+}
+LaneMask less(Lanes a, Lanes b)
+{
+    return compare(a, b, [](float x, float y) { return x < y; });
+}
+LaneMask lessEqual(Lanes a, Lanes b)
+{
+    return compare(a, b, [](float x, float y) { return x <= y; });
+}
+LaneMask equal(Lanes a, Lanes b)
+{
+    return compare(a, b, [](float x, float y) { return x == y; });
+}
+LaneMask both(LaneMask a, LaneMask b)
+{
+    LaneMask ret;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret[l] = a[l] && b[l];
+    return ret;
+}
+LaneMask either(LaneMask a, LaneMask b)
+{
+    LaneMask ret;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret[l] = a[l] || b[l];
+    return ret;
+}
+uint32_t bits(LaneMask mask)
+{
+    uint32_t ret = 0;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret |= mask[l] ? 1u << l : 0u;
+    return ret;
+}
+Lanes select(LaneMask mask, Lanes a, Lanes b)
+{
+    Lanes ret;
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+        ret[l] = mask[l] ? a[l] : b[l];
+    return ret;
+}
+void transpose(Lanes &a, Lanes &b, Lanes &c, Lanes &d)
+{
+    const StaticArray rows{{a, b, c, d}};
+    for (uint32_t l = 0; l < sLaneWidth; ++l)
+    {
+        a[l] = rows[l][0];
+        b[l] = rows[l][1];
+        c[l] = rows[l][2];
+        d[l] = rows[l][3];
+    }
+}
+
+#endif
+
+// Components of a value in four lanes. The w of vec3 values is zero.
+struct LaneValues
+{
+    Lanes x;
+    Lanes y;
+    Lanes z;
+    Lanes w;
+};
+
+// Loads src[indices[l] + offset] of each lane l
+Lanes gather(const float *src, const uint32_t *indices, uint32_t offset)
+{
+    const StaticArray<float, sLaneWidth> values{{
+        src[indices[0] + offset],
+        src[indices[1] + offset],
+        src[indices[2] + offset],
+        src[indices[3] + offset],
+    }};
+    return load(values.data());
+}
+
+// Loads the values at indices[l] + offset of each lane l
+LaneValues gatherValues(
+    const float *values, const uint32_t *indices, uint32_t offset)
+{
+    const auto value = [&](uint32_t lane)
+    {
+        return load(
+            values +
+            (static_cast<size_t>(indices[lane] + offset) * sValueWidth));
+    };
+    LaneValues ret{
+        .x = value(0),
+        .y = value(1),
+        .z = value(2),
+        .w = value(3),
+    };
+    transpose(ret.x, ret.y, ret.z, ret.w);
+    return ret;
+}
+
+LaneValues weighted(Lanes weight, const LaneValues &v)
+{
+    return LaneValues{
+        .x = mul(weight, v.x),
+        .y = mul(weight, v.y),
+        .z = mul(weight, v.z),
+        .w = mul(weight, v.w),
+    };
+}
+
+void accumulate(LaneValues &sum, Lanes weight, const LaneValues &v)
+{
+    sum.x = add(sum.x, mul(weight, v.x));
+    sum.y = add(sum.y, mul(weight, v.y));
+    sum.z = add(sum.z, mul(weight, v.z));
+    sum.w = add(sum.w, mul(weight, v.w));
+}
+
+Lanes dot(const LaneValues &a, const LaneValues &b)
+{
+    return add(
+        add(mul(a.x, b.x), mul(a.y, b.y)), add(mul(a.z, b.z), mul(a.w, b.w)));
+}
+
+LaneValues select(LaneMask mask, const LaneValues &a, const LaneValues &b)
+{
+    return LaneValues{
+        .x = select(mask, a.x, b.x),
+        .y = select(mask, a.y, b.y),
+        .z = select(mask, a.z, b.z),
+        .w = select(mask, a.w, b.w),
+    };
+}
+
+// acos for [0, 1] through the asin polynomial from Cephes' asinf. The argument
+// of the polynomial stays within [0, 0.25] and the error is a few ulps.
+Lanes acos01(Lanes x)
+{
+    const LaneMask upper = less(splat(0.5f), x);
+    // acos(x) = 2 * asin(sqrt((1 - x) / 2)) above 0.5
+    const Lanes zz =
+        select(upper, mul(splat(0.5f), sub(splat(1.f), x)), mul(x, x));
+    const Lanes z = select(upper, sqrt(zz), x);
+
+    Lanes p = splat(4.2163199048e-2f);
+    p = add(mul(p, zz), splat(2.4181311049e-2f));
+    p = add(mul(p, zz), splat(4.5470025998e-2f));
+    p = add(mul(p, zz), splat(7.4953002686e-2f));
+    p = add(mul(p, zz), splat(1.6666752422e-1f));
+    const Lanes asinZ = add(z, mul(mul(z, zz), p));
+
+    // acos(x) = pi / 2 - asin(x) below 0.5
+    return select(
+        upper, add(asinZ, asinZ), sub(splat(glm::half_pi<float>()), asinZ));
+}
+
+// Taylor series of sin up to x^11, the error is below 1e-7 for [0, pi / 2]
+Lanes sin0ToHalfPi(Lanes x)
+{
+    const Lanes x2 = mul(x, x);
+    Lanes p = splat(-1.f / 39916800.f);
+    p = add(mul(p, x2), splat(1.f / 362880.f));
+    p = add(mul(p, x2), splat(-1.f / 5040.f));
+    p = add(mul(p, x2), splat(1.f / 120.f));
+    p = add(mul(p, x2), splat(-1.f / 6.f));
+    p = add(mul(p, x2), splat(1.f));
+    return mul(x, p);
+}
+
+template <typename T>
+void createBatches(
+    const Array<Animation<T>> &animations, Array<AnimationBatch> &batches)
+{
+    const uint32_t componentCount = sizeof(T) / sizeof(float);
+    const float infinity = std::numeric_limits<float>::infinity();
+    // The world allocator is linear so let's not grow the arrays
+    batches.reserve(3);
+    const StaticArray interpolations{{
+        InterpolationType::Step,
+        InterpolationType::Linear,
+        InterpolationType::CubicSpline,
+    }};
+    for (const InterpolationType interpolation : interpolations)
+    {
+        AnimationBatch batch{
+            .interpolation = interpolation,
+        };
+        size_t animationCount = 0;
+        size_t timeCount = 0;
+        uint32_t valueCount = 0;
+        for (const Animation<T> &animation : animations)
+        {
+            if (animation.interpolation() == interpolation)
+            {
+                animationCount++;
+                timeCount += animation.timeFrames().times().size();
+                valueCount += animation.valueFrames().count();
+            }
+        }
+        if (animationCount == 0)
+            continue;
+
+        const uint32_t laneCount = asserted_cast<uint32_t>(animationCount);
+        batch.laneStride =
+            ((laneCount + sLaneWidth - 1) / sLaneWidth) * sLaneWidth;
+
+        batch.animations.reserve(animationCount);
+        for (uint32_t i = 0; i < animations.size(); ++i)
+        {
+            if (animations[i].interpolation() == interpolation)
+                batch.animations.push_back(i);
+        }
+        // Animations that start and end together share lane groups so that
+        // whole groups are clamped at once more often
+        std::stable_sort(
+            batch.animations.begin(), batch.animations.end(),
+            [&](uint32_t a, uint32_t b)
+            {
+                const TimeAccessor::Interval &aInterval =
+                    animations[a].timeFrames().interval();
+                const TimeAccessor::Interval &bInterval =
+                    animations[b].timeFrames().interval();
+                if (aInterval.startTimeS != bInterval.startTimeS)
+                    return aInterval.startTimeS < bInterval.startTimeS;
+                return aInterval.endTimeS < bInterval.endTimeS;
+            });
+
+        // The accessors point into the times so those can't reallocate. Each
+        // lane has sentinel times around its keyframes and the padding lanes
+        // share a clamped interval at the end.
+        batch.times.reserve(timeCount + (2 * animationCount) + 3);
+        batch.timeAccessors.reserve(animationCount);
+        batch.firstTimes.reserve(animationCount);
+        batch.timeIndices.reserve(batch.laneStride);
+        batch.values.resize(
+            static_cast<size_t>(valueCount + sValuePadding) * sValueWidth, 0.f);
+        batch.firstValues.reserve(animationCount);
+        batch.valueIndices.reserve(batch.laneStride);
+        batch.keyframeTs.resize(batch.laneStride, 0.f);
+        batch.stepDurations.resize(batch.laneStride, 0.f);
+        batch.blended.resize(
+            static_cast<size_t>(batch.laneStride) * sValueWidth, 0.f);
+
+        uint32_t firstValue = 0;
+        for (const uint32_t i : batch.animations)
+        {
+            const Animation<T> &animation = animations[i];
+
+            const TimeAccessor &timeFrames = animation.timeFrames();
+            const Span<const float> times = timeFrames.times();
+            const auto firstTime = asserted_cast<uint32_t>(batch.times.size());
+            batch.times.push_back(-infinity);
+            batch.times.extend(times);
+            batch.times.push_back(infinity);
+            batch.timeAccessors.emplace_back(
+                batch.times.data() + firstTime + 1,
+                asserted_cast<uint32_t>(times.size()), timeFrames.interval());
+            batch.firstTimes.push_back(firstTime);
+            batch.timeIndices.push_back(firstTime);
+
+            const ValueAccessor<T> &valueFrames = animation.valueFrames();
+            batch.firstValues.push_back(firstValue);
+            batch.valueIndices.push_back(firstValue);
+            for (uint32_t v = 0; v < valueFrames.count(); ++v)
+            {
+                const T value = valueFrames.read(v);
+                const float *components = glm::value_ptr(value);
+                const size_t dst =
+                    static_cast<size_t>(firstValue + v) * sValueWidth;
+                for (uint32_t c = 0; c < componentCount; ++c)
+                    batch.values[dst + c] = components[c];
+            }
+            firstValue += valueFrames.count();
+        }
+        WHEELS_ASSERT(firstValue == valueCount);
+
+        const auto paddingTime = asserted_cast<uint32_t>(batch.times.size());
+        batch.times.push_back(-infinity);
+        batch.times.push_back(infinity);
+        batch.times.push_back(infinity);
+        batch.timeIndices.resize(batch.laneStride, paddingTime);
+        // Padding lanes stay clamped to the zeros after the last value
+        batch.valueIndices.resize(batch.laneStride, valueCount);
+
+        batches.push_back(WHEELS_MOV(batch));
+    }
+}
+
+// Finds the keyframes of each lane. Forward playback usually stays within the
+// previous keyframe interval of a lane or moves to the next one, which are
+// checked four lanes at a time. Lanes that seeked go through their time
+// accessors as the searches can't be done in lockstep.
+void lookUpKeyframes(AnimationBatch &batch, float timeS)
+{
+    const uint32_t valuesPerKeyframe =
+        batch.interpolation == InterpolationType::CubicSpline ? 3 : 1;
+    const uint32_t laneCount = asserted_cast<uint32_t>(batch.animations.size());
+    const float *times = batch.times.data();
+    const Lanes time = splat(timeS);
+    const float infinity = std::numeric_limits<float>::infinity();
+    for (uint32_t lane = 0; lane < batch.laneStride; lane += sLaneWidth)
+    {
+        const uint32_t *timeIndices = batch.timeIndices.data() + lane;
+        const Lanes previousTime = gather(times, timeIndices, 0);
+        const Lanes currentTime = gather(times, timeIndices, 1);
+        const Lanes nextTime = gather(times, timeIndices, 2);
+        const LaneMask withinPrevious =
+            both(lessEqual(previousTime, time), less(time, currentTime));
+        const LaneMask withinNext =
+            both(lessEqual(currentTime, time), less(time, nextTime));
+        const Lanes firstTime = select(withinNext, currentTime, previousTime);
+        const Lanes secondTime = select(withinNext, nextTime, currentTime);
+
+        // Same math as TimeAccessor::interpolation(). The sentinel intervals
+        // before the first and after the last keyframe clamp.
+        const LaneMask clamped = either(
+            equal(firstTime, splat(-infinity)),
+            equal(secondTime, splat(infinity)));
+        const Lanes stepDuration =
+            select(clamped, splat(0.f), sub(time, firstTime));
+        store(batch.stepDurations.data() + lane, stepDuration);
+        store(
+            batch.keyframeTs.data() + lane,
+            select(
+                clamped, splat(0.f),
+                div(stepDuration, sub(secondTime, firstTime))));
+
+        // Lanes that stay within their interval are done, the rest are
+        // updated one by one
+        const uint32_t laneMask =
+            (1u << (std::min(lane + sLaneWidth, laneCount) - lane)) - 1;
+        uint32_t movedLanes = laneMask & ~bits(withinPrevious);
+        const uint32_t nextLanes = movedLanes & bits(withinNext);
+        while (movedLanes != 0)
+        {
+            const auto laneOffset =
+                static_cast<uint32_t>(std::countr_zero(movedLanes));
+            const uint32_t laneBit = 1u << laneOffset;
+            const uint32_t l = lane + laneOffset;
+            movedLanes &= ~laneBit;
+
+            const uint32_t firstTimeIndex = batch.firstTimes[l];
+            if ((nextLanes & laneBit) != 0)
+            {
+                // The sentinel interval before the first keyframe clamps to it
+                // so moving out of that keeps the same value
+                if (batch.timeIndices[l] != firstTimeIndex)
+                    batch.valueIndices[l] += valuesPerKeyframe;
+                batch.timeIndices[l]++;
+                continue;
+            }
+
+            const KeyFrameInterpolation interp =
+                batch.timeAccessors[l].interpolation(timeS);
+            const bool beforeFirst = timeS < times[firstTimeIndex + 1];
+            batch.timeIndices[l] =
+                firstTimeIndex + (beforeFirst ? 0 : interp.firstFrame + 1);
+            batch.valueIndices[l] = batch.firstValues[l] +
+                                    (interp.firstFrame * valuesPerKeyframe);
+            batch.keyframeTs[l] = interp.t;
+            batch.stepDurations[l] = interp.stepDuration;
+        }
+    }
+}
+
+// Same as glm::slerp() but as weights of the two keyframe values
+void slerpWeights(
+    const LaneValues &first, const LaneValues &second, Lanes t,
+    Lanes &firstWeight, Lanes &secondWeight)
+{
+    Lanes cosTheta = dot(first, second);
+
+    // Take the short way around
+    const Lanes sign =
+        select(less(cosTheta, splat(0.f)), splat(-1.f), splat(1.f));
+    // Rounding can push the cosine of unit quaternions over one
+    cosTheta = min(mul(cosTheta, sign), splat(1.f));
+
+    // Both sines are within [0, pi / 2] as the angle is
+    const Lanes angle = acos01(cosTheta);
+    const Lanes invSin = div(splat(1.f), sin0ToHalfPi(angle));
+    const Lanes oneMinusT = sub(splat(1.f), t);
+    const Lanes slerp0 = mul(sin0ToHalfPi(mul(oneMinusT, angle)), invSin);
+    const Lanes slerp1 = mul(sin0ToHalfPi(mul(t, angle)), invSin);
+
+    // Nearly parallel rotations would divide by a tiny sine so lerp those
+    const LaneMask lerp = less(splat(1.f - glm::epsilon<float>()), cosTheta);
+    firstWeight = select(lerp, oneMinusT, slerp0);
+    secondWeight = mul(sign, select(lerp, t, slerp1));
+}
+
+// Interpolates the lanes from their first keyframe values
+template <typename T, InterpolationType Interpolation>
+LaneValues interpolate(
+    const AnimationBatch &batch, uint32_t lane, const LaneValues &firstValue)
+{
+    const float *values = batch.values.data();
+    const uint32_t *indices = batch.valueIndices.data() + lane;
+    const Lanes t = load(batch.keyframeTs.data() + lane);
+
+    if constexpr (Interpolation == InterpolationType::Linear)
+    {
+        const LaneValues secondValue = gatherValues(values, indices, 1);
+
+        Lanes firstWeight = sub(splat(1.f), t);
+        Lanes secondWeight = t;
+        if constexpr (SameAs<T, glm::quat>)
+            slerpWeights(firstValue, secondValue, t, firstWeight, secondWeight);
+
+        LaneValues ret = weighted(firstWeight, firstValue);
+        accumulate(ret, secondWeight, secondValue);
+        return ret;
+    }
+    else
+    {
+        static_assert(Interpolation == InterpolationType::CubicSpline);
+
+        // Three values per keyframe: in-tangent, property, out-tangent
+        const LaneValues &vk = firstValue;
+        const LaneValues bk = gatherValues(values, indices, 2);
+        const LaneValues vk1 = gatherValues(values, indices, 3 + 1);
+        const LaneValues ak1 = gatherValues(values, indices, 3);
+
+        const Lanes td = load(batch.stepDurations.data() + lane);
+        const Lanes t2 = mul(t, t);
+        const Lanes t3 = mul(t2, t);
+        const Lanes t2Times2 = add(t2, t2);
+        const Lanes t2Times3 = add(t2Times2, t2);
+        const Lanes t3Times2 = add(t3, t3);
+
+        LaneValues ret = weighted(add(sub(t3Times2, t2Times3), splat(1.f)), vk);
+        accumulate(ret, mul(td, add(sub(t3, t2Times2), t)), bk);
+        accumulate(ret, sub(t2Times3, t3Times2), vk1);
+        accumulate(ret, mul(td, sub(t3, t2)), ak1);
+
+        if constexpr (SameAs<T, glm::quat>)
+        {
+            // Blended quaternions drift from unit length. Padding lanes divide
+            // by zero but are replaced by the clamped value.
+            const Lanes invLength = div(splat(1.f), sqrt(dot(ret, ret)));
+            ret = weighted(invLength, ret);
+        }
+        return ret;
+    }
+}
+
+// Writes the blended values into the blended rows, four lanes at a time
+template <typename T, InterpolationType Interpolation>
+void blend(AnimationBatch &batch)
+{
+    // The property value of cubic keyframes is after the in-tangent
+    const uint32_t firstOffset =
+        Interpolation == InterpolationType::CubicSpline ? 1 : 0;
+    for (uint32_t lane = 0; lane < batch.laneStride; lane += sLaneWidth)
+    {
+        LaneValues value = gatherValues(
+            batch.values.data(), batch.valueIndices.data() + lane,
+            firstOffset);
+
+        if constexpr (Interpolation != InterpolationType::Step)
+        {
+            // Clamped lanes use the first value as is. Animations that have
+            // ended are common so groups of those skip the interpolation.
+            const LaneMask clamped =
+                equal(load(batch.keyframeTs.data() + lane), splat(0.f));
+            if (bits(clamped) != 0xF)
+                value = select(
+                    clamped, value,
+                    interpolate<T, Interpolation>(batch, lane, value));
+        }
+
+        transpose(value.x, value.y, value.z, value.w);
+        float *blended = batch.blended.data() + (lane * sValueWidth);
+        store(blended, value.x);
+        store(blended + sValueWidth, value.y);
+        store(blended + (2 * sValueWidth), value.z);
+        store(blended + (3 * sValueWidth), value.w);
+    }
+}
+
+template <typename T> void blend(AnimationBatch &batch)
+{
+    switch (batch.interpolation)
+    {
+    case InterpolationType::Step:
+        blend<T, InterpolationType::Step>(batch);
+        return;
+    case InterpolationType::Linear:
+        blend<T, InterpolationType::Linear>(batch);
+        return;
+    case InterpolationType::CubicSpline:
+        blend<T, InterpolationType::CubicSpline>(batch);
+        return;
+    }
+    WHEELS_ASSERT(!"Unimplemented interpolation mode");
+}
+
+template <typename T>
+void writeTargets(
+    const Array<Animation<T>> &animations, const AnimationBatch &batch)
+{
+    const uint32_t componentCount = sizeof(T) / sizeof(float);
+    for (uint32_t lane = 0; lane < batch.animations.size(); ++lane)
+    {
+        const float *blended = batch.blended.data() + (lane * sValueWidth);
+        T value{};
+        float *components = glm::value_ptr(value);
+        for (uint32_t c = 0; c < componentCount; ++c)
+            components[c] = blended[c];
+        animations[batch.animations[lane]].writeTargets(value);
+    }
+}
+
+template <typename T>
+void update(
+    const Array<Animation<T>> &animations, Array<AnimationBatch> &batches,
+    float timeS)
+{
+    for (AnimationBatch &batch : batches)
+    {
+        lookUpKeyframes(batch, timeS);
+        blend<T>(batch);
+        writeTargets(animations, batch);
+    }
+}
+
+} // namespace
+
+void Animations::createBatches()
+{
+    WHEELS_ASSERT(vec3Batches.empty() && quatBatches.empty());
+
+    scene::createBatches(vec3, vec3Batches);
+    scene::createBatches(quat, quatBatches);
+}
+
+void Animations::update(float timeS)
+{
+    scene::update(vec3, vec3Batches, timeS);
+    scene::update(quat, quatBatches, timeS);
+}
+
+} // namespace scene
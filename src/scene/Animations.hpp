@@ -28,9 +28,12 @@ template <typename T> class Animation
         ValueAccessor<T> &&valueFrames);
 
     [[nodiscard]] float endTimeS() const;
+    [[nodiscard]] InterpolationType interpolation() const;
+    [[nodiscard]] const TimeAccessor &timeFrames() const;
+    [[nodiscard]] const ValueAccessor<T> &valueFrames() const;
 
     void registerTarget(T &target);
-    void update(float timeS);
+    void writeTargets(const T &value) const;
 
   private:
     // General because we don't know how many of these we'll have beforehand
@@ -42,10 +45,47 @@ template <typename T> class Animation
     ValueAccessor<T> m_valueFrames;
 };
 
+// Animations of one value type and interpolation mode, one lane for each
+// animation. Keyframes are copied into the batch when it's created. Keyframe
+// lookups and blends are evaluated four lanes at a time and only seeks search
+// the keyframes lane by lane.
+struct AnimationBatch
+{
+    InterpolationType interpolation{InterpolationType::Step};
+    // Animation count rounded up to a multiple of four
+    uint32_t laneStride{0};
+    // Sorted by the animation time intervals
+    wheels::Array<uint32_t> animations{gAllocators.world};
+    // Keyframe times of the lanes back to back, each between -inf and inf so
+    // that the clamped ends are intervals too. The accessors point into these
+    // and are used when a lane seeks.
+    wheels::Array<float> times{gAllocators.world};
+    wheels::Array<TimeAccessor> timeAccessors{gAllocators.world};
+    wheels::Array<uint32_t> firstTimes{gAllocators.world};
+    // Start of the current interval of each lane, laneStride entries
+    wheels::Array<uint32_t> timeIndices{gAllocators.world};
+    // Keyframe values of the lanes back to back, each padded to four floats.
+    // Padding lanes read the zeros after the last value.
+    wheels::Array<float> values{gAllocators.world};
+    wheels::Array<uint32_t> firstValues{gAllocators.world};
+    // Written by the keyframe lookups, laneStride entries each
+    wheels::Array<uint32_t> valueIndices{gAllocators.world};
+    wheels::Array<float> keyframeTs{gAllocators.world};
+    wheels::Array<float> stepDurations{gAllocators.world};
+    // Blended value of each lane, padded to four floats
+    wheels::Array<float> blended{gAllocators.world};
+};
+
 struct Animations
 {
     wheels::Array<Animation<glm::vec3>> vec3{gAllocators.world};
     wheels::Array<Animation<glm::quat>> quat{gAllocators.world};
+    wheels::Array<AnimationBatch> vec3Batches{gAllocators.world};
+    wheels::Array<AnimationBatch> quatBatches{gAllocators.world};
+
+    // Has to be called once after all animations have been added
+    void createBatches();
+    void update(float timeS);
 };
 
 template <typename T>
@@ -68,58 +108,25 @@ template <typename T> float Animation<T>::endTimeS() const
     return m_timeFrames.endTimeS();
 }
 
-template <typename T> void Animation<T>::update(float timeS)
+template <typename T> InterpolationType Animation<T>::interpolation() const
+{
+    return m_interpolation;
+}
+
+template <typename T>
+const TimeAccessor &Animation<T>::timeFrames() const
+{
+    return m_timeFrames;
+}
+
+template <typename T>
+const ValueAccessor<T> &Animation<T>::valueFrames() const
 {
-    const KeyFrameInterpolation interp = m_timeFrames.interpolation(timeS);
-
-    T firstValue{};
-    if (interp.t == 0.f && m_interpolation == InterpolationType::CubicSpline)
-        // Three values per frame, property value is the middle one
-        firstValue = m_valueFrames.read((interp.firstFrame * 3) + 1);
-    else
-        firstValue = m_valueFrames.read(interp.firstFrame);
-
-    T value{};
-    if (interp.t == 0.f || m_interpolation == InterpolationType::Step)
-        value = firstValue;
-    else
-    {
-        if (m_interpolation == InterpolationType::Linear)
-        {
-            const T secondValue = m_valueFrames.read(interp.firstFrame + 1);
-            if constexpr (wheels::SameAs<T, glm::quat>)
-                value = glm::slerp(firstValue, secondValue, interp.t);
-            else
-                value = (1.f - interp.t) * firstValue + interp.t * secondValue;
-        }
-        else if (m_interpolation == InterpolationType::CubicSpline)
-        {
-            // Three values per keyframe: in-tangent, property, out-tangent
-            const uint32_t firstIndex = interp.firstFrame * 3;
-            const T vk = m_valueFrames.read(firstIndex + 1);
-            const T bk = m_valueFrames.read(firstIndex + 2);
-            const T vk1 = m_valueFrames.read(firstIndex + 3 + 1);
-            const T ak1 = m_valueFrames.read(firstIndex + 3);
-
-            const float t3 = interp.t * interp.t * interp.t;
-            const float t2 = interp.t * interp.t;
-            const float t2Times2 = 2.f * interp.t * interp.t;
-            const float t3Times2 = 2.f * interp.t * interp.t * interp.t;
-            const float t2Times3 = 3.f * interp.t * interp.t;
-            const float td = interp.stepDuration;
-            const float t = interp.t;
-
-            value = (t3Times2 - t2Times3 + 1.f) * vk +
-                    td * (t3 - t2Times2 + t) * bk +
-                    (-t3Times2 + t2Times3) * vk1 + td * (t3 - t2) * ak1;
-
-            if constexpr (wheels::SameAs<T, glm::quat>)
-                value = glm::normalize(value);
-        }
-        else
-            WHEELS_ASSERT(!"Unimplemented interpolation mode");
-    }
+    return m_valueFrames;
+}
 
+template <typename T> void Animation<T>::writeTargets(const T &value) const
+{
     for (T *target : m_targets)
         *target = value;
 }
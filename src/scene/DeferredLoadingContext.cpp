@@ -2,13 +2,18 @@
 
 #include "gfx/Device.hpp"
 #include "gfx/VkUtils.hpp"
+#include "scene/SceneSnapshot.hpp"
+#include "scene/TextureStreamer.hpp"
 #include "utils/Logger.hpp"
+#include "utils/MappedFile.hpp"
 #include "utils/Utils.hpp"
 
 #include <glm/gtc/packing.hpp>
 #include <meshoptimizer.h>
 #include <mikktspace.h>
 #include <wheels/allocators/linear_allocator.hpp>
+#include <wheels/containers/hash.hpp>
+#include <wheels/containers/hash_map.hpp>
 
 using namespace glm;
 using namespace wheels;
@@ -19,26 +24,106 @@ namespace scene
 namespace
 {
 
+const StaticArray sCgltfResultStr{{
+    "cgltf_result_success",
+    "cgltf_result_data_too_short",
+    "cgltf_result_unknown_format",
+    "cgltf_result_invalid_json",
+    "cgltf_result_invalid_gltf",
+    "cgltf_result_invalid_options",
+    "cgltf_result_file_not_found",
+    "cgltf_result_io_error",
+    "cgltf_result_out_of_memory",
+    "cgltf_result_legacy_gltf",
+}};
+// TODO:
+// StaticArray<const char*, cgltf_result_max_enum> ctor should also complain at
+// compile time
+static_assert(
+    sCgltfResultStr.size() == cgltf_result_max_enum,
+    "Missing cgltf_result strings");
+
+// Geometry buffers are allocated in chunks of this size
 constexpr uint32_t sGeometryBufferSize = asserted_cast<uint32_t>(megabytes(64));
 
-const uint64_t sMeshCacheMagic = 0x4853'4D52'5053'5250; // PRSPRMSH
+// Each mesh worker reserves a full loading scratch of its own as a single mesh
+// can need all of it
+constexpr size_t sMeshWorkerScratchSize = Allocators::sLoadingScratchSize;
+// Worker scratches are bounded by a share of the system memory instead of a
+// fixed budget so that the worker count follows the core count on machines
+// that have the memory to back it
+constexpr size_t sWorkerScratchMemoryDivisor = 4;
+// Used when the system memory can't be queried
+constexpr size_t sFallbackWorkerScratchBudget = megabytes(1024);
+// Texture workers size their scratch by the largest source but the cache
+// checks need some even if none of the sources can be read
+constexpr size_t sMinTextureWorkerScratchSize = megabytes(16);
+// Enough to keep the transfer queue busy while the next texture is read
+constexpr uint32_t sTextureUploadSlotCount = 4;
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+bool gCompressMeshCaches{true};
+
+const uint64_t sMeshCacheArchiveMagic = 0x4153'4D52'5053'5250; // PRSPRMSA
 // This should be incremented when breaking changes are made to
 // what's cached
-const uint32_t sMeshCacheVersion = 4;
+const uint32_t sMeshCacheVersion = 9;
+
+// Changes to this require changes to sMeshCacheVersion
+struct MeshCacheArchiveHeader
+{
+    uint64_t magic{sMeshCacheArchiveMagic};
+    uint32_t version{sMeshCacheVersion};
+    uint32_t entryCount{0};
+};
+// The archive is read through a mapping so let's make sure the entries are
+// tightly packed and aligned after the header
+static_assert(sizeof(MeshCacheArchiveHeader) == 2 * sizeof(uint64_t));
+static_assert(sizeof(MeshCacheHeader) == 26 * sizeof(uint32_t));
+static_assert(sizeof(MeshCacheArchiveEntry) == 14 * sizeof(uint64_t));
+
+// Compressed blobs start with a table of these, one for each section of the
+// uncompressed blob in order. The encoded sections follow the table tightly.
+struct CompressedMeshSection
+{
+    uint32_t rawByteOffset{0};
+    uint32_t rawByteCount{0};
+    uint32_t compressedByteCount{0};
+    // Index buffer codec is used if this is 0, vertex codec otherwise
+    uint32_t elementByteCount{0};
+};
+// indices, positions, normals, tangents, texCoord0s, meshlets, meshletBounds,
+// meshletVertices, meshletTriangles, lods
+constexpr uint32_t sCompressedMeshSectionCount = 10;
+// Raw bytes of a section and the element byte count for the codec
+using RawMeshSection = Pair<Span<const uint8_t>, uint32_t>;
 
 // Balance between cluster size and cone culling efficiency
 const float sConeWeight = 0.5f;
 
-// Need to pass the allocator with function pointers that don't have userdata
+// Simplified LODs are generated until there are this many levels or the
+// simplifier can't make meaningful progress anymore
+constexpr uint32_t sMaxMeshLodCount = 5;
+// Each LOD targets this fraction of the indices of the previous one
+const float sLodIndexRatio = 0.5f;
+// LODs that keep more than this fraction of the indices of the previous one
+// aren't worth the extra meshlets
+const float sMinLodIndexReduction = 0.85f;
+// Relative to the mesh extents. LODs are picked based on the projected error so
+// coarse levels only show up when they are small on screen.
+const float sMaxLodSimplificationError = 0.1f;
+
+// Need to pass the allocator with function pointers that don't have userdata.
+// Each mesh worker has its own allocator so this is per thread.
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
-Allocator *sMeshoptAllocator = nullptr;
+thread_local Allocator *sMeshoptAllocator = nullptr;
 
 template <typename T>
 void remapVertexAttribute(
-    Array<T> &src, const Array<uint32_t> &remapIndices,
+    Allocator &alloc, Array<T> &src, const Array<uint32_t> &remapIndices,
     size_t uniqueVertexCount)
 {
-    Array<T> remapped{gAllocators.loadingWorker};
+    Array<T> remapped{alloc};
     remapped.resize(uniqueVertexCount);
     meshopt_remapVertexBuffer(
         remapped.data(), src.data(), src.size(), sizeof(T),
@@ -66,6 +151,23 @@ static_assert(
     sizeof(meshopt_Meshlet) == 4 * sizeof(uint32_t),
     "Mesh shaders use meshoptimizer meshlets as is.");
 
+// The levels share the vertices and the meshlet arrays. Meshlets of each level
+// are a contiguous range, LOD0 first.
+struct MeshLod
+{
+    // Bounding sphere of the level
+    vec3 center{};
+    float radius{0.f};
+    uint32_t meshletOffset{0};
+    uint32_t meshletCount{0};
+    // Object space simplification error, 0 for LOD0
+    float error{0.f};
+    uint32_t padding{0};
+};
+static_assert(
+    sizeof(MeshLod) == 8 * sizeof(uint32_t),
+    "Draw list generator loads these as is.");
+
 struct MeshData
 {
     wheels::Array<uint32_t> indices;
@@ -77,28 +179,28 @@ struct MeshData
     wheels::Array<MeshletBounds> meshletBounds;
     wheels::Array<uint32_t> meshletVertices;
     wheels::Array<uint8_t> meshletTriangles;
+    wheels::Array<MeshLod> lods;
 };
 
 struct PackedMeshData
 {
-    wheels::Array<uint32_t> indices{gAllocators.loadingWorker};
-    // Packed as r16g16b16a16_sfloat
-    // TODO:
-    // Pack as r16g16b16a16_snorm relative to object space AABB to have uniform
-    // (and potentially better) precision. Unpacking would then be pos *
-    // aabbHalfAxisOS + aabbCenterOS and it can be concatenated into the
-    // objectToWorld transform (careful to not include it in parent transforms)
-    wheels::Array<uint64_t> positions{gAllocators.loadingWorker};
+    wheels::Array<uint32_t> indices;
+    // Packed as r16g16b16_snorm relative to the object space AABB for uniform
+    // precision. Unpacking is pos * positionsHalfExtent + positionsCenter.
+    wheels::Array<uint16_t> positions;
+    glm::vec3 positionsCenter{0.f};
+    glm::vec3 positionsHalfExtent{0.f};
     // Packed as r10g10b10(a2)_snorm
-    wheels::Array<uint32_t> normals{gAllocators.loadingWorker};
+    wheels::Array<uint32_t> normals;
     // Packed as r10g10b10a2_snorm, sign in a2
-    wheels::Array<uint32_t> tangents{gAllocators.loadingWorker};
+    wheels::Array<uint32_t> tangents;
     // Packed as r16g16_sfloat
-    wheels::Array<uint32_t> texCoord0s{gAllocators.loadingWorker};
-    wheels::Array<meshopt_Meshlet> meshlets{gAllocators.loadingWorker};
-    wheels::Array<MeshletBounds> meshletBounds{gAllocators.loadingWorker};
-    wheels::Array<uint32_t> meshletVertices{gAllocators.loadingWorker};
-    wheels::Array<uint8_t> meshletTriangles{gAllocators.loadingWorker};
+    wheels::Array<uint32_t> texCoord0s;
+    wheels::Array<meshopt_Meshlet> meshlets;
+    wheels::Array<MeshletBounds> meshletBounds;
+    wheels::Array<uint32_t> meshletVertices;
+    wheels::Array<uint8_t> meshletTriangles;
+    wheels::Array<MeshLod> lods;
 };
 static_assert(
     sizeof(meshopt_Meshlet) == 4 * sizeof(uint32_t),
@@ -109,30 +211,105 @@ static_assert(
     offsetof(MeshletBounds, coneCutoffS8) ==
     4 * sizeof(uint32_t) + 3 * sizeof(int8_t));
 
+template <typename T, int N>
+void unpackComponents(
+    const uint8_t *data, size_t stride, bool normalized,
+    Array<vec<N, float, defaultp>> &out)
+{
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        const uint8_t *element = data + (i * stride);
+        for (int c = 0; c < N; ++c)
+        {
+            T value{};
+            memcpy(&value, element + (c * sizeof(T)), sizeof(T));
+
+            float unpacked = static_cast<float>(value);
+            if (normalized)
+            {
+                // Signed values are mapped to [-1,1] as in the glTF spec
+                unpacked /= static_cast<float>(std::numeric_limits<T>::max());
+                if constexpr (std::is_signed_v<T>)
+                    unpacked = max(unpacked, -1.f);
+            }
+            out[i][c] = unpacked;
+        }
+    }
+}
+
+// Quantized data from KHR_mesh_quantization is converted to floats here so the
+// rest of the pipeline only deals with floats
 template <int N>
 void unpackVector(
     const cgltf_accessor *accessor, Array<vec<N, float, defaultp>> &out)
 {
     WHEELS_ASSERT(accessor != nullptr);
     out.resize(accessor->count);
+
+    // This also points to the decoded data if the view is meshopt compressed
+    const uint8_t *data = accessor->buffer_view != nullptr
+                              ? cgltf_buffer_view_data(accessor->buffer_view)
+                              : nullptr;
+    if (data != nullptr && accessor->is_sparse == 0)
+    {
+        data += accessor->offset;
+        const size_t stride = accessor->stride;
+        const bool normalized = accessor->normalized == 1;
+        switch (accessor->component_type)
+        {
+        case cgltf_component_type_r_32f:
+            if (stride == sizeof(out[0]))
+                memcpy(out.data(), data, out.size() * sizeof(out[0]));
+            else
+                unpackComponents<float>(data, stride, false, out);
+            return;
+        case cgltf_component_type_r_16:
+            unpackComponents<int16_t>(data, stride, normalized, out);
+            return;
+        case cgltf_component_type_r_16u:
+            unpackComponents<uint16_t>(data, stride, normalized, out);
+            return;
+        case cgltf_component_type_r_8:
+            unpackComponents<int8_t>(data, stride, normalized, out);
+            return;
+        case cgltf_component_type_r_8u:
+            unpackComponents<uint8_t>(data, stride, normalized, out);
+            return;
+        default:
+            break;
+        }
+    }
+
+    // Let cgltf resolve sparse accessors and anything unexpected
     const cgltf_size unpackedCount = cgltf_accessor_unpack_floats(
         accessor, &out.data()[0][0], out.size() * N);
     WHEELS_ASSERT(unpackedCount == out.size() * N);
 }
 
+void applyTexCoordTransform(
+    const cgltf_texture_transform &transform, Array<vec2> &texCoords)
+{
+    const vec2 offset{transform.offset[0], transform.offset[1]};
+    const vec2 scale{transform.scale[0], transform.scale[1]};
+    for (vec2 &uv : texCoords)
+        uv = offset + (uv * scale);
+}
+
 MeshData getMeshData(
-    const InputGeometryMetadata &metadata, const MeshInfo &meshInfo)
+    Allocator &alloc, const InputGeometryMetadata &metadata,
+    const MeshInfo &meshInfo)
 {
     MeshData ret{
-        .indices = Array<uint32_t>{gAllocators.loadingWorker},
-        .positions = Array<vec3>{gAllocators.loadingWorker},
-        .normals = Array<vec3>{gAllocators.loadingWorker},
-        .tangents = Array<vec4>{gAllocators.loadingWorker},
-        .texCoord0s = Array<vec2>{gAllocators.loadingWorker},
-        .meshlets = Array<meshopt_Meshlet>{gAllocators.loadingWorker},
-        .meshletBounds = Array<MeshletBounds>{gAllocators.loadingWorker},
-        .meshletVertices = Array<uint32_t>{gAllocators.loadingWorker},
-        .meshletTriangles = Array<uint8_t>{gAllocators.loadingWorker},
+        .indices = Array<uint32_t>{alloc},
+        .positions = Array<vec3>{alloc},
+        .normals = Array<vec3>{alloc},
+        .tangents = Array<vec4>{alloc},
+        .texCoord0s = Array<vec2>{alloc},
+        .meshlets = Array<meshopt_Meshlet>{alloc},
+        .meshletBounds = Array<MeshletBounds>{alloc},
+        .meshletVertices = Array<uint32_t>{alloc},
+        .meshletTriangles = Array<uint8_t>{alloc},
+        .lods = Array<MeshLod>{alloc},
     };
 
     {
@@ -147,10 +324,21 @@ MeshData getMeshData(
 
     unpackVector(metadata.positions, ret.positions);
     unpackVector(metadata.normals, ret.normals);
+    // Quantized normals are only approximately unit length
+    if (metadata.normals->component_type != cgltf_component_type_r_32f)
+    {
+        for (vec3 &n : ret.normals)
+            n = normalize(n);
+    }
     if (metadata.tangents != nullptr)
         unpackVector(metadata.tangents, ret.tangents);
     if (metadata.texCoord0s != nullptr)
+    {
         unpackVector(metadata.texCoord0s, ret.texCoord0s);
+        if (metadata.texCoord0Transform.has_value())
+            applyTexCoordTransform(
+                *metadata.texCoord0Transform, ret.texCoord0s);
+    }
 
     return ret;
 }
@@ -254,16 +442,17 @@ void mikkTSetTSpaceBasic(
 // NOLINTEND(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays,bugprone-easily-swappable-parameters)
 
 template <typename T>
-void flattenAttribute(Array<T> &attribute, const Array<uint32_t> &indices)
+void flattenAttribute(
+    Allocator &alloc, Array<T> &attribute, const Array<uint32_t> &indices)
 {
-    Array<T> flattened{gAllocators.loadingWorker, indices.size()};
+    Array<T> flattened{alloc, indices.size()};
     for (const uint32_t i : indices)
         flattened.push_back(attribute[i]);
 
     attribute = WHEELS_MOV(flattened);
 }
 
-void generateTangents(MeshData &meshData)
+void generateTangents(Allocator &alloc, MeshData &meshData)
 {
     WHEELS_ASSERT(meshData.tangents.empty());
     WHEELS_ASSERT(meshData.positions.size() == meshData.normals.size());
@@ -272,9 +461,9 @@ void generateTangents(MeshData &meshData)
     // Flatten data first as instructed in the mikktspace header
     // TODO: tmp buffers here
     const size_t flattenedVertexCount = meshData.indices.size();
-    flattenAttribute(meshData.positions, meshData.indices);
-    flattenAttribute(meshData.normals, meshData.indices);
-    flattenAttribute(meshData.texCoord0s, meshData.indices);
+    flattenAttribute(alloc, meshData.positions, meshData.indices);
+    flattenAttribute(alloc, meshData.normals, meshData.indices);
+    flattenAttribute(alloc, meshData.texCoord0s, meshData.indices);
     meshData.indices.clear();
 
     meshData.tangents.resize(flattenedVertexCount);
@@ -320,7 +509,7 @@ void generateTangents(MeshData &meshData)
         },
     }};
 
-    Array<uint32_t> remapTable{gAllocators.loadingWorker};
+    Array<uint32_t> remapTable{alloc};
     remapTable.resize(flattenedVertexCount);
     const size_t uniqueVertexCount = meshopt_generateVertexRemapMulti(
         remapTable.data(), nullptr, flattenedVertexCount, flattenedVertexCount,
@@ -331,19 +520,24 @@ void generateTangents(MeshData &meshData)
         meshData.indices.data(), nullptr, flattenedVertexCount,
         remapTable.data());
 
-    remapVertexAttribute(meshData.positions, remapTable, uniqueVertexCount);
-    remapVertexAttribute(meshData.normals, remapTable, uniqueVertexCount);
-    remapVertexAttribute(meshData.tangents, remapTable, uniqueVertexCount);
-    remapVertexAttribute(meshData.texCoord0s, remapTable, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.positions, remapTable, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.normals, remapTable, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.tangents, remapTable, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.texCoord0s, remapTable, uniqueVertexCount);
 }
 
 void optimizeMeshData(
-    MeshData &meshData, MeshInfo &meshInfo, const char *meshName)
+    Allocator &alloc, MeshData &meshData, MeshInfo &meshInfo,
+    const char *meshName)
 {
     const size_t indexCount = meshData.indices.size();
     const size_t vertexCount = meshData.positions.size();
 
-    Array<uint32_t> tmpIndices{gAllocators.loadingWorker};
+    Array<uint32_t> tmpIndices{alloc};
     tmpIndices.resize(meshData.indices.size());
     meshopt_optimizeVertexCache(
         tmpIndices.data(), meshData.indices.data(), indexCount, vertexCount);
@@ -354,7 +548,7 @@ void optimizeMeshData(
         &meshData.positions.data()[0].x, vertexCount, sizeof(vec3),
         vertexCacheDegradationThreshod);
 
-    Array<uint32_t> remapIndices{gAllocators.loadingWorker};
+    Array<uint32_t> remapIndices{alloc};
     remapIndices.resize(vertexCount);
     const size_t uniqueVertexCount = meshopt_optimizeVertexFetchRemap(
         remapIndices.data(), meshData.indices.data(), indexCount, vertexCount);
@@ -367,58 +561,80 @@ void optimizeMeshData(
         remapIndices.data());
     meshData.indices = WHEELS_MOV(tmpIndices);
 
-    remapVertexAttribute(meshData.positions, remapIndices, uniqueVertexCount);
-    remapVertexAttribute(meshData.normals, remapIndices, uniqueVertexCount);
-    remapVertexAttribute(meshData.tangents, remapIndices, uniqueVertexCount);
-    remapVertexAttribute(meshData.texCoord0s, remapIndices, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.positions, remapIndices, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.normals, remapIndices, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.tangents, remapIndices, uniqueVertexCount);
+    remapVertexAttribute(
+        alloc, meshData.texCoord0s, remapIndices, uniqueVertexCount);
 
     meshInfo.vertexCount = asserted_cast<uint32_t>(uniqueVertexCount);
 }
 
-void generateMeshlets(MeshData &meshData)
+// Builds meshlets for indices into the vertices of meshData and appends them
+// into its meshlet arrays. Nothing is appended and 0 is returned if more than
+// maxMeshletCount meshlets would be required.
+uint32_t appendMeshlets(
+    Allocator &alloc, MeshData &meshData, const Array<uint32_t> &indices,
+    size_t maxMeshletCount)
 {
-    WHEELS_ASSERT(meshData.meshlets.empty());
-    WHEELS_ASSERT(meshData.meshletVertices.empty());
-    WHEELS_ASSERT(meshData.meshletTriangles.empty());
-
     const size_t maxMeshlets = meshopt_buildMeshletsBound(
-        meshData.indices.size(), sMaxMsVertices, sMaxMsTriangles);
+        indices.size(), sMaxMsVertices, sMaxMsTriangles);
     WHEELS_ASSERT(maxMeshlets > 0);
 
-    meshData.meshlets.resize(maxMeshlets);
-    meshData.meshletVertices.resize(maxMeshlets * sMaxMsVertices);
-    meshData.meshletTriangles.resize(maxMeshlets * sMaxMsTriangles * 3);
+    Array<meshopt_Meshlet> meshlets{alloc};
+    Array<uint32_t> meshletVertices{alloc};
+    Array<uint8_t> meshletTriangles{alloc};
+    meshlets.resize(maxMeshlets);
+    meshletVertices.resize(maxMeshlets * sMaxMsVertices);
+    meshletTriangles.resize(maxMeshlets * sMaxMsTriangles * 3);
 
     const size_t meshletCount = meshopt_buildMeshlets(
-        meshData.meshlets.data(), meshData.meshletVertices.data(),
-        meshData.meshletTriangles.data(), meshData.indices.data(),
-        meshData.indices.size(), &meshData.positions[0].x,
+        meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+        indices.data(), indices.size(), &meshData.positions[0].x,
         meshData.positions.size(), sizeof(vec3), sMaxMsVertices,
         sMaxMsTriangles, sConeWeight);
     WHEELS_ASSERT(meshletCount > 0);
-
-    // Need to trim the buffers now that we know the tight sizes
-    meshData.meshlets.resize(meshletCount);
-
-    const meshopt_Meshlet &lastMeshlet = meshData.meshlets.back();
-
-    meshData.meshletVertices.resize(
-        lastMeshlet.vertex_offset + lastMeshlet.vertex_count);
-    // Pad up to a u32 boundary
-    const uint32_t trianglesSize =
-        asserted_cast<uint32_t>(wheels::aligned_offset(
-            lastMeshlet.triangle_offset + lastMeshlet.triangle_count,
-            sizeof(uint32_t)));
-    meshData.meshletTriangles.resize(asserted_cast<size_t>(trianglesSize) * 3);
-
-    meshData.meshletBounds.reserve(meshData.meshlets.size());
-    for (const meshopt_Meshlet &meshlet : meshData.meshlets)
+    if (meshletCount > maxMeshletCount)
+        return 0;
+
+    meshlets.resize(meshletCount);
+
+    const meshopt_Meshlet &lastMeshlet = meshlets.back();
+    const size_t vertexCount =
+        lastMeshlet.vertex_offset + lastMeshlet.vertex_count;
+    // Pad up to a u32 boundary so that the ranges of the following LODs stay
+    // aligned too
+    const size_t triangleByteCount = wheels::aligned_offset(
+        lastMeshlet.triangle_offset + (lastMeshlet.triangle_count * 3),
+        sizeof(uint32_t));
+
+    const uint32_t vertexOffset =
+        asserted_cast<uint32_t>(meshData.meshletVertices.size());
+    const uint32_t triangleByteOffset =
+        asserted_cast<uint32_t>(meshData.meshletTriangles.size());
+    WHEELS_ASSERT(triangleByteOffset % sizeof(uint32_t) == 0);
+
+    meshData.meshletVertices.resize(vertexOffset + vertexCount);
+    memcpy(
+        meshData.meshletVertices.data() + vertexOffset, meshletVertices.data(),
+        vertexCount * sizeof(uint32_t));
+    meshData.meshletTriangles.resize(triangleByteOffset + triangleByteCount);
+    memcpy(
+        meshData.meshletTriangles.data() + triangleByteOffset,
+        meshletTriangles.data(), triangleByteCount);
+
+    meshData.meshlets.reserve(meshData.meshlets.size() + meshletCount);
+    meshData.meshletBounds.reserve(
+        meshData.meshletBounds.size() + meshletCount);
+    for (const meshopt_Meshlet &meshlet : meshlets)
     {
         const meshopt_Bounds bounds = meshopt_computeMeshletBounds(
-            &meshData.meshletVertices[meshlet.vertex_offset],
-            &meshData.meshletTriangles[meshlet.triangle_offset],
-            meshlet.triangle_count, &meshData.positions[0].x,
-            meshData.positions.size(), sizeof(vec3));
+            &meshletVertices[meshlet.vertex_offset],
+            &meshletTriangles[meshlet.triangle_offset], meshlet.triangle_count,
+            &meshData.positions[0].x, meshData.positions.size(), sizeof(vec3));
         meshData.meshletBounds.push_back(
             MeshletBounds{
                 .center =
@@ -436,22 +652,189 @@ void generateMeshlets(MeshData &meshData)
                     },
                 .coneCutoffS8 = bounds.cone_cutoff_s8,
             });
+
+        meshData.meshlets.push_back(
+            meshopt_Meshlet{
+                .vertex_offset = vertexOffset + meshlet.vertex_offset,
+                .triangle_offset = triangleByteOffset + meshlet.triangle_offset,
+                .vertex_count = meshlet.vertex_count,
+                .triangle_count = meshlet.triangle_count,
+            });
+    }
+
+    return asserted_cast<uint32_t>(meshletCount);
+}
+
+// Returns center and radius of a sphere around the vertices referenced by
+// indices
+vec4 computeBoundingSphere(
+    const Array<vec3> &positions, const Array<uint32_t> &indices)
+{
+    WHEELS_ASSERT(!indices.empty());
+
+    vec3 aabbMin{std::numeric_limits<float>::max()};
+    vec3 aabbMax{std::numeric_limits<float>::lowest()};
+    for (const uint32_t i : indices)
+    {
+        aabbMin = min(aabbMin, positions[i]);
+        aabbMax = max(aabbMax, positions[i]);
+    }
+    const vec3 center = (aabbMin + aabbMax) * 0.5f;
+
+    float radiusSq = 0.f;
+    for (const uint32_t i : indices)
+    {
+        const vec3 toVertex = positions[i] - center;
+        radiusSq = std::max(radiusSq, dot(toVertex, toVertex));
+    }
+
+    return vec4{center, std::sqrt(radiusSq)};
+}
+
+// Generates the meshlets for the full detail indices and a chain of simplified
+// levels on top of them
+void generateMeshlets(Allocator &alloc, MeshData &meshData)
+{
+    WHEELS_ASSERT(meshData.meshlets.empty());
+    WHEELS_ASSERT(meshData.meshletVertices.empty());
+    WHEELS_ASSERT(meshData.meshletTriangles.empty());
+    WHEELS_ASSERT(meshData.lods.empty());
+
+    const size_t vertexCount = meshData.positions.size();
+    const float *positions = &meshData.positions[0].x;
+    // Simplifier errors are relative to the mesh extents
+    const float errorScale =
+        meshopt_simplifyScale(positions, vertexCount, sizeof(vec3));
+
+    // LOD0 is the optimized full index buffer that's also used for RT
+    Array<uint32_t> lodIndices{alloc};
+    lodIndices.resize(meshData.indices.size());
+    memcpy(
+        lodIndices.data(), meshData.indices.data(),
+        lodIndices.size() * sizeof(uint32_t));
+
+    float lodError = 0.f;
+    for (uint32_t lod = 0; lod < sMaxMeshLodCount; ++lod)
+    {
+        if (lod > 0)
+        {
+            const size_t srcIndexCount = lodIndices.size();
+            const size_t targetIndexCount =
+                static_cast<size_t>(
+                    static_cast<float>(srcIndexCount / 3) * sLodIndexRatio) *
+                3;
+
+            Array<uint32_t> simplifiedIndices{alloc};
+            simplifiedIndices.resize(srcIndexCount);
+            float simplificationError = 0.f;
+            const size_t indexCount = meshopt_simplify(
+                simplifiedIndices.data(), lodIndices.data(), srcIndexCount,
+                positions, vertexCount, sizeof(vec3), targetIndexCount,
+                sMaxLodSimplificationError, 0, &simplificationError);
+            if (indexCount == 0 ||
+                static_cast<float>(indexCount) >
+                    static_cast<float>(srcIndexCount) * sMinLodIndexReduction)
+                break;
+            simplifiedIndices.resize(indexCount);
+
+            meshopt_optimizeVertexCache(
+                simplifiedIndices.data(), simplifiedIndices.data(), indexCount,
+                vertexCount);
+
+            // Each level is simplified from the previous one so the error
+            // relative to LOD0 is at most the sum
+            lodError += simplificationError * errorScale;
+            lodIndices = WHEELS_MOV(simplifiedIndices);
+        }
+
+        // Coarser levels should never need more meshlets than the previous one
+        // as the draw lists are sized for LOD0
+        const uint32_t meshletOffset =
+            asserted_cast<uint32_t>(meshData.meshlets.size());
+        const size_t maxMeshletCount =
+            lod == 0 ? std::numeric_limits<size_t>::max()
+                     : meshData.lods.back().meshletCount - 1;
+        const uint32_t meshletCount =
+            appendMeshlets(alloc, meshData, lodIndices, maxMeshletCount);
+        if (meshletCount == 0)
+            break;
+
+        const vec4 bounds =
+            computeBoundingSphere(meshData.positions, lodIndices);
+        meshData.lods.push_back(
+            MeshLod{
+                .center = vec3{bounds},
+                .radius = bounds.w,
+                .meshletOffset = meshletOffset,
+                .meshletCount = meshletCount,
+                .error = lodError,
+            });
     }
+    WHEELS_ASSERT(!meshData.lods.empty());
+}
+
+// Positions are padded to u32 with at least one extra component as the BLAS
+// build reads them as r16g16b16a16 and the last vertex would read past the end
+size_t packedPositionComponentCount(size_t vertexCount)
+{
+    return aligned_offset((vertexCount * 3) + 1, 2);
 }
 
-PackedMeshData packMeshData(MeshData &&meshData)
+PackedMeshData packMeshData(Allocator &alloc, MeshData &&meshData)
 {
-    PackedMeshData ret;
+    PackedMeshData ret{
+        .indices = Array<uint32_t>{alloc},
+        .positions = Array<uint16_t>{alloc},
+        .normals = Array<uint32_t>{alloc},
+        .tangents = Array<uint32_t>{alloc},
+        .texCoord0s = Array<uint32_t>{alloc},
+        .meshlets = Array<meshopt_Meshlet>{alloc},
+        .meshletBounds = Array<MeshletBounds>{alloc},
+        .meshletVertices = Array<uint32_t>{alloc},
+        .meshletTriangles = Array<uint8_t>{alloc},
+        .lods = Array<MeshLod>{alloc},
+    };
 
     ret.indices = WHEELS_MOV(meshData.indices);
 
-    ret.positions.reserve(meshData.positions.size());
-    for (const vec3 &p : meshData.positions)
     {
-        static_assert(
-            sVertexPositionFormat == vk::Format::eR16G16B16A16Sfloat,
-            "Packing doesn't match the global format");
-        ret.positions.push_back(packHalf4x16(vec4{p, 1.f}));
+        vec3 aabbMin{std::numeric_limits<float>::max()};
+        vec3 aabbMax{std::numeric_limits<float>::lowest()};
+        for (const vec3 &p : meshData.positions)
+        {
+            aabbMin = min(aabbMin, p);
+            aabbMax = max(aabbMax, p);
+        }
+        ret.positionsCenter = (aabbMin + aabbMax) * 0.5f;
+        ret.positionsHalfExtent = (aabbMax - aabbMin) * 0.5f;
+
+        // Flat axes pack as 0 and unpack as the center
+        const vec3 invHalfExtent{
+            ret.positionsHalfExtent.x > 0.f ? 1.f / ret.positionsHalfExtent.x
+                                            : 0.f,
+            ret.positionsHalfExtent.y > 0.f ? 1.f / ret.positionsHalfExtent.y
+                                            : 0.f,
+            ret.positionsHalfExtent.z > 0.f ? 1.f / ret.positionsHalfExtent.z
+                                            : 0.f,
+        };
+
+        ret.positions.reserve(
+            packedPositionComponentCount(meshData.positions.size()));
+        for (const vec3 &p : meshData.positions)
+        {
+            static_assert(
+                sVertexPositionFormat == vk::Format::eR16G16B16A16Snorm &&
+                    sVertexPositionByteSize == 3 * sizeof(uint16_t),
+                "Packing doesn't match the global format");
+            const vec3 normalized = (p - ret.positionsCenter) * invHalfExtent;
+            const uint64_t packed = packSnorm4x16(vec4{normalized, 0.f});
+            ret.positions.push_back(static_cast<uint16_t>(packed));
+            ret.positions.push_back(static_cast<uint16_t>(packed >> 16));
+            ret.positions.push_back(static_cast<uint16_t>(packed >> 32));
+        }
+        while (ret.positions.size() <
+               packedPositionComponentCount(meshData.positions.size()))
+            ret.positions.push_back(0);
     }
 
     ret.normals.reserve(meshData.normals.size());
@@ -485,93 +868,302 @@ PackedMeshData packMeshData(MeshData &&meshData)
     ret.meshletBounds = WHEELS_MOV(meshData.meshletBounds);
     ret.meshletVertices = WHEELS_MOV(meshData.meshletVertices);
     ret.meshletTriangles = WHEELS_MOV(meshData.meshletTriangles);
+    ret.lods = WHEELS_MOV(meshData.lods);
+
+    return ret;
+}
+
+// Hashes the source data so that caches stay valid when the scene file is
+// touched or meshes are reordered, and identical primitives can share them
+uint64_t hashAccessor(
+    Allocator &alloc, const cgltf_accessor *accessor, uint64_t seed)
+{
+    if (accessor == nullptr)
+    {
+        const uint32_t missingMarker = 0xFFFF'FFFF;
+        return wyhash(
+            &missingMarker, sizeof(missingMarker), seed,
+            (uint64_t const *)_wyp);
+    }
+
+    const StaticArray layout{{
+        static_cast<uint64_t>(accessor->component_type),
+        static_cast<uint64_t>(accessor->type),
+        static_cast<uint64_t>(accessor->normalized),
+        static_cast<uint64_t>(accessor->count),
+    }};
+    uint64_t ret = wyhash(
+        layout.data(), layout.size() * sizeof(uint64_t), seed,
+        (uint64_t const *)_wyp);
+
+    const uint8_t *data = accessor->buffer_view != nullptr
+                              ? cgltf_buffer_view_data(accessor->buffer_view)
+                              : nullptr;
+    if (data == nullptr || accessor->is_sparse == 1)
+    {
+        // Let cgltf resolve the tricky cases. Indices are unpacked as floats
+        // too, which is exact for any index that fits in a mesh.
+        const size_t componentCount = cgltf_num_components(accessor->type);
+        Array<float> unpacked{alloc};
+        unpacked.resize(accessor->count * componentCount);
+        const cgltf_size unpackedCount = cgltf_accessor_unpack_floats(
+            accessor, unpacked.data(), unpacked.size());
+        WHEELS_ASSERT(unpackedCount == unpacked.size());
+
+        return wyhash(
+            unpacked.data(), unpacked.size() * sizeof(float), ret,
+            (uint64_t const *)_wyp);
+    }
+
+    data += accessor->offset;
+    const size_t elementByteCount =
+        cgltf_num_components(accessor->type) *
+        cgltf_component_size(accessor->component_type);
+    if (accessor->stride == elementByteCount)
+        return wyhash(
+            data, accessor->count * elementByteCount, ret,
+            (uint64_t const *)_wyp);
+
+    // Interleaved data has to be hashed element by element
+    for (size_t i = 0; i < accessor->count; ++i)
+        ret = wyhash(
+            data + (i * accessor->stride), elementByteCount, ret,
+            (uint64_t const *)_wyp);
 
     return ret;
 }
 
-std::filesystem::path getCachePath(
-    const std::filesystem::path &sceneDir, uint32_t meshIndex)
+// Returns the byte count of the blob as it is stored in the cache
+uint32_t storedBlobByteCount(const MeshCacheHeader &header)
+{
+    return header.usesCompression == 1 ? header.compressedBlobByteCount
+                                       : header.blobByteCount;
+}
+
+std::filesystem::path getCacheArchivePath(const std::filesystem::path &sceneDir)
 {
-    const std::string filename =
-        "cache" + std::to_string(meshIndex) + ".prosper_mesh";
-    std::filesystem::path ret{sceneDir / "prosper_cache" / filename};
+    std::filesystem::path ret{
+        sceneDir / "prosper_cache" / "meshes.prosper_mesh_archive"};
     return ret;
 }
 
-// Returns the read header or null if cache wasn't up to date. If a pointer to
-// an array for the data blob is given, its resized and the blob is read into
-// it.
-Optional<MeshCacheHeader> readCache(
-    const std::filesystem::path &cachePath,
-    Array<uint8_t> *dataBlobOut = nullptr)
+std::filesystem::path getCacheArchiveTmpPath(
+    const std::filesystem::path &sceneDir)
 {
-    Optional<MeshCacheHeader> ret;
+    std::filesystem::path ret = getCacheArchivePath(sceneDir);
+    ret.replace_extension("prosper_mesh_archive_TMP");
+    return ret;
+}
 
-    if (!std::filesystem::exists(cachePath))
+// Returns false if the archive isn't valid. Entry indices are gathered by
+// source hash.
+bool readCacheArchiveToc(
+    const utils::MappedFile &archive,
+    HashMap<uint64_t, uint32_t> &entryIndicesOut)
+{
+    const Span<const uint8_t> data = archive.data();
+    if (data.size() < sizeof(MeshCacheArchiveHeader))
     {
-        LOG_INFO("Missing cache for {}", cachePath.string().c_str());
-        return ret;
+        LOG_INFO("Truncated mesh cache archive");
+        return false;
     }
 
-    std::ifstream cacheFile{cachePath, std::ios_base::binary};
-
-    uint64_t magic{0};
-    static_assert(sizeof(magic) == sizeof(sMeshCacheMagic));
+    MeshCacheArchiveHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != sMeshCacheArchiveMagic)
+    {
+        LOG_INFO("Invalid mesh cache archive");
+        return false;
+    }
+    if (header.version != sMeshCacheVersion)
+    {
+        LOG_INFO("Old mesh cache archive version");
+        return false;
+    }
 
-    readRaw(cacheFile, magic);
-    if (magic != sMeshCacheMagic)
-        throw std::runtime_error(
-            "Expected a valid mesh cache in file '" + cachePath.string() + "'");
+    const size_t tocEnd = sizeof(MeshCacheArchiveHeader) +
+                          (header.entryCount * sizeof(MeshCacheArchiveEntry));
+    if (data.size() < tocEnd)
+    {
+        LOG_INFO("Truncated mesh cache archive");
+        return false;
+    }
 
-    uint32_t version{0};
-    static_assert(sizeof(version) == sizeof(sMeshCacheVersion));
-    readRaw(cacheFile, version);
-    if (sMeshCacheVersion != version)
+    const MeshCacheArchiveEntry *entries =
+        reinterpret_cast<const MeshCacheArchiveEntry *>(
+            data.data() + sizeof(MeshCacheArchiveHeader));
+    for (uint32_t i = 0; i < header.entryCount; ++i)
     {
-        LOG_INFO("Old cache data version for {}", cachePath.string().c_str());
-        return ret;
+        const MeshCacheArchiveEntry &entry = entries[i];
+        if (entry.blobByteOffset < tocEnd ||
+            entry.blobByteOffset + storedBlobByteCount(entry.header) >
+                data.size())
+        {
+            LOG_INFO("Truncated mesh cache archive");
+            entryIndicesOut.clear();
+            return false;
+        }
+        entryIndicesOut.insert_or_assign(entry.header.sourceHash, i);
     }
 
-    ret = MeshCacheHeader{};
+    return true;
+}
 
-    readRaw(cacheFile, ret->sourceWriteTime);
-    readRaw(cacheFile, ret->indexCount);
-    readRaw(cacheFile, ret->vertexCount);
-    readRaw(cacheFile, ret->meshletCount);
-    readRaw(cacheFile, ret->positionsOffset);
-    readRaw(cacheFile, ret->normalsOffset);
-    readRaw(cacheFile, ret->tangentsOffset);
-    readRaw(cacheFile, ret->texCoord0sOffset);
-    readRaw(cacheFile, ret->meshletsOffset);
-    readRaw(cacheFile, ret->meshletBoundsOffset);
-    readRaw(cacheFile, ret->meshletVerticesOffset);
-    readRaw(cacheFile, ret->meshletTrianglesByteOffset);
-    readRaw(cacheFile, ret->usesShortIndices);
-    readRaw(cacheFile, ret->blobByteCount);
+const MeshCacheArchiveEntry &getCacheArchiveEntry(
+    const utils::MappedFile &archive, uint32_t entryIndex)
+{
+    const Span<const uint8_t> data = archive.data();
+    const size_t entryOffset = sizeof(MeshCacheArchiveHeader) +
+                               (entryIndex * sizeof(MeshCacheArchiveEntry));
+    WHEELS_ASSERT(entryOffset + sizeof(MeshCacheArchiveEntry) <= data.size());
+
+    // Entries are aligned for u64 so this is fine
+    return *reinterpret_cast<const MeshCacheArchiveEntry *>(
+        data.data() + entryOffset);
+}
 
-    if (dataBlobOut != nullptr)
-    {
-        dataBlobOut->resize(ret->blobByteCount);
-        readRawSpan(cacheFile, dataBlobOut->mut_span());
-    }
+void beginCacheArchive(DeferredLoadingContext &ctx, uint32_t entryCount)
+{
+    WHEELS_ASSERT(!ctx.meshCacheArchiveWriter.is_open());
 
-    return ret;
+    const std::filesystem::path archivePath =
+        getCacheArchivePath(ctx.sceneDir);
+
+    const std::filesystem::path cacheFolder = archivePath.parent_path();
+    if (!std::filesystem::exists(cacheFolder))
+        std::filesystem::create_directories(cacheFolder);
+
+    // Write into a tmp file and rename when done to minimize the potential for
+    // corrupted files. The previous archive might still be mapped and used as
+    // a source until then.
+    const std::filesystem::path archiveTmpPath =
+        getCacheArchiveTmpPath(ctx.sceneDir);
+    ctx.meshCacheArchiveWriter.open(archiveTmpPath, std::ios_base::binary);
+    ctx.meshCacheArchiveReader.open(archiveTmpPath, std::ios_base::binary);
+
+    // Header and the table of contents are filled in when all meshes have
+    // been appended
+    writeRaw(ctx.meshCacheArchiveWriter, MeshCacheArchiveHeader{});
+    for (uint32_t i = 0; i < entryCount; ++i)
+        writeRaw(ctx.meshCacheArchiveWriter, MeshCacheArchiveEntry{});
+
+    ctx.meshCacheArchiveEntries.reserve(entryCount);
+    ctx.meshCacheArchiveWorkerEntries.resize(ctx.meshes.size(), 0xFFFF'FFFF);
 }
 
-bool cacheValid(
-    const std::filesystem::path &cachePath,
-    std::filesystem::file_time_type sceneWriteTime)
+// Returns the index of the appended entry. This is called from both the mesh
+// workers and the worker.
+uint32_t appendToCacheArchive(
+    DeferredLoadingContext &ctx, const MeshCacheHeader &header,
+    Span<const uint8_t> dataBlob)
 {
-    const Optional<MeshCacheHeader> header = readCache(cachePath);
-    if (!header.has_value())
-        return false;
+    WHEELS_ASSERT(storedBlobByteCount(header) == dataBlob.size());
+
+    const std::lock_guard lock{ctx.meshCacheArchiveMutex};
 
-    if (header->sourceWriteTime != sceneWriteTime)
+    WHEELS_ASSERT(ctx.meshCacheArchiveWriter.is_open());
+    // Appends should never allocate as the mesh workers can't use the loading
+    // worker allocator
+    WHEELS_ASSERT(
+        ctx.meshCacheArchiveEntries.size() <
+        ctx.meshCacheArchiveEntries.capacity());
+
+    const std::streampos blobStart = ctx.meshCacheArchiveWriter.tellp();
+    writeRawSpan(ctx.meshCacheArchiveWriter, dataBlob);
+
+    const uint32_t entryIndex =
+        asserted_cast<uint32_t>(ctx.meshCacheArchiveEntries.size());
+    ctx.meshCacheArchiveEntries.push_back(
+        MeshCacheArchiveEntry{
+            .header = header,
+            .blobByteOffset = asserted_cast<uint64_t>(
+                static_cast<std::streamoff>(blobStart)),
+        });
+
+    return entryIndex;
+}
+
+// Reads back an entry that a mesh worker appended into the archive that's
+// still being written. Uncompressed blobs are read straight into the upload
+// staging and compressed ones into meshCacheArchiveReadBlob.
+MeshCacheHeader readWrittenCacheArchiveEntry(
+    DeferredLoadingContext &ctx, uint32_t entryIndex,
+    const uint8_t *&dataBlobOut)
+{
+    MeshCacheArchiveEntry entry;
     {
-        LOG_INFO("Stale cache for {}", cachePath.string().c_str());
-        return false;
+        const std::lock_guard lock{ctx.meshCacheArchiveMutex};
+
+        WHEELS_ASSERT(entryIndex < ctx.meshCacheArchiveEntries.size());
+        entry = ctx.meshCacheArchiveEntries[entryIndex];
+        // Make sure the blob has made it to the file
+        ctx.meshCacheArchiveWriter.flush();
     }
-    return true;
+
+    const size_t byteCount = storedBlobByteCount(entry.header);
+    uint8_t *dst = nullptr;
+    if (entry.header.usesCompression == 1)
+    {
+        if (ctx.meshCacheArchiveReadBlob.size() < byteCount)
+            ctx.meshCacheArchiveReadBlob.resize(byteCount);
+        dst = ctx.meshCacheArchiveReadBlob.data();
+    }
+    else
+        dst = ctx.geometryUploadStaging(entry.header.blobByteCount);
+
+    std::ifstream &reader = ctx.meshCacheArchiveReader;
+    WHEELS_ASSERT(reader.is_open());
+    // The previous read might have hit the end of what was written then
+    reader.clear();
+    reader.seekg(asserted_cast<std::streamoff>(entry.blobByteOffset));
+    readRawSpan(reader, Span{dst, byteCount});
+    WHEELS_ASSERT(reader.good());
+
+    dataBlobOut = dst;
+
+    return entry.header;
+}
+
+void finishCacheArchive(DeferredLoadingContext &ctx)
+{
+    WHEELS_ASSERT(ctx.meshCacheArchiveWriter.is_open());
+
+    ctx.meshCacheArchiveWriter.seekp(0);
+    writeRaw(
+        ctx.meshCacheArchiveWriter,
+        MeshCacheArchiveHeader{
+            .entryCount =
+                asserted_cast<uint32_t>(ctx.meshCacheArchiveEntries.size()),
+        });
+    writeRawSpan(
+        ctx.meshCacheArchiveWriter, ctx.meshCacheArchiveEntries.span());
+    ctx.meshCacheArchiveWriter.close();
+    ctx.meshCacheArchiveReader.close();
+    ctx.meshCacheArchiveReadBlob.clear();
+
+    // The previous archive can't be replaced while it's mapped on all
+    // platforms
+    ctx.meshCacheArchive.close();
+    ctx.meshCacheArchiveEntryIndices.clear();
+
+    const std::filesystem::path archivePath =
+        getCacheArchivePath(ctx.sceneDir);
+    const std::filesystem::path archiveTmpPath =
+        getCacheArchiveTmpPath(ctx.sceneDir);
+
+    // Make sure we have rw permissions for the user to be nice
+    const std::filesystem::perms initialPerms =
+        std::filesystem::status(archiveTmpPath).permissions();
+    std::filesystem::permissions(
+        archiveTmpPath, initialPerms | std::filesystem::perms::owner_read |
+                            std::filesystem::perms::owner_write);
+
+    // Rename when the file is done to minimize the potential of a corrupted
+    // file
+    std::filesystem::rename(archiveTmpPath, archivePath);
+
+    ctx.meshCacheArchiveEntries.clear();
+    ctx.meshCacheArchiveWorkerEntries.clear();
 }
 
 Optional<uint32_t> getImageIndex(
@@ -606,13 +1198,149 @@ void printImageColorSpaceReuseWarning(const cgltf_image *image)
             "Mip maps will be generated with sRgb filtering");
 }
 
-void writeCache(
-    const std::filesystem::path &sceneDir,
-    std::filesystem::file_time_type sceneWriteTime, uint32_t meshIndex,
-    PackedMeshData &&meshData, const MeshInfo &meshInfo)
+template <typename T> Span<const uint8_t> asBytes(const Array<T> &data)
+{
+    return Span{
+        reinterpret_cast<const uint8_t *>(data.data()),
+        data.size() * sizeof(T)};
+}
+
+// Encodes the sections that make up the uncompressed blob. Sections should be
+// given in blob order.
+Array<uint8_t> compressMeshBlob(
+    Allocator &alloc, const Array<uint32_t> &indices, uint32_t vertexCount,
+    Span<const RawMeshSection> sections)
+{
+    WHEELS_ASSERT(sections.size() == sCompressedMeshSectionCount);
+    WHEELS_ASSERT(
+        indices.size() % 3 == 0 && "Index codec only supports triangle lists");
+
+    const size_t tableByteCount =
+        sCompressedMeshSectionCount * sizeof(CompressedMeshSection);
+
+    size_t boundByteCount = tableByteCount;
+    for (const RawMeshSection &section : sections)
+    {
+        if (section.first.size() == 0)
+            continue;
+        if (section.second == 0)
+            boundByteCount +=
+                meshopt_encodeIndexBufferBound(indices.size(), vertexCount);
+        else
+            boundByteCount += meshopt_encodeVertexBufferBound(
+                section.first.size() / section.second, section.second);
+    }
+
+    Array<uint8_t> ret{alloc};
+    ret.resize(boundByteCount);
+
+    size_t byteCount = tableByteCount;
+    uint32_t rawByteOffset = 0;
+    for (uint32_t i = 0; i < sCompressedMeshSectionCount; ++i)
+    {
+        const Span<const uint8_t> rawBytes = sections[i].first;
+        const uint32_t elementByteCount = sections[i].second;
+
+        size_t compressedByteCount = 0;
+        if (rawBytes.size() > 0)
+        {
+            if (elementByteCount == 0)
+                // Index codec encodes the original indices and decodes into
+                // either u16 or u32
+                compressedByteCount = meshopt_encodeIndexBuffer(
+                    ret.data() + byteCount, ret.size() - byteCount,
+                    indices.data(), indices.size());
+            else
+            {
+                WHEELS_ASSERT(rawBytes.size() % elementByteCount == 0);
+                compressedByteCount = meshopt_encodeVertexBuffer(
+                    ret.data() + byteCount, ret.size() - byteCount,
+                    rawBytes.data(), rawBytes.size() / elementByteCount,
+                    elementByteCount);
+            }
+            WHEELS_ASSERT(compressedByteCount > 0);
+        }
+
+        const CompressedMeshSection section{
+            .rawByteOffset = rawByteOffset,
+            .rawByteCount = asserted_cast<uint32_t>(rawBytes.size()),
+            .compressedByteCount = asserted_cast<uint32_t>(compressedByteCount),
+            .elementByteCount = elementByteCount,
+        };
+        memcpy(
+            ret.data() + (i * sizeof(CompressedMeshSection)), &section,
+            sizeof(section));
+
+        byteCount += compressedByteCount;
+        rawByteOffset += section.rawByteCount;
+    }
+    ret.resize(byteCount);
+
+    return ret;
+}
+
+void decompressMeshBlob(
+    const MeshCacheHeader &header, Span<const uint8_t> src, uint8_t *dst)
+{
+    WHEELS_ASSERT(header.usesCompression == 1);
+    WHEELS_ASSERT(src.size() == header.compressedBlobByteCount);
+
+    const size_t tableByteCount =
+        sCompressedMeshSectionCount * sizeof(CompressedMeshSection);
+    WHEELS_ASSERT(src.size() >= tableByteCount);
+
+    size_t srcByteOffset = tableByteCount;
+    for (uint32_t i = 0; i < sCompressedMeshSectionCount; ++i)
+    {
+        CompressedMeshSection section;
+        memcpy(
+            &section, src.data() + (i * sizeof(CompressedMeshSection)),
+            sizeof(section));
+        if (section.compressedByteCount == 0)
+            continue;
+
+        WHEELS_ASSERT(
+            section.rawByteOffset + section.rawByteCount <=
+            header.blobByteCount);
+        WHEELS_ASSERT(
+            srcByteOffset + section.compressedByteCount <= src.size());
+
+        const uint8_t *sectionSrc = src.data() + srcByteOffset;
+        int result = 0;
+        if (section.elementByteCount == 0)
+        {
+            const size_t indexByteCount = header.usesShortIndices == 1
+                                              ? sizeof(uint16_t)
+                                              : sizeof(uint32_t);
+            WHEELS_ASSERT(
+                header.indexCount * indexByteCount <= section.rawByteCount);
+            result = meshopt_decodeIndexBuffer(
+                dst + section.rawByteOffset, header.indexCount, indexByteCount,
+                sectionSrc, section.compressedByteCount);
+        }
+        else
+            result = meshopt_decodeVertexBuffer(
+                dst + section.rawByteOffset,
+                section.rawByteCount / section.elementByteCount,
+                section.elementByteCount, sectionSrc,
+                section.compressedByteCount);
+        if (result != 0)
+            throw std::runtime_error("Failed to decode mesh cache data");
+
+        srcByteOffset += section.compressedByteCount;
+    }
+}
+
+// Returns the header of the cache and fills the blob as it is stored in the
+// archive
+MeshCacheHeader serializeCache(
+    Allocator &alloc, uint64_t sourceHash, PackedMeshData &&meshData,
+    const MeshInfo &meshInfo, bool compress, Array<uint8_t> &dataBlobOut)
 {
     WHEELS_ASSERT(meshData.indices.size() == meshInfo.indexCount);
-    WHEELS_ASSERT(meshData.positions.size() == meshInfo.vertexCount);
+    WHEELS_ASSERT(
+        meshData.positions.size() ==
+        packedPositionComponentCount(meshInfo.vertexCount));
     WHEELS_ASSERT(meshData.normals.size() == meshInfo.vertexCount);
     WHEELS_ASSERT(
         meshData.tangents.size() == meshInfo.vertexCount ||
@@ -625,8 +1353,8 @@ void writeCache(
     const bool hasTexCoord0s = !meshData.texCoord0s.empty();
 
     const bool usesShortIndices = meshInfo.vertexCount <= 0xFFFF;
-    Array<uint8_t> packedIndices{gAllocators.loadingWorker};
-    Array<uint8_t> packedMeshletVertices{gAllocators.loadingWorker};
+    Array<uint8_t> packedIndices{alloc};
+    Array<uint8_t> packedMeshletVertices{alloc};
     if (usesShortIndices)
     {
         {
@@ -667,7 +1395,8 @@ void writeCache(
             memcpy(packedIndices.data(), meshData.indices.data(), byteCount);
         }
         {
-            const size_t byteCount = meshInfo.indexCount * sizeof(uint32_t);
+            const size_t byteCount =
+                meshData.meshletVertices.size() * sizeof(uint32_t);
             packedMeshletVertices.resize(byteCount);
             memcpy(
                 packedMeshletVertices.data(), meshData.meshletVertices.data(),
@@ -693,7 +1422,7 @@ void writeCache(
     const uint32_t elementSize = static_cast<uint32_t>(sizeof(uint32_t));
 
     // Figure out the offsets and total byte count
-    // NOTE: Order here has to match the write order into the file
+    // NOTE: Order here has to match the write order into the blob
     const uint32_t positionsOffset =
         computeOffset(meshData.positions) / elementSize;
     const uint32_t normalsOffset =
@@ -712,19 +1441,45 @@ void writeCache(
             usesShortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
     const uint32_t meshletTrianglesOffset =
         computeOffset(meshData.meshletTriangles);
+    const uint32_t lodsOffset = computeOffset(meshData.lods) / elementSize;
 
     WHEELS_ASSERT(
         byteCount % sizeof(uint32_t) == 0 &&
         "Mesh data is not aligned properly");
-    WHEELS_ASSERT(
-        byteCount < sGeometryBufferSize &&
-        "The default size for geometry buffers doesn't fit the mesh");
+
+    Array<uint8_t> compressedBlob{alloc};
+    if (compress)
+    {
+        const StaticArray sections{{
+            RawMeshSection{packedIndices.span(), 0u},
+            // These are padded to u32 so let's encode as u32
+            RawMeshSection{asBytes(meshData.positions), sizeof(uint32_t)},
+            RawMeshSection{asBytes(meshData.normals), sizeof(uint32_t)},
+            RawMeshSection{asBytes(meshData.tangents), sizeof(uint32_t)},
+            RawMeshSection{asBytes(meshData.texCoord0s), sizeof(uint32_t)},
+            RawMeshSection{
+                asBytes(meshData.meshlets), sizeof(meshopt_Meshlet)},
+            RawMeshSection{
+                asBytes(meshData.meshletBounds), sizeof(MeshletBounds)},
+            // These are padded to u32 so let's encode as u32 for both
+            // index sizes
+            RawMeshSection{packedMeshletVertices.span(), sizeof(uint32_t)},
+            RawMeshSection{
+                meshData.meshletTriangles.span(), sizeof(uint32_t)},
+            RawMeshSection{asBytes(meshData.lods), sizeof(MeshLod)},
+        }};
+        compressedBlob = compressMeshBlob(
+            alloc, meshData.indices, meshInfo.vertexCount,
+            Span{sections.data(), sections.size()});
+    }
 
     const MeshCacheHeader header{
-        .sourceWriteTime = sceneWriteTime,
+        .sourceHash = sourceHash,
         .indexCount = meshInfo.indexCount,
         .vertexCount = meshInfo.vertexCount,
-        .meshletCount = asserted_cast<uint32_t>(meshData.meshlets.size()),
+        .meshletCount = meshData.lods[0].meshletCount,
+        .positionsCenter = meshData.positionsCenter,
+        .positionsHalfExtent = meshData.positionsHalfExtent,
         .positionsOffset = positionsOffset,
         .normalsOffset = normalsOffset,
         .tangentsOffset = hasTangents ? tangentsOffset : 0xFFFF'FFFF,
@@ -733,153 +1488,496 @@ void writeCache(
         .meshletBoundsOffset = meshletBoundsOffset,
         .meshletVerticesOffset = meshletVerticesOffset,
         .meshletTrianglesByteOffset = meshletTrianglesOffset,
+        .lodsOffset = lodsOffset,
+        .lodCount = asserted_cast<uint32_t>(meshData.lods.size()),
         .usesShortIndices = usesShortIndices ? 1u : 0u,
         .blobByteCount = byteCount,
+        .usesCompression = compress ? 1u : 0u,
+        .compressedBlobByteCount =
+            asserted_cast<uint32_t>(compressedBlob.size()),
     };
 
-    const std::filesystem::path cachePath = getCachePath(sceneDir, meshIndex);
-
-    const std::filesystem::path cacheFolder = cachePath.parent_path();
-    if (!std::filesystem::exists(cacheFolder))
-        std::filesystem::create_directories(cacheFolder);
-
-    std::filesystem::remove(cachePath);
-
-    // Write into a tmp file and rename when done to minimize the potential for
-    // corrupted files
-    std::filesystem::path cacheTmpPath = cachePath;
-    cacheTmpPath.replace_extension("prosper_mesh_TMP");
-
     // NOTE:
     // Caches aren't supposed to be portable so we don't pay attention to
     // endianness.
-    std::ofstream cacheFile{cacheTmpPath, std::ios_base::binary};
-    writeRaw(cacheFile, sMeshCacheMagic);
-    writeRaw(cacheFile, sMeshCacheVersion);
-
-    writeRaw(cacheFile, header.sourceWriteTime);
-    writeRaw(cacheFile, header.indexCount);
-    writeRaw(cacheFile, header.vertexCount);
-    writeRaw(cacheFile, header.meshletCount);
-    writeRaw(cacheFile, header.positionsOffset);
-    writeRaw(cacheFile, header.normalsOffset);
-    writeRaw(cacheFile, header.tangentsOffset);
-    writeRaw(cacheFile, header.texCoord0sOffset);
-    writeRaw(cacheFile, header.meshletsOffset);
-    writeRaw(cacheFile, header.meshletBoundsOffset);
-    writeRaw(cacheFile, header.meshletVerticesOffset);
-    writeRaw(cacheFile, header.meshletTrianglesByteOffset);
-    writeRaw(cacheFile, header.usesShortIndices);
-    writeRaw(cacheFile, header.blobByteCount);
-
-    const std::streampos blobStart = cacheFile.tellp();
-    writeRawSpan(cacheFile, packedIndices.span());
-    writeRawSpan(cacheFile, meshData.positions.span());
-    writeRawSpan(cacheFile, meshData.normals.span());
-    writeRawSpan(cacheFile, meshData.tangents.span());
-    writeRawSpan(cacheFile, meshData.texCoord0s.span());
-    writeRawSpan(cacheFile, meshData.meshlets.span());
-    writeRawSpan(cacheFile, meshData.meshletBounds.span());
-    writeRawSpan(cacheFile, packedMeshletVertices.span());
-    writeRawSpan(cacheFile, meshData.meshletTriangles.span());
-    const std::streampos blobEnd = cacheFile.tellp();
-    const std::streamoff blobLen = blobEnd - blobStart;
-    WHEELS_ASSERT(
-        blobLen == asserted_cast<std::streamoff>(header.blobByteCount));
-
-    cacheFile.close();
-
-    // Make sure we have rw permissions for the user to be nice
-    const std::filesystem::perms initialPerms =
-        std::filesystem::status(cacheTmpPath).permissions();
-    std::filesystem::permissions(
-        cacheTmpPath, initialPerms | std::filesystem::perms::owner_read |
-                          std::filesystem::perms::owner_write);
+    if (compress)
+        dataBlobOut = WHEELS_MOV(compressedBlob);
+    else
+    {
+        dataBlobOut.clear();
+        dataBlobOut.reserve(byteCount);
+        dataBlobOut.extend(packedIndices.span());
+        dataBlobOut.extend(asBytes(meshData.positions));
+        dataBlobOut.extend(asBytes(meshData.normals));
+        dataBlobOut.extend(asBytes(meshData.tangents));
+        dataBlobOut.extend(asBytes(meshData.texCoord0s));
+        dataBlobOut.extend(asBytes(meshData.meshlets));
+        dataBlobOut.extend(asBytes(meshData.meshletBounds));
+        dataBlobOut.extend(packedMeshletVertices.span());
+        dataBlobOut.extend(meshData.meshletTriangles.span());
+        dataBlobOut.extend(asBytes(meshData.lods));
+    }
+    WHEELS_ASSERT(dataBlobOut.size() == storedBlobByteCount(header));
 
-    // Rename when the file is done to minimize the potential of a corrupted
-    // file
-    std::filesystem::rename(cacheTmpPath, cachePath);
+    return header;
 }
 
-void loadNextMesh(DeferredLoadingContext &ctx)
+// Generates the cache for the mesh and appends it into the archive that's
+// being written. This is called from the mesh workers so only ctx members that
+// are constant while they run or guarded by meshCacheArchiveMutex should be
+// accessed.
+void processMesh(
+    Allocator &alloc, DeferredLoadingContext &ctx, uint32_t meshIndex)
 {
-    // Set up a custom allocator for meshopt, let's keep track of allocations
-    // there too
-    sMeshoptAllocator = &gAllocators.loadingWorker;
-    auto meshoptAllocate = [](size_t byteCount) -> void *
-    { return sMeshoptAllocator->allocate(byteCount); };
-    auto meshoptDeallocate = [](void *ptr)
-    { sMeshoptAllocator->deallocate(ptr); };
-    meshopt_setAllocator(meshoptAllocate, meshoptDeallocate);
-
-    const uint32_t meshIndex = ctx.workerLoadedMeshCount;
     WHEELS_ASSERT(meshIndex < ctx.meshes.size());
+    WHEELS_ASSERT(ctx.meshSourceIndices[meshIndex] == meshIndex);
 
-    // Ctx member functions will use the command buffer
-    ctx.cb.reset();
-    ctx.cb.begin(
-        vk::CommandBufferBeginInfo{
-            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
-        });
-
-    const gfx::QueueFamilies &families = gfx::gDevice.queueFamilies();
-    WHEELS_ASSERT(families.graphicsFamily.has_value());
-    WHEELS_ASSERT(families.transferFamily.has_value());
+    const uint64_t sourceHash = ctx.meshHashes[meshIndex];
 
     const Pair<InputGeometryMetadata, MeshInfo> &nextMesh =
         ctx.meshes[meshIndex];
     const InputGeometryMetadata &metadata = nextMesh.first;
     MeshInfo info = nextMesh.second;
 
-    const char *meshName = ctx.gltfData->meshes[metadata.sourceMeshIndex].name;
-    ctx.meshNames.emplace_back(gAllocators.loadingWorker, meshName);
+    const char *meshName = ctx.meshNames[meshIndex].c_str();
 
-    const std::filesystem::path cachePath =
-        getCachePath(ctx.sceneDir, meshIndex);
-    if (!cacheValid(cachePath, ctx.sceneWriteTime))
+    MeshData meshData = getMeshData(alloc, metadata, info);
+
+    if (meshData.tangents.empty() && !meshData.texCoord0s.empty())
     {
-        MeshData meshData = getMeshData(metadata, info);
+        generateTangents(alloc, meshData);
+        info.vertexCount = asserted_cast<uint32_t>(meshData.positions.size());
+    }
 
-        if (meshData.tangents.empty() && !meshData.texCoord0s.empty())
+    optimizeMeshData(alloc, meshData, info, meshName);
+
+    generateMeshlets(alloc, meshData);
+
+    PackedMeshData packedMeshData = packMeshData(alloc, WHEELS_MOV(meshData));
+
+    // The blob goes straight into the archive so the data is only written
+    // once
+    Array<uint8_t> dataBlob{alloc};
+    const MeshCacheHeader header = serializeCache(
+        alloc, sourceHash, WHEELS_MOV(packedMeshData), info,
+        gCompressMeshCaches, dataBlob);
+
+    ctx.meshCacheArchiveWorkerEntries[meshIndex] =
+        appendToCacheArchive(ctx, header, dataBlob.span());
+}
+
+// Returns how many workers with the given scratch size fit in the scratch
+// budget
+uint32_t maxWorkerCount(size_t workerScratchByteCount)
+{
+    const size_t systemMemory = systemMemoryByteCount();
+    const size_t budget = systemMemory > 0
+                              ? systemMemory / sWorkerScratchMemoryDivisor
+                              : sFallbackWorkerScratchBudget;
+
+    return std::max(
+        asserted_cast<uint32_t>(std::min<size_t>(
+            budget / workerScratchByteCount,
+            std::numeric_limits<uint32_t>::max())),
+        1u);
+}
+
+// Reorders the queue if newer priorities have been published since it was
+// last ordered. Expects the caller to hold the lock that guards the queue.
+void refreshLoadingQueue(
+    DeferredLoadingContext &ctx, LoadingQueue &queue,
+    const Array<float> &priorities)
+{
+    if (queue.generation() == ctx.loadingPrioritiesGeneration)
+        return;
+
+    const std::lock_guard lock{ctx.loadingPrioritiesMutex};
+    queue.reorder(priorities.span(), ctx.loadingPrioritiesGeneration);
+}
+
+// Queues the source mesh and its duplicates for upload. Expects the caller to
+// hold processedMeshesMutex.
+void queueMeshUploads(DeferredLoadingContext &ctx, uint32_t sourceIndex)
+{
+    WHEELS_ASSERT(ctx.meshSourceIndices[sourceIndex] == sourceIndex);
+
+    for (uint32_t i = sourceIndex; i != 0xFFFF'FFFF;
+         i = ctx.meshDuplicateLinks[i])
+        ctx.meshUploadQueue.push(i);
+}
+
+void meshWorker(DeferredLoadingContext *ctx, uint32_t workerIndex)
+{
+    WHEELS_ASSERT(ctx != nullptr);
+
+    const std::string threadName =
+        "prosper mesh " + std::to_string(workerIndex);
+    setCurrentThreadName(threadName.c_str());
+
+    // Mesh processing is allocation heavy so let's not contend on a shared
+    // allocator
+    TlsfAllocator alloc;
+    alloc.init(sMeshWorkerScratchSize);
+    defer { alloc.destroy(); };
+
+    sMeshoptAllocator = &alloc;
+
+    while (!ctx->interruptLoading)
+    {
+        // Only the missing meshes are queued so that the most important ones
+        // are generated first
+        Optional<uint32_t> meshIndex;
+        {
+            const std::lock_guard lock{ctx->meshProcessingQueueMutex};
+            refreshLoadingQueue(
+                *ctx, ctx->meshProcessingQueue, ctx->meshPriorities);
+            meshIndex = ctx->meshProcessingQueue.pop();
+        }
+        if (!meshIndex.has_value())
+            break;
+
+        processMesh(alloc, *ctx, *meshIndex);
+
+        {
+            const std::lock_guard lock{ctx->processedMeshesMutex};
+            ctx->processedMeshes[*meshIndex] = 1;
+            queueMeshUploads(*ctx, *meshIndex);
+        }
+        ctx->processedMeshesCondition.notify_all();
+    }
+}
+
+// Fills the accessors of the mesh inputs from the glTF, parsing it first if
+// the managing thread didn't
+bool parseMeshInputs(DeferredLoadingContext &ctx)
+{
+    if (ctx.gltfData == nullptr)
+    {
+        utils::Timer t;
+        try
+        {
+            // Malloc as the managing thread's allocators aren't thread-safe
+            ctx.gltfData = loadGltf(ctx.scenePath, nullptr);
+        }
+        catch (std::exception &e)
+        {
+            LOG_ERR("{}", e.what());
+            return false;
+        }
+        LOG_INFO("Deferred glTF loading took {:.2f}s", t.getSeconds());
+    }
+
+    const cgltf_data &gltfData = *ctx.gltfData;
+    uint32_t meshIndex = 0;
+    for (uint32_t mi = 0; mi < gltfData.meshes_count; ++mi)
+    {
+        const cgltf_mesh &mesh = gltfData.meshes[mi];
+        for (uint32_t pi = 0; pi < mesh.primitives_count; ++pi)
+        {
+            WHEELS_ASSERT(
+                meshIndex < ctx.meshes.size() &&
+                "glTF doesn't match the one the world was set up from");
+            Pair<InputGeometryMetadata, MeshInfo> &input =
+                ctx.meshes[meshIndex++];
+            input.first = getInputGeometry(gltfData, mi, pi).first;
+            WHEELS_ASSERT(input.first.sourceMeshIndex == mi);
+        }
+    }
+    WHEELS_ASSERT(
+        meshIndex == ctx.meshes.size() &&
+        "glTF doesn't match the one the world was set up from");
+
+    return true;
+}
+
+// Deduplicates the meshes, figures out what's already in the cache archive and
+// launches the mesh workers for the rest. The glTF is only parsed if some
+// meshes are missing as their inputs come from the scene snapshot otherwise.
+// Returns false if it had to be parsed and that failed.
+bool prepareMeshes(DeferredLoadingContext &ctx)
+{
+    const uint32_t meshCount = asserted_cast<uint32_t>(ctx.meshes.size());
+    WHEELS_ASSERT(ctx.meshNames.size() == meshCount);
+    WHEELS_ASSERT(ctx.meshHashes.size() == meshCount);
+
+    // Meshes are uploaded in priority order so set up everything that's
+    // indexed by mesh up front
+    ctx.workerUploadedMeshes.reserve(meshCount);
+    for (uint32_t i = 0; i < meshCount; ++i)
+        ctx.workerUploadedMeshes.emplace_back(
+            UploadedGeometryData{}, MeshInfo{});
+
+    uint32_t uniqueMeshCount = 0;
+    {
+        HashMap<uint64_t, uint32_t> firstMeshWithHash{
+            gAllocators.loadingWorker, meshCount};
+        ctx.meshSourceIndices.reserve(meshCount);
+        ctx.meshDuplicateLinks.resize(meshCount, 0xFFFF'FFFF);
+        for (uint32_t i = 0; i < meshCount; ++i)
+        {
+            const uint64_t hash = ctx.meshHashes[i];
+
+            const uint32_t *firstMesh = firstMeshWithHash.find(hash);
+            if (firstMesh != nullptr)
+            {
+                ctx.meshSourceIndices.push_back(*firstMesh);
+                // Order within the chain doesn't matter
+                ctx.meshDuplicateLinks[i] = ctx.meshDuplicateLinks[*firstMesh];
+                ctx.meshDuplicateLinks[*firstMesh] = i;
+            }
+            else
+            {
+                firstMeshWithHash.insert_or_assign(hash, i);
+                ctx.meshSourceIndices.push_back(i);
+                uniqueMeshCount++;
+            }
+        }
+    }
+    if (uniqueMeshCount < meshCount)
+        LOG_INFO(
+            "{} of {} meshes are duplicates", meshCount - uniqueMeshCount,
+            meshCount);
+
+    const std::filesystem::path archivePath =
+        getCacheArchivePath(ctx.sceneDir);
+    if (ctx.meshCacheArchive.open(archivePath))
+    {
+        if (!readCacheArchiveToc(
+                ctx.meshCacheArchive, ctx.meshCacheArchiveEntryIndices))
+            ctx.meshCacheArchive.close();
+    }
+    else
+        LOG_INFO("Missing mesh cache archive");
+
+    // Workers aren't running yet so the queues don't need to be locked
+    ctx.meshProcessingQueue.init(meshCount);
+    ctx.meshUploadQueue.init(meshCount);
+
+    uint32_t missingMeshCount = 0;
+    ctx.processedMeshes.reserve(meshCount);
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        const bool isDuplicate = ctx.meshSourceIndices[i] != i;
+        const bool isArchived =
+            ctx.meshCacheArchive.isOpen() &&
+            ctx.meshCacheArchiveEntryIndices.contains(ctx.meshHashes[i]);
+        if (isDuplicate || isArchived)
+            ctx.processedMeshes.push_back(1);
+        else
         {
-            generateTangents(meshData);
-            info.vertexCount =
-                asserted_cast<uint32_t>(meshData.positions.size());
+            ctx.processedMeshes.push_back(0);
+            ctx.meshProcessingQueue.push(i);
+            missingMeshCount++;
         }
+    }
+    // Duplicates are queued with their sources
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        if (ctx.meshSourceIndices[i] == i && ctx.processedMeshes[i] == 1)
+            queueMeshUploads(ctx, i);
+    }
+
+    if (missingMeshCount == 0)
+        return true;
+
+    LOG_INFO("{} meshes missing from the cache archive", missingMeshCount);
+
+    // Bake fills the accessors up front
+    if (ctx.meshes[0].first.indices == nullptr && !parseMeshInputs(ctx))
+        return false;
+
+    // The archive is rewritten with all the unique meshes, including the ones
+    // that can be copied from the old archive
+    beginCacheArchive(ctx, uniqueMeshCount);
 
-        optimizeMeshData(meshData, info, meshName);
+    if (ctx.meshWorkerCount == 0)
+    {
+        // Leave one core for the main thread. The loading worker mostly waits
+        // on the mesh workers and the transfer queue.
+        const uint32_t hwThreadCount = std::thread::hardware_concurrency();
+        ctx.meshWorkerCount = hwThreadCount > 1 ? hwThreadCount - 1 : 1;
+    }
+    ctx.meshWorkerCount = std::min(
+        ctx.meshWorkerCount, maxWorkerCount(sMeshWorkerScratchSize));
+    ctx.meshWorkerCount =
+        std::max(std::min(ctx.meshWorkerCount, missingMeshCount), 1u);
+    LOG_INFO("Using {} mesh workers", ctx.meshWorkerCount);
+
+    // Mesh workers won't allocate from the loading worker allocator so this is
+    // safe while the earlier workers are already running
+    ctx.meshWorkers.reserve(ctx.meshWorkerCount);
+    for (uint32_t i = 0; i < ctx.meshWorkerCount; ++i)
+        ctx.meshWorkers.emplace_back(&meshWorker, &ctx, i);
+
+    return true;
+}
+
+bool meshUploaded(const DeferredLoadingContext &ctx, uint32_t meshIndex)
+{
+    return ctx.workerUploadedMeshes[meshIndex].first.byteCount > 0;
+}
 
-        generateMeshlets(meshData);
+void pushLoadedMesh(
+    DeferredLoadingContext &ctx, uint32_t meshIndex,
+    UploadedGeometryData uploadData, const MeshInfo &info)
+{
+    WHEELS_ASSERT(!meshUploaded(ctx, meshIndex));
+    WHEELS_ASSERT(uploadData.byteCount > 0);
+
+    uploadData.meshIndex = meshIndex;
+    ctx.workerUploadedMeshes[meshIndex] =
+        Pair<UploadedGeometryData, MeshInfo>{uploadData, info};
+    ctx.workerLoadedMeshCount++;
+
+    {
+        const std::lock_guard lock{ctx.loadedMeshesMutex};
 
-        PackedMeshData packedMeshData = packMeshData(WHEELS_MOV(meshData));
+        ctx.loadedMeshes.emplace_back(uploadData, info);
+    }
 
-        writeCache(
-            ctx.sceneDir, ctx.sceneWriteTime, meshIndex,
-            WHEELS_MOV(packedMeshData), info);
+    if (ctx.workerLoadedMeshCount == ctx.meshes.size())
+    {
+        if (ctx.meshCacheArchiveWriter.is_open())
+            finishCacheArchive(ctx);
+
+        LOG_INFO("Mesh loading took {:.2f}s", ctx.meshTimer.getSeconds());
+        LOG_INFO(
+            "Mesh caches: {:.2f}MB read, {:.2f}MB decoded",
+            static_cast<double>(ctx.meshCacheBytesRead) / 1024. / 1024.,
+            static_cast<double>(ctx.meshCacheBytesDecoded) / 1024. / 1024.);
+        ctx.textureTimer.reset();
+    }
+}
+
+// Pops the highest priority mesh that isn't uploaded yet and whose cache is
+// ready. Expects the caller to hold processedMeshesMutex.
+Optional<uint32_t> pickNextMesh(DeferredLoadingContext &ctx)
+{
+    refreshLoadingQueue(ctx, ctx.meshUploadQueue, ctx.meshPriorities);
+
+    while (true)
+    {
+        const Optional<uint32_t> ret = ctx.meshUploadQueue.pop();
+        // Sources are uploaded ahead of their duplicates when a duplicate is
+        // picked first so they can still be in the queue
+        if (!ret.has_value() || !meshUploaded(ctx, *ret))
+            return ret;
+    }
+}
+
+void loadNextMesh(DeferredLoadingContext &ctx)
+{
+    WHEELS_ASSERT(ctx.workerLoadedMeshCount < ctx.meshes.size());
+
+    // Meshes are processed in parallel and uploads pick the most important
+    // ready mesh so that what's in view shows up first
+    Optional<uint32_t> nextMeshIndex;
+    {
+        std::unique_lock lock{ctx.processedMeshesMutex};
+        ctx.processedMeshesCondition.wait(
+            lock,
+            [&ctx, &nextMeshIndex]
+            {
+                if (ctx.interruptLoading)
+                    return true;
+                nextMeshIndex = pickNextMesh(ctx);
+                return nextMeshIndex.has_value();
+            });
+    }
+    if (ctx.interruptLoading)
+        return;
+    WHEELS_ASSERT(nextMeshIndex.has_value());
+
+    const uint32_t sourceIndex = ctx.meshSourceIndices[*nextMeshIndex];
+    if (sourceIndex != *nextMeshIndex && meshUploaded(ctx, sourceIndex))
+    {
+        // Identical source data so let's just point to the range that was
+        // uploaded for the first instance of it
+        const uint32_t meshIndex = *nextMeshIndex;
+        const Pair<UploadedGeometryData, MeshInfo> &source =
+            ctx.workerUploadedMeshes[sourceIndex];
+
+        UploadedGeometryData uploadData = source.first;
+        uploadData.meshName = ctx.meshNames[meshIndex];
+        uploadData.sharesEarlierRange = true;
+
+        MeshInfo info = ctx.meshes[meshIndex].second;
+        info.vertexCount = source.second.vertexCount;
+        info.meshletCount = source.second.meshletCount;
+
+        pushLoadedMesh(ctx, meshIndex, uploadData, info);
+        return;
+    }
+
+    // A duplicate is pushed after the data it points to has been uploaded so
+    // upload that first. The duplicate will be picked next if it still has
+    // the highest priority.
+    const uint32_t meshIndex = sourceIndex;
+    if (meshIndex != *nextMeshIndex)
+    {
+        const std::lock_guard lock{ctx.processedMeshesMutex};
+        ctx.meshUploadQueue.push(*nextMeshIndex);
     }
+    MeshInfo info = ctx.meshes[meshIndex].second;
+
+    // Ctx member functions will use the command buffer
+    ctx.cb.reset();
+    ctx.cb.begin(
+        vk::CommandBufferBeginInfo{
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+        });
+
+    const gfx::QueueFamilies &families = gfx::gDevice.queueFamilies();
+    WHEELS_ASSERT(families.graphicsFamily.has_value());
+    WHEELS_ASSERT(families.transferFamily.has_value());
+
+    const uint64_t sourceHash = ctx.meshHashes[meshIndex];
 
     // Always read from the cache to make caching issues always visible
-    Array<uint8_t> dataBlob{gAllocators.loadingWorker};
-    const Optional<MeshCacheHeader> cacheHeader =
-        readCache(cachePath, &dataBlob);
-    WHEELS_ASSERT(cacheHeader.has_value());
-    WHEELS_ASSERT(cacheHeader->indexCount == info.indexCount);
+    MeshCacheHeader cacheHeader;
+    const uint8_t *dataBlobPtr = nullptr;
+    const uint32_t *archiveEntryIndex =
+        ctx.meshCacheArchive.isOpen()
+            ? ctx.meshCacheArchiveEntryIndices.find(sourceHash)
+            : nullptr;
+    if (archiveEntryIndex != nullptr)
+    {
+        const MeshCacheArchiveEntry &entry =
+            getCacheArchiveEntry(ctx.meshCacheArchive, *archiveEntryIndex);
+        cacheHeader = entry.header;
+        dataBlobPtr = ctx.meshCacheArchive.data().data() + entry.blobByteOffset;
+    }
+    else
+    {
+        // Mesh workers append the missing meshes straight into the new
+        // archive
+        cacheHeader = readWrittenCacheArchiveEntry(
+            ctx, ctx.meshCacheArchiveWorkerEntries[meshIndex], dataBlobPtr);
+    }
+    WHEELS_ASSERT(cacheHeader.sourceHash == sourceHash);
+    WHEELS_ASSERT(cacheHeader.indexCount == info.indexCount);
     // Tangent generation can change vertex count
-    info.vertexCount = cacheHeader->vertexCount;
-    info.meshletCount = cacheHeader->meshletCount;
+    info.vertexCount = cacheHeader.vertexCount;
+    info.meshletCount = cacheHeader.meshletCount;
+
+    const Span<const uint8_t> storedBlob{
+        dataBlobPtr, storedBlobByteCount(cacheHeader)};
+    if (archiveEntryIndex != nullptr && ctx.meshCacheArchiveWriter.is_open())
+        appendToCacheArchive(ctx, cacheHeader, storedBlob);
+
+    ctx.meshCacheBytesRead += storedBlob.size();
+    ctx.meshCacheBytesDecoded += cacheHeader.blobByteCount;
 
     const UploadedGeometryData uploadData = ctx.uploadGeometryData(
-        *cacheHeader, dataBlob, ctx.meshNames[meshIndex]);
+        cacheHeader, storedBlob, ctx.meshNames[meshIndex]);
 
     if (*families.graphicsFamily != *families.transferFamily)
     {
         const gfx::Buffer &buffer =
             ctx.geometryBuffers[uploadData.metadata.bufferIndex];
 
-        // Transfer ownership of the newly pushed buffer range.
-        // NOTE: This expects the subsequent ranges to be packed tightly.
-        // Extra bytes in between should not happen since the buffer is
-        // bound up to the final offset + bytecount.
+        // Transfer ownership of the newly allocated buffer range. The main
+        // thread acquires the exact same range.
         const vk::BufferMemoryBarrier2 releaseBarrier{
             .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
             .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
@@ -911,40 +2009,262 @@ void loadNextMesh(DeferredLoadingContext &ctx)
     // We could have multiple uploads in flight, but let's be simple for now
     transferQueue.waitIdle();
 
-    ctx.workerLoadedMeshCount++;
+    pushLoadedMesh(ctx, meshIndex, uploadData, info);
+}
 
+TextureColorSpace imageColorSpace(
+    const DeferredLoadingContext &ctx, uint32_t imageIndex)
+{
+    if (ctx.linearColorImages.contains(imageIndex))
     {
-        const std::lock_guard lock{ctx.loadedMeshesMutex};
+        WHEELS_ASSERT(
+            !ctx.sRgbColorImages.contains(imageIndex) &&
+            "Image should belong to exactly one colorspace set");
+        return TextureColorSpace::Linear;
+    }
 
-        ctx.loadedMeshes.emplace_back(uploadData, info);
+    WHEELS_ASSERT(
+        ctx.sRgbColorImages.contains(imageIndex) &&
+        "Image should belong to exactly one colorspace set");
+    return TextureColorSpace::sRgb;
+}
+
+TextureChannelUsage imageChannelUsage(
+    const DeferredLoadingContext &ctx, uint32_t imageIndex)
+{
+    const TextureChannelUsage *usage = ctx.imageChannelUsages.find(imageIndex);
+    if (usage != nullptr)
+        return *usage;
+    return TextureChannelUsage::Color;
+}
+
+// Pops the highest priority image that no texture worker has picked up yet.
+// Expects the caller to hold processedImagesMutex.
+Optional<uint32_t> pickNextImageToProcess(DeferredLoadingContext &ctx)
+{
+    refreshLoadingQueue(ctx, ctx.imageProcessingQueue, ctx.imagePriorities);
+
+    return ctx.imageProcessingQueue.pop();
+}
+
+void textureWorker(DeferredLoadingContext *ctx, uint32_t workerIndex)
+{
+    WHEELS_ASSERT(ctx != nullptr);
+
+    const std::string threadName =
+        "prosper tex " + std::to_string(workerIndex);
+    setCurrentThreadName(threadName.c_str());
+
+    // Malloc backed as the loading worker allocator isn't thread-safe. Scopes
+    // rewind this for each image.
+    LinearAllocator scopeBacking{ctx->textureWorkerScratchByteCount};
+
+    while (!ctx->interruptLoading)
+    {
+        Optional<uint32_t> imageIndex;
+        {
+            const std::lock_guard lock{ctx->processedImagesMutex};
+            imageIndex = pickNextImageToProcess(*ctx);
+        }
+        if (!imageIndex.has_value())
+            break;
+
+        const String &uri = ctx->imageUris[*imageIndex];
+        // The loading worker reports missing uris and hits failed imports
+        // again when it uploads the image
+        if (!uri.empty())
+        {
+            try
+            {
+                updateTextureCache(
+                    ScopedScratch{scopeBacking}, ctx->sceneDir / uri.c_str(),
+                    Texture2DOptions{
+                        .generateMipMaps = true,
+                        .colorSpace = imageColorSpace(*ctx, *imageIndex),
+                        .channelUsage = imageChannelUsage(*ctx, *imageIndex),
+                    });
+            }
+            catch (std::exception &e)
+            {
+                LOG_ERR("{}", e.what());
+            }
+        }
+
+        {
+            const std::lock_guard lock{ctx->processedImagesMutex};
+            ctx->processedImages[*imageIndex] = 1;
+            ctx->imageUploadQueue.push(*imageIndex);
+        }
+        ctx->processedImagesCondition.notify_all();
     }
 
-    if (ctx.workerLoadedMeshCount == ctx.meshes.size())
+    // The last textures finish sooner when the idle workers help compress them
+    if (!ctx->interruptLoading)
+        helpCompressTextures();
+}
+
+void launchTextureWorkers(DeferredLoadingContext &ctx)
+{
+    const uint32_t imageCount = ctx.imageCount;
+    if (imageCount == 0)
+        return;
+
+    // Only the image headers are read here so this is quick compared to the
+    // compression itself
+    size_t scratchByteCount = 0;
+    for (const String &uri : ctx.imageUris)
     {
-        LOG_INFO("Mesh loading took {:.2f}s", ctx.meshTimer.getSeconds());
-        ctx.textureTimer.reset();
+        if (uri.empty())
+            continue;
+
+        try
+        {
+            scratchByteCount = std::max(
+                scratchByteCount,
+                textureCacheScratchByteCount(ctx.sceneDir / uri.c_str()));
+        }
+        catch (std::exception &)
+        {
+            // The workers report the image when they fail to read it
+        }
+    }
+    ctx.textureWorkerScratchByteCount =
+        std::max(scratchByteCount, sMinTextureWorkerScratchSize);
+
+    if (ctx.textureWorkerCount == 0)
+    {
+        // Mesh workers take most of the cores early on and each texture worker
+        // holds a big scratch allocation
+        const uint32_t hwThreadCount = std::thread::hardware_concurrency();
+        ctx.textureWorkerCount = std::max(hwThreadCount / 2, 1u);
+    }
+    ctx.textureWorkerCount = std::min(
+        ctx.textureWorkerCount,
+        maxWorkerCount(ctx.textureWorkerScratchByteCount));
+    ctx.textureWorkerCount =
+        std::max(std::min(ctx.textureWorkerCount, imageCount), 1u);
+    LOG_INFO("Using {} texture workers", ctx.textureWorkerCount);
+
+    ctx.textureWorkers.reserve(ctx.textureWorkerCount);
+    for (uint32_t i = 0; i < ctx.textureWorkerCount; ++i)
+        ctx.textureWorkers.emplace_back(&textureWorker, &ctx, i);
+}
+
+// Pops the highest priority image that isn't loaded yet and whose cache is
+// ready. Expects the caller to hold processedImagesMutex.
+Optional<uint32_t> pickNextImage(DeferredLoadingContext &ctx)
+{
+    refreshLoadingQueue(ctx, ctx.imageUploadQueue, ctx.imagePriorities);
+
+    const Optional<uint32_t> ret = ctx.imageUploadQueue.pop();
+    WHEELS_ASSERT(!ret.has_value() || ctx.workerLoadedImages[*ret] == 0);
+
+    return ret;
+}
+
+void waitTextureUploads(DeferredLoadingContext &ctx, uint64_t value)
+{
+    const vk::SemaphoreWaitInfo waitInfo{
+        .semaphoreCount = 1,
+        .pSemaphores = &ctx.textureUploadSemaphore,
+        .pValues = &value,
+    };
+    gfx::checkSuccess(
+        gfx::gDevice.logical().waitSemaphores(
+            &waitInfo, std::numeric_limits<uint64_t>::max()),
+        "waitSemaphores");
+}
+
+// Hands the textures whose uploads are done over to the managing thread
+void publishUploadedTextures(DeferredLoadingContext &ctx)
+{
+    uint64_t completedValue = 0;
+    gfx::checkSuccess(
+        gfx::gDevice.logical().getSemaphoreCounterValue(
+            ctx.textureUploadSemaphore, &completedValue),
+        "getSemaphoreCounterValue");
+
+    const std::lock_guard lock{ctx.loadedTexturesMutex};
+    for (TextureUploadSlot &slot : ctx.textureUploadSlots)
+    {
+        if (!slot.texture.has_value() || slot.uploadValue > completedValue)
+            continue;
+
+        ctx.loadedTextures.emplace_back(WHEELS_MOV(*slot.texture));
+        slot.texture.reset();
     }
 }
 
+void flushTextureUploads(DeferredLoadingContext &ctx)
+{
+    waitTextureUploads(ctx, ctx.textureUploadValue);
+    publishUploadedTextures(ctx);
+}
+
 void loadNextTexture(DeferredLoadingContext &ctx)
 {
-    const uint32_t imageIndex = ctx.workerLoadedImageCount;
-    if (imageIndex == ctx.gltfData->images_count)
+    if (ctx.workerLoadedImageCount == ctx.imageCount)
     {
+        flushTextureUploads(ctx);
         LOG_INFO("Texture loading took {:.2f}s", ctx.textureTimer.getSeconds());
         ctx.interruptLoading = true;
         return;
     }
 
-    WHEELS_ASSERT(ctx.gltfData->images_count > imageIndex);
-    const cgltf_image &image = ctx.gltfData->images[imageIndex];
-    if (image.uri == nullptr)
+    publishUploadedTextures(ctx);
+
+    // Caches are processed in parallel and uploads pick the most important
+    // ready image
+    Optional<uint32_t> nextImageIndex;
+    {
+        const std::lock_guard lock{ctx.processedImagesMutex};
+        nextImageIndex = pickNextImage(ctx);
+    }
+    if (!nextImageIndex.has_value())
+    {
+        // Finished uploads shouldn't sit in the ring while the next cache is
+        // being processed
+        flushTextureUploads(ctx);
+
+        std::unique_lock lock{ctx.processedImagesMutex};
+        ctx.processedImagesCondition.wait(
+            lock,
+            [&ctx, &nextImageIndex]
+            {
+                if (ctx.interruptLoading)
+                    return true;
+                nextImageIndex = pickNextImage(ctx);
+                return nextImageIndex.has_value();
+            });
+    }
+    if (ctx.interruptLoading)
+        return;
+    WHEELS_ASSERT(nextImageIndex.has_value());
+
+    const uint32_t imageIndex = *nextImageIndex;
+    WHEELS_ASSERT(ctx.imageCount > imageIndex);
+    const String &uri = ctx.imageUris[imageIndex];
+    if (uri.empty())
         throw std::runtime_error(
             "Embedded glTF textures aren't supported. "
             "Scene should be glTF + bin + textures.");
 
-    ctx.cb.reset();
-    ctx.cb.begin(
+    const uint32_t slotCount =
+        asserted_cast<uint32_t>(ctx.textureUploadSlots.size());
+    TextureUploadSlot &slot = ctx.textureUploadSlots[ctx.nextTextureUploadSlot];
+    ctx.nextTextureUploadSlot = (ctx.nextTextureUploadSlot + 1) % slotCount;
+
+    // Staging and the command buffer are reused so the oldest upload has to
+    // be done. Slots are only emptied when their uploads are done.
+    if (slot.texture.has_value())
+    {
+        waitTextureUploads(ctx, slot.uploadValue);
+        publishUploadedTextures(ctx);
+    }
+    WHEELS_ASSERT(!slot.texture.has_value());
+
+    slot.cb.reset();
+    slot.cb.begin(
         vk::CommandBufferBeginInfo{
             .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
         });
@@ -952,26 +2272,16 @@ void loadNextTexture(DeferredLoadingContext &ctx)
     LinearAllocator scopeBacking{
         gAllocators.loadingWorker, Allocators::sLoadingScratchSize};
 
-    TextureColorSpace colorSpace = TextureColorSpace::sRgb;
-    if (ctx.linearColorImages.contains(imageIndex))
-    {
-        WHEELS_ASSERT(
-            !ctx.sRgbColorImages.contains(imageIndex) &&
-            "Image should belong to exactly one colorspace set");
-        colorSpace = TextureColorSpace::Linear;
-    }
-    else
-        WHEELS_ASSERT(
-            ctx.sRgbColorImages.contains(imageIndex) &&
-            "Image should belong to exactly one colorspace set");
-
+    // The cache is up to date so this only reads and uploads it
     Texture2D tex;
     tex.init(
-        ScopedScratch{scopeBacking}, ctx.sceneDir / image.uri, ctx.cb,
-        ctx.stagingBuffer,
+        ScopedScratch{scopeBacking}, ctx.sceneDir / uri.c_str(), slot.cb,
+        slot.stagingBuffer,
         Texture2DOptions{
             .generateMipMaps = true,
-            .colorSpace = colorSpace,
+            .colorSpace = imageColorSpace(ctx, imageIndex),
+            .channelUsage = imageChannelUsage(ctx, imageIndex),
+            .maxResidentExtent = TextureStreamer::sBaseResidentExtent,
         });
 
     const gfx::QueueFamilies &families = gfx::gDevice.queueFamilies();
@@ -999,33 +2309,41 @@ void loadNextTexture(DeferredLoadingContext &ctx)
                     .layerCount = VK_REMAINING_ARRAY_LAYERS,
                 },
         };
-        ctx.cb.pipelineBarrier2(
+        slot.cb.pipelineBarrier2(
             vk::DependencyInfo{
                 .imageMemoryBarrierCount = 1,
                 .pImageMemoryBarriers = &releaseBarrier,
             });
     }
 
-    ctx.cb.end();
+    slot.cb.end();
 
+    const uint64_t signalValue = ++ctx.textureUploadValue;
+    const vk::TimelineSemaphoreSubmitInfo timelineInfo{
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &signalValue,
+    };
     const vk::Queue transferQueue = gfx::gDevice.transferQueue();
     const vk::SubmitInfo submitInfo{
+        .pNext = &timelineInfo,
         .commandBufferCount = 1,
-        .pCommandBuffers = &ctx.cb,
+        .pCommandBuffers = &slot.cb,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &ctx.textureUploadSemaphore,
     };
     gfx::checkSuccess(
         transferQueue.submit(1, &submitInfo, vk::Fence{}),
         "submitTextureUpload");
-    // We could have multiple uploads in flight, but let's be simple for now
-    transferQueue.waitIdle();
-
-    ctx.workerLoadedImageCount++;
 
-    {
-        const std::lock_guard lock{ctx.loadedTexturesMutex};
+    slot.uploadValue = signalValue;
+    slot.texture.emplace(
+        LoadedTexture{
+            .texture = WHEELS_MOV(tex),
+            .imageIndex = imageIndex,
+        });
 
-        ctx.loadedTextures.emplace_back(WHEELS_MOV(tex));
-    }
+    ctx.workerLoadedImageCount++;
+    ctx.workerLoadedImages[imageIndex] = 1;
 }
 
 void loadingWorker(DeferredLoadingContext *ctx)
@@ -1036,6 +2354,13 @@ void loadingWorker(DeferredLoadingContext *ctx)
     setCurrentThreadName("prosper loading");
 
     ctx->meshTimer.reset();
+    if (!ctx->meshes.empty() && !prepareMeshes(*ctx))
+        return;
+
+    // Textures are uploaded after the meshes but their caches can be processed
+    // in the meantime
+    launchTextureWorkers(*ctx);
+
     while (!ctx->interruptLoading)
     {
         if (ctx->workerLoadedMeshCount < ctx->meshes.size())
@@ -1053,85 +2378,338 @@ void loadingWorker(DeferredLoadingContext *ctx)
     }
 }
 
-} // namespace
+void stopWorkers(DeferredLoadingContext &ctx)
+{
+    {
+        // Hold the locks so that the loading worker can't miss the wakeup
+        const std::scoped_lock lock{
+            ctx.processedMeshesMutex, ctx.processedImagesMutex};
+        ctx.interruptLoading = true;
+    }
+    ctx.processedMeshesCondition.notify_all();
+    ctx.processedImagesCondition.notify_all();
+
+    // The loading worker launches the mesh and texture workers so it has to be
+    // joined first
+    if (ctx.worker.has_value())
+    {
+        ctx.worker->join();
+        ctx.worker.reset();
+    }
+
+    for (std::thread &t : ctx.meshWorkers)
+        t.join();
+    ctx.meshWorkers.clear();
+
+    for (std::thread &t : ctx.textureWorkers)
+        t.join();
+    ctx.textureWorkers.clear();
+}
+
+void *cgltf_alloc_func(void *user, cgltf_size size)
+{
+    Allocator *alloc = static_cast<Allocator *>(user);
+    return alloc->allocate(size);
+}
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters) lib interface
+void cgltf_free_func(void *user, void *ptr)
+{
+    Allocator *alloc = static_cast<Allocator *>(user);
+    alloc->deallocate(ptr);
+}
 
-gfx::Buffer createTextureStaging()
+void setMeshoptAllocator()
+{
+    // The hooks are global but they only read the thread-local allocator
+    // pointer that each mesh worker sets up for itself
+    auto meshoptAllocate = [](size_t byteCount) -> void *
+    { return sMeshoptAllocator->allocate(byteCount); };
+    auto meshoptDeallocate = [](void *ptr)
+    { sMeshoptAllocator->deallocate(ptr); };
+    meshopt_setAllocator(meshoptAllocate, meshoptDeallocate);
+}
+
+gfx::Buffer createGeometryUploadBuffer(uint32_t byteCount)
 {
-    // Assume at most 4k at 8bits per channel
-    const vk::DeviceSize stagingSize = static_cast<size_t>(4096) *
-                                       static_cast<size_t>(4096) *
-                                       sizeof(uint32_t);
     return gfx::gDevice.createBuffer(
         gfx::BufferCreateInfo{
             .desc =
                 gfx::BufferDescription{
-                    .byteSize = stagingSize,
+                    .byteSize = byteCount,
                     .usage = vk::BufferUsageFlagBits::eTransferSrc,
                     .properties = vk::MemoryPropertyFlagBits::eHostVisible |
                                   vk::MemoryPropertyFlagBits::eHostCoherent,
                 },
-            .debugName = "Texture2DStaging",
+            .debugName = "GeometryUploadBuffer",
         });
 }
-DeferredLoadingContext::~DeferredLoadingContext()
+
+// Decodes EXT_meshopt_compression buffer views so that cgltf reads them like
+// any other view. Returns false if any of them fails to decode.
+bool decodeMeshoptBufferViews(cgltf_data &gltfData)
 {
-    // Don't check for m_initialized as we might be cleaning up after a failed
-    // init.
-    if (worker.has_value())
+    for (cgltf_buffer_view &view :
+         Span{gltfData.buffer_views, gltfData.buffer_views_count})
     {
-        interruptLoading = true;
-        worker->join();
+        if (view.has_meshopt_compression == 0)
+            continue;
+
+        const cgltf_meshopt_compression &compression = view.meshopt_compression;
+        WHEELS_ASSERT(compression.buffer != nullptr);
+        if (compression.buffer->data == nullptr)
+            return false;
+
+        const uint8_t *src =
+            static_cast<const uint8_t *>(compression.buffer->data) +
+            compression.offset;
+        const size_t byteCount = compression.count * compression.stride;
+        // cgltf_free() releases the decoded data through the same callbacks
+        void *dst = gltfData.memory.alloc_func(
+            gltfData.memory.user_data, byteCount);
+        view.data = dst;
+
+        int result = -1;
+        switch (compression.mode)
+        {
+        case cgltf_meshopt_compression_mode_attributes:
+            result = meshopt_decodeVertexBuffer(
+                dst, compression.count, compression.stride, src,
+                compression.size);
+            break;
+        case cgltf_meshopt_compression_mode_triangles:
+            result = meshopt_decodeIndexBuffer(
+                dst, compression.count, compression.stride, src,
+                compression.size);
+            break;
+        case cgltf_meshopt_compression_mode_indices:
+            result = meshopt_decodeIndexSequence(
+                dst, compression.count, compression.stride, src,
+                compression.size);
+            break;
+        default:
+            break;
+        }
+        if (result != 0)
+            return false;
+
+        switch (compression.filter)
+        {
+        case cgltf_meshopt_compression_filter_octahedral:
+            meshopt_decodeFilterOct(dst, compression.count, compression.stride);
+            break;
+        case cgltf_meshopt_compression_filter_quaternion:
+            meshopt_decodeFilterQuat(
+                dst, compression.count, compression.stride);
+            break;
+        case cgltf_meshopt_compression_filter_exponential:
+            meshopt_decodeFilterExp(dst, compression.count, compression.stride);
+            break;
+        default:
+            break;
+        }
     }
 
-    gfx::gDevice.destroy(stagingBuffer);
+    return true;
+}
 
-    gfx::gDevice.destroy(geometryUploadBuffer);
-    cgltf_free(gltfData);
+// gltfpack uses the same transform for all textures of a material so the first
+// one found is used for the texture coordinates. Rotations aren't supported.
+Optional<cgltf_texture_transform> getTexCoord0Transform(
+    const cgltf_material &material)
+{
+    const StaticArray views{{
+        &material.pbr_metallic_roughness.base_color_texture,
+        &material.pbr_metallic_roughness.metallic_roughness_texture,
+        &material.normal_texture,
+    }};
+    for (const cgltf_texture_view *view : views)
+    {
+        if (view->texture == nullptr || view->has_transform == 0)
+            continue;
+
+        if (view->transform.rotation != 0.f)
+        {
+            LOG_WARN("Rotated texture transforms are not supported");
+            return {};
+        }
+
+        return view->transform;
+    }
+
+    return {};
 }
 
-void DeferredLoadingContext::init(
-    std::filesystem::path inSceneDir,
-    std::filesystem::file_time_type inSceneWriteTime, cgltf_data &inGltfData)
+} // namespace
+
+cgltf_data *loadGltf(const std::filesystem::path &path, Allocator *alloc)
 {
-    WHEELS_ASSERT(!initialized);
+    cgltf_file_type gltfType = cgltf_file_type_invalid;
+    if (path.extension() == ".gltf")
+        gltfType = cgltf_file_type_gltf;
+    else if (path.extension() == ".glb")
+        gltfType = cgltf_file_type_glb;
+    else
+        throw std::runtime_error(
+            "Unknown extension '" + path.extension().string() + "'");
 
-    sceneDir = WHEELS_MOV(inSceneDir);
-    sceneWriteTime = inSceneWriteTime;
-    gltfData = &inGltfData;
-    cb = gfx::gDevice.logical().allocateCommandBuffers(
-        vk::CommandBufferAllocateInfo{
-            .commandPool = gfx::gDevice.transferPool(),
-            .level = vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = 1})[0];
-    loadedMeshes.reserve(gltfData->meshes_count);
-    loadedTextures.reserve(gltfData->images_count);
-    materials.reserve(gltfData->materials_count);
+    // Zeroed memory options make cgltf use malloc
+    cgltf_options options{
+        .type = gltfType,
+    };
+    if (alloc != nullptr)
+        options.memory = cgltf_memory_options{
+            .alloc_func = cgltf_alloc_func,
+            .free_func = cgltf_free_func,
+            .user_data = alloc,
+        };
 
-    stagingBuffer = createTextureStaging();
+    cgltf_data *data = nullptr;
+    cgltf_result result =
+        cgltf_parse_file(&options, path.string().c_str(), &data);
+    if (result != cgltf_result_success)
+        throw std::runtime_error(
+            "Failed to parse gltf '" + path.string() +
+            "': " + sCgltfResultStr[result]);
 
-    geometryUploadBuffer = gfx::gDevice.createBuffer(
-        gfx::BufferCreateInfo{
-            .desc =
-                gfx::BufferDescription{
-                    .byteSize = sGeometryBufferSize,
-                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                    .properties = vk::MemoryPropertyFlagBits::eHostVisible |
-                                  vk::MemoryPropertyFlagBits::eHostCoherent,
-                },
-            .debugName = "GeometryUploadBuffer",
-        });
+    result = cgltf_load_buffers(&options, data, path.string().c_str());
+    if (result != cgltf_result_success)
+    {
+        cgltf_free(data);
+        throw std::runtime_error(
+            std::string("Failed to load glTF buffers: ") +
+            sCgltfResultStr[result]);
+    }
 
-    initialized = true;
+    if (!decodeMeshoptBufferViews(*data))
+    {
+        cgltf_free(data);
+        throw std::runtime_error(
+            "Failed to decode meshopt compressed buffers of '" +
+            path.string() + "'");
+    }
+
+    return data;
 }
 
-void DeferredLoadingContext::launch()
+Pair<InputGeometryMetadata, MeshInfo> getInputGeometry(
+    const cgltf_data &gltfData, uint32_t meshIndex, uint32_t primitiveIndex)
 {
-    WHEELS_ASSERT(initialized);
+    WHEELS_ASSERT(meshIndex < gltfData.meshes_count);
+    const cgltf_mesh &mesh = gltfData.meshes[meshIndex];
+    WHEELS_ASSERT(primitiveIndex < mesh.primitives_count);
+    const cgltf_primitive &primitive = mesh.primitives[primitiveIndex];
+    WHEELS_ASSERT(primitive.indices != nullptr);
+
+    InputGeometryMetadata metadata{
+        .indices = primitive.indices,
+        .sourceMeshIndex = meshIndex,
+        .sourcePrimitiveIndex = primitiveIndex,
+    };
+
+    for (cgltf_size ai = 0; ai < primitive.attributes_count; ++ai)
+    {
+        const cgltf_attribute &attr = primitive.attributes[ai];
+        WHEELS_ASSERT(attr.data != nullptr);
+
+        if (strcmp("POSITION", attr.name) == 0)
+            metadata.positions = attr.data;
+        else if (strcmp("NORMAL", attr.name) == 0)
+            metadata.normals = attr.data;
+        else if (strcmp("TANGENT", attr.name) == 0)
+            metadata.tangents = attr.data;
+        else if (strcmp("TEXCOORD_0", attr.name) == 0)
+            metadata.texCoord0s = attr.data;
+    }
+    WHEELS_ASSERT(metadata.positions != nullptr);
+    WHEELS_ASSERT(metadata.normals != nullptr);
+    WHEELS_ASSERT(metadata.positions->count == metadata.normals->count);
     WHEELS_ASSERT(
-        !worker.has_value() && "Tried to launch deferred loading worker twice");
+        metadata.tangents == nullptr ||
+        metadata.tangents->count == metadata.positions->count);
+    WHEELS_ASSERT(
+        metadata.texCoord0s == nullptr ||
+        metadata.texCoord0s->count == metadata.positions->count);
+
+    if (primitive.material != nullptr)
+        metadata.texCoord0Transform =
+            getTexCoord0Transform(*primitive.material);
+
+    const uint32_t material =
+        primitive.material != nullptr
+            ? asserted_cast<uint32_t>(
+                  cgltf_material_index(&gltfData, primitive.material) + 1)
+            : 0;
+
+    const MeshInfo info{
+        .vertexCount = asserted_cast<uint32_t>(metadata.positions->count),
+        .indexCount = asserted_cast<uint32_t>(metadata.indices->count),
+        .materialIndex = material,
+    };
+
+    return Pair<InputGeometryMetadata, MeshInfo>{metadata, info};
+}
+
+uint64_t hashSourceData(Allocator &alloc, const InputGeometryMetadata &metadata)
+{
+    uint64_t ret = 0;
+    ret = hashAccessor(alloc, metadata.indices, ret);
+    ret = hashAccessor(alloc, metadata.positions, ret);
+    ret = hashAccessor(alloc, metadata.normals, ret);
+    ret = hashAccessor(alloc, metadata.tangents, ret);
+    ret = hashAccessor(alloc, metadata.texCoord0s, ret);
+    if (metadata.texCoord0Transform.has_value())
+    {
+        const cgltf_texture_transform &transform =
+            *metadata.texCoord0Transform;
+        const StaticArray transformValues{{
+            transform.offset[0],
+            transform.offset[1],
+            transform.scale[0],
+            transform.scale[1],
+        }};
+        ret = wyhash(
+            transformValues.data(), transformValues.size() * sizeof(float),
+            ret, (uint64_t const *)_wyp);
+    }
+    return ret;
+}
+
+void setMeshCacheCompression(bool compress)
+{
+    gCompressMeshCaches = compress;
+}
+
+void collectImageUsages(
+    Allocator &alloc, const cgltf_data &gltfData,
+    HashSet<uint32_t> &sRgbImagesOut, HashSet<uint32_t> &linearImagesOut,
+    HashMap<uint32_t, TextureChannelUsage> &channelUsagesOut)
+{
+    enum UsageFlags : uint32_t
+    {
+        UsageFlags_BaseColor = 0x1,
+        UsageFlags_RoughnessMetalness = 0x2,
+        UsageFlags_Occlusion = 0x4,
+        UsageFlags_Normal = 0x8,
+    };
+
+    const uint32_t imageCount = asserted_cast<uint32_t>(gltfData.images_count);
+    // Images can only drop channels if all the materials that use them read
+    // the same ones
+    Array<uint32_t> usageFlags{alloc};
+    usageFlags.resize(imageCount, 0);
+
+    const auto addLinear = [&](uint32_t imageIndex)
+    {
+        if (sRgbImagesOut.contains(imageIndex))
+            printImageColorSpaceReuseWarning(
+                gltfData.textures[imageIndex].image);
+        else
+            linearImagesOut.insert(imageIndex);
+    };
 
     for (const cgltf_material &material :
-         Span{gltfData->materials, gltfData->materials_count})
+         Span{gltfData.materials, gltfData.materials_count})
     {
         if (material.has_pbr_metallic_roughness == 1)
         {
@@ -1139,76 +2717,344 @@ void DeferredLoadingContext::launch()
                 material.pbr_metallic_roughness;
 
             const Optional<uint32_t> baseColorIndex =
-                getImageIndex(gltfData, pbrParams.base_color_texture.texture);
+                getImageIndex(&gltfData, pbrParams.base_color_texture.texture);
             if (baseColorIndex.has_value())
             {
-                if (linearColorImages.contains(*baseColorIndex))
+                if (linearImagesOut.contains(*baseColorIndex))
                 {
                     printImageColorSpaceReuseWarning(
-                        gltfData->textures[*baseColorIndex].image);
-                    linearColorImages.remove(*baseColorIndex);
+                        gltfData.textures[*baseColorIndex].image);
+                    linearImagesOut.remove(*baseColorIndex);
                 }
-                sRgbColorImages.insert(*baseColorIndex);
+                sRgbImagesOut.insert(*baseColorIndex);
+                usageFlags[*baseColorIndex] |= UsageFlags_BaseColor;
             }
 
             const Optional<uint32_t> metallicRoughnessIndex = getImageIndex(
-                gltfData, pbrParams.metallic_roughness_texture.texture);
+                &gltfData, pbrParams.metallic_roughness_texture.texture);
             if (metallicRoughnessIndex.has_value())
             {
-                if (sRgbColorImages.contains(*metallicRoughnessIndex))
-                    printImageColorSpaceReuseWarning(
-                        gltfData->textures[*metallicRoughnessIndex].image);
-                else
-                    linearColorImages.insert(*metallicRoughnessIndex);
+                addLinear(*metallicRoughnessIndex);
+                usageFlags[*metallicRoughnessIndex] |=
+                    UsageFlags_RoughnessMetalness;
             }
         }
 
+        const Optional<uint32_t> occlusionIndex =
+            getImageIndex(&gltfData, material.occlusion_texture.texture);
+        if (occlusionIndex.has_value())
+        {
+            addLinear(*occlusionIndex);
+            usageFlags[*occlusionIndex] |= UsageFlags_Occlusion;
+        }
+
         const Optional<uint32_t> normalIndex =
-            getImageIndex(gltfData, material.normal_texture.texture);
+            getImageIndex(&gltfData, material.normal_texture.texture);
         if (normalIndex.has_value())
         {
-            if (sRgbColorImages.contains(*normalIndex))
-                printImageColorSpaceReuseWarning(
-                    gltfData->textures[*normalIndex].image);
-            else
-                linearColorImages.insert(*normalIndex);
+            addLinear(*normalIndex);
+            usageFlags[*normalIndex] |= UsageFlags_Normal;
+        }
+    }
+
+    // Shared and base color images keep all channels
+    for (uint32_t i = 0; i < imageCount; ++i)
+    {
+        switch (usageFlags[i])
+        {
+        case UsageFlags_RoughnessMetalness:
+            channelUsagesOut.insert_or_assign(
+                i, TextureChannelUsage::RoughnessMetalness);
+            break;
+        case UsageFlags_Occlusion:
+            channelUsagesOut.insert_or_assign(
+                i, TextureChannelUsage::Occlusion);
+            break;
+        case UsageFlags_Normal:
+            channelUsagesOut.insert_or_assign(
+                i, TextureChannelUsage::NormalMap);
+            break;
+        default:
+            break;
         }
     }
+}
+
+gfx::Buffer createTextureStaging(uint32_t maxExtent)
+{
+    // Twice the size of the first level is plenty for the mips
+    const vk::DeviceSize stagingSize = static_cast<size_t>(maxExtent) *
+                                       static_cast<size_t>(maxExtent) *
+                                       sizeof(uint32_t) * 2;
+    return gfx::gDevice.createBuffer(
+        gfx::BufferCreateInfo{
+            .desc =
+                gfx::BufferDescription{
+                    .byteSize = stagingSize,
+                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
+                    .properties = vk::MemoryPropertyFlagBits::eHostVisible |
+                                  vk::MemoryPropertyFlagBits::eHostCoherent,
+                },
+            .debugName = "Texture2DStaging",
+        });
+}
+
+DeferredLoadingContext::~DeferredLoadingContext()
+{
+    // Don't check for m_initialized as we might be cleaning up after a failed
+    // init.
+    stopWorkers(*this);
+
+    // Offline bakes don't init the context and might not have a device at all
+    if (textureUploadSemaphore != vk::Semaphore{})
+    {
+        // Textures and staging in the ring might still be used by uploads
+        waitTextureUploads(*this, textureUploadValue);
+        gfx::gDevice.logical().destroy(textureUploadSemaphore);
+    }
+    for (TextureUploadSlot &slot : textureUploadSlots)
+        gfx::gDevice.destroy(slot.stagingBuffer);
+
+    if (geometryUploadBuffer.handle != vk::Buffer{})
+        gfx::gDevice.destroy(geometryUploadBuffer);
+    cgltf_free(gltfData);
+}
+
+void DeferredLoadingContext::init(
+    std::filesystem::path inScenePath, cgltf_data *inGltfData,
+    const SceneSnapshot &snapshot, GeometryAllocator &inGeometryAllocator)
+{
+    WHEELS_ASSERT(!initialized);
+
+    scenePath = WHEELS_MOV(inScenePath);
+    sceneDir = scenePath.parent_path();
+    gltfData = inGltfData;
+    meshCount = asserted_cast<uint32_t>(snapshot.meshes.size());
+    imageCount = asserted_cast<uint32_t>(snapshot.images.size());
+    geometryAllocator = &inGeometryAllocator;
+
+    // The worker only fills in the accessors if it has to generate caches
+    meshes.reserve(meshCount);
+    meshNames.reserve(meshCount);
+    meshHashes.reserve(meshCount);
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        const SceneSnapshot::Mesh &mesh = snapshot.meshes[i];
+        meshes.emplace_back(
+            InputGeometryMetadata{},
+            MeshInfo{
+                .vertexCount = mesh.vertexCount,
+                .indexCount = mesh.indexCount,
+                .materialIndex = snapshot.meshMaterialIndices[i],
+            });
+        meshNames.emplace_back(
+            gAllocators.loadingWorker,
+            StrSpan{
+                snapshot.meshNames.data() + mesh.nameOffset, mesh.nameLength});
+        meshHashes.push_back(mesh.sourceHash);
+    }
+
+    imageUris.reserve(imageCount);
+    for (uint32_t i = 0; i < imageCount; ++i)
+    {
+        const SceneSnapshot::Image &image = snapshot.images[i];
+        imageUris.emplace_back(
+            gAllocators.loadingWorker,
+            StrSpan{
+                snapshot.imageUris.data() + image.uriOffset, image.uriLength});
+        if ((image.flags & SceneSnapshot::ImageFlags_SRgb) != 0)
+            sRgbColorImages.insert(i);
+        if ((image.flags & SceneSnapshot::ImageFlags_Linear) != 0)
+            linearColorImages.insert(i);
+        if ((image.flags & SceneSnapshot::ImageFlags_NormalMap) != 0)
+            imageChannelUsages.insert_or_assign(
+                i, TextureChannelUsage::NormalMap);
+        else if ((image.flags & SceneSnapshot::ImageFlags_Occlusion) != 0)
+            imageChannelUsages.insert_or_assign(
+                i, TextureChannelUsage::Occlusion);
+        else if (
+            (image.flags & SceneSnapshot::ImageFlags_RoughnessMetalness) != 0)
+            imageChannelUsages.insert_or_assign(
+                i, TextureChannelUsage::RoughnessMetalness);
+    }
+
+    cb = gfx::gDevice.logical().allocateCommandBuffers(
+        vk::CommandBufferAllocateInfo{
+            .commandPool = gfx::gDevice.transferPool(),
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1})[0];
+    loadedMeshes.reserve(meshCount);
+    loadedTextures.reserve(imageCount);
+
+    // Only the base levels are uploaded here and the streamer loads the rest
+    textureUploadSlots.resize(sTextureUploadSlotCount);
+    for (TextureUploadSlot &slot : textureUploadSlots)
+    {
+        slot.stagingBuffer =
+            createTextureStaging(TextureStreamer::sBaseResidentExtent);
+        slot.cb = gfx::gDevice.logical().allocateCommandBuffers(
+            vk::CommandBufferAllocateInfo{
+                .commandPool = gfx::gDevice.transferPool(),
+                .level = vk::CommandBufferLevel::ePrimary,
+                .commandBufferCount = 1})[0];
+    }
+
+    const vk::SemaphoreTypeCreateInfo semaphoreTypeInfo{
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue = 0,
+    };
+    textureUploadSemaphore = gfx::gDevice.logical().createSemaphore(
+        vk::SemaphoreCreateInfo{
+            .pNext = &semaphoreTypeInfo,
+        });
+
+    geometryUploadBuffer = createGeometryUploadBuffer(sGeometryBufferSize);
+
+    initialized = true;
+}
+
+void DeferredLoadingContext::launch()
+{
+    WHEELS_ASSERT(initialized);
+    WHEELS_ASSERT(
+        !worker.has_value() && "Tried to launch deferred loading worker twice");
+
+    setMeshoptAllocator();
+
+    // These are not resized after this so the managing thread can update
+    // the priorities while the worker reads them
+    meshPriorities.resize(meshCount);
+    imagePriorities.resize(imageCount);
+    workerLoadedImages.resize(imageCount);
+    processedImages.resize(imageCount);
+    loadedImages.resize(imageCount);
+    loadedMaterials.resize(materials.size());
+    memset(meshPriorities.data(), 0, meshPriorities.size() * sizeof(float));
+    memset(imagePriorities.data(), 0, imagePriorities.size() * sizeof(float));
+    memset(workerLoadedImages.data(), 0, workerLoadedImages.size());
+    memset(processedImages.data(), 0, processedImages.size());
+    memset(loadedImages.data(), 0, loadedImages.size());
+    memset(loadedMaterials.data(), 0, loadedMaterials.size());
+
+    // All images go through the texture workers
+    imageProcessingQueue.init(imageCount);
+    imageUploadQueue.init(imageCount);
+    for (uint32_t i = 0; i < imageCount; ++i)
+        imageProcessingQueue.push(i);
 
     worker = std::thread{&loadingWorker, this};
 }
 
+void DeferredLoadingContext::bakeMeshCaches(
+    std::filesystem::path inSceneDir, cgltf_data &inGltfData)
+{
+    WHEELS_ASSERT(!initialized);
+    WHEELS_ASSERT(!worker.has_value());
+    WHEELS_ASSERT(meshes.empty());
+
+    sceneDir = WHEELS_MOV(inSceneDir);
+    gltfData = &inGltfData;
+
+    for (uint32_t mi = 0; mi < gltfData->meshes_count; ++mi)
+    {
+        const cgltf_mesh &mesh = gltfData->meshes[mi];
+        const char *meshName = mesh.name != nullptr ? mesh.name : "";
+        for (uint32_t pi = 0; pi < mesh.primitives_count; ++pi)
+        {
+            meshes.push_back(getInputGeometry(*gltfData, mi, pi));
+            meshNames.emplace_back(gAllocators.loadingWorker, meshName);
+            meshHashes.push_back(
+                hashSourceData(gAllocators.loadingWorker, meshes.back().first));
+        }
+    }
+    meshCount = asserted_cast<uint32_t>(meshes.size());
+    if (meshes.empty())
+        return;
+
+    setMeshoptAllocator();
+
+    // The accessors are already filled so this doesn't parse the glTF
+    if (!prepareMeshes(*this))
+        throw std::runtime_error("Failed to prepare the mesh inputs");
+    for (std::thread &t : meshWorkers)
+        t.join();
+    meshWorkers.clear();
+
+    // Nothing was missing from the archive
+    if (!meshCacheArchiveWriter.is_open())
+        return;
+
+    // The mesh workers appended the missing meshes so copy over the rest from
+    // the old archive. The loading worker does this as it uploads them but
+    // there's no priority order here so the glTF order it is.
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        if (meshSourceIndices[i] != i)
+            continue;
+
+        const uint32_t *archiveEntryIndex =
+            meshCacheArchive.isOpen()
+                ? meshCacheArchiveEntryIndices.find(meshHashes[i])
+                : nullptr;
+        if (archiveEntryIndex == nullptr)
+        {
+            WHEELS_ASSERT(meshCacheArchiveWorkerEntries[i] != 0xFFFF'FFFF);
+            continue;
+        }
+
+        const MeshCacheArchiveEntry &entry =
+            getCacheArchiveEntry(meshCacheArchive, *archiveEntryIndex);
+        appendToCacheArchive(
+            *this, entry.header,
+            Span{
+                meshCacheArchive.data().data() + entry.blobByteOffset,
+                storedBlobByteCount(entry.header)});
+    }
+
+    finishCacheArchive(*this);
+}
+
 void DeferredLoadingContext::kill()
 {
     // This is ok to call unconditionally even if init() hasn't been called
-    if (worker.has_value())
+    stopWorkers(*this);
+}
+
+uint8_t *DeferredLoadingContext::geometryUploadStaging(uint32_t byteCount)
+{
+    WHEELS_ASSERT(initialized);
+
+    if (geometryUploadBuffer.byteSize < byteCount)
     {
-        interruptLoading = true;
-        worker->join();
-        worker.reset();
+        // Previous uploads have finished so the old buffer can go. Let's not
+        // shrink back as more large meshes are likely to follow.
+        gfx::gDevice.destroy(geometryUploadBuffer);
+        geometryUploadBuffer = createGeometryUploadBuffer(byteCount);
     }
+
+    return static_cast<uint8_t *>(geometryUploadBuffer.mapped);
 }
 
 UploadedGeometryData DeferredLoadingContext::uploadGeometryData(
-    const MeshCacheHeader &cacheHeader, const Array<uint8_t> &dataBlob,
+    const MeshCacheHeader &cacheHeader, Span<const uint8_t> dataBlob,
     const String &meshName)
 {
     WHEELS_ASSERT(initialized);
     WHEELS_ASSERT(cacheHeader.blobByteCount > 0);
-    WHEELS_ASSERT(cacheHeader.blobByteCount == dataBlob.size());
+    WHEELS_ASSERT(storedBlobByteCount(cacheHeader) == dataBlob.size());
 
-    const uint32_t dstBufferI = getGeometryBuffer(cacheHeader.blobByteCount);
-
-    // The mesh data ranges are expected to not leave gaps in the buffer so that
-    // ownership is transferred properly between the queues.
-    const uint32_t startByteOffset =
-        (sGeometryBufferSize - geometryBufferRemainingByteCounts[dstBufferI]);
+    const GeometryRange range = allocateGeometry(cacheHeader.blobByteCount);
+    const uint32_t dstBufferI = range.bufferIndex;
+    const uint32_t startByteOffset = range.byteOffset;
     WHEELS_ASSERT(
         startByteOffset % sizeof(uint32_t) == 0 &&
         "Mesh data should be aligned for u32");
 
-    uint32_t *dstPtr = static_cast<uint32_t *>(geometryUploadBuffer.mapped);
-    memcpy(dstPtr, dataBlob.data(), cacheHeader.blobByteCount);
+    uint8_t *dstPtr = geometryUploadStaging(cacheHeader.blobByteCount);
+    if (cacheHeader.usesCompression == 1)
+        decompressMeshBlob(cacheHeader, dataBlob, dstPtr);
+    else if (dataBlob.data() != dstPtr)
+        memcpy(dstPtr, dataBlob.data(), cacheHeader.blobByteCount);
 
     const vk::BufferCopy copyRegion{
         .srcOffset = 0,
@@ -1221,12 +3067,6 @@ UploadedGeometryData DeferredLoadingContext::uploadGeometryData(
     cb.copyBuffer(
         geometryUploadBuffer.handle, dstBuffer.handle, 1, &copyRegion);
 
-    // The mesh data ranges are expected to not leave gaps in the buffer so
-    // that ownership is transferred properly between the queues. Any
-    // alignment/padding for the next mesh should be included in the byte
-    // count of the previous one.
-    geometryBufferRemainingByteCounts[dstBufferI] -= cacheHeader.blobByteCount;
-
     const uint32_t startOffsetU32 =
         startByteOffset / asserted_cast<uint32_t>(sizeof(uint32_t));
     const uint32_t startOffsetU16 =
@@ -1259,6 +3099,14 @@ UploadedGeometryData DeferredLoadingContext::uploadGeometryData(
                 .meshletTrianglesByteOffset =
                     startByteOffset + cacheHeader.meshletTrianglesByteOffset,
                 .usesShortIndices = cacheHeader.usesShortIndices,
+                .lodsOffset = startOffsetU32 + cacheHeader.lodsOffset,
+                .lodCount = cacheHeader.lodCount,
+                .positionsCenterX = cacheHeader.positionsCenter.x,
+                .positionsCenterY = cacheHeader.positionsCenter.y,
+                .positionsCenterZ = cacheHeader.positionsCenter.z,
+                .positionsHalfExtentX = cacheHeader.positionsHalfExtent.x,
+                .positionsHalfExtentY = cacheHeader.positionsHalfExtent.y,
+                .positionsHalfExtentZ = cacheHeader.positionsHalfExtent.z,
             },
         .byteOffset = startByteOffset,
         .byteCount = cacheHeader.blobByteCount,
@@ -1268,55 +3116,62 @@ UploadedGeometryData DeferredLoadingContext::uploadGeometryData(
     return ret;
 }
 
-uint32_t DeferredLoadingContext::getGeometryBuffer(uint32_t byteCount)
+GeometryRange DeferredLoadingContext::allocateGeometry(uint32_t byteCount)
 {
-    // Find a buffer that fits the data or create a new one
-    // Let's assume there's only a handful of these so we can just comb
-    // through all of them and potentially fill early buffers more
-    // completely than if we just checked the last one.
-    uint32_t dstBufferI = 0;
+    WHEELS_ASSERT(geometryAllocator != nullptr);
+
+    Optional<GeometryRange> range =
+        geometryAllocator->allocate(byteCount, sGeometryAlignment);
+    if (range.has_value())
+        return *range;
+
+    // Buffers are made of whole default sized chunks so that a mesh that
+    // doesn't fit one gets as many as it needs and the rest of the last chunk
+    // is left for other meshes. Offsets into the buffers are u32 so this is
+    // still limited to 4GB.
+    const uint32_t maxBufferByteCount =
+        gfx::gDevice.properties().device.limits.maxStorageBufferRange;
+    const size_t chunkCount =
+        roundedUpQuotient<size_t>(byteCount, sGeometryBufferSize);
+    const uint32_t bufferByteCount = asserted_cast<uint32_t>(std::min(
+        chunkCount * sGeometryBufferSize,
+        static_cast<size_t>(maxBufferByteCount)));
     WHEELS_ASSERT(
-        geometryBuffers.size() == geometryBufferRemainingByteCounts.size());
-    const uint32_t bufferCount =
-        asserted_cast<uint32_t>(geometryBufferRemainingByteCounts.size());
-    for (; dstBufferI < bufferCount; ++dstBufferI)
+        byteCount <= bufferByteCount && "Mesh doesn't fit in a storage buffer");
+
+    gfx::Buffer buffer = gfx::gDevice.createBuffer(
+        gfx::BufferCreateInfo{
+            .desc =
+                gfx::BufferDescription{
+                    .byteSize = bufferByteCount,
+                    .usage = vk::BufferUsageFlagBits::
+                                 eAccelerationStructureBuildInputReadOnlyKHR |
+                             vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                             vk::BufferUsageFlagBits::eStorageBuffer |
+                             vk::BufferUsageFlagBits::eTransferSrc |
+                             vk::BufferUsageFlagBits::eTransferDst,
+                    .properties = vk::MemoryPropertyFlagBits::eDeviceLocal,
+                },
+            .cacheDeviceAddress = true,
+            .debugName = "GeometryBuffer",
+        });
     {
-        const uint32_t bc = geometryBufferRemainingByteCounts[dstBufferI];
-        if (bc >= byteCount)
-            break;
+        // The managing thread should only read the buffer array. A lock
+        // is only be needed for the append op on the worker side to
+        // sync those reads.
+        const std::lock_guard lock{geometryBuffersMutex};
+        geometryBuffers.push_back(WHEELS_MOV(buffer));
     }
 
-    WHEELS_ASSERT(byteCount <= sGeometryBufferSize);
+    const uint32_t bufferIndex =
+        geometryAllocator->addBuffer(bufferByteCount);
+    WHEELS_ASSERT(bufferIndex + 1 == geometryBuffers.size());
 
-    if (dstBufferI >= geometryBuffers.size())
-    {
-        gfx::Buffer buffer = gfx::gDevice.createBuffer(
-            gfx::BufferCreateInfo{
-                .desc =
-                    gfx::BufferDescription{
-                        .byteSize = sGeometryBufferSize,
-                        .usage =
-                            vk::BufferUsageFlagBits::
-                                eAccelerationStructureBuildInputReadOnlyKHR |
-                            vk::BufferUsageFlagBits::eShaderDeviceAddress |
-                            vk::BufferUsageFlagBits::eStorageBuffer |
-                            vk::BufferUsageFlagBits::eTransferDst,
-                        .properties = vk::MemoryPropertyFlagBits::eDeviceLocal,
-                    },
-                .cacheDeviceAddress = true,
-                .debugName = "GeometryBuffer",
-            });
-        {
-            // The managing thread should only read the buffer array. A lock
-            // is only be needed for the append op on the worker side to
-            // sync those reads.
-            const std::lock_guard lock{geometryBuffersMutex};
-            geometryBuffers.push_back(WHEELS_MOV(buffer));
-        }
-        geometryBufferRemainingByteCounts.push_back(sGeometryBufferSize);
-    }
+    range = geometryAllocator->allocate(byteCount, sGeometryAlignment);
+    WHEELS_ASSERT(range.has_value());
+    WHEELS_ASSERT(range->bufferIndex == bufferIndex);
 
-    return dstBufferI;
+    return *range;
 }
 
 } // namespace scene
@@ -2,25 +2,32 @@
 #define PROSPER_SCENE_DEFERRED_LOADING_CONTEXT
 
 #include "Allocators.hpp"
+#include "GeometryAllocator.hpp"
+#include "LoadingQueue.hpp"
 #include "Mesh.hpp"
 #include "Texture.hpp"
 #include "gfx/Fwd.hpp"
 #include "gfx/Resources.hpp"
 #include "scene/Fwd.hpp"
 #include "scene/Material.hpp"
+#include "utils/MappedFile.hpp"
 #include "utils/Timer.hpp"
 
 #include <atomic>
 #include <cgltf.h>
+#include <condition_variable>
 #include <filesystem>
+#include <fstream>
 #include <glm/glm.hpp>
 #include <mutex>
 #include <thread>
 #include <wheels/allocators/tlsf_allocator.hpp>
 #include <wheels/containers/array.hpp>
+#include <wheels/containers/hash_map.hpp>
 #include <wheels/containers/hash_set.hpp>
 #include <wheels/containers/optional.hpp>
 #include <wheels/containers/pair.hpp>
+#include <wheels/containers/span.hpp>
 #include <wheels/containers/static_array.hpp>
 #include <wheels/containers/string.hpp>
 
@@ -41,6 +48,9 @@ struct InputGeometryMetadata
     cgltf_accessor *normals{nullptr};
     cgltf_accessor *tangents{nullptr};
     cgltf_accessor *texCoord0s{nullptr};
+    // Baked into the texture coordinates as materials don't support
+    // KHR_texture_transform. gltfpack dequantizes texture coordinates with it.
+    wheels::Optional<cgltf_texture_transform> texCoord0Transform;
     uint32_t sourceMeshIndex{0xFFFF'FFFF};
     uint32_t sourcePrimitiveIndex{0xFFFF'FFFF};
 };
@@ -48,21 +58,80 @@ struct InputGeometryMetadata
 struct UploadedGeometryData
 {
     shader_structs::GeometryMetadata metadata;
+    // Meshes are uploaded in priority order instead of the glTF order
+    uint32_t meshIndex{0xFFFF'FFFF};
     uint32_t byteOffset{0};
     uint32_t byteCount{0};
     // This is valid while DeferredLoadingContext is
     wheels::StrSpan meshName;
+    // Set if the range was uploaded for an earlier mesh with identical source
+    // data. Ownership of the range has then already been transferred.
+    bool sharesEarlierRange{false};
 };
 
-gfx::Buffer createTextureStaging();
+struct LoadedTexture
+{
+    Texture2D texture;
+    // Images are loaded in priority order instead of the glTF order
+    uint32_t imageIndex{0xFFFF'FFFF};
+};
+
+// Texture uploads are pipelined through a ring of these
+struct TextureUploadSlot
+{
+    gfx::Buffer stagingBuffer;
+    vk::CommandBuffer cb;
+    // The slot can be reused when the upload semaphore reaches this value
+    uint64_t uploadValue{0};
+    // Published to the managing thread when the upload is done
+    wheels::Optional<LoadedTexture> texture;
+};
+
+// Parses the glTF and loads its buffers. The data is allocated from alloc, or
+// with malloc if it's null, and should be freed with cgltf_free().
+cgltf_data *loadGltf(
+    const std::filesystem::path &path, wheels::Allocator *alloc);
+
+// Gathers the input data of a glTF primitive. Vertex count and meshlet count
+// are updated when the mesh is processed.
+wheels::Pair<InputGeometryMetadata, MeshInfo> getInputGeometry(
+    const cgltf_data &gltfData, uint32_t meshIndex, uint32_t primitiveIndex);
+
+// Hashes the source data of the primitive. This is the key of its cache in the
+// mesh cache archive. Temporary data is allocated from alloc.
+uint64_t hashSourceData(
+    wheels::Allocator &alloc, const InputGeometryMetadata &metadata);
+
+// Base color images are sRGB, the rest are linear. Images that are only used
+// for one of normals, occlusion or roughness and metalness get that channel
+// usage, the ones that are missing are Color. Temporary data is allocated from
+// alloc.
+void collectImageUsages(
+    wheels::Allocator &alloc, const cgltf_data &gltfData,
+    wheels::HashSet<uint32_t> &sRgbImagesOut,
+    wheels::HashSet<uint32_t> &linearImagesOut,
+    wheels::HashMap<uint32_t, TextureChannelUsage> &channelUsagesOut);
+
+// Written mesh caches are meshopt encoded unless this is cleared. Reads handle
+// both so existing caches stay valid. Should be called before any caches are
+// written.
+void setMeshCacheCompression(bool compress);
+
+// Assumes at most 8bits per channel and leaves room for the mips
+gfx::Buffer createTextureStaging(uint32_t maxExtent);
 
 // Changes to this require changes to sMeshCacheVersion
 struct MeshCacheHeader
 {
-    std::filesystem::file_time_type sourceWriteTime;
+    // Hash of the source accessor data
+    uint64_t sourceHash{0};
     uint32_t indexCount{0};
     uint32_t vertexCount{0};
+    // Meshlets in LOD0, the coarser levels have less
     uint32_t meshletCount{0};
+    // Positions are stored as snorm relative to the object space AABB
+    glm::vec3 positionsCenter{0.f};
+    glm::vec3 positionsHalfExtent{0.f};
     // Offsets are for u32 values starting from the beginning of the blob.
     // The offset for indices is 0.
     uint32_t positionsOffset{0xFFFF'FFFF};
@@ -73,8 +142,24 @@ struct MeshCacheHeader
     uint32_t meshletBoundsOffset{0xFFFF'FFFF};
     uint32_t meshletVerticesOffset{0xFFFF'FFFF};
     uint32_t meshletTrianglesByteOffset{0xFFFF'FFFF};
+    uint32_t lodsOffset{0xFFFF'FFFF};
+    uint32_t lodCount{0};
     uint32_t usesShortIndices{0};
+    // Byte count of the uncompressed blob, i.e. the range in the geometry
+    // buffer
     uint32_t blobByteCount{0};
+    // Stored blob is meshopt encoded if set
+    uint32_t usesCompression{0};
+    uint32_t compressedBlobByteCount{0};
+};
+
+// Table of contents entry in the scene's mesh cache archive. Changes to this
+// require changes to sMeshCacheVersion
+struct MeshCacheArchiveEntry
+{
+    MeshCacheHeader header;
+    // From the beginning of the archive file
+    uint64_t blobByteOffset{0};
 };
 
 class DeferredLoadingContext
@@ -89,41 +174,107 @@ class DeferredLoadingContext
     DeferredLoadingContext &operator=(const DeferredLoadingContext &) = delete;
     DeferredLoadingContext &operator=(DeferredLoadingContext &&) = delete;
 
+    // Geometry ranges are allocated from geometryAllocator, which should
+    // outlive this context. The context takes ownership of inGltfData. Mesh
+    // and image inputs are copied from the snapshot. inGltfData is null when
+    // the world was set up from a stored snapshot and the worker only parses
+    // the glTF if some meshes are missing from the cache archive.
     void init(
-        std::filesystem::path inSceneDir,
-        std::filesystem::file_time_type inSceneWriteTime,
-        cgltf_data &inGltfData);
+        std::filesystem::path inScenePath, cgltf_data *inGltfData,
+        const SceneSnapshot &snapshot, GeometryAllocator &inGeometryAllocator);
 
     void launch();
     void kill();
 
+    // Fills the scene's mesh cache archive without touching the device. This is
+    // used for offline baking instead of init() and launch(), and the context
+    // can't be used for loading after it.
+    void bakeMeshCaches(
+        std::filesystem::path inSceneDir, cgltf_data &inGltfData);
+
+    // Returns the mapped upload staging, grown to fit byteCount. Uncompressed
+    // blobs that are read into it are uploaded without a copy.
+    [[nodiscard]] uint8_t *geometryUploadStaging(uint32_t byteCount);
     UploadedGeometryData uploadGeometryData(
         const MeshCacheHeader &cacheHeader,
-        const wheels::Array<uint8_t> &dataBlob, const wheels::String &meshName);
+        wheels::Span<const uint8_t> dataBlob, const wheels::String &meshName);
 
     // TODO:
     // Make worker context private?
     // Make shared context private and access through methods that handle
     // mutexes?
     bool initialized{false};
+    std::filesystem::path scenePath;
     std::filesystem::path sceneDir;
-    std::filesystem::file_time_type sceneWriteTime;
+    // These are set in init() and safe to read from any thread as the glTF
+    // might not be parsed at all
+    uint32_t meshCount{0};
+    uint32_t imageCount{0};
     // If there's no worker, main thread handles loading
     wheels::Optional<std::thread> worker;
+    // Mesh cache generation is spread over these while worker handles the
+    // uploads in order. worker launches these if any meshes are missing from
+    // the cache. 0 picks the count based on the hardware threads, set before
+    // launch() to override.
+    uint32_t meshWorkerCount{0};
+    wheels::Array<std::thread> meshWorkers{gAllocators.loadingWorker};
+    // Texture caches are decoded, mipped, compressed and written by these in
+    // priority order while worker uploads the ready ones. The count also caps
+    // the memory in flight as each one holds a scratch that fits the largest
+    // texture. 0 picks the count based on the hardware threads, set before
+    // launch() to override.
+    uint32_t textureWorkerCount{0};
+    size_t textureWorkerScratchByteCount{0};
+    wheels::Array<std::thread> textureWorkers{gAllocators.loadingWorker};
 
     // Worker context
     cgltf_data *gltfData{nullptr};
     vk::CommandBuffer cb;
     uint32_t workerLoadedImageCount{0};
+    // Staging for the next texture is filled while the transfer queue copies
+    // the previous ones. The semaphore is a timeline that the uploads signal
+    // in submission order.
+    wheels::Array<TextureUploadSlot> textureUploadSlots{
+        gAllocators.loadingWorker};
+    uint32_t nextTextureUploadSlot{0};
+    vk::Semaphore textureUploadSemaphore;
+    uint64_t textureUploadValue{0};
     wheels::HashSet<uint32_t> sRgbColorImages{gAllocators.loadingWorker};
     wheels::HashSet<uint32_t> linearColorImages{gAllocators.loadingWorker};
+    // Images that are missing are Color
+    wheels::HashMap<uint32_t, TextureChannelUsage> imageChannelUsages{
+        gAllocators.loadingWorker};
+    // Relative to sceneDir, empty if the image is embedded in the glTF
+    wheels::Array<wheels::String> imageUris{gAllocators.loadingWorker};
+    // The accessors are null until the worker needs them for generating caches
     wheels::Array<wheels::Pair<InputGeometryMetadata, MeshInfo>> meshes{
         gAllocators.loadingWorker};
+    // Filled for all meshes before the uploads begin as the uploads refer to
+    // these
     wheels::Array<wheels::String> meshNames{gAllocators.loadingWorker};
+    wheels::Array<uint64_t> meshHashes{gAllocators.loadingWorker};
+    // Index of the first mesh with identical source data, the mesh itself if
+    // it's the first one
+    wheels::Array<uint32_t> meshSourceIndices{gAllocators.loadingWorker};
+    // Chains the meshes with identical source data from the source mesh to its
+    // duplicates, 0xFFFF'FFFF ends the chain
+    wheels::Array<uint32_t> meshDuplicateLinks{gAllocators.loadingWorker};
+    // Indexed by mesh, byteCount of the data is zero until the mesh has been
+    // uploaded
+    wheels::Array<wheels::Pair<UploadedGeometryData, MeshInfo>>
+        workerUploadedMeshes{gAllocators.loadingWorker};
+    // Non-zero when the image has been loaded
+    wheels::Array<uint8_t> workerLoadedImages{gAllocators.loadingWorker};
     gfx::Buffer geometryUploadBuffer;
-    wheels::Array<uint32_t> geometryBufferRemainingByteCounts{
-        gAllocators.loadingWorker};
+    GeometryAllocator *geometryAllocator{nullptr};
     uint32_t workerLoadedMeshCount{0};
+    size_t meshCacheBytesRead{0};
+    size_t meshCacheBytesDecoded{0};
+    // Valid if there was an archive for the scene. Uploads read the mesh data
+    // straight from the mapping for the meshes that are found in it.
+    utils::MappedFile meshCacheArchive;
+    wheels::HashMap<uint64_t, uint32_t> meshCacheArchiveEntryIndices{
+        gAllocators.loadingWorker};
     utils::Timer meshTimer;
     utils::Timer textureTimer;
 
@@ -139,24 +290,76 @@ class DeferredLoadingContext
         gAllocators.loadingWorker};
 
     std::mutex loadedTexturesMutex;
-    wheels::Array<Texture2D> loadedTextures{gAllocators.loadingWorker};
+    wheels::Array<LoadedTexture> loadedTextures{gAllocators.loadingWorker};
+
+    // Written by the managing thread when they change and read by the
+    // workers when they reorder their loading queues. Higher is more urgent
+    // and ties are broken by the glTF order. These are sized in launch() and
+    // not resized after that.
+    std::mutex loadingPrioritiesMutex;
+    wheels::Array<float> meshPriorities{gAllocators.loadingWorker};
+    wheels::Array<float> imagePriorities{gAllocators.loadingWorker};
+    // Bumped under the lock when new priorities are published so that the
+    // queues are only reordered when they are stale
+    std::atomic<uint32_t> loadingPrioritiesGeneration{0};
 
     std::atomic<bool> interruptLoading{false};
 
+    // Meshes whose caches are missing, claimed by the mesh workers
+    std::mutex meshProcessingQueueMutex;
+    LoadingQueue meshProcessingQueue;
+    std::mutex processedMeshesMutex;
+    std::condition_variable processedMeshesCondition;
+    // Non-zero when the cache for the mesh is up to date
+    wheels::Array<uint8_t> processedMeshes{gAllocators.loadingWorker};
+    // Meshes whose caches are ready for upload, guarded by processedMeshesMutex
+    LoadingQueue meshUploadQueue;
+
+    // Used to write a new archive when some meshes were missing from
+    // meshCacheArchive. Mesh workers append the meshes they generate and the
+    // worker copies the rest over from the old archive. Both arrays are sized
+    // before the mesh workers launch so appends don't allocate.
+    std::mutex meshCacheArchiveMutex;
+    std::ofstream meshCacheArchiveWriter;
+    // Open on the new archive for as long as the writer so that the uploads
+    // read the appended meshes back without reopening it for each mesh. Only
+    // used by the worker.
+    std::ifstream meshCacheArchiveReader;
+    // Compressed blobs read back from the new archive are decoded from here.
+    // Grows to the largest blob and is only used by the worker.
+    wheels::Array<uint8_t> meshCacheArchiveReadBlob{gAllocators.loadingWorker};
+    wheels::Array<MeshCacheArchiveEntry> meshCacheArchiveEntries{
+        gAllocators.loadingWorker};
+    // Indexed by mesh, index into meshCacheArchiveEntries for the meshes
+    // appended by the mesh workers. Written before processedMeshes is set.
+    wheels::Array<uint32_t> meshCacheArchiveWorkerEntries{
+        gAllocators.loadingWorker};
+
+    std::mutex processedImagesMutex;
+    std::condition_variable processedImagesCondition;
+    // Images that no texture worker has picked up yet, guarded by
+    // processedImagesMutex
+    LoadingQueue imageProcessingQueue;
+    // Non-zero when the texture worker is done with the image's cache
+    wheels::Array<uint8_t> processedImages{gAllocators.loadingWorker};
+    // Images whose caches are ready for upload, guarded by
+    // processedImagesMutex
+    LoadingQueue imageUploadQueue;
+
     // Main context
-    uint32_t geometryGeneration{0};
-    uint32_t materialsGeneration{0};
     uint32_t framesSinceFinish{0};
-    uint32_t textureArrayBinding{0};
     uint32_t loadedMeshCount{0};
     uint32_t loadedImageCount{0};
     uint32_t loadedMaterialCount{0};
     wheels::Array<shader_structs::MaterialData> materials{
         gAllocators.loadingWorker};
-    gfx::Buffer stagingBuffer;
+    // Non-zero when the image's descriptor has been written
+    wheels::Array<uint8_t> loadedImages{gAllocators.loadingWorker};
+    // Non-zero when the material has been updated with its textures
+    wheels::Array<uint8_t> loadedMaterials{gAllocators.loadingWorker};
 
   private:
-    uint32_t getGeometryBuffer(uint32_t byteCount);
+    GeometryRange allocateGeometry(uint32_t byteCount);
 };
 
 } // namespace scene
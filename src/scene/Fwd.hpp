@@ -24,6 +24,10 @@ struct DebugLines;
 // DeferredLoadingContext.hpp
 class DeferredLoadingContext;
 
+// GeometryAllocator.hpp
+struct GeometryRange;
+class GeometryAllocator;
+
 // Lights.hpp
 struct DirectionalLight;
 struct PointLights;
@@ -39,6 +43,9 @@ struct ModelInstance;
 // Scene.hpp
 struct Scene;
 
+// SceneSnapshot.hpp
+struct SceneSnapshot;
+
 // Texture.hpp
 class Texture;
 class Texture2D;
@@ -0,0 +1,252 @@
+#include "GeometryAllocator.hpp"
+
+#include "utils/Utils.hpp"
+
+#include <wheels/allocators/utils.hpp>
+
+using namespace wheels;
+
+namespace scene
+{
+
+namespace
+{
+
+bool isBefore(const GeometryRange &lhs, const GeometryRange &rhs)
+{
+    return lhs.bufferIndex < rhs.bufferIndex ||
+           (lhs.bufferIndex == rhs.bufferIndex &&
+            lhs.byteOffset < rhs.byteOffset);
+}
+
+} // namespace
+
+GeometryAllocator::GeometryAllocator()
+: m_alloc{megabytes(1)}
+{
+}
+
+uint32_t GeometryAllocator::addBuffer(uint32_t byteCount)
+{
+    WHEELS_ASSERT(byteCount > 0);
+
+    const std::lock_guard lock{m_mutex};
+
+    const uint32_t bufferIndex =
+        asserted_cast<uint32_t>(m_bufferByteCounts.size());
+    m_bufferByteCounts.push_back(byteCount);
+    // Buffer indices only grow so the new range goes last
+    m_freeRanges.push_back(
+        GeometryRange{
+            .bufferIndex = bufferIndex,
+            .byteOffset = 0,
+            .byteCount = byteCount,
+        });
+
+    return bufferIndex;
+}
+
+Optional<GeometryRange> GeometryAllocator::allocate(
+    uint32_t byteCount, uint32_t alignment)
+{
+    const std::lock_guard lock{m_mutex};
+
+    // No buffer has this index so all ranges are considered
+    const GeometryRange end{
+        .bufferIndex = 0xFFFF'FFFF,
+        .byteOffset = 0,
+    };
+
+    return allocateFirstFit(byteCount, alignment, end);
+}
+
+Optional<GeometryRange> GeometryAllocator::allocateBefore(
+    const GeometryRange &range, uint32_t alignment)
+{
+    const std::lock_guard lock{m_mutex};
+
+    return allocateFirstFit(range.byteCount, alignment, range);
+}
+
+void GeometryAllocator::release(const GeometryRange &range)
+{
+    WHEELS_ASSERT(range.byteCount > 0);
+
+    const std::lock_guard lock{m_mutex};
+
+    WHEELS_ASSERT(range.bufferIndex < m_bufferByteCounts.size());
+    WHEELS_ASSERT(
+        range.byteOffset + range.byteCount <=
+        m_bufferByteCounts[range.bufferIndex]);
+
+    size_t index = 0;
+    const size_t freeRangeCount = m_freeRanges.size();
+    while (index < freeRangeCount && isBefore(m_freeRanges[index], range))
+        index++;
+
+    // Insert in order by bubbling the new range down from the back
+    m_freeRanges.push_back(range);
+    for (size_t i = m_freeRanges.size() - 1; i > index; --i)
+        std::swap(m_freeRanges[i], m_freeRanges[i - 1]);
+
+    if (index + 1 < m_freeRanges.size())
+    {
+        const GeometryRange &next = m_freeRanges[index + 1];
+        if (next.bufferIndex == range.bufferIndex)
+        {
+            WHEELS_ASSERT(
+                range.byteOffset + range.byteCount <= next.byteOffset &&
+                "Released range overlaps a free range");
+            if (range.byteOffset + range.byteCount == next.byteOffset)
+            {
+                m_freeRanges[index].byteCount += next.byteCount;
+                m_freeRanges.erase(index + 1);
+            }
+        }
+    }
+
+    if (index > 0)
+    {
+        GeometryRange &previous = m_freeRanges[index - 1];
+        if (previous.bufferIndex == range.bufferIndex)
+        {
+            WHEELS_ASSERT(
+                previous.byteOffset + previous.byteCount <= range.byteOffset &&
+                "Released range overlaps a free range");
+            if (previous.byteOffset + previous.byteCount == range.byteOffset)
+            {
+                previous.byteCount += m_freeRanges[index].byteCount;
+                m_freeRanges.erase(index);
+            }
+        }
+    }
+}
+
+uint32_t GeometryAllocator::removeEmptyTrailingBuffers()
+{
+    const std::lock_guard lock{m_mutex};
+
+    // An empty buffer has a single free range that covers all of it and that's
+    // the last free range if the buffer is the last one
+    while (!m_bufferByteCounts.empty() && !m_freeRanges.empty())
+    {
+        const uint32_t bufferIndex =
+            asserted_cast<uint32_t>(m_bufferByteCounts.size() - 1);
+        const GeometryRange &lastFree = m_freeRanges.back();
+        if (lastFree.bufferIndex != bufferIndex || lastFree.byteOffset != 0 ||
+            lastFree.byteCount != m_bufferByteCounts.back())
+            break;
+
+        m_freeRanges.pop_back();
+        m_bufferByteCounts.pop_back();
+    }
+
+    return asserted_cast<uint32_t>(m_bufferByteCounts.size());
+}
+
+uint32_t GeometryAllocator::bufferCount() const
+{
+    const std::lock_guard lock{m_mutex};
+
+    return asserted_cast<uint32_t>(m_bufferByteCounts.size());
+}
+
+uint32_t GeometryAllocator::usedByteCount(uint32_t bufferIndex) const
+{
+    const std::lock_guard lock{m_mutex};
+
+    WHEELS_ASSERT(bufferIndex < m_bufferByteCounts.size());
+    const uint32_t bufferByteCount = m_bufferByteCounts[bufferIndex];
+
+    // Only the last free range of the buffer can reach its end
+    const GeometryRange *lastFree = nullptr;
+    for (const GeometryRange &range : m_freeRanges)
+    {
+        if (range.bufferIndex > bufferIndex)
+            break;
+        if (range.bufferIndex == bufferIndex)
+            lastFree = &range;
+    }
+
+    if (lastFree != nullptr &&
+        lastFree->byteOffset + lastFree->byteCount == bufferByteCount)
+        return lastFree->byteOffset;
+
+    return bufferByteCount;
+}
+
+size_t GeometryAllocator::freeByteCount() const
+{
+    const std::lock_guard lock{m_mutex};
+
+    size_t ret = 0;
+    for (const GeometryRange &range : m_freeRanges)
+        ret += range.byteCount;
+
+    return ret;
+}
+
+Optional<GeometryRange> GeometryAllocator::allocateFirstFit(
+    uint32_t byteCount, uint32_t alignment, const GeometryRange &end)
+{
+    WHEELS_ASSERT(byteCount > 0);
+    WHEELS_ASSERT(alignment > 0);
+
+    const size_t freeRangeCount = m_freeRanges.size();
+    for (size_t i = 0; i < freeRangeCount; ++i)
+    {
+        const GeometryRange freeRange = m_freeRanges[i];
+        if (freeRange.bufferIndex > end.bufferIndex)
+            break;
+
+        const uint32_t placementOffset = asserted_cast<uint32_t>(
+            aligned_offset(freeRange.byteOffset, alignment));
+        const uint32_t paddingByteCount =
+            placementOffset - freeRange.byteOffset;
+        if (paddingByteCount + byteCount > freeRange.byteCount)
+            continue;
+
+        // Ranges are sorted so nothing later in this buffer can be placed
+        // before end either
+        if (freeRange.bufferIndex == end.bufferIndex &&
+            placementOffset + byteCount > end.byteOffset)
+            break;
+
+        const uint32_t tailOffset = placementOffset + byteCount;
+        const uint32_t tailByteCount =
+            freeRange.byteOffset + freeRange.byteCount - tailOffset;
+
+        if (paddingByteCount > 0)
+        {
+            m_freeRanges[i].byteCount = paddingByteCount;
+            if (tailByteCount > 0)
+            {
+                m_freeRanges.push_back(
+                    GeometryRange{
+                        .bufferIndex = freeRange.bufferIndex,
+                        .byteOffset = tailOffset,
+                        .byteCount = tailByteCount,
+                    });
+                for (size_t j = m_freeRanges.size() - 1; j > i + 1; --j)
+                    std::swap(m_freeRanges[j], m_freeRanges[j - 1]);
+            }
+        }
+        else if (tailByteCount > 0)
+        {
+            m_freeRanges[i].byteOffset = tailOffset;
+            m_freeRanges[i].byteCount = tailByteCount;
+        }
+        else
+            m_freeRanges.erase(i);
+
+        return GeometryRange{
+            .bufferIndex = freeRange.bufferIndex,
+            .byteOffset = placementOffset,
+            .byteCount = byteCount,
+        };
+    }
+
+    return {};
+}
+
+} // namespace scene
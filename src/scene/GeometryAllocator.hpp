@@ -0,0 +1,76 @@
+#ifndef PROSPER_SCENE_GEOMETRY_ALLOCATOR_HPP
+#define PROSPER_SCENE_GEOMETRY_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <wheels/allocators/tlsf_allocator.hpp>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/optional.hpp>
+
+namespace scene
+{
+
+// Many offsets into the geometry buffers are for u32
+constexpr uint32_t sGeometryAlignment = sizeof(uint32_t);
+
+struct GeometryRange
+{
+    uint32_t bufferIndex{0xFFFF'FFFF};
+    uint32_t byteOffset{0};
+    uint32_t byteCount{0};
+};
+
+// Sub-allocates mesh data ranges from the bindless geometry buffers. Only the
+// ranges are tracked here, the buffers themselves are created and owned by the
+// users. This is thread safe as the deferred loading worker allocates while the
+// main thread compacts.
+class GeometryAllocator
+{
+  public:
+    GeometryAllocator();
+    ~GeometryAllocator() = default;
+
+    GeometryAllocator(const GeometryAllocator &other) = delete;
+    GeometryAllocator(GeometryAllocator &&other) = delete;
+    GeometryAllocator &operator=(const GeometryAllocator &other) = delete;
+    GeometryAllocator &operator=(GeometryAllocator &&other) = delete;
+
+    // Returns the index of the added buffer
+    uint32_t addBuffer(uint32_t byteCount);
+
+    // Returns the lowest placement that fits the byte count or an empty
+    // optional if none of the buffers has room for it
+    [[nodiscard]] wheels::Optional<GeometryRange> allocate(
+        uint32_t byteCount, uint32_t alignment);
+    // Returns the lowest placement for range that's in an earlier buffer or at
+    // a lower offset in the same one, if there is one
+    [[nodiscard]] wheels::Optional<GeometryRange> allocateBefore(
+        const GeometryRange &range, uint32_t alignment);
+    void release(const GeometryRange &range);
+    // Removes the buffers at the end that have no allocations left. Returns the
+    // remaining buffer count, the users are expected to destroy the removed
+    // buffers once they are no longer in use.
+    uint32_t removeEmptyTrailingBuffers();
+
+    [[nodiscard]] uint32_t bufferCount() const;
+    // Returns the end of the last allocated range in the buffer, 0 if there is
+    // none
+    [[nodiscard]] uint32_t usedByteCount(uint32_t bufferIndex) const;
+    [[nodiscard]] size_t freeByteCount() const;
+
+  private:
+    [[nodiscard]] wheels::Optional<GeometryRange> allocateFirstFit(
+        uint32_t byteCount, uint32_t alignment, const GeometryRange &end);
+
+    mutable std::mutex m_mutex;
+    // The global allocators aren't thread safe. This has to be declared before
+    // the arrays so that it's destroyed after them.
+    wheels::TlsfAllocator m_alloc;
+    // Kept sorted by buffer index and offset, adjacent ranges are coalesced
+    wheels::Array<GeometryRange> m_freeRanges{m_alloc};
+    wheels::Array<uint32_t> m_bufferByteCounts{m_alloc};
+};
+
+} // namespace scene
+
+#endif // PROSPER_SCENE_GEOMETRY_ALLOCATOR_HPP
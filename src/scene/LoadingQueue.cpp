@@ -0,0 +1,74 @@
+#include "LoadingQueue.hpp"
+
+#include "utils/Utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace wheels;
+
+namespace scene
+{
+
+void LoadingQueue::init(uint32_t indexCount)
+{
+    m_heap.clear();
+    m_heap.reserve(indexCount);
+    m_priorities.resize(indexCount);
+    memset(m_priorities.data(), 0, m_priorities.size() * sizeof(float));
+    m_generation = 0;
+}
+
+void LoadingQueue::push(uint32_t index)
+{
+    WHEELS_ASSERT(index < m_priorities.size());
+    WHEELS_ASSERT(
+        m_heap.size() < m_heap.capacity() &&
+        "Queue should have room for all indices");
+
+    m_heap.push_back(index);
+    std::push_heap(
+        m_heap.begin(), m_heap.end(),
+        [this](uint32_t lhs, uint32_t rhs) { return isLess(lhs, rhs); });
+}
+
+Optional<uint32_t> LoadingQueue::pop()
+{
+    if (m_heap.empty())
+        return {};
+
+    std::pop_heap(
+        m_heap.begin(), m_heap.end(),
+        [this](uint32_t lhs, uint32_t rhs) { return isLess(lhs, rhs); });
+
+    return m_heap.pop_back();
+}
+
+void LoadingQueue::reorder(Span<const float> priorities, uint32_t generation)
+{
+    WHEELS_ASSERT(priorities.size() == m_priorities.size());
+
+    memcpy(
+        m_priorities.data(), priorities.data(),
+        m_priorities.size() * sizeof(float));
+    std::make_heap(
+        m_heap.begin(), m_heap.end(),
+        [this](uint32_t lhs, uint32_t rhs) { return isLess(lhs, rhs); });
+    m_generation = generation;
+}
+
+bool LoadingQueue::empty() const { return m_heap.empty(); }
+
+uint32_t LoadingQueue::generation() const { return m_generation; }
+
+bool LoadingQueue::isLess(uint32_t lhs, uint32_t rhs) const
+{
+    const float lhsPriority = m_priorities[lhs];
+    const float rhsPriority = m_priorities[rhs];
+    if (lhsPriority != rhsPriority)
+        return lhsPriority < rhsPriority;
+    // Earlier indices go first on ties
+    return lhs > rhs;
+}
+
+} // namespace scene
@@ -0,0 +1,53 @@
+#ifndef PROSPER_SCENE_LOADING_QUEUE_HPP
+#define PROSPER_SCENE_LOADING_QUEUE_HPP
+
+#include "Allocators.hpp"
+
+#include <cstdint>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/optional.hpp>
+#include <wheels/containers/span.hpp>
+
+namespace scene
+{
+
+// Max heap of mesh or image indices ordered by their loading priorities, ties
+// are broken by the lower index. The priorities are copied in when the queue
+// is reordered so that the heap stays valid while newer ones are published.
+// This is not thread safe and each index should be queued at most once at a
+// time.
+class LoadingQueue
+{
+  public:
+    LoadingQueue() noexcept = default;
+    ~LoadingQueue() = default;
+
+    LoadingQueue(const LoadingQueue &other) = delete;
+    LoadingQueue(LoadingQueue &&other) = delete;
+    LoadingQueue &operator=(const LoadingQueue &other) = delete;
+    LoadingQueue &operator=(LoadingQueue &&other) = delete;
+
+    // Reserves room for the indices [0, indexCount) so that pushes don't
+    // allocate. All priorities start at 0.
+    void init(uint32_t indexCount);
+
+    void push(uint32_t index);
+    [[nodiscard]] wheels::Optional<uint32_t> pop();
+    // Reorders the queued indices by priorities, generation identifies the
+    // published priorities
+    void reorder(wheels::Span<const float> priorities, uint32_t generation);
+
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] uint32_t generation() const;
+
+  private:
+    [[nodiscard]] bool isLess(uint32_t lhs, uint32_t rhs) const;
+
+    wheels::Array<uint32_t> m_heap{gAllocators.loadingWorker};
+    wheels::Array<float> m_priorities{gAllocators.loadingWorker};
+    uint32_t m_generation{0};
+};
+
+} // namespace scene
+
+#endif // PROSPER_SCENE_LOADING_QUEUE_HPP
@@ -8,8 +8,12 @@
 namespace scene
 {
 
-constexpr vk::Format sVertexPositionFormat = vk::Format::eR16G16B16A16Sfloat;
-constexpr uint32_t sVertexPositionByteSize = 8;
+// Positions are tightly packed r16g16b16_snorm relative to the mesh AABB. The
+// BLAS build reads them with the four component format as the three component
+// one isn't guaranteed to be supported. The fourth component overlaps the next
+// vertex and is ignored.
+constexpr vk::Format sVertexPositionFormat = vk::Format::eR16G16B16A16Snorm;
+constexpr uint32_t sVertexPositionByteSize = 6;
 constexpr vk::Format sVertexNormalFormat = vk::Format::eA2B10G10R10SnormPack32;
 constexpr vk::Format sVertexTangentFormat = vk::Format::eA2B10G10R10SnormPack32;
 constexpr vk::Format sVertexTexCoord0Format = vk::Format::eR16G16Sfloat;
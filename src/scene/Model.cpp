@@ -0,0 +1,53 @@
+#include "Model.hpp"
+
+#include <algorithm>
+#include <glm/gtc/matrix_access.hpp>
+
+using namespace glm;
+
+namespace scene
+{
+
+namespace
+{
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+bool relativeEq(float a, float b, float maxRelativeDiff)
+{
+    const float diff = std::abs(a - b);
+    const float maxMagnitude = std::max(std::abs(a), std::abs(b));
+    const float scaledEpsilon = maxRelativeDiff * maxMagnitude;
+    return diff < scaledEpsilon;
+}
+
+} // namespace
+
+void ModelInstance::updateTransforms(const mat4 &modelToWorld4x4)
+{
+    const mat3x4 modelToWorld = transpose(modelToWorld4x4);
+    // No transpose as mat4->mat3x4 effectively does it
+    const mat3x4 normalToWorld = inverse(modelToWorld4x4);
+
+    transforms = shader_structs::ModelInstanceTransforms{
+        .modelToWorld = modelToWorld,
+        .normalToWorld = normalToWorld,
+    };
+}
+
+float ModelInstance::uniformScale() const
+{
+    const mat3x4 &modelToWorld = transforms.modelToWorld;
+    // lengths of rows instead of columns because of the transposed 3x4
+    const vec3 scale{
+        length(row(modelToWorld, 0)), length(row(modelToWorld, 1)),
+        length(row(modelToWorld, 2))};
+
+    // 0.1mm precision should be plenty
+    const float tolerance = 0.0001f;
+    if (relativeEq(scale.x, scale.y, tolerance) &&
+        relativeEq(scale.x, scale.z, tolerance))
+        return scale.x;
+    return 0.f;
+}
+
+} // namespace scene
@@ -3,6 +3,7 @@
 
 #include "Allocators.hpp"
 
+#include <glm/glm.hpp>
 #include <shader_structs/scene/model_instance_transforms.h>
 #include <wheels/allocators/allocator.hpp>
 #include <wheels/containers/array.hpp>
@@ -27,6 +28,10 @@ struct ModelInstance
     uint32_t modelIndex{0xFFFF'FFFF};
     shader_structs::ModelInstanceTransforms transforms;
     wheels::StrSpan fullName;
+
+    void updateTransforms(const glm::mat4 &modelToWorld4x4);
+    // Zero if the scale is non-uniform
+    [[nodiscard]] float uniformScale() const;
 };
 
 } // namespace scene
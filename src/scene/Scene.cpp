@@ -0,0 +1,256 @@
+#include "Scene.hpp"
+
+#include "utils/Utils.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace glm;
+using namespace wheels;
+
+namespace scene
+{
+
+namespace
+{
+
+void updateDirectionalLight(Scene &scene)
+{
+    const mat4 &modelToWorld4x4 =
+        scene.nodes.worldTransforms[scene.directionalLightNode];
+    auto &parameters = scene.lights.directionalLight.parameters;
+    parameters.direction =
+        vec4{mat3{modelToWorld4x4} * vec3{0.f, 0.f, -1.f}, 0.f};
+}
+
+void updatePointLight(Scene &scene, uint32_t i)
+{
+    const mat4 &modelToWorld4x4 =
+        scene.nodes.worldTransforms[scene.pointLightNodes[i]];
+    shader_structs::PointLight &sceneLight = scene.lights.pointLights.data[i];
+
+    sceneLight.position = modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f};
+}
+
+void updateSpotLight(Scene &scene, uint32_t i)
+{
+    const mat4 &modelToWorld4x4 =
+        scene.nodes.worldTransforms[scene.spotLightNodes[i]];
+    shader_structs::SpotLight &sceneLight = scene.lights.spotLights.data[i];
+
+    const vec3 position = vec3{modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f}};
+    sceneLight.positionAndAngleOffset.x = position.x;
+    sceneLight.positionAndAngleOffset.y = position.y;
+    sceneLight.positionAndAngleOffset.z = position.z;
+
+    sceneLight.direction =
+        vec4{mat3{modelToWorld4x4} * vec3{0.f, 0.f, -1.f}, 0.f};
+}
+
+} // namespace
+
+uint32_t Scene::Nodes::size() const
+{
+    return asserted_cast<uint32_t>(parents.size());
+}
+
+void Scene::Nodes::reserve(size_t capacity)
+{
+    parents.reserve(capacity);
+    flags.reserve(capacity);
+    translations.reserve(capacity);
+    rotations.reserve(capacity);
+    scales.reserve(capacity);
+    worldTransforms.reserve(capacity);
+    gltfSourceNodes.reserve(capacity);
+    fullNames.reserve(capacity);
+}
+
+uint32_t Scene::Nodes::push_back(
+    uint32_t parent, uint32_t gltfSourceNode, String &&fullName)
+{
+    WHEELS_ASSERT(
+        (parent == sNoNode || parent < size()) &&
+        "Parents have to be added before their children");
+
+    const uint32_t ret = size();
+
+    parents.push_back(parent);
+    flags.push_back(0);
+    translations.emplace_back(0.f);
+    rotations.emplace_back(1.f, 0.f, 0.f, 0.f);
+    scales.emplace_back(1.f);
+    worldTransforms.emplace_back(1.f);
+    gltfSourceNodes.push_back(gltfSourceNode);
+    fullNames.push_back(WHEELS_MOV(fullName));
+
+    return ret;
+}
+
+void Scene::Nodes::updateWorldTransform(uint32_t node)
+{
+    const uint32_t parent = parents[node];
+    const uint32_t nodeFlags = flags[node];
+
+    mat4 modelToWorld4x4 =
+        parent != sNoNode ? worldTransforms[parent] : mat4{1.f};
+    if ((nodeFlags & NodeFlags_Translation) != 0)
+        modelToWorld4x4 = translate(modelToWorld4x4, translations[node]);
+    if ((nodeFlags & NodeFlags_Rotation) != 0)
+        modelToWorld4x4 *= mat4_cast(rotations[node]);
+    if ((nodeFlags & NodeFlags_Scale) != 0)
+        modelToWorld4x4 = scale(modelToWorld4x4, scales[node]);
+
+    worldTransforms[node] = modelToWorld4x4;
+}
+
+void Scene::initTransforms()
+{
+    const auto isDynamic = [this](uint32_t node)
+    { return (nodes.flags[node] & NodeFlags_DynamicTransform) != 0; };
+
+    // Parents are before their children so one pass propagates the dynamic
+    // flags
+    size_t dynamicNodeCount = 0;
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+    {
+        const uint32_t parent = nodes.parents[i];
+        if (parent != sNoNode && isDynamic(parent))
+            nodes.flags[i] |= NodeFlags_DynamicTransform;
+
+        if (isDynamic(i))
+            dynamicNodeCount++;
+    }
+
+    dynamicNodes.reserve(dynamicNodeCount);
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+    {
+        if (isDynamic(i))
+            dynamicNodes.push_back(i);
+    }
+
+    // Static instance transforms are uploaded once so they have to be known
+    // before the first update
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+        nodes.updateWorldTransform(i);
+
+    size_t dynamicInstanceCount = 0;
+    for (uint32_t mi = 0; mi < modelInstances.size(); ++mi)
+    {
+        const uint32_t node = modelInstanceNodes[mi];
+        modelInstances[mi].updateTransforms(nodes.worldTransforms[node]);
+        if (isDynamic(node))
+            dynamicInstanceCount++;
+    }
+
+    dynamicModelInstances.reserve(dynamicInstanceCount);
+    modelInstanceTransformIndices.reserve(modelInstances.size());
+    uint32_t staticInstanceCount = 0;
+    for (uint32_t mi = 0; mi < modelInstances.size(); ++mi)
+    {
+        if (isDynamic(modelInstanceNodes[mi]))
+        {
+            modelInstanceTransformIndices.push_back(
+                asserted_cast<uint32_t>(dynamicModelInstances.size()) |
+                shader_structs::DynamicTransformBit);
+            dynamicModelInstances.push_back(mi);
+        }
+        else
+            modelInstanceTransformIndices.push_back(staticInstanceCount++);
+    }
+
+    // Lights are written here so that updates only have to touch the dynamic
+    // ones
+    if (directionalLightNode != sNoNode)
+        updateDirectionalLight(*this);
+
+    for (uint32_t i = 0; i < pointLightNodes.size(); ++i)
+    {
+        updatePointLight(*this, i);
+        if (isDynamic(pointLightNodes[i]))
+            dynamicPointLights.push_back(i);
+    }
+
+    for (uint32_t i = 0; i < spotLightNodes.size(); ++i)
+    {
+        updateSpotLight(*this, i);
+        if (isDynamic(spotLightNodes[i]))
+            dynamicSpotLights.push_back(i);
+    }
+}
+
+void Scene::updateTransforms(ScopedScratch scopeAlloc)
+{
+    if (dirtyNodes.empty())
+    {
+        // Parents of dynamic nodes are either dynamic and come before them or
+        // static and cached
+        for (const uint32_t node : dynamicNodes)
+            nodes.updateWorldTransform(node);
+
+        for (const uint32_t mi : dynamicModelInstances)
+            modelInstances[mi].updateTransforms(
+                nodes.worldTransforms[modelInstanceNodes[mi]]);
+
+        if (directionalLightNode != sNoNode)
+        {
+            const uint32_t flags = nodes.flags[directionalLightNode];
+            if ((flags & NodeFlags_DynamicTransform) != 0)
+                updateDirectionalLight(*this);
+        }
+        for (const uint32_t i : dynamicPointLights)
+            updatePointLight(*this, i);
+        for (const uint32_t i : dynamicSpotLights)
+            updateSpotLight(*this, i);
+
+        return;
+    }
+
+    // Editor moves can touch static nodes so let's also recompute everything
+    // under the dirty ones
+    Array<bool> updated{scopeAlloc};
+    updated.resize(nodes.size(), false);
+    for (const uint32_t node : dirtyNodes)
+        updated[node] = true;
+    dirtyNodes.clear();
+
+    for (uint32_t node = 0; node < nodes.size(); ++node)
+    {
+        const uint32_t parent = nodes.parents[node];
+        updated[node] = updated[node] ||
+                        (nodes.flags[node] & NodeFlags_DynamicTransform) != 0 ||
+                        (parent != sNoNode && updated[parent]);
+        if (updated[node])
+            nodes.updateWorldTransform(node);
+    }
+
+    for (uint32_t mi = 0; mi < modelInstances.size(); ++mi)
+    {
+        const uint32_t node = modelInstanceNodes[mi];
+        if (!updated[node])
+            continue;
+
+        ModelInstance &instance = modelInstances[mi];
+        const mat3x4 previousModelToWorld = instance.transforms.modelToWorld;
+        instance.updateTransforms(nodes.worldTransforms[node]);
+
+        // Dynamic instances are written into the ring every frame anyway
+        if ((nodes.flags[node] & NodeFlags_DynamicTransform) == 0 &&
+            instance.transforms.modelToWorld != previousModelToWorld)
+            dirtyStaticModelInstances.push_back(mi);
+    }
+
+    if (directionalLightNode != sNoNode && updated[directionalLightNode])
+        updateDirectionalLight(*this);
+    for (uint32_t i = 0; i < pointLightNodes.size(); ++i)
+    {
+        if (updated[pointLightNodes[i]])
+            updatePointLight(*this, i);
+    }
+    for (uint32_t i = 0; i < spotLightNodes.size(); ++i)
+    {
+        if (updated[spotLightNodes[i]])
+            updateSpotLight(*this, i);
+    }
+}
+
+} // namespace scene
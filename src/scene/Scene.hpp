@@ -10,7 +10,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <wheels/allocators/allocator.hpp>
+#include <wheels/allocators/scoped_scratch.hpp>
 #include <wheels/containers/array.hpp>
+#include <wheels/containers/string.hpp>
 
 namespace scene
 {
@@ -18,29 +20,49 @@ namespace scene
 struct Scene
 {
     static const uint32_t sDirectionalLight = 0xFFFF'FFFF;
+    static const uint32_t sNoNode = 0xFFFF'FFFF;
 
-    // TODO:
-    // More cache/memory friendly storage?
-    // Shared bitfield for populated members instead of optionals?
-    struct Node
+    // Transform components that a node doesn't have are stored as identity and
+    // left out of its flags
+    enum NodeFlags : uint32_t
     {
-        uint32_t gltfSourceNode{0};
-        uint32_t firstChild{0};
-        uint32_t lastChild{0};
-        wheels::Optional<uint32_t> parent;
-        wheels::Optional<glm::vec3> translation;
-        wheels::Optional<glm::quat> rotation;
-        wheels::Optional<glm::vec3> scale;
-        wheels::Optional<uint32_t> modelIndex;
-        wheels::Optional<uint32_t> modelInstance;
-        wheels::Optional<uint32_t> camera;
-        wheels::Optional<uint32_t> pointLight;
-        wheels::Optional<uint32_t> spotLight;
-        bool directionalLight{false};
-        // True if either this node's or one of its parents' transform is
+        NodeFlags_Translation = 0x1,
+        NodeFlags_Rotation = 0x2,
+        NodeFlags_Scale = 0x4,
+        // Set if either this node's or one of its parents' transform is
         // animated
-        bool dynamicTransform{false};
-        wheels::StrSpan fullName;
+        NodeFlags_DynamicTransform = 0x8,
+    };
+
+    // Nodes are stored as separate arrays with parents always before their
+    // children so that transforms propagate in a single pass over them
+    struct Nodes
+    {
+        // sNoNode for roots
+        wheels::Array<uint32_t> parents{gAllocators.world};
+        wheels::Array<uint32_t> flags{gAllocators.world};
+        wheels::Array<glm::vec3> translations{gAllocators.world};
+        wheels::Array<glm::quat> rotations{gAllocators.world};
+        wheels::Array<glm::vec3> scales{gAllocators.world};
+        // World transforms as of the previous update
+        wheels::Array<glm::mat4> worldTransforms{gAllocators.world};
+        wheels::Array<uint32_t> gltfSourceNodes{gAllocators.world};
+        wheels::Array<wheels::String> fullNames{gAllocators.world};
+
+        [[nodiscard]] uint32_t size() const;
+        void reserve(size_t capacity);
+        // Appends a node with an identity transform and returns its index
+        uint32_t push_back(
+            uint32_t parent, uint32_t gltfSourceNode,
+            wheels::String &&fullName);
+        // Parent's world transform has to be up to date
+        void updateWorldTransform(uint32_t node);
+    };
+
+    struct CameraNode
+    {
+        uint32_t camera{0};
+        uint32_t node{sNoNode};
     };
 
     struct Lights
@@ -50,14 +72,51 @@ struct Scene
         SpotLights spotLights;
     };
 
-    wheels::Array<Node> nodes{gAllocators.world};
-    wheels::Array<wheels::String> fullNodeNames{gAllocators.world};
+    Nodes nodes;
     wheels::Array<uint32_t> rootNodes{gAllocators.world};
+    // Nodes with NodeFlags_DynamicTransform in ascending order, which keeps
+    // parents before their children. These are recomputed on every update.
+    wheels::Array<uint32_t> dynamicNodes{gAllocators.world};
+    // Nodes whose transform was changed outside animations, e.g. by an editor.
+    // Their subtrees are recomputed on the next update. General because this
+    // is refilled at runtime.
+    wheels::Array<uint32_t> dirtyNodes{gAllocators.general};
     float endTimeS{0.f};
 
     wheels::Array<ModelInstance> modelInstances{gAllocators.world};
+    // Node of each model instance
+    wheels::Array<uint32_t> modelInstanceNodes{gAllocators.world};
+    // Model instances with dynamic nodes in the order their transforms are
+    // written into the per-frame ring. The rest have their transforms and
+    // scales uploaded once into the static buffers.
+    wheels::Array<uint32_t> dynamicModelInstances{gAllocators.world};
+    // Index of each model instance's transforms in either the ring or the
+    // static buffers, the former with DynamicTransformBit set
+    wheels::Array<uint32_t> modelInstanceTransformIndices{gAllocators.world};
+    // Static model instances whose transforms were changed by dirty nodes.
+    // These are re-uploaded into the static buffers by the next buffer
+    // update. General because this is refilled at runtime.
+    wheels::Array<uint32_t> dirtyStaticModelInstances{gAllocators.general};
+    // Static model instances that were re-uploaded by the latest buffer
+    // update. Their previous transforms are synced to the current ones by the
+    // next update so that they only have motion on the frame they moved.
+    // General because this is refilled at runtime.
+    wheels::Array<uint32_t> movedStaticModelInstances{gAllocators.general};
+    gfx::Buffer staticModelInstanceTransformsBuffer;
+    // Transforms of the static instances on the previous frame for motion
+    gfx::Buffer previousStaticModelInstanceTransformsBuffer;
+    gfx::Buffer staticModelInstanceScalesBuffer;
     bool previousTransformsValid{false};
 
+    wheels::Array<CameraNode> cameraNodes{gAllocators.world};
+    uint32_t directionalLightNode{sNoNode};
+    // Node of each point and spot light
+    wheels::Array<uint32_t> pointLightNodes{gAllocators.world};
+    wheels::Array<uint32_t> spotLightNodes{gAllocators.world};
+    // Point and spot lights with dynamic nodes
+    wheels::Array<uint32_t> dynamicPointLights{gAllocators.world};
+    wheels::Array<uint32_t> dynamicSpotLights{gAllocators.world};
+
     uint32_t drawInstanceCount{0};
     wheels::Array<shader_structs::DrawInstance> drawInstances{
         gAllocators.world};
@@ -66,6 +125,15 @@ struct Scene
     vk::DescriptorSet rtDescriptorSet;
 
     Lights lights;
+
+    // Propagates NodeFlags_DynamicTransform to children, computes the initial
+    // transforms and gathers the dynamic nodes, instances and lights. Expects
+    // the nodes, instances and lights to be in place.
+    void initTransforms();
+    // Recomputes the dynamic nodes and the instances and lights on them. Dirty
+    // nodes take a full pass that also recomputes their subtrees and queues
+    // the static instances that moved in dirtyStaticModelInstances.
+    void updateTransforms(wheels::ScopedScratch scopeAlloc);
 };
 
 } // namespace scene
@@ -0,0 +1,955 @@
+#include "SceneSnapshot.hpp"
+
+#include "Allocators.hpp"
+#include "scene/DeferredLoadingContext.hpp"
+#include "utils/Logger.hpp"
+#include "utils/MappedFile.hpp"
+#include "utils/Utils.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <string>
+#include <type_traits>
+#include <wheels/containers/hash_map.hpp>
+#include <wheels/containers/hash_set.hpp>
+#include <wheels/containers/pair.hpp>
+#include <wheels/containers/span.hpp>
+#include <wheels/containers/static_array.hpp>
+
+using namespace glm;
+using namespace wheels;
+
+namespace scene
+{
+
+namespace
+{
+
+const uint64_t sSceneSnapshotMagic = 0x4E43'5353'5053'5250; // PRSPSSCN
+// This should be incremented when breaking changes are made to what's stored
+// or how it's gathered from the glTF
+const uint32_t sSceneSnapshotVersion = 4;
+
+// Changes to this require changes to sSceneSnapshotVersion
+struct SceneSnapshotHeader
+{
+    uint64_t magic{sSceneSnapshotMagic};
+    uint32_t version{sSceneSnapshotVersion};
+    // Buffers that are read from separate files. Each is stored as the uri
+    // length, the uri and its write time.
+    uint32_t bufferCount{0};
+    std::filesystem::file_time_type sourceWriteTime;
+    uint64_t sourceByteCount{0};
+    uint32_t imageCount{0};
+    uint32_t defaultScene{0};
+};
+
+constexpr int s_gl_nearest = 0x2600;
+constexpr int s_gl_linear = 0x2601;
+constexpr int s_gl_nearest_mipmap_nearest = 0x2700;
+constexpr int s_gl_linear_mipmap_nearest = 0x2701;
+constexpr int s_gl_nearest_mipmap_linear = 0x2702;
+constexpr int s_gl_linear_mimpap_linear = 0x2703;
+constexpr int s_gl_clamp_to_edge = 0x812F;
+constexpr int s_gl_mirrored_repeat = 0x8370;
+constexpr int s_gl_repeat = 0x2901;
+
+const StaticArray sCgltfAlphaModeStr{{
+    "cgltf_alpha_mode_opaque",
+    "cgltf_alpha_mode_mask",
+    "cgltf_alpha_mode_blend",
+}};
+static_assert(
+    sCgltfAlphaModeStr.size() == cgltf_alpha_mode_max_enum,
+    "Missing cgltf_alpha_mode strings");
+
+const StaticArray sCgltfLightTypeStr{{
+    "cgltf_light_type_invalid",
+    "cgltf_light_type_directional",
+    "cgltf_light_type_point",
+    "cgltf_light_type_spot",
+}};
+static_assert(
+    sCgltfLightTypeStr.size() == cgltf_light_type_max_enum,
+    "Missing cgltf_light_type strings");
+
+const StaticArray sCgltfCameraTypeStr{{
+    "cgltf_camera_type_invalid",
+    "cgltf_camera_type_perspective",
+    "cgltf_camera_type_orthographic",
+}};
+static_assert(
+    sCgltfCameraTypeStr.size() == cgltf_camera_type_max_enum,
+    "Missing cgltf_camera_type strings");
+
+vk::Filter getVkFilterMode(cgltf_int glEnum)
+{
+    switch (glEnum)
+    {
+    case s_gl_nearest:
+    case s_gl_nearest_mipmap_nearest:
+    case s_gl_nearest_mipmap_linear:
+        return vk::Filter::eNearest;
+    case s_gl_linear:
+    case s_gl_linear_mipmap_nearest:
+    case s_gl_linear_mimpap_linear:
+        return vk::Filter::eLinear;
+    default:
+        LOG_ERR("Invalid gl filter {}", glEnum);
+    }
+
+    return vk::Filter::eLinear;
+}
+
+vk::SamplerAddressMode getVkAddressMode(cgltf_int glEnum)
+{
+    switch (glEnum)
+    {
+    case s_gl_clamp_to_edge:
+        return vk::SamplerAddressMode::eClampToEdge;
+    case s_gl_mirrored_repeat:
+        return vk::SamplerAddressMode::eMirroredRepeat;
+    case s_gl_repeat:
+        return vk::SamplerAddressMode::eRepeat;
+    default:
+        LOG_ERR("Invalid gl wrapping mode {}", glEnum);
+    }
+
+    return vk::SamplerAddressMode::eClampToEdge;
+}
+
+// Appends the elements of accessor to rawData as tightly packed floats and
+// returns their offset in rawData. Normalized integer values are unpacked too.
+uint32_t appendAccessorData(
+    Array<uint8_t> &rawData, const cgltf_accessor &accessor)
+{
+    const uint32_t ret = asserted_cast<uint32_t>(rawData.size());
+    // Offsets stay float aligned as only floats are appended
+    WHEELS_ASSERT(ret % sizeof(float) == 0);
+
+    const size_t floatCount =
+        accessor.count * cgltf_num_components(accessor.type);
+    rawData.resize(rawData.size() + (floatCount * sizeof(float)));
+
+    // cgltf reads the decoded data of meshopt compressed buffer views
+    float *dst = reinterpret_cast<float *>(rawData.data() + ret);
+    const cgltf_size unpackedCount =
+        cgltf_accessor_unpack_floats(&accessor, dst, floatCount);
+    WHEELS_ASSERT(unpackedCount == floatCount);
+
+    return ret;
+}
+
+vec4 getBoundingSphere(const cgltf_accessor &positions)
+{
+    // Min and max are required for positions by the spec but let's not crash
+    // on files that leave them out. Such meshes just get loaded last.
+    if (positions.has_min == 0 || positions.has_max == 0)
+        return vec4{0.f};
+
+    const vec3 minBounds = make_vec3(positions.min);
+    const vec3 maxBounds = make_vec3(positions.max);
+
+    return vec4{
+        (minBounds + maxBounds) * 0.5f, length(maxBounds - minBounds) * 0.5f};
+}
+
+void gatherTextures(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    WHEELS_ASSERT(
+        gltfData.samplers_count < 0xFE &&
+        "Too many samplers to pack in u32 texture index");
+    snapshot.samplers.reserve(gltfData.samplers_count);
+    for (const cgltf_sampler &sampler :
+         Span{gltfData.samplers, gltfData.samplers_count})
+        snapshot.samplers.push_back(
+            SceneSnapshot::Sampler{
+                .magFilter = getVkFilterMode(sampler.mag_filter),
+                .minFilter = getVkFilterMode(sampler.min_filter),
+                .addressModeU = getVkAddressMode(sampler.wrap_s),
+                .addressModeV = getVkAddressMode(sampler.wrap_t),
+            });
+
+    snapshot.textures.reserve(gltfData.textures_count);
+    for (const cgltf_texture &texture :
+         Span{gltfData.textures, gltfData.textures_count})
+    {
+        WHEELS_ASSERT(texture.image != nullptr);
+
+        const uint32_t imageIndex = asserted_cast<uint32_t>(
+            cgltf_image_index(&gltfData, texture.image) + 1);
+        const uint32_t samplerIndex =
+            texture.sampler == nullptr
+                ? 0
+                : asserted_cast<uint32_t>(
+                      cgltf_sampler_index(&gltfData, texture.sampler) + 1);
+        snapshot.textures.emplace_back(imageIndex, samplerIndex);
+    }
+
+    snapshot.imageCount = asserted_cast<uint32_t>(gltfData.images_count);
+}
+
+void gatherMaterials(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    for (const cgltf_material &material :
+         Span{gltfData.materials, gltfData.materials_count})
+    {
+        shader_structs::MaterialData mat;
+        if (material.has_pbr_metallic_roughness == 0)
+        {
+            LOG_WARN(
+                "'{}' doesn't have pbr metallic roughness components",
+                material.name);
+            continue;
+        }
+
+        auto const getTexture2dSampler =
+            [&](cgltf_texture_view const &tv,
+                const char *channelName) -> shader_structs::Texture2DSampler
+        {
+            if (tv.texture != nullptr)
+            {
+                if (tv.has_transform == 1)
+                    LOG_WARN(
+                        "{}: {} has a transform", material.name, channelName);
+                if (tv.scale != 1.f)
+                    LOG_WARN(
+                        "{}: {} Scale isn't 1", material.name, channelName);
+                if (tv.texcoord != 0)
+                    LOG_WARN(
+                        "{}: {} TexCoord isn't 0", material.name, channelName);
+
+                const cgltf_size index =
+                    cgltf_texture_index(&gltfData, tv.texture);
+                return snapshot.textures[index];
+            }
+            return shader_structs::Texture2DSampler{};
+        };
+
+        const cgltf_pbr_metallic_roughness &pbrParams =
+            material.pbr_metallic_roughness;
+
+        mat.baseColorTextureSampler =
+            getTexture2dSampler(pbrParams.base_color_texture, "base color");
+        mat.baseColorFactor = make_vec4(&pbrParams.base_color_factor[0]);
+        mat.metallicRoughnessTextureSampler = getTexture2dSampler(
+            pbrParams.metallic_roughness_texture, "metallic roughness");
+        mat.metallicFactor = pbrParams.metallic_factor;
+        mat.roughnessFactor = pbrParams.roughness_factor;
+        mat.normalTextureSampler =
+            getTexture2dSampler(material.normal_texture, "normal");
+        if (material.alpha_mode == cgltf_alpha_mode_mask)
+            mat.alphaMode = shader_structs::AlphaMode_Mask;
+        else if (material.alpha_mode == cgltf_alpha_mode_blend)
+            mat.alphaMode = shader_structs::AlphaMode_Blend;
+        else if (material.alpha_mode != cgltf_alpha_mode_opaque)
+            LOG_ERR(
+                "%s: Unsupported alpha mode '{}'", material.name,
+                sCgltfAlphaModeStr[material.alpha_mode]);
+        mat.alphaCutoff = material.alpha_cutoff;
+
+        snapshot.materials.push_back(mat);
+    }
+}
+
+void gatherModels(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    snapshot.modelMeshCounts.reserve(gltfData.meshes_count);
+    for (const cgltf_mesh &mesh : Span{gltfData.meshes, gltfData.meshes_count})
+    {
+        snapshot.modelMeshCounts.push_back(
+            asserted_cast<uint32_t>(mesh.primitives_count));
+
+        for (const cgltf_primitive &primitive :
+             Span{mesh.primitives, mesh.primitives_count})
+        {
+            // Material indices are offset by the default material like in
+            // getInputGeometry()
+            const uint32_t material =
+                primitive.material != nullptr
+                    ? asserted_cast<uint32_t>(
+                          cgltf_material_index(&gltfData, primitive.material) +
+                          1)
+                    : 0;
+            snapshot.meshMaterialIndices.push_back(material);
+
+            const cgltf_accessor *positions = nullptr;
+            for (const cgltf_attribute &attr :
+                 Span{primitive.attributes, primitive.attributes_count})
+            {
+                if (strcmp("POSITION", attr.name) == 0)
+                    positions = attr.data;
+            }
+            WHEELS_ASSERT(positions != nullptr);
+            snapshot.meshBoundingSpheres.push_back(
+                getBoundingSphere(*positions));
+        }
+    }
+}
+
+// Gathers what the loading worker needs for the meshes and images so that it
+// only has to parse the glTF for meshes that are missing from the cache
+void gatherLoadingInputs(
+    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
+    SceneSnapshot &snapshot)
+{
+    snapshot.meshes.reserve(snapshot.meshMaterialIndices.size());
+    for (uint32_t mi = 0; mi < gltfData.meshes_count; ++mi)
+    {
+        const cgltf_mesh &gltfMesh = gltfData.meshes[mi];
+        const char *name = gltfMesh.name != nullptr ? gltfMesh.name : "";
+        const size_t nameLength = strlen(name);
+        const auto nameOffset =
+            asserted_cast<uint32_t>(snapshot.meshNames.size());
+        snapshot.meshNames.extend(Span<const char>{name, nameLength});
+
+        for (uint32_t pi = 0; pi < gltfMesh.primitives_count; ++pi)
+        {
+            const Pair<InputGeometryMetadata, MeshInfo> input =
+                getInputGeometry(gltfData, mi, pi);
+            snapshot.meshes.push_back(
+                SceneSnapshot::Mesh{
+                    .sourceHash =
+                        hashSourceData(gAllocators.general, input.first),
+                    .vertexCount = input.second.vertexCount,
+                    .indexCount = input.second.indexCount,
+                    .nameOffset = nameOffset,
+                    .nameLength = asserted_cast<uint32_t>(nameLength),
+                });
+        }
+    }
+    WHEELS_ASSERT(
+        snapshot.meshes.size() == snapshot.meshMaterialIndices.size());
+
+    HashSet<uint32_t> sRgbImages{scopeAlloc};
+    HashSet<uint32_t> linearImages{scopeAlloc};
+    HashMap<uint32_t, TextureChannelUsage> channelUsages{scopeAlloc};
+    collectImageUsages(
+        scopeAlloc, gltfData, sRgbImages, linearImages, channelUsages);
+
+    snapshot.images.reserve(gltfData.images_count);
+    for (uint32_t i = 0; i < gltfData.images_count; ++i)
+    {
+        const cgltf_image &gltfImage = gltfData.images[i];
+        const char *uri = gltfImage.uri != nullptr ? gltfImage.uri : "";
+        const size_t uriLength = strlen(uri);
+
+        uint32_t flags = 0;
+        if (sRgbImages.contains(i))
+            flags |= SceneSnapshot::ImageFlags_SRgb;
+        if (linearImages.contains(i))
+            flags |= SceneSnapshot::ImageFlags_Linear;
+        const TextureChannelUsage *channelUsage = channelUsages.find(i);
+        if (channelUsage != nullptr)
+        {
+            switch (*channelUsage)
+            {
+            case TextureChannelUsage::Color:
+                break;
+            case TextureChannelUsage::NormalMap:
+                flags |= SceneSnapshot::ImageFlags_NormalMap;
+                break;
+            case TextureChannelUsage::Occlusion:
+                flags |= SceneSnapshot::ImageFlags_Occlusion;
+                break;
+            case TextureChannelUsage::RoughnessMetalness:
+                flags |= SceneSnapshot::ImageFlags_RoughnessMetalness;
+                break;
+            }
+        }
+
+        snapshot.images.push_back(
+            SceneSnapshot::Image{
+                .uriOffset = asserted_cast<uint32_t>(snapshot.imageUris.size()),
+                .uriLength = asserted_cast<uint32_t>(uriLength),
+                .flags = flags,
+            });
+        snapshot.imageUris.extend(Span<const char>{uri, uriLength});
+    }
+}
+
+void gatherAnimations(
+    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
+    SceneSnapshot &snapshot)
+{
+    for (const cgltf_animation &animation :
+         Span{gltfData.animations, gltfData.animations_count})
+    {
+        // Map gathered animations to indices in gltf samplers
+        Array<uint32_t> samplerAnimations{scopeAlloc, animation.samplers_count};
+        for (const cgltf_animation_sampler &sampler :
+             Span{animation.samplers, animation.samplers_count})
+        {
+            InterpolationType interpolation{InterpolationType::Step};
+            if (sampler.interpolation == cgltf_interpolation_type_step)
+                interpolation = InterpolationType::Step;
+            else if (sampler.interpolation == cgltf_interpolation_type_linear)
+                interpolation = InterpolationType::Linear;
+            else if (
+                sampler.interpolation == cgltf_interpolation_type_cubic_spline)
+                interpolation = InterpolationType::CubicSpline;
+            else
+                WHEELS_ASSERT(!"Unsupported interpolation type");
+
+            WHEELS_ASSERT(sampler.input != nullptr);
+            const cgltf_accessor &inputAccessor = *sampler.input;
+            WHEELS_ASSERT(!inputAccessor.is_sparse);
+            WHEELS_ASSERT(
+                inputAccessor.component_type == cgltf_component_type_r_32f);
+            WHEELS_ASSERT(inputAccessor.type == cgltf_type_scalar);
+            WHEELS_ASSERT(inputAccessor.has_min);
+            WHEELS_ASSERT(inputAccessor.has_max);
+
+            // Outputs can also be normalized integers, e.g. rotations from
+            // gltfpack. They are unpacked to floats when gathered.
+            WHEELS_ASSERT(sampler.output != nullptr);
+            const cgltf_accessor &outputAccessor = *sampler.output;
+            WHEELS_ASSERT(!outputAccessor.is_sparse);
+            WHEELS_ASSERT(
+                outputAccessor.component_type == cgltf_component_type_r_32f ||
+                outputAccessor.normalized == 1);
+
+            // TODO:
+            // Share data for accessors that use the same bytes?
+            const SceneSnapshot::AnimationSampler gathered{
+                .interpolation = interpolation,
+                .timesByteOffset = appendAccessorData(
+                    snapshot.rawAnimationData, inputAccessor),
+                .timeCount = asserted_cast<uint32_t>(inputAccessor.count),
+                .startTimeS = static_cast<float>(inputAccessor.min[0]),
+                .endTimeS = static_cast<float>(inputAccessor.max[0]),
+                .valuesByteOffset = appendAccessorData(
+                    snapshot.rawAnimationData, outputAccessor),
+                .valueCount = asserted_cast<uint32_t>(outputAccessor.count),
+            };
+
+            if (outputAccessor.type == cgltf_type_vec3)
+            {
+                samplerAnimations.push_back(
+                    asserted_cast<uint32_t>(snapshot.vec3Animations.size()));
+                snapshot.vec3Animations.push_back(gathered);
+            }
+            else if (outputAccessor.type == cgltf_type_vec4)
+            {
+                // Only quaternion animations are currently sampled from vec4
+                // outputs
+                samplerAnimations.push_back(
+                    asserted_cast<uint32_t>(snapshot.quatAnimations.size()));
+                snapshot.quatAnimations.push_back(gathered);
+            }
+            else
+            {
+                WHEELS_ASSERT(!"Unsupported animation output type");
+                samplerAnimations.push_back(SceneSnapshot::sNone);
+            }
+        }
+
+        for (const cgltf_animation_channel &channel :
+             Span{animation.channels, animation.channels_count})
+        {
+            WHEELS_ASSERT(channel.target_node != nullptr);
+            const uint32_t nodeIndex = asserted_cast<uint32_t>(
+                cgltf_node_index(&gltfData, channel.target_node));
+
+            WHEELS_ASSERT(channel.sampler != nullptr);
+            const uint32_t samplerIndex = asserted_cast<uint32_t>(
+                cgltf_animation_sampler_index(&animation, channel.sampler));
+            const cgltf_type outputType = channel.sampler->output->type;
+
+            SceneSnapshot::Node &node = snapshot.nodes[nodeIndex];
+            if (channel.target_path == cgltf_animation_path_type_translation)
+            {
+                WHEELS_ASSERT(outputType == cgltf_type_vec3);
+                node.translationAnimation = samplerAnimations[samplerIndex];
+            }
+            else if (channel.target_path == cgltf_animation_path_type_rotation)
+            {
+                WHEELS_ASSERT(outputType == cgltf_type_vec4);
+                node.rotationAnimation = samplerAnimations[samplerIndex];
+            }
+            else if (channel.target_path == cgltf_animation_path_type_scale)
+            {
+                WHEELS_ASSERT(outputType == cgltf_type_vec3);
+                node.scaleAnimation = samplerAnimations[samplerIndex];
+            }
+        }
+    }
+}
+
+void gatherLights(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    snapshot.lights.reserve(gltfData.lights_count);
+    for (const cgltf_light &light :
+         Span{gltfData.lights, gltfData.lights_count})
+    {
+        SceneSnapshot::Light gathered{
+            .color = make_vec3(&light.color[0]),
+            .intensity = static_cast<float>(light.intensity),
+            .range = static_cast<float>(light.range),
+            .spotInnerConeAngle =
+                static_cast<float>(light.spot_inner_cone_angle),
+            .spotOuterConeAngle =
+                static_cast<float>(light.spot_outer_cone_angle),
+        };
+        if (light.type == cgltf_light_type_directional)
+            gathered.type = SceneSnapshot::LightType::Directional;
+        else if (light.type == cgltf_light_type_point)
+            gathered.type = SceneSnapshot::LightType::Point;
+        else if (light.type == cgltf_light_type_spot)
+            gathered.type = SceneSnapshot::LightType::Spot;
+        // Unsupported lights are logged and dropped when the nodes are gathered
+
+        snapshot.lights.push_back(gathered);
+    }
+}
+
+void gatherNodes(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    snapshot.nodes.reserve(gltfData.nodes_count);
+    for (const cgltf_node &gltfNode :
+         Span{gltfData.nodes, gltfData.nodes_count})
+    {
+        snapshot.nodes.emplace_back();
+        SceneSnapshot::Node &node = snapshot.nodes.back();
+
+        const char *name = gltfNode.name != nullptr ? gltfNode.name : "";
+        const size_t nameLength = strlen(name);
+        node.nameOffset = asserted_cast<uint32_t>(snapshot.nodeNames.size());
+        node.nameLength = asserted_cast<uint32_t>(nameLength);
+        snapshot.nodeNames.extend(Span<const char>{name, nameLength});
+
+        node.firstChild = asserted_cast<uint32_t>(snapshot.nodeChildren.size());
+        node.childCount = asserted_cast<uint32_t>(gltfNode.children_count);
+        for (const cgltf_node *child :
+             Span{gltfNode.children, gltfNode.children_count})
+        {
+            WHEELS_ASSERT(child != nullptr);
+            const cgltf_size index = cgltf_node_index(&gltfData, child);
+            snapshot.nodeChildren.push_back(asserted_cast<uint32_t>(index));
+        }
+
+        if (gltfNode.mesh != nullptr)
+            node.modelIndex = asserted_cast<uint32_t>(
+                cgltf_mesh_index(&gltfData, gltfNode.mesh));
+        if (gltfNode.camera != nullptr)
+        {
+            const uint32_t cameraIndex = asserted_cast<uint32_t>(
+                cgltf_camera_index(&gltfData, gltfNode.camera));
+            const cgltf_camera &cam = *gltfNode.camera;
+            if (cam.type == cgltf_camera_type_perspective)
+            {
+                if (snapshot.cameras.size() <= cameraIndex)
+                    snapshot.cameras.resize(cameraIndex + 1);
+
+                snapshot.cameras[cameraIndex] = CameraParameters{
+                    .fov = static_cast<float>(cam.data.perspective.yfov),
+                    .zN = static_cast<float>(cam.data.perspective.znear),
+                    .zF = static_cast<float>(cam.data.perspective.zfar),
+                };
+
+                node.camera = cameraIndex;
+            }
+            else
+                LOG_ERR(
+                    "Unsupported camera type '{}'",
+                    sCgltfCameraTypeStr[cam.type]);
+        }
+        if (gltfNode.light != nullptr)
+        {
+            const cgltf_light &light = *gltfNode.light;
+            if (light.type == cgltf_light_type_directional ||
+                light.type == cgltf_light_type_point ||
+                light.type == cgltf_light_type_spot)
+                node.light = asserted_cast<uint32_t>(
+                    cgltf_light_index(&gltfData, gltfNode.light));
+            else
+                LOG_ERR(
+                    "Unsupported light type '{}'",
+                    sCgltfLightTypeStr[light.type]);
+        }
+
+        vec3 translation{0.f};
+        vec3 scale{1.f};
+        quat rotation{1.f, 0.f, 0.f, 0.f};
+        if (gltfNode.has_matrix == 1)
+        {
+            // Spec defines the matrix to be decomposeable to T * R * S
+            const mat4 matrix = make_mat4(&gltfNode.matrix[0]);
+            vec3 skew;
+            vec4 perspective;
+            decompose(matrix, scale, rotation, translation, skew, perspective);
+        }
+        if (gltfNode.has_translation == 1)
+            translation = make_vec3(&gltfNode.translation[0]);
+        if (gltfNode.has_rotation == 1)
+            rotation = make_quat(&gltfNode.rotation[0]);
+        if (gltfNode.has_scale == 1)
+            scale = make_vec3(&gltfNode.scale[0]);
+
+        // Skip transform components that are close to identity
+        const float srtThreshold = 0.001f;
+
+        if (any(lessThan(translation, vec3{-srtThreshold})) ||
+            any(greaterThan(translation, vec3{srtThreshold})))
+        {
+            node.flags |= SceneSnapshot::NodeFlags_Translation;
+            node.translation = translation;
+        }
+
+        const vec3 eulers = eulerAngles(rotation);
+        if (any(lessThan(eulers, vec3{-srtThreshold})) ||
+            any(greaterThan(eulers, vec3{srtThreshold})))
+        {
+            node.flags |= SceneSnapshot::NodeFlags_Rotation;
+            node.rotation = rotation;
+        }
+
+        if (any(lessThan(scale, vec3{1.f - srtThreshold})) ||
+            any(greaterThan(scale, vec3{1.f + srtThreshold})))
+        {
+            node.flags |= SceneSnapshot::NodeFlags_Scale;
+            node.scale = scale;
+        }
+    }
+}
+
+void gatherScenes(const cgltf_data &gltfData, SceneSnapshot &snapshot)
+{
+    snapshot.defaultScene =
+        gltfData.scene != nullptr
+            ? asserted_cast<uint32_t>(
+                  cgltf_scene_index(&gltfData, gltfData.scene))
+            : 0;
+
+    snapshot.sceneRootCounts.reserve(gltfData.scenes_count);
+    for (const cgltf_scene &gltfScene :
+         Span{gltfData.scenes, gltfData.scenes_count})
+    {
+        snapshot.sceneRootCounts.push_back(
+            asserted_cast<uint32_t>(gltfScene.nodes_count));
+        for (const cgltf_node *node :
+             Span{gltfScene.nodes, gltfScene.nodes_count})
+        {
+            WHEELS_ASSERT(node != nullptr);
+            snapshot.sceneRoots.push_back(
+                asserted_cast<uint32_t>(cgltf_node_index(&gltfData, node)));
+        }
+    }
+}
+
+std::filesystem::path snapshotPath(const std::filesystem::path &scenePath)
+{
+    std::filesystem::path filename = scenePath.filename();
+    filename.replace_extension("prosper_scene");
+    return scenePath.parent_path() / "prosper_cache" / filename;
+}
+
+// Returns the paths of the buffers that are read from separate files, relative
+// to the scene directory. Embedded buffers are covered by the glTF itself.
+Array<std::string> bufferFiles(Allocator &alloc, const cgltf_data &gltfData)
+{
+    Array<std::string> ret{alloc, gltfData.buffers_count};
+    for (const cgltf_buffer &buffer :
+         Span{gltfData.buffers, gltfData.buffers_count})
+    {
+        if (buffer.uri == nullptr || strncmp(buffer.uri, "data:", 5) == 0)
+            continue;
+
+        // Decode like cgltf does when it loads the buffer
+        std::string uri{buffer.uri};
+        cgltf_decode_uri(uri.data());
+        uri.resize(strlen(uri.c_str()));
+        ret.push_back(WHEELS_MOV(uri));
+    }
+
+    return ret;
+}
+
+template <typename T>
+bool readValue(Span<const uint8_t> data, size_t &offset, T &out)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    if (data.size() - offset < sizeof(T))
+        return false;
+
+    memcpy(&out, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+
+    return true;
+}
+
+template <typename T>
+bool readArray(Span<const uint8_t> data, size_t &offset, Array<T> &out)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    uint64_t count = 0;
+    if (!readValue(data, offset, count))
+        return false;
+    if ((data.size() - offset) / sizeof(T) < count)
+        return false;
+
+    out.resize(asserted_cast<size_t>(count));
+    if (count > 0)
+        memcpy(out.data(), data.data() + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+
+    return true;
+}
+
+template <typename T>
+void writeArray(std::ofstream &stream, const Array<T> &values)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    writeRaw(stream, static_cast<uint64_t>(values.size()));
+    writeRawSpan(stream, values.span());
+}
+
+} // namespace
+
+SceneSnapshot::SceneSnapshot(Allocator &alloc) noexcept
+: samplers{alloc}
+, textures{alloc}
+, materials{alloc}
+, modelMeshCounts{alloc}
+, meshMaterialIndices{alloc}
+, meshBoundingSpheres{alloc}
+, meshes{alloc}
+, meshNames{alloc}
+, images{alloc}
+, imageUris{alloc}
+, cameras{alloc}
+, lights{alloc}
+, nodes{alloc}
+, nodeChildren{alloc}
+, nodeNames{alloc}
+, sceneRootCounts{alloc}
+, sceneRoots{alloc}
+, rawAnimationData{alloc}
+, vec3Animations{alloc}
+, quatAnimations{alloc}
+{
+}
+
+void SceneSnapshot::clear()
+{
+    samplers.clear();
+    textures.clear();
+    materials.clear();
+    imageCount = 0;
+    modelMeshCounts.clear();
+    meshMaterialIndices.clear();
+    meshBoundingSpheres.clear();
+    meshes.clear();
+    meshNames.clear();
+    images.clear();
+    imageUris.clear();
+    cameras.clear();
+    lights.clear();
+    nodes.clear();
+    nodeChildren.clear();
+    nodeNames.clear();
+    sceneRootCounts.clear();
+    sceneRoots.clear();
+    defaultScene = 0;
+    rawAnimationData.clear();
+    vec3Animations.clear();
+    quatAnimations.clear();
+}
+
+void gatherSceneSnapshot(
+    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
+    SceneSnapshot &snapshot)
+{
+    WHEELS_ASSERT(snapshot.nodes.empty() && "Snapshot should be empty");
+
+    gatherTextures(gltfData, snapshot);
+    gatherMaterials(gltfData, snapshot);
+    gatherModels(gltfData, snapshot);
+    gatherLoadingInputs(scopeAlloc.child_scope(), gltfData, snapshot);
+    gatherLights(gltfData, snapshot);
+    gatherNodes(gltfData, snapshot);
+    // Animations are stored in the nodes they target
+    gatherAnimations(scopeAlloc.child_scope(), gltfData, snapshot);
+    gatherScenes(gltfData, snapshot);
+}
+
+bool readSceneSnapshot(
+    const std::filesystem::path &scenePath, SceneSnapshot &snapshot)
+{
+    const std::filesystem::path path = snapshotPath(scenePath);
+
+    utils::MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    const Span<const uint8_t> data = file.data();
+    size_t offset = 0;
+
+    SceneSnapshotHeader header;
+    if (!readValue(data, offset, header))
+    {
+        LOG_INFO("Truncated scene snapshot");
+        return false;
+    }
+    if (header.magic != sSceneSnapshotMagic)
+    {
+        LOG_INFO("Invalid scene snapshot");
+        return false;
+    }
+    if (header.version != sSceneSnapshotVersion)
+    {
+        LOG_INFO("Old scene snapshot version");
+        return false;
+    }
+
+    std::error_code ec;
+    if (header.sourceWriteTime !=
+            std::filesystem::last_write_time(scenePath, ec) ||
+        header.sourceByteCount != std::filesystem::file_size(scenePath, ec))
+    {
+        LOG_INFO("Stale scene snapshot");
+        return false;
+    }
+
+    const std::filesystem::path sceneDir = scenePath.parent_path();
+    for (uint32_t i = 0; i < header.bufferCount; ++i)
+    {
+        uint32_t uriLength = 0;
+        if (!readValue(data, offset, uriLength) ||
+            data.size() - offset < uriLength)
+        {
+            LOG_INFO("Truncated scene snapshot");
+            return false;
+        }
+        const std::string uri{
+            reinterpret_cast<const char *>(data.data() + offset), uriLength};
+        offset += uriLength;
+
+        std::filesystem::file_time_type writeTime;
+        if (!readValue(data, offset, writeTime))
+        {
+            LOG_INFO("Truncated scene snapshot");
+            return false;
+        }
+
+        if (writeTime != std::filesystem::last_write_time(sceneDir / uri, ec))
+        {
+            LOG_INFO("Stale scene snapshot");
+            return false;
+        }
+    }
+
+    const bool sectionsRead =
+        readArray(data, offset, snapshot.samplers) &&
+        readArray(data, offset, snapshot.textures) &&
+        readArray(data, offset, snapshot.materials) &&
+        readArray(data, offset, snapshot.modelMeshCounts) &&
+        readArray(data, offset, snapshot.meshMaterialIndices) &&
+        readArray(data, offset, snapshot.meshBoundingSpheres) &&
+        readArray(data, offset, snapshot.meshes) &&
+        readArray(data, offset, snapshot.meshNames) &&
+        readArray(data, offset, snapshot.images) &&
+        readArray(data, offset, snapshot.imageUris) &&
+        readArray(data, offset, snapshot.cameras) &&
+        readArray(data, offset, snapshot.lights) &&
+        readArray(data, offset, snapshot.nodes) &&
+        readArray(data, offset, snapshot.nodeChildren) &&
+        readArray(data, offset, snapshot.nodeNames) &&
+        readArray(data, offset, snapshot.sceneRootCounts) &&
+        readArray(data, offset, snapshot.sceneRoots) &&
+        readArray(data, offset, snapshot.rawAnimationData) &&
+        readArray(data, offset, snapshot.vec3Animations) &&
+        readArray(data, offset, snapshot.quatAnimations);
+    if (!sectionsRead)
+    {
+        LOG_INFO("Truncated scene snapshot");
+        snapshot.clear();
+        return false;
+    }
+
+    snapshot.imageCount = header.imageCount;
+    snapshot.defaultScene = header.defaultScene;
+
+    return true;
+}
+
+void writeSceneSnapshot(
+    const std::filesystem::path &scenePath, const cgltf_data &gltfData,
+    const SceneSnapshot &snapshot)
+{
+    const std::filesystem::path path = snapshotPath(scenePath);
+
+    const std::filesystem::path cacheFolder = path.parent_path();
+    if (!std::filesystem::exists(cacheFolder))
+        std::filesystem::create_directories(cacheFolder);
+
+    std::filesystem::remove(path);
+
+    // Write into a tmp file and rename when done to minimize the potential for
+    // corrupted files
+    std::filesystem::path tmpPath = path;
+    tmpPath.replace_extension("prosper_scene_TMP");
+
+    const std::filesystem::path sceneDir = scenePath.parent_path();
+    const Array<std::string> buffers =
+        bufferFiles(gAllocators.general, gltfData);
+
+    // NOTE:
+    // Caches aren't supposed to be portable so we don't pay attention to
+    // endianness.
+    const SceneSnapshotHeader header{
+        .bufferCount = asserted_cast<uint32_t>(buffers.size()),
+        .sourceWriteTime = std::filesystem::last_write_time(scenePath),
+        .sourceByteCount = std::filesystem::file_size(scenePath),
+        .imageCount = snapshot.imageCount,
+        .defaultScene = snapshot.defaultScene,
+    };
+
+    std::ofstream file{tmpPath, std::ios_base::binary};
+    writeRaw(file, header);
+    for (const std::string &uri : buffers)
+    {
+        writeRaw(file, asserted_cast<uint32_t>(uri.size()));
+        writeRawStrSpan(file, StrSpan{uri.data(), uri.size()});
+        writeRaw(file, std::filesystem::last_write_time(sceneDir / uri));
+    }
+    writeArray(file, snapshot.samplers);
+    writeArray(file, snapshot.textures);
+    writeArray(file, snapshot.materials);
+    writeArray(file, snapshot.modelMeshCounts);
+    writeArray(file, snapshot.meshMaterialIndices);
+    writeArray(file, snapshot.meshBoundingSpheres);
+    writeArray(file, snapshot.meshes);
+    writeArray(file, snapshot.meshNames);
+    writeArray(file, snapshot.images);
+    writeArray(file, snapshot.imageUris);
+    writeArray(file, snapshot.cameras);
+    writeArray(file, snapshot.lights);
+    writeArray(file, snapshot.nodes);
+    writeArray(file, snapshot.nodeChildren);
+    writeArray(file, snapshot.nodeNames);
+    writeArray(file, snapshot.sceneRootCounts);
+    writeArray(file, snapshot.sceneRoots);
+    writeArray(file, snapshot.rawAnimationData);
+    writeArray(file, snapshot.vec3Animations);
+    writeArray(file, snapshot.quatAnimations);
+    file.close();
+
+    // Make sure we have rw permissions for the user to be nice
+    const std::filesystem::perms initialPerms =
+        std::filesystem::status(tmpPath).permissions();
+    std::filesystem::permissions(
+        tmpPath, initialPerms | std::filesystem::perms::owner_read |
+                     std::filesystem::perms::owner_write);
+
+    // Rename when the file is done to minimize the potential of a corrupted
+    // file
+    std::filesystem::rename(tmpPath, path);
+}
+
+} // namespace scene
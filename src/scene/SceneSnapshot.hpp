@@ -0,0 +1,178 @@
+#ifndef PROSPER_SCENE_SCENE_SNAPSHOT_HPP
+#define PROSPER_SCENE_SCENE_SNAPSHOT_HPP
+
+#include "scene/Animations.hpp"
+#include "scene/Camera.hpp"
+#include "scene/Material.hpp"
+
+#include <cgltf.h>
+#include <cstdint>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vulkan/vulkan.hpp>
+#include <wheels/allocators/allocator.hpp>
+#include <wheels/allocators/scoped_scratch.hpp>
+#include <wheels/containers/array.hpp>
+
+namespace scene
+{
+
+// Flattened glTF scene that the world is built from. It's stored in the
+// scene's cache folder when the glTF is first loaded so that later loads don't
+// have to parse the glTF or load its buffers before the world is ready. All the
+// data is trivially copyable and stored as is.
+struct SceneSnapshot
+{
+    static const uint32_t sNone = 0xFFFF'FFFF;
+
+    struct Sampler
+    {
+        vk::Filter magFilter{vk::Filter::eLinear};
+        vk::Filter minFilter{vk::Filter::eLinear};
+        vk::SamplerAddressMode addressModeU{vk::SamplerAddressMode::eRepeat};
+        vk::SamplerAddressMode addressModeV{vk::SamplerAddressMode::eRepeat};
+    };
+
+    enum class LightType : uint32_t
+    {
+        Directional,
+        Point,
+        Spot,
+    };
+
+    struct Light
+    {
+        LightType type{LightType::Point};
+        glm::vec3 color{1.f};
+        float intensity{1.f};
+        float range{0.f};
+        float spotInnerConeAngle{0.f};
+        float spotOuterConeAngle{0.f};
+    };
+
+    // Transform components that are close to identity are left out
+    enum NodeFlags : uint32_t
+    {
+        NodeFlags_Translation = 0x1,
+        NodeFlags_Rotation = 0x2,
+        NodeFlags_Scale = 0x4,
+    };
+
+    // Indexed like the glTF nodes. Other indices are sNone if not set.
+    struct Node
+    {
+        // Children are contiguous in nodeChildren
+        uint32_t firstChild{0};
+        uint32_t childCount{0};
+        // Name is contiguous in nodeNames
+        uint32_t nameOffset{0};
+        uint32_t nameLength{0};
+        uint32_t flags{0};
+        glm::vec3 translation{0.f};
+        glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale{1.f};
+        uint32_t modelIndex{sNone};
+        uint32_t camera{sNone};
+        uint32_t light{sNone};
+        // Indices in vec3Animations and quatAnimations
+        uint32_t translationAnimation{sNone};
+        uint32_t rotationAnimation{sNone};
+        uint32_t scaleAnimation{sNone};
+    };
+
+    struct AnimationSampler
+    {
+        InterpolationType interpolation{InterpolationType::Step};
+        // Offsets are from the beginning of rawAnimationData
+        uint32_t timesByteOffset{0};
+        uint32_t timeCount{0};
+        float startTimeS{0.f};
+        float endTimeS{0.f};
+        uint32_t valuesByteOffset{0};
+        uint32_t valueCount{0};
+    };
+
+    // Everything the loading worker needs from a glTF mesh primitive when its
+    // cache is in the archive. Name is contiguous in meshNames.
+    struct Mesh
+    {
+        // Hash of the source accessor data, the key in the mesh cache archive
+        uint64_t sourceHash{0};
+        uint32_t vertexCount{0};
+        uint32_t indexCount{0};
+        uint32_t nameOffset{0};
+        uint32_t nameLength{0};
+    };
+
+    enum ImageFlags : uint32_t
+    {
+        ImageFlags_SRgb = 0x1,
+        ImageFlags_Linear = 0x2,
+        ImageFlags_NormalMap = 0x4,
+        ImageFlags_Occlusion = 0x8,
+        ImageFlags_RoughnessMetalness = 0x10,
+    };
+
+    // Uri is contiguous in imageUris and empty if the image is embedded
+    struct Image
+    {
+        uint32_t uriOffset{0};
+        uint32_t uriLength{0};
+        uint32_t flags{0};
+    };
+
+    SceneSnapshot(wheels::Allocator &alloc) noexcept;
+
+    void clear();
+
+    wheels::Array<Sampler> samplers;
+    // Image and sampler of each glTF texture. Both are offset by one as the
+    // first ones are the defaults.
+    wheels::Array<shader_structs::Texture2DSampler> textures;
+    wheels::Array<shader_structs::MaterialData> materials;
+    uint32_t imageCount{0};
+    // Meshes of each model are contiguous
+    wheels::Array<uint32_t> modelMeshCounts;
+    wheels::Array<uint32_t> meshMaterialIndices;
+    // Model space bounding sphere of each mesh
+    wheels::Array<glm::vec4> meshBoundingSpheres;
+    // Indexed like meshMaterialIndices
+    wheels::Array<Mesh> meshes;
+    wheels::Array<char> meshNames;
+    // Indexed like the glTF images
+    wheels::Array<Image> images;
+    wheels::Array<char> imageUris;
+    // Indexed like the glTF cameras
+    wheels::Array<CameraParameters> cameras;
+    // Indexed like the glTF lights
+    wheels::Array<Light> lights;
+    wheels::Array<Node> nodes;
+    wheels::Array<uint32_t> nodeChildren;
+    wheels::Array<char> nodeNames;
+    // Root nodes of each scene are contiguous in sceneRoots
+    wheels::Array<uint32_t> sceneRootCounts;
+    wheels::Array<uint32_t> sceneRoots;
+    uint32_t defaultScene{0};
+    wheels::Array<uint8_t> rawAnimationData;
+    wheels::Array<AnimationSampler> vec3Animations;
+    wheels::Array<AnimationSampler> quatAnimations;
+};
+
+// gltfData should have its buffers loaded as the mesh source data is hashed
+void gatherSceneSnapshot(
+    wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData,
+    SceneSnapshot &snapshot);
+
+// Returns false if there is no snapshot for the scene or if the glTF or its
+// buffers have been changed after it was written. snapshot is left empty then.
+[[nodiscard]] bool readSceneSnapshot(
+    const std::filesystem::path &scenePath, SceneSnapshot &snapshot);
+
+void writeSceneSnapshot(
+    const std::filesystem::path &scenePath, const cgltf_data &gltfData,
+    const SceneSnapshot &snapshot);
+
+} // namespace scene
+
+#endif // PROSPER_SCENE_SCENE_SNAPSHOT_HPP
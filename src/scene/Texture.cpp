@@ -2,18 +2,29 @@
 
 #include "gfx/Device.hpp"
 #include "utils/Dds.hpp"
+#include "utils/Downsample.hpp"
 #include "utils/Ktx.hpp"
 #include "utils/Logger.hpp"
+#include "utils/Timer.hpp"
 #include "utils/Utils.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bcdec.h>
 #include <cmath>
+#include <condition_variable>
 #include <fstream>
+#include <glm/gtc/packing.hpp>
 #include <iostream>
 #include <ispc_texcomp.h>
+#include <limits>
+#include <mutex>
 #include <stb_image.h>
 #include <stb_image_resize2.h>
 #include <wheels/containers/array.hpp>
+#include <wheels/containers/optional.hpp>
 #include <wheels/containers/pair.hpp>
+#include <wheels/containers/static_array.hpp>
 #include <wyhash.h>
 
 namespace scene
@@ -26,13 +37,55 @@ namespace
 
 const uint64_t sTextureCacheMagic = 0x5845'5452'5053'5250; // PRSPRTEX
 // This should be incremented when changes are made to what's cached
-const uint32_t sTextureCacheVersion = 5;
+const uint32_t sTextureCacheVersion = 9;
+
+#ifdef PROSPER_KTX2_TEXTURE_CACHE
+// Levels are stored zstd supercompressed and the tag is within the file
+const bool sKtx2Cache = true;
+#else
+const bool sKtx2Cache = false;
+#endif // PROSPER_KTX2_TEXTURE_CACHE
+const char *const sKtx2CacheTagKey = "prosperCacheTag";
+const char *const sKtx2WriterKey = "KTXwriter";
+const char *const sKtx2Writer = "prosper";
+
+// Seeds the content hash that is checked against the shared cache entries to
+// catch collisions of the one in the file name
+const uint64_t sCacheCheckHashSeed = 0x4B43'4548'4358'4554; // TEXHCHEK
+
+// Set before any caches are updated and only read after that
+std::filesystem::path gSharedCacheDir;
+uintmax_t gSharedCacheMaxByteCount{0};
+// Entries used after this are touched so trims never evict the ones that the
+// loaded scenes still point to
+std::filesystem::file_time_type gSharedCacheSessionStart;
+// Serializes the shared cache size checks between the texture workers
+std::mutex gSharedCacheTrimMutex;
+// Serializes checking, compressing and writing a shared entry so that
+// concurrent workers don't compress the same contents twice. Striped by the
+// source hash.
+std::array<std::mutex, 64> gSharedCacheEntryMutexes;
+#ifdef NDEBUG
+TextureCacheQuality gCacheQuality{TextureCacheQuality::Basic};
+#else
+TextureCacheQuality gCacheQuality{TextureCacheQuality::UltraFast};
+#endif // NDEBUG
+
+// Levels are split into stripes of block rows that are compressed in parallel
+constexpr uint32_t sStripeBlockRows = 16;
+// Stripes that don't fit in the queue are compressed by the thread that
+// compresses their texture
+constexpr size_t sMaxQueuedStripeCount = 256;
+// Covers the small allocations of compression on top of the levels
+constexpr size_t sCompressionScratchSlack = megabytes(16);
 
 struct UncompressedPixelData
 {
     Span<const uint8_t> data;
     vk::Extent2D extent{.width = 0, .height = 0};
     uint32_t channels{0};
+    // Channels are f32 instead of u8 if set
+    bool hdr{false};
 };
 
 std::filesystem::path cachePath(const std::filesystem::path &source)
@@ -42,10 +95,15 @@ std::filesystem::path cachePath(const std::filesystem::path &source)
         std::filesystem::create_directory(cacheFolder, source.parent_path());
 
     auto cacheFile = source.filename();
-    cacheFile.replace_extension("dds");
+    cacheFile.replace_extension(sKtx2Cache ? "ktx2" : "dds");
     return cacheFolder / cacheFile;
 }
 
+bool isKtx2(const std::filesystem::path &cacheFile)
+{
+    return cacheFile.extension() == ".ktx2";
+}
+
 std::filesystem::path cacheTagPath(const std::filesystem::path &cacheFile)
 {
     std::filesystem::path tagPath = cacheFile;
@@ -53,15 +111,123 @@ std::filesystem::path cacheTagPath(const std::filesystem::path &cacheFile)
     return tagPath;
 }
 
+std::filesystem::path sharedCachePath(uint64_t sourceHash)
+{
+    const std::string filename = fmt::format(
+        "texture{:016x}.{}", sourceHash, sKtx2Cache ? "ktx2" : "dds");
+    return gSharedCacheDir / filename;
+}
+
+// Identifies what a cache was compressed from
+struct CacheSource
+{
+    // Set for the caches next to the source. Use write time instead of a hash
+    // because hashing a 4k texture is _slow_ in debug.
+    std::filesystem::file_time_type writeTime;
+    // Set for the shared caches and the local tags that point to them. Shared
+    // caches are tied to the contents so that copies of the source hit them.
+    uint64_t byteCount{0};
+    uint64_t hash{0};
+    uint64_t checkHash{0};
+    // Texture2DOptions that affect the cached data
+    uint32_t options{0};
+};
+
+bool sameSource(const CacheSource &a, const CacheSource &b)
+{
+    return a.writeTime == b.writeTime && a.byteCount == b.byteCount &&
+           a.hash == b.hash && a.checkHash == b.checkHash &&
+           a.options == b.options;
+}
+
+uint32_t packOptions(const Texture2DOptions &options)
+{
+    return (options.generateMipMaps ? 0x1u : 0u) |
+           (static_cast<uint32_t>(options.colorSpace) << 1) |
+           (static_cast<uint32_t>(gCacheQuality) << 2) |
+           (static_cast<uint32_t>(options.channelUsage) << 4);
+}
+
+CacheSource hashSource(
+    Span<const uint8_t> sourceBytes, const Texture2DOptions &options)
+{
+    const uint32_t packedOptions = packOptions(options);
+    return CacheSource{
+        .byteCount = sourceBytes.size(),
+        .hash = wyhash(
+            sourceBytes.data(), sourceBytes.size(), packedOptions,
+            (uint64_t const *)_wyp),
+        .checkHash = wyhash(
+            sourceBytes.data(), sourceBytes.size(),
+            sCacheCheckHashSeed ^ packedOptions, (uint64_t const *)_wyp),
+        .options = packedOptions,
+    };
+}
+
+Array<uint8_t> readSourceBytes(
+    Allocator &alloc, const std::filesystem::path &path)
+{
+    std::ifstream file{path, std::ios::ate | std::ios::binary};
+    if (!file.is_open())
+        throw std::runtime_error(
+            "Failed to open texture '" + path.string() + "'");
+
+    const auto byteCount = static_cast<size_t>(file.tellg());
+    Array<uint8_t> ret{alloc};
+    ret.resize(byteCount);
+
+    file.seekg(0);
+    readRawSpan(file, ret.mut_span());
+
+    return ret;
+}
+
 struct CacheTag
 {
     uint32_t version{0xFFFF'FFFFu};
-    // Use write time instead of a hash because hashing a 4k texture is _slow_
-    // in debug.
-    std::filesystem::file_time_type sourceWriteTime;
+    CacheSource source;
+};
+
+// Value of sKtx2CacheTagKey in KTX2 caches
+struct Ktx2CacheTag
+{
+    uint64_t magic{sTextureCacheMagic};
+    uint32_t version{sTextureCacheVersion};
+    uint32_t padding{0};
+    CacheSource source;
 };
 
-CacheTag readCacheTag(const std::filesystem::path &cacheFile)
+CacheTag readKtx2CacheTag(
+    ScopedScratch scopeAlloc, const std::filesystem::path &cacheFile)
+{
+    CacheTag tag;
+
+    const utils::Ktx2Header header =
+        utils::readKtx2Header(scopeAlloc, cacheFile);
+    const Span<const uint8_t> value =
+        utils::findKtx2Value(header, sKtx2CacheTagKey);
+    if (value.size() != sizeof(Ktx2CacheTag))
+        return tag;
+
+    Ktx2CacheTag storedTag;
+    memcpy(&storedTag, value.data(), sizeof(storedTag));
+
+    tag.version = storedTag.version;
+    if (sTextureCacheVersion != tag.version)
+        return tag;
+
+    if (storedTag.magic != sTextureCacheMagic)
+        throw std::runtime_error(
+            "Expected a valid texture cache tag in file '" +
+            cacheFile.string() + "'");
+
+    tag.source = storedTag.source;
+
+    return tag;
+}
+
+// Reads the tag file that sits next to cacheFile
+CacheTag readSidecarCacheTag(const std::filesystem::path &cacheFile)
 {
     CacheTag tag;
 
@@ -89,23 +255,30 @@ CacheTag readCacheTag(const std::filesystem::path &cacheFile)
             "Expected a valid texture cache tag in file '" + tagPath.string() +
             "'");
 
-    readRaw(tagFile, tag.sourceWriteTime);
+    readRaw(tagFile, tag.source);
 
     return tag;
 }
 
+CacheTag readCacheTag(
+    ScopedScratch scopeAlloc, const std::filesystem::path &cacheFile)
+{
+    if (isKtx2(cacheFile))
+        return readKtx2CacheTag(WHEELS_MOV(scopeAlloc), cacheFile);
+
+    return readSidecarCacheTag(cacheFile);
+}
+
+// Also used on its own to store the content key of the source next to it when
+// the cache itself is shared
 void writeCacheTag(
-    const std::filesystem::path &cacheFile,
-    const std::filesystem::file_time_type &sourceWriteTime)
+    const std::filesystem::path &cacheFile, const CacheSource &source)
 {
     const std::filesystem::path tagPath = cacheTagPath(cacheFile);
 
-    std::filesystem::remove(tagPath);
-
-    // Write into a tmp file and rename when done to minimize the potential for
-    // corrupted files
-    std::filesystem::path tagTmpPath = tagPath;
-    tagTmpPath.replace_extension("prosper_cache_tag_TMP");
+    // Write into a tmp file and rename over the old one when done to minimize
+    // the potential for corrupted files
+    const std::filesystem::path tagTmpPath = uniqueTmpPath(tagPath);
 
     // NOTE:
     // Caches aren't supposed to be portable so we don't pay attention to
@@ -113,7 +286,7 @@ void writeCacheTag(
     std::ofstream tagFile{tagTmpPath, std::ios_base::binary};
     writeRaw(tagFile, sTextureCacheVersion);
     writeRaw(tagFile, sTextureCacheMagic);
-    writeRaw(tagFile, sourceWriteTime);
+    writeRaw(tagFile, source);
     tagFile.close();
 
     // Make sure we have rw permissions for the user to be nice
@@ -129,8 +302,8 @@ void writeCacheTag(
 }
 
 bool cacheValid(
-    const std::filesystem::path &cacheFile,
-    const std::filesystem::file_time_type &sourceWriteTime)
+    ScopedScratch scopeAlloc, const std::filesystem::path &cacheFile,
+    const CacheSource &source)
 {
     try
     {
@@ -140,7 +313,8 @@ bool cacheValid(
             return false;
         }
 
-        const CacheTag storedTag = readCacheTag(cacheFile);
+        const CacheTag storedTag =
+            readCacheTag(WHEELS_MOV(scopeAlloc), cacheFile);
 
         if (sTextureCacheVersion != storedTag.version)
         {
@@ -149,7 +323,7 @@ bool cacheValid(
             return false;
         }
 
-        if (storedTag.sourceWriteTime != sourceWriteTime)
+        if (!sameSource(storedTag.source, source))
         {
             LOG_INFO("Stale cache for {}", cacheFile.string().c_str());
             return false;
@@ -163,13 +337,81 @@ bool cacheValid(
     return true;
 }
 
+vk::Format asVkFormat(utils::DxgiFormat format)
+{
+    switch (format)
+    {
+    case utils::DxgiFormat::R8G8B8A8Unorm:
+        return vk::Format::eR8G8B8A8Unorm;
+    case utils::DxgiFormat::R9G9B9E5SharedExp:
+        return vk::Format::eE5B9G9R9UfloatPack32;
+    case utils::DxgiFormat::BC4Unorm:
+        return vk::Format::eBc4UnormBlock;
+    case utils::DxgiFormat::BC5Unorm:
+        return vk::Format::eBc5UnormBlock;
+    case utils::DxgiFormat::BC6HUf16:
+        return vk::Format::eBc6HUfloatBlock;
+    case utils::DxgiFormat::BC7Unorm:
+        return vk::Format::eBc7UnormBlock;
+    default:
+        break;
+    }
+    throw std::runtime_error("Unkown DxgiFormat");
+}
+
+void writeCache(
+    ScopedScratch scopeAlloc, utils::Dds &&dds,
+    const std::filesystem::path &cacheFile, const CacheSource &source)
+{
+    if (!sKtx2Cache)
+    {
+        writeDds(dds, cacheFile);
+        writeCacheTag(cacheFile, source);
+        return;
+    }
+
+    const utils::Ktx ktx{
+        .width = dds.width,
+        .height = dds.height,
+        .depth = 1,
+        .format = asVkFormat(dds.format),
+        .arrayLayerCount = 1,
+        .faceCount = 1,
+        .mipLevelCount = dds.mipLevelCount,
+        .data = WHEELS_MOV(dds.data),
+        .levelByteOffsets = WHEELS_MOV(dds.levelByteOffsets),
+    };
+
+    const Ktx2CacheTag tag{
+        .source = source,
+    };
+    // Keys have to be sorted
+    const StaticArray<utils::Ktx2KeyValue, 2> keyValues{{
+        utils::Ktx2KeyValue{
+            .key = sKtx2WriterKey,
+            .value =
+                Span{
+                    reinterpret_cast<const uint8_t *>(sKtx2Writer),
+                    strlen(sKtx2Writer) + 1},
+        },
+        utils::Ktx2KeyValue{
+            .key = sKtx2CacheTagKey,
+            .value =
+                Span{reinterpret_cast<const uint8_t *>(&tag), sizeof(tag)},
+        },
+    }};
+
+    utils::writeKtx2(WHEELS_MOV(scopeAlloc), ktx, keyValues.span(), cacheFile);
+}
+
 void generateMipLevels(
     Array<uint8_t> &rawLevels, Array<uint32_t> &rawLevelByteOffsets,
     const UncompressedPixelData &pixels, TextureColorSpace colorSpace)
 {
     const size_t mipLevelCount = rawLevelByteOffsets.size();
-    // TODO: Non-8bit channels?
-    const uint32_t pixelStride = pixels.channels;
+    const uint32_t pixelStride =
+        pixels.channels *
+        static_cast<uint32_t>(pixels.hdr ? sizeof(float) : sizeof(uint8_t));
     // TODO: Pass in actual layout
     const auto pixelLayout = static_cast<stbir_pixel_layout>(pixels.channels);
 
@@ -192,7 +434,22 @@ void generateMipLevels(
             rawLevels.data() + rawLevelByteOffsets[level - 1]);
         uint8_t *data = reinterpret_cast<uint8_t *>(
             rawLevels.data() + rawLevelByteOffsets[level]);
-        if (colorSpace == TextureColorSpace::sRgb)
+        if (!pixels.hdr && pixels.channels == 4 &&
+            utils::canDownsample2x(parentWidth, parentHeight))
+            // The general resizer is slow for the plain halving that most
+            // levels need
+            utils::downsample2xRgba8(
+                parentData, parentWidth, parentHeight, data,
+                colorSpace == TextureColorSpace::sRgb);
+        else if (pixels.hdr)
+            // HDR data is always linear
+            stbir_resize_float_linear(
+                reinterpret_cast<const float *>(parentData),
+                asserted_cast<int>(parentWidth),
+                asserted_cast<int>(parentHeight), 0,
+                reinterpret_cast<float *>(data), asserted_cast<int>(width),
+                asserted_cast<int>(height), 0, pixelLayout);
+        else if (colorSpace == TextureColorSpace::sRgb)
             stbir_resize_uint8_srgb(
                 parentData, asserted_cast<int>(parentWidth),
                 asserted_cast<int>(parentHeight), 0, data,
@@ -210,9 +467,313 @@ void generateMipLevels(
     }
 }
 
-void compress(
-    ScopedScratch scopeAlloc, const std::filesystem::path &targetPath,
+utils::DxgiFormat selectBlockFormat(
     const UncompressedPixelData &pixels, const Texture2DOptions &options)
+{
+    if (pixels.hdr)
+        return utils::DxgiFormat::BC6HUf16;
+
+    switch (options.channelUsage)
+    {
+    case TextureChannelUsage::Color:
+        return utils::DxgiFormat::BC7Unorm;
+    case TextureChannelUsage::NormalMap:
+    case TextureChannelUsage::RoughnessMetalness:
+        return utils::DxgiFormat::BC5Unorm;
+    case TextureChannelUsage::Occlusion:
+        return utils::DxgiFormat::BC4Unorm;
+    }
+    throw std::runtime_error("Unexpected TextureChannelUsage");
+}
+
+// First channel of the rgba source that BC4 and BC5 store
+uint32_t encodedFirstChannel(const Texture2DOptions &options)
+{
+    return options.channelUsage == TextureChannelUsage::RoughnessMetalness
+               ? 1
+               : 0;
+}
+
+// Pixel byte count of the input that ispc_texcomp expects for the format
+uint32_t encoderPixelByteCount(utils::DxgiFormat format)
+{
+    switch (format)
+    {
+    case utils::DxgiFormat::BC4Unorm:
+        // R8
+        return 1;
+    case utils::DxgiFormat::BC5Unorm:
+        // R8G8
+        return 2;
+    case utils::DxgiFormat::BC6HUf16:
+        // R16G16B16A16 half
+        return 8;
+    case utils::DxgiFormat::BC7Unorm:
+        // R8G8B8A8
+        return 4;
+    default:
+        break;
+    }
+    throw std::runtime_error("Unexpected block compressed DxgiFormat");
+}
+
+// Converts the rgba8 or rgba32f level into the input format of the encoder.
+// BC4 and BC5 take the channels from firstChannel on. BC7 takes rgba8 as is.
+void packEncoderInput(
+    utils::DxgiFormat format, uint32_t firstChannel, const uint8_t *src,
+    uint8_t *dst, size_t pixelCount)
+{
+    switch (format)
+    {
+    case utils::DxgiFormat::BC4Unorm:
+        WHEELS_ASSERT(firstChannel < 4);
+        for (size_t i = 0; i < pixelCount; ++i)
+            dst[i] = src[i * 4 + firstChannel];
+        break;
+    case utils::DxgiFormat::BC5Unorm:
+        WHEELS_ASSERT(firstChannel < 3);
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            dst[i * 2] = src[i * 4 + firstChannel];
+            dst[i * 2 + 1] = src[i * 4 + firstChannel + 1];
+        }
+        break;
+    case utils::DxgiFormat::BC6HUf16:
+    {
+        const float *srcF32 = reinterpret_cast<const float *>(src);
+        for (size_t i = 0; i < pixelCount * 4; ++i)
+        {
+            // BC6H is unsigned
+            const uint16_t half =
+                glm::packHalf1x16(std::max(srcF32[i], 0.f));
+            memcpy(dst + i * sizeof(half), &half, sizeof(half));
+        }
+        break;
+    }
+    default:
+        throw std::runtime_error("Unexpected block compressed DxgiFormat");
+    }
+}
+
+struct BlockStripe
+{
+    rgba_surface surface{};
+    uint8_t *dst{nullptr};
+};
+
+struct StripeJob
+{
+    utils::DxgiFormat format{utils::DxgiFormat::Unknown};
+    const BlockStripe *stripe{nullptr};
+    const bc7_enc_settings *bc7Settings{nullptr};
+    const bc6h_enc_settings *bc6hSettings{nullptr};
+    // Owned by the thread that compresses the texture, it waits for this to
+    // reach zero. Guarded by the queue mutex.
+    uint32_t *pendingCount{nullptr};
+};
+
+// Stripes of all the textures that are being compressed go through this so
+// that the texture workers help each other instead of each texture starting
+// threads of its own
+struct StripeJobQueue
+{
+    std::mutex mutex;
+    // Signaled when jobs are queued or finished
+    std::condition_variable condition;
+    std::array<StripeJob, sMaxQueuedStripeCount> jobs;
+    size_t first{0};
+    size_t count{0};
+};
+StripeJobQueue gStripeJobs;
+
+// Expects the caller to hold the queue mutex
+Optional<StripeJob> popStripeJob()
+{
+    if (gStripeJobs.count == 0)
+        return {};
+
+    const StripeJob job = gStripeJobs.jobs[gStripeJobs.first];
+    gStripeJobs.first = (gStripeJobs.first + 1) % sMaxQueuedStripeCount;
+    gStripeJobs.count--;
+
+    return job;
+}
+
+// Runs the job without holding the queue lock and marks it finished
+void runStripeJob(std::unique_lock<std::mutex> &lock, const StripeJob &job)
+{
+    lock.unlock();
+    {
+        // The encoders take the settings as mutable so give each job its own
+        // copy
+        bc7_enc_settings bc7Settings = *job.bc7Settings;
+        bc6h_enc_settings bc6hSettings = *job.bc6hSettings;
+
+        const rgba_surface *src = &job.stripe->surface;
+        uint8_t *dst = job.stripe->dst;
+        switch (job.format)
+        {
+        case utils::DxgiFormat::BC4Unorm:
+            CompressBlocksBC4(src, dst);
+            break;
+        case utils::DxgiFormat::BC5Unorm:
+            CompressBlocksBC5(src, dst);
+            break;
+        case utils::DxgiFormat::BC6HUf16:
+            CompressBlocksBC6H(src, dst, &bc6hSettings);
+            break;
+        case utils::DxgiFormat::BC7Unorm:
+            CompressBlocksBC7(src, dst, &bc7Settings);
+            break;
+        default:
+            WHEELS_ASSERT(!"Unexpected block compressed DxgiFormat");
+            break;
+        }
+    }
+    lock.lock();
+
+    WHEELS_ASSERT(*job.pendingCount > 0);
+    (*job.pendingCount)--;
+    if (*job.pendingCount == 0)
+        gStripeJobs.condition.notify_all();
+}
+
+// Blocks are compressed independently so the output is identical to
+// compressing each level in one go
+void compressStripes(utils::DxgiFormat format, Span<const BlockStripe> stripes)
+{
+    bc7_enc_settings bc7Settings{};
+    bc6h_enc_settings bc6hSettings{};
+    switch (gCacheQuality)
+    {
+    case TextureCacheQuality::UltraFast:
+        // BC6H doesn't have an ultrafast profile
+        GetProfile_alpha_ultrafast(&bc7Settings);
+        GetProfile_bc6h_veryfast(&bc6hSettings);
+        break;
+    case TextureCacheQuality::Fast:
+        GetProfile_alpha_fast(&bc7Settings);
+        GetProfile_bc6h_fast(&bc6hSettings);
+        break;
+    case TextureCacheQuality::Basic:
+        GetProfile_alpha_basic(&bc7Settings);
+        GetProfile_bc6h_basic(&bc6hSettings);
+        break;
+    case TextureCacheQuality::Slow:
+        GetProfile_alpha_slow(&bc7Settings);
+        GetProfile_bc6h_slow(&bc6hSettings);
+        break;
+    }
+
+    const size_t stripeCount = stripes.size();
+    uint32_t pendingCount = asserted_cast<uint32_t>(stripeCount);
+    const auto stripeJob = [&](size_t i)
+    {
+        return StripeJob{
+            .format = format,
+            .stripe = &stripes[i],
+            .bc7Settings = &bc7Settings,
+            .bc6hSettings = &bc6hSettings,
+            .pendingCount = &pendingCount,
+        };
+    };
+
+    std::unique_lock lock{gStripeJobs.mutex};
+
+    size_t nextStripe = 0;
+    while (nextStripe < stripeCount &&
+           gStripeJobs.count < sMaxQueuedStripeCount)
+    {
+        const size_t slot =
+            (gStripeJobs.first + gStripeJobs.count) % sMaxQueuedStripeCount;
+        gStripeJobs.jobs[slot] = stripeJob(nextStripe++);
+        gStripeJobs.count++;
+    }
+    gStripeJobs.condition.notify_all();
+
+    // The stripes that didn't fit are only ours to compress. After those, help
+    // with whatever is queued until the other threads finish our stripes.
+    while (pendingCount > 0)
+    {
+        if (nextStripe < stripeCount)
+        {
+            runStripeJob(lock, stripeJob(nextStripe++));
+            continue;
+        }
+
+        const Optional<StripeJob> job = popStripeJob();
+        if (job.has_value())
+            runStripeJob(lock, *job);
+        else
+            gStripeJobs.condition.wait(lock);
+    }
+}
+
+// Decodes the tightly packed blocks of a level and compares them against the
+// encoder input. HDR formats aren't supported as there's no meaningful peak.
+float blockPsnr(
+    utils::DxgiFormat format, const uint8_t *input, const uint8_t *blocks,
+    uint32_t width, uint32_t height)
+{
+    const uint32_t channelCount = encoderPixelByteCount(format);
+    const uint32_t blockByteCount =
+        format == utils::DxgiFormat::BC4Unorm ? 8 : 16;
+    const uint32_t blockRowStride = 4 * channelCount;
+
+    StaticArray<uint8_t, 4 * 4 * 4> decoded{0};
+    uint64_t squaredErrorSum = 0;
+    const uint8_t *block = blocks;
+    for (uint32_t by = 0; by < height / 4; ++by)
+    {
+        for (uint32_t bx = 0; bx < width / 4; ++bx)
+        {
+            switch (format)
+            {
+            case utils::DxgiFormat::BC4Unorm:
+                bcdec_bc4(block, decoded.data(), blockRowStride, 0);
+                break;
+            case utils::DxgiFormat::BC5Unorm:
+                bcdec_bc5(block, decoded.data(), blockRowStride, 0);
+                break;
+            case utils::DxgiFormat::BC7Unorm:
+                bcdec_bc7(block, decoded.data(), blockRowStride);
+                break;
+            default:
+                throw std::runtime_error("Unexpected LDR block DxgiFormat");
+            }
+            block += blockByteCount;
+
+            for (uint32_t y = 0; y < 4; ++y)
+            {
+                const uint8_t *inputRow =
+                    input + (((static_cast<size_t>(by * 4 + y) * width) +
+                              (bx * 4)) *
+                             channelCount);
+                const uint8_t *decodedRow =
+                    decoded.data() + (y * blockRowStride);
+                for (uint32_t i = 0; i < blockRowStride; ++i)
+                {
+                    const int32_t diff = static_cast<int32_t>(inputRow[i]) -
+                                         static_cast<int32_t>(decodedRow[i]);
+                    squaredErrorSum += static_cast<uint64_t>(diff * diff);
+                }
+            }
+        }
+    }
+
+    if (squaredErrorSum == 0)
+        return std::numeric_limits<float>::infinity();
+
+    const double mse = static_cast<double>(squaredErrorSum) /
+                       (static_cast<double>(width) * height * channelCount);
+    return static_cast<float>(10. * std::log10((255. * 255.) / mse));
+}
+
+// Returns the PSNR of the first level for the LDR block formats
+Optional<float> compress(
+    ScopedScratch scopeAlloc, const std::filesystem::path &targetPath,
+    const CacheSource &source, const UncompressedPixelData &pixels,
+    const Texture2DOptions &options)
 {
     // First calculate mip count down to 1x1
     const int32_t fullMipLevelCount =
@@ -224,14 +785,15 @@ void compress(
     const uint32_t mipLevelCount =
         asserted_cast<uint32_t>(std::max(fullMipLevelCount - 2, 1));
 
-    utils::DxgiFormat format = utils::DxgiFormat::BC7Unorm;
-    // All BC7 levels have to divide evenly by 4 in both directions
+    utils::DxgiFormat format = selectBlockFormat(pixels, options);
+    // All BC levels have to divide evenly by 4 in both directions
     for (uint32_t i = 0; i < mipLevelCount; ++i)
     {
         if (std::max(pixels.extent.width >> i, 1u) % 4 != 0 ||
             std::max(pixels.extent.height >> i, 1u) % 4 != 0)
         {
-            format = utils::DxgiFormat::R8G8B8A8Unorm;
+            format = pixels.hdr ? utils::DxgiFormat::R9G9B9E5SharedExp
+                                : utils::DxgiFormat::R8G8B8A8Unorm;
             break;
         }
     }
@@ -248,51 +810,321 @@ void compress(
     Array<uint32_t> rawLevelByteOffsets{scopeAlloc};
     rawLevelByteOffsets.resize(mipLevelCount, 0);
 
+    Optional<float> psnr;
+
     if (mipLevelCount > 1)
         generateMipLevels(
             rawLevels, rawLevelByteOffsets, pixels, options.colorSpace);
 
-    if (format == utils::DxgiFormat::BC7Unorm)
+    if (format == utils::DxgiFormat::R8G8B8A8Unorm)
     {
-        bc7_enc_settings bc7Settings{};
-        // Don't really care about quality at this point, this is much faster
-        // than even veryfast
-        GetProfile_alpha_ultrafast(&bc7Settings);
+        WHEELS_ASSERT(dds.data.size() <= rawLevels.size());
+        memcpy(dds.data.data(), rawLevels.data(), dds.data.size());
+    }
+    else if (format == utils::DxgiFormat::R9G9B9E5SharedExp)
+    {
+        // Levels are tightly packed in both
+        const size_t pixelCount = dds.data.size() / sizeof(uint32_t);
+        WHEELS_ASSERT(pixelCount * 4 * sizeof(float) <= rawLevels.size());
+        const float *src = reinterpret_cast<const float *>(rawLevels.data());
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            const uint32_t packed = glm::packF3x9_E1x5(
+                glm::vec3{src[i * 4], src[i * 4 + 1], src[i * 4 + 2]});
+            memcpy(
+                dds.data.data() + i * sizeof(packed), &packed, sizeof(packed));
+        }
+    }
+    else
+    {
+        const uint32_t inputPixelByteCount = encoderPixelByteCount(format);
+        const uint32_t rawPixelByteCount = asserted_cast<uint32_t>(
+            pixels.hdr ? 4 * sizeof(float) : 4 * sizeof(uint8_t));
+
+        // 4x4 blocks are 8bytes for BC4 and 16bytes for the rest
+        const uint32_t blockByteCount =
+            format == utils::DxgiFormat::BC4Unorm ? 8 : 16;
+
+        Array<uint8_t> encoderInput{scopeAlloc};
+        if (format != utils::DxgiFormat::BC7Unorm)
+            encoderInput.resize(
+                (rawLevels.size() / rawPixelByteCount) * inputPixelByteCount);
 
+        Array<BlockStripe> stripes{scopeAlloc};
+        size_t inputLevelByteOffset = 0;
         for (uint32_t i = 0; i < mipLevelCount; ++i)
         {
-
             const uint32_t width = std::max(dds.width >> i, 1u);
             const uint32_t height = std::max(dds.height >> i, 1u);
             WHEELS_ASSERT(
                 width % 4 == 0 && height % 4 == 0 &&
-                "BC7 mips should be divide evenly by 4x4");
+                "BC mips should be divide evenly by 4x4");
             WHEELS_ASSERT(
                 width >= 4 && height >= 4 &&
-                "BC7 mip dimensions should be at least 4x4");
-
-            const rgba_surface rgbaSurface{
-                .ptr = rawLevels.data() + rawLevelByteOffsets[i],
-                .width = asserted_cast<int32_t>(width),
-                .height = asserted_cast<int32_t>(height),
-                .stride = asserted_cast<int32_t>(width * 4),
-            };
-            uint8_t *dst = dds.data.data() + dds.levelByteOffsets[i];
-            // TODO:
-            // 4k textures are really slow to convert even when AVX2 is
-            // available. The vectorized code path seems to be used as expected
-            // so this is apparently just slow. Parallelize this with OpenMP or
-            // something?
-            CompressBlocksBC7(&rgbaSurface, dst, &bc7Settings);
+                "BC mip dimensions should be at least 4x4");
+
+            uint8_t *input = rawLevels.data() + rawLevelByteOffsets[i];
+            if (format != utils::DxgiFormat::BC7Unorm)
+            {
+                uint8_t *packedInput =
+                    encoderInput.data() + inputLevelByteOffset;
+                packEncoderInput(
+                    format, encodedFirstChannel(options), input, packedInput,
+                    static_cast<size_t>(width) * height);
+                input = packedInput;
+                inputLevelByteOffset +=
+                    static_cast<size_t>(width) * height * inputPixelByteCount;
+            }
+
+            const uint32_t rowStride = width * inputPixelByteCount;
+            const uint32_t blockRowByteCount = (width / 4) * blockByteCount;
+            const uint32_t blockRowCount = height / 4;
+            for (uint32_t row = 0; row < blockRowCount;
+                 row += sStripeBlockRows)
+            {
+                const uint32_t stripeRowCount =
+                    std::min(sStripeBlockRows, blockRowCount - row);
+                stripes.push_back(
+                    BlockStripe{
+                        .surface =
+                            rgba_surface{
+                                .ptr = input + (row * 4 * rowStride),
+                                .width = asserted_cast<int32_t>(width),
+                                .height =
+                                    asserted_cast<int32_t>(stripeRowCount * 4),
+                                .stride = asserted_cast<int32_t>(rowStride),
+                            },
+                        .dst = dds.data.data() + dds.levelByteOffsets[i] +
+                               (row * blockRowByteCount),
+                    });
+            }
+        }
+
+        compressStripes(format, stripes.span());
+
+        if (format != utils::DxgiFormat::BC6HUf16)
+        {
+            const uint8_t *input = format == utils::DxgiFormat::BC7Unorm
+                                       ? rawLevels.data()
+                                       : encoderInput.data();
+            psnr = blockPsnr(
+                format, input, dds.data.data(), dds.width, dds.height);
         }
     }
+
+    writeCache(scopeAlloc.child_scope(), WHEELS_MOV(dds), targetPath, source);
+
+    return psnr;
+}
+
+// Decodes the source from sourceBytes if they are given and from path
+// otherwise
+void compressSource(
+    ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    Span<const uint8_t> sourceBytes, const std::filesystem::path &targetPath,
+    const CacheSource &source, const Texture2DOptions &options)
+{
+    const auto pathString = path.string();
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    const int desiredChannels = 4;
+    void *stb_pixels = nullptr;
+    bool hdr = false;
+    // HDR sources are loaded as f32 and compressed into BC6H
+    if (sourceBytes.empty())
+    {
+        hdr = stbi_is_hdr(pathString.c_str()) != 0;
+        if (hdr)
+            stb_pixels = stbi_loadf(
+                pathString.c_str(), &width, &height, &channels,
+                desiredChannels);
+        else
+            stb_pixels = stbi_load(
+                pathString.c_str(), &width, &height, &channels,
+                desiredChannels);
+    }
     else
     {
-        WHEELS_ASSERT(dds.data.size() <= rawLevels.size());
-        memcpy(dds.data.data(), rawLevels.data(), dds.data.size());
+        const stbi_uc *bytes = sourceBytes.data();
+        const int byteCount = asserted_cast<int>(sourceBytes.size());
+        hdr = stbi_is_hdr_from_memory(bytes, byteCount) != 0;
+        if (hdr)
+            stb_pixels = stbi_loadf_from_memory(
+                bytes, byteCount, &width, &height, &channels, desiredChannels);
+        else
+            stb_pixels = stbi_load_from_memory(
+                bytes, byteCount, &width, &height, &channels, desiredChannels);
     }
+    if (stb_pixels == nullptr)
+        throw std::runtime_error("Failed to load texture '" + pathString + "'");
+    channels = desiredChannels;
+
+    defer { stbi_image_free(stb_pixels); };
+
+    const UncompressedPixelData pixels{
+        .data =
+            Span{
+                static_cast<const uint8_t *>(stb_pixels),
+                asserted_cast<size_t>(width) * asserted_cast<size_t>(height) *
+                    asserted_cast<size_t>(channels) *
+                    (hdr ? sizeof(float) : sizeof(uint8_t))},
+        .extent =
+            vk::Extent2D{
+                .width = asserted_cast<uint32_t>(width),
+                .height = asserted_cast<uint32_t>(height),
+            },
+        .channels = asserted_cast<uint32_t>(channels),
+        .hdr = hdr,
+    };
 
-    writeDds(dds, targetPath);
+    const utils::Timer t;
+    const Optional<float> psnr =
+        compress(WHEELS_MOV(scopeAlloc), targetPath, source, pixels, options);
+    if (psnr.has_value())
+        LOG_INFO(
+            "Compressed '{}' in {:.2f}s, PSNR {:.2f}dB", pathString,
+            t.getSeconds(), *psnr);
+    else
+        LOG_INFO("Compressed '{}' in {:.2f}s", pathString, t.getSeconds());
+}
+
+// Marks the entry as recently used
+void touchSharedCache(const std::filesystem::path &cacheFile)
+{
+    std::error_code ec;
+    std::filesystem::last_write_time(
+        cacheFile, std::filesystem::file_time_type::clock::now(), ec);
+}
+
+// Removes the least recently used entries until the shared cache fits in its
+// limit. Entries used in this session are never removed so the cache can stay
+// over the limit if the loaded scenes don't fit in it.
+void trimSharedCache(ScopedScratch scopeAlloc)
+{
+    if (gSharedCacheMaxByteCount == 0)
+        return;
+
+    struct Entry
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type writeTime;
+        uintmax_t byteCount{0};
+    };
+
+    const std::lock_guard _lock{gSharedCacheTrimMutex};
+
+    Array<Entry> entries{scopeAlloc};
+    uintmax_t totalByteCount = 0;
+    std::error_code ec;
+    for (const std::filesystem::directory_entry &dirEntry :
+         std::filesystem::directory_iterator{gSharedCacheDir, ec})
+    {
+        const std::filesystem::path &entryPath = dirEntry.path();
+        const std::string ext = entryPath.extension().string();
+        if (ext.ends_with("_TMP"))
+        {
+            // Tmp files from earlier sessions are left over from interrupted
+            // writes
+            if (dirEntry.last_write_time(ec) < gSharedCacheSessionStart &&
+                !ec)
+                std::filesystem::remove(entryPath, ec);
+            continue;
+        }
+        if (ext != ".dds" && ext != ".ktx2")
+            continue;
+
+        Entry entry{
+            .path = entryPath,
+            .writeTime = dirEntry.last_write_time(ec),
+            .byteCount = dirEntry.file_size(ec),
+        };
+        if (ec)
+            continue;
+
+        if (ext == ".dds")
+            entry.byteCount +=
+                std::filesystem::file_size(cacheTagPath(entryPath), ec);
+        if (ec)
+            continue;
+
+        totalByteCount += entry.byteCount;
+        entries.push_back(WHEELS_MOV(entry));
+    }
+
+    if (totalByteCount <= gSharedCacheMaxByteCount)
+        return;
+
+    std::sort(
+        entries.begin(), entries.end(),
+        [](const Entry &a, const Entry &b)
+        { return a.writeTime < b.writeTime; });
+
+    for (const Entry &entry : entries)
+    {
+        if (totalByteCount <= gSharedCacheMaxByteCount)
+            break;
+
+        // The rest are pinned as they are sorted by the write time
+        if (entry.writeTime >= gSharedCacheSessionStart)
+        {
+            LOG_WARN(
+                "Shared texture cache is over its limit with the textures in "
+                "use");
+            break;
+        }
+
+        LOG_INFO("Evicting shared texture cache {}", entry.path.string());
+        std::filesystem::remove(entry.path, ec);
+        std::filesystem::remove(cacheTagPath(entry.path), ec);
+        totalByteCount -= entry.byteCount;
+    }
+}
+
+// Returns an empty path if the shared entry for the source hash belongs to
+// different contents, the caller should fall back to a local cache then
+std::filesystem::path updateSharedCache(
+    ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    Span<const uint8_t> sourceBytes, const CacheSource &source,
+    const Texture2DOptions &options)
+{
+    const std::filesystem::path cached = sharedCachePath(source.hash);
+
+    const std::lock_guard _lock{
+        gSharedCacheEntryMutexes
+            [source.hash % gSharedCacheEntryMutexes.size()]};
+
+    CacheTag storedTag;
+    try
+    {
+        if (std::filesystem::exists(cached))
+            storedTag = readCacheTag(scopeAlloc.child_scope(), cached);
+    }
+    catch (std::exception &)
+    {
+        // Corrupted entries are rewritten below
+    }
+
+    // Entries from older cache versions are just overwritten
+    if (storedTag.version == sTextureCacheVersion)
+    {
+        if (sameSource(storedTag.source, source))
+        {
+            touchSharedCache(cached);
+            return cached;
+        }
+
+        LOG_WARN(
+            "Shared texture cache hash collision between '{}' and {}",
+            path.string(), cached.string());
+        return std::filesystem::path{};
+    }
+
+    compressSource(
+        scopeAlloc.child_scope(), path, sourceBytes, cached, source, options);
+    trimSharedCache(scopeAlloc.child_scope());
+
+    return cached;
 }
 
 void transitionImageLayout(
@@ -319,20 +1151,117 @@ void transitionImageLayout(
         nullptr, 1, &barrier);
 }
 
-vk::Format asVkFormat(utils::DxgiFormat format)
+// Returns the first level that fits in maxExtent on both axes, or the last
+// level if none do
+uint32_t firstMipWithin(const Texture2DLevels &levels, uint32_t maxExtent)
 {
-    switch (format)
+    uint32_t ret = 0;
+    while (ret + 1 < levels.mipCount &&
+           std::max(levels.extent.width >> ret, levels.extent.height >> ret) >
+               maxExtent)
+        ret++;
+
+    return ret;
+}
+
+Texture2DLevels collectLevels(
+    const std::filesystem::path &cachePath, const utils::Dds &dds)
+{
+    WHEELS_ASSERT(dds.mipLevelCount > 0);
+    WHEELS_ASSERT(dds.mipLevelCount <= Texture2DLevels::sMaxMipCount);
+    WHEELS_ASSERT(dds.levelByteOffsets.size() == dds.mipLevelCount);
+
+    Texture2DLevels ret{
+        .cachePath = cachePath,
+        .format = asVkFormat(dds.format),
+        .extent =
+            vk::Extent2D{
+                .width = dds.width,
+                .height = dds.height,
+            },
+        .mipCount = dds.mipLevelCount,
+    };
+    for (uint32_t i = 0; i < dds.mipLevelCount; ++i)
     {
-    case utils::DxgiFormat::R8G8B8A8Unorm:
-        return vk::Format::eR8G8B8A8Unorm;
-    case utils::DxgiFormat::R9G9B9E5SharedExp:
-        return vk::Format::eE5B9G9R9UfloatPack32;
-    case utils::DxgiFormat::BC7Unorm:
-        return vk::Format::eBc7UnormBlock;
-    default:
-        break;
+        const size_t levelEnd = i + 1 < dds.mipLevelCount
+                                    ? dds.levelByteOffsets[i + 1]
+                                    : dds.data.size();
+        ret.levelByteCounts[i] =
+            asserted_cast<uint32_t>(levelEnd - dds.levelByteOffsets[i]);
     }
-    throw std::runtime_error("Unkown DxgiFormat");
+
+    return ret;
+}
+
+Texture2DLevels collectLevels(
+    const std::filesystem::path &cachePath, const utils::Ktx2Header &ktx)
+{
+    WHEELS_ASSERT(ktx.mipLevelCount > 0);
+    WHEELS_ASSERT(ktx.mipLevelCount <= Texture2DLevels::sMaxMipCount);
+    WHEELS_ASSERT(ktx.levels.size() == ktx.mipLevelCount);
+
+    Texture2DLevels ret{
+        .cachePath = cachePath,
+        .format = ktx.format,
+        .extent =
+            vk::Extent2D{
+                .width = ktx.width,
+                .height = ktx.height,
+            },
+        .mipCount = ktx.mipLevelCount,
+    };
+    for (uint32_t i = 0; i < ktx.mipLevelCount; ++i)
+        ret.levelByteCounts[i] =
+            asserted_cast<uint32_t>(ktx.levels[i].uncompressedByteCount);
+
+    return ret;
+}
+
+// Stages the levels starting from firstMip, or from the first one that fits
+// in maxExtent if that is smaller
+Texture2DLevels stageCachedLevels(
+    ScopedScratch scopeAlloc, const std::filesystem::path &cachePath,
+    uint32_t firstMip, uint32_t maxExtent, const gfx::Buffer &stagingBuffer)
+{
+    WHEELS_ASSERT(stagingBuffer.mapped != nullptr);
+
+    if (isKtx2(cachePath))
+    {
+        // Only the headers are read here and the levels are decompressed
+        // straight into the staging buffer
+        const utils::Ktx2Header ktx =
+            utils::readKtx2Header(scopeAlloc, cachePath);
+
+        Texture2DLevels ret = collectLevels(cachePath, ktx);
+        ret.firstMip = std::min(
+            std::max(firstMip, firstMipWithin(ret, maxExtent)),
+            ret.mipCount - 1);
+
+        const size_t byteCount = ret.byteCountFrom(ret.firstMip);
+        WHEELS_ASSERT(byteCount <= stagingBuffer.byteSize);
+        utils::readKtx2Levels(
+            scopeAlloc.child_scope(), cachePath, ktx, ret.firstMip,
+            Span{static_cast<uint8_t *>(stagingBuffer.mapped), byteCount});
+
+        return ret;
+    }
+
+    const utils::Dds dds = utils::readDds(scopeAlloc, cachePath);
+    WHEELS_ASSERT(!dds.data.empty());
+
+    Texture2DLevels ret = collectLevels(cachePath, dds);
+    ret.firstMip = std::min(
+        std::max(firstMip, firstMipWithin(ret, maxExtent)), ret.mipCount - 1);
+
+    // Levels are tightly packed so the resident ones are one contiguous range
+    const size_t byteOffset = dds.levelByteOffsets[ret.firstMip];
+    const size_t byteCount = ret.byteCountFrom(ret.firstMip);
+    WHEELS_ASSERT(byteOffset + byteCount == dds.data.size());
+    WHEELS_ASSERT(byteCount <= stagingBuffer.byteSize);
+
+    memcpy(stagingBuffer.mapped, dds.data.data() + byteOffset, byteCount);
+
+    return ret;
 }
 
 } // namespace
@@ -366,65 +1295,174 @@ vk::Image Texture::nativeHandle() const
 
 void Texture::destroy() { gfx::gDevice.destroy(m_image); }
 
-void Texture2D::init(
+TextureCacheQuality textureCacheQualityFromName(const std::string &name)
+{
+    if (name == "ultrafast")
+        return TextureCacheQuality::UltraFast;
+    if (name == "fast")
+        return TextureCacheQuality::Fast;
+    if (name == "basic")
+        return TextureCacheQuality::Basic;
+    if (name == "slow")
+        return TextureCacheQuality::Slow;
+
+    throw std::runtime_error("Unknown texture cache quality '" + name + "'");
+}
+
+void setTextureCacheQuality(TextureCacheQuality quality)
+{
+    gCacheQuality = quality;
+}
+
+void setSharedTextureCache(
+    const std::filesystem::path &directory, uintmax_t maxByteCount)
+{
+    gSharedCacheDir = directory;
+    gSharedCacheMaxByteCount = maxByteCount;
+    gSharedCacheSessionStart = std::filesystem::file_time_type::clock::now();
+
+    if (!gSharedCacheDir.empty())
+        std::filesystem::create_directories(gSharedCacheDir);
+}
+
+std::filesystem::path updateTextureCache(
     ScopedScratch scopeAlloc, const std::filesystem::path &path,
-    vk::CommandBuffer cb, const gfx::Buffer &stagingBuffer,
     const Texture2DOptions &options)
 {
     const std::filesystem::file_time_type sourceWriteTime =
         std::filesystem::last_write_time(path);
 
     const auto cached = cachePath(path);
-    if (!cacheValid(cached, sourceWriteTime))
-    {
-        const auto pathString = path.string();
-        int width = 0;
-        int height = 0;
-        int channels = 0;
-        const int desiredChannels = 4;
-        stbi_uc *stb_pixels = stbi_load(
-            pathString.c_str(), &width, &height, &channels, desiredChannels);
-        if (stb_pixels == nullptr)
-            throw std::runtime_error(
-                "Failed to load texture '" + pathString + "'");
-        channels = desiredChannels;
-
-        defer { stbi_image_free(stb_pixels); };
-
-        const UncompressedPixelData pixels{
-            .data =
-                Span{
-                    stb_pixels, asserted_cast<size_t>(width) *
-                                    asserted_cast<size_t>(height) *
-                                    asserted_cast<size_t>(channels)},
-            .extent =
-                vk::Extent2D{
-                    .width = asserted_cast<uint32_t>(width),
-                    .height = asserted_cast<uint32_t>(height),
-                },
-            .channels = asserted_cast<uint32_t>(channels),
-        };
+    if (!gSharedCacheDir.empty())
+    {
+        // The tag next to the source maps its write time to the content key so
+        // that unchanged sources don't have to be read and hashed again
+        CacheTag localTag;
+        try
+        {
+            localTag = readSidecarCacheTag(cached);
+        }
+        catch (std::exception &)
+        {
+            // Handled as a missing tag
+        }
 
-        compress(scopeAlloc.child_scope(), cached, pixels, options);
+        if (localTag.version == sTextureCacheVersion &&
+            localTag.source.writeTime == sourceWriteTime &&
+            localTag.source.hash != 0 &&
+            localTag.source.options == packOptions(options))
+        {
+            CacheSource sharedSource = localTag.source;
+            sharedSource.writeTime = std::filesystem::file_time_type{};
 
-        writeCacheTag(cached, sourceWriteTime);
-    }
+            const std::filesystem::path shared =
+                sharedCachePath(sharedSource.hash);
+            if (cacheValid(scopeAlloc.child_scope(), shared, sharedSource))
+            {
+                touchSharedCache(shared);
+                return shared;
+            }
+        }
 
-    // TODO:
-    // If cache was invalid, the newly cached one directly from memory
-    utils::Dds dds = utils::readDds(scopeAlloc, cached);
+        const Array<uint8_t> sourceBytes =
+            readSourceBytes(scopeAlloc, path);
+        CacheSource source = hashSource(sourceBytes.span(), options);
 
-    WHEELS_ASSERT(!dds.data.empty());
+        const std::filesystem::path shared = updateSharedCache(
+            scopeAlloc.child_scope(), path, sourceBytes.span(), source,
+            options);
+        if (!shared.empty())
+        {
+            source.writeTime = sourceWriteTime;
+            writeCacheTag(cached, source);
+            return shared;
+        }
+    }
 
-    const vk::Extent2D extent{
-        .width = dds.width,
-        .height = dds.height,
+    const CacheSource source{
+        .writeTime = sourceWriteTime,
+        .options = packOptions(options),
     };
+    if (!cacheValid(scopeAlloc.child_scope(), cached, source))
+        compressSource(
+            WHEELS_MOV(scopeAlloc), path, Span<const uint8_t>{}, cached, source,
+            options);
 
-    WHEELS_ASSERT(stagingBuffer.mapped != nullptr);
-    WHEELS_ASSERT(dds.data.size() <= stagingBuffer.byteSize);
+    return cached;
+}
 
-    memcpy(stagingBuffer.mapped, dds.data.data(), dds.data.size());
+size_t textureCacheScratchByteCount(const std::filesystem::path &path)
+{
+    const std::string pathString = path.string();
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    if (stbi_info(pathString.c_str(), &width, &height, &channels) == 0)
+        return 0;
+
+    const bool hdr = stbi_is_hdr(pathString.c_str()) != 0;
+    const size_t pixelCount =
+        asserted_cast<size_t>(width) * asserted_cast<size_t>(height);
+    // Sources are expanded to rgba
+    const size_t pixelsByteCount =
+        pixelCount * 4 * (hdr ? sizeof(float) : sizeof(uint8_t));
+    // Cached formats are at most four bytes per pixel and mips add a third
+    const size_t cacheByteCount = (pixelCount * 4 * 4) / 3;
+
+    // The source bytes, the level chain, the packed encoder input that is at
+    // most the size of the first level and the cached levels that are copied
+    // once more when they are written
+    return asserted_cast<size_t>(std::filesystem::file_size(path)) +
+           (pixelsByteCount * 3) + (cacheByteCount * 2) +
+           sCompressionScratchSlack;
+}
+
+void helpCompressTextures()
+{
+    std::unique_lock lock{gStripeJobs.mutex};
+    while (true)
+    {
+        const Optional<StripeJob> job = popStripeJob();
+        if (!job.has_value())
+            break;
+        runStripeJob(lock, *job);
+    }
+}
+
+size_t Texture2DLevels::byteCountFrom(uint32_t mip) const
+{
+    WHEELS_ASSERT(mip < mipCount);
+
+    size_t ret = 0;
+    for (uint32_t i = mip; i < mipCount; ++i)
+        ret += levelByteCounts[i];
+
+    return ret;
+}
+
+Texture2DLevels stageTexture2DLevels(
+    ScopedScratch scopeAlloc, const std::filesystem::path &cachePath,
+    uint32_t firstMip, const gfx::Buffer &stagingBuffer)
+{
+    return stageCachedLevels(
+        WHEELS_MOV(scopeAlloc), cachePath, firstMip, 0xFFFF'FFFF,
+        stagingBuffer);
+}
+
+void Texture2D::init(
+    ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    vk::CommandBuffer cb, const gfx::Buffer &stagingBuffer,
+    const Texture2DOptions &options)
+{
+    const std::filesystem::path cached =
+        updateTextureCache(scopeAlloc.child_scope(), path, options);
+
+    // TODO:
+    // If cache was invalid, the newly cached one directly from memory
+    m_levels = stageCachedLevels(
+        WHEELS_MOV(scopeAlloc), cached, 0, options.maxResidentExtent,
+        stagingBuffer);
+    m_levels.channelUsage = options.channelUsage;
 
     // TODO:
     // Use srgb formats in dds for srgb data, have a flag in texture ctor for
@@ -432,68 +1470,197 @@ void Texture2D::init(
     // potentially confusing.
 
     const std::filesystem::path relPath = relativePath(path);
+    createImage(relPath.generic_string().c_str());
+
+    copyFromStaging(cb, stagingBuffer);
+
+    if (options.initialState != gfx::ImageState::Unknown)
+        m_image.transition(cb, options.initialState);
+}
+
+void Texture2D::init(
+    const Texture2DLevels &levels, vk::CommandBuffer cb,
+    const gfx::Buffer &stagingBuffer, gfx::ImageState initialState)
+{
+    m_levels = levels;
+
+    const std::filesystem::path relPath = relativePath(m_levels.cachePath);
+    createImage(relPath.generic_string().c_str());
+
+    copyFromStaging(cb, stagingBuffer);
 
+    m_image.transition(cb, initialState);
+}
+
+void Texture2D::init(
+    Texture2D &source, uint32_t firstMip, vk::CommandBuffer cb,
+    gfx::ImageState initialState)
+{
+    const Texture2DLevels &sourceLevels = source.m_levels;
+    WHEELS_ASSERT(firstMip >= sourceLevels.firstMip);
+    WHEELS_ASSERT(firstMip < sourceLevels.mipCount);
+
+    m_levels = sourceLevels;
+    m_levels.firstMip = firstMip;
+
+    const std::filesystem::path relPath = relativePath(m_levels.cachePath);
+    createImage(relPath.generic_string().c_str());
+
+    // Textures that were uploaded on the transfer queue were acquired without
+    // the tracked state so the barrier for the source is explicit
+    const vk::ImageMemoryBarrier2 sourceBarrier{
+        .srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader |
+                        vk::PipelineStageFlagBits2::eRayTracingShaderKHR,
+        .srcAccessMask = vk::AccessFlagBits2::eNone,
+        .dstStageMask = vk::PipelineStageFlagBits2::eCopy,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        .oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = source.m_image.handle,
+        .subresourceRange = source.m_image.subresourceRange,
+    };
+    cb.pipelineBarrier2(
+        vk::DependencyInfo{
+            .imageMemoryBarrierCount = 1,
+            .pImageMemoryBarriers = &sourceBarrier,
+        });
+    source.m_image.state = gfx::ImageState::TransferSrc;
+
+    m_image.transition(cb, gfx::ImageState::TransferDst);
+
+    const uint32_t levelCount = m_levels.mipCount - firstMip;
+    const uint32_t sourceLevelOffset = firstMip - sourceLevels.firstMip;
+    StaticArray<vk::ImageCopy, Texture2DLevels::sMaxMipCount> regions;
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        const uint32_t mip = firstMip + i;
+        regions[i] = vk::ImageCopy{
+            .srcSubresource =
+                vk::ImageSubresourceLayers{
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = sourceLevelOffset + i,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            .srcOffset = vk::Offset3D{.x = 0, .y = 0, .z = 0},
+            .dstSubresource =
+                vk::ImageSubresourceLayers{
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = i,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            .dstOffset = vk::Offset3D{.x = 0, .y = 0, .z = 0},
+            .extent =
+                vk::Extent3D{
+                    .width = std::max(m_levels.extent.width >> mip, 1u),
+                    .height = std::max(m_levels.extent.height >> mip, 1u),
+                    .depth = 1u,
+                },
+        };
+    }
+
+    cb.copyImage(
+        source.m_image.handle, vk::ImageLayout::eTransferSrcOptimal,
+        m_image.handle, vk::ImageLayout::eTransferDstOptimal, levelCount,
+        regions.data());
+
+    m_image.transition(cb, initialState);
+}
+
+vk::DescriptorImageInfo Texture2D::imageInfo() const
+{
+    return vk::DescriptorImageInfo{
+        .imageView = m_image.view,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    };
+}
+
+const Texture2DLevels &Texture2D::levels() const { return m_levels; }
+
+void Texture2D::createImage(const char *debugName)
+{
+    WHEELS_ASSERT(m_levels.firstMip < m_levels.mipCount);
+
+    vk::ComponentMapping viewComponents;
+    // Single channel data is sampled as grayscale
+    if (m_levels.format == vk::Format::eBc4UnormBlock)
+        viewComponents = vk::ComponentMapping{
+            .r = vk::ComponentSwizzle::eR,
+            .g = vk::ComponentSwizzle::eR,
+            .b = vk::ComponentSwizzle::eR,
+            .a = vk::ComponentSwizzle::eOne,
+        };
+    // Roughness and metalness were packed into rg, materials read them from gb
+    else if (
+        m_levels.format == vk::Format::eBc5UnormBlock &&
+        m_levels.channelUsage == TextureChannelUsage::RoughnessMetalness)
+        viewComponents = vk::ComponentMapping{
+            .r = vk::ComponentSwizzle::eZero,
+            .g = vk::ComponentSwizzle::eR,
+            .b = vk::ComponentSwizzle::eG,
+            .a = vk::ComponentSwizzle::eOne,
+        };
+
+    const uint32_t firstMip = m_levels.firstMip;
     m_image = gfx::gDevice.createImage(
         gfx::ImageCreateInfo{
             .desc =
                 gfx::ImageDescription{
-                    .format = asVkFormat(dds.format),
-                    .width = extent.width,
-                    .height = extent.height,
-                    .mipCount = dds.mipLevelCount,
+                    .format = m_levels.format,
+                    .width = std::max(m_levels.extent.width >> firstMip, 1u),
+                    .height = std::max(m_levels.extent.height >> firstMip, 1u),
+                    .mipCount = m_levels.mipCount - firstMip,
                     .layerCount = 1,
                     .usageFlags = vk::ImageUsageFlagBits::eTransferSrc |
                                   vk::ImageUsageFlagBits::eTransferDst |
                                   vk::ImageUsageFlagBits::eSampled,
                 },
-            .debugName = relPath.generic_string().c_str(),
+            .viewComponents = viewComponents,
+            .debugName = debugName,
         });
+}
 
+void Texture2D::copyFromStaging(
+    vk::CommandBuffer cb, const gfx::Buffer &stagingBuffer)
+{
     m_image.transition(cb, gfx::ImageState::TransferDst);
 
-    std::vector<vk::BufferImageCopy> regions;
-    regions.reserve(dds.mipLevelCount);
-    WHEELS_ASSERT(dds.levelByteOffsets.size() == dds.mipLevelCount);
-    for (uint32_t i = 0; i < dds.mipLevelCount; ++i)
+    // Staging holds the resident levels back to back
+    const uint32_t levelCount = m_levels.mipCount - m_levels.firstMip;
+    StaticArray<vk::BufferImageCopy, Texture2DLevels::sMaxMipCount> regions;
+    vk::DeviceSize bufferOffset = 0;
+    for (uint32_t i = 0; i < levelCount; ++i)
     {
-        regions.push_back(
-            vk::BufferImageCopy{
-                .bufferOffset =
-                    asserted_cast<vk::DeviceSize>(dds.levelByteOffsets[i]),
-                .bufferRowLength = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource =
-                    vk::ImageSubresourceLayers{
-                        .aspectMask = vk::ImageAspectFlagBits::eColor,
-                        .mipLevel = i,
-                        .baseArrayLayer = 0,
-                        .layerCount = 1,
-                    },
-                .imageOffset = vk::Offset3D{.x = 0, .y = 0, .z = 0},
-                .imageExtent =
-                    vk::Extent3D{
-                        .width = std::max(extent.width >> i, 1u),
-                        .height = std::max(extent.height >> i, 1u),
-                        .depth = 1u,
-                    },
-            });
+        const uint32_t mip = m_levels.firstMip + i;
+        regions[i] = vk::BufferImageCopy{
+            .bufferOffset = bufferOffset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource =
+                vk::ImageSubresourceLayers{
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = i,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            .imageOffset = vk::Offset3D{.x = 0, .y = 0, .z = 0},
+            .imageExtent =
+                vk::Extent3D{
+                    .width = std::max(m_levels.extent.width >> mip, 1u),
+                    .height = std::max(m_levels.extent.height >> mip, 1u),
+                    .depth = 1u,
+                },
+        };
+        bufferOffset += m_levels.levelByteCounts[mip];
     }
+    WHEELS_ASSERT(bufferOffset <= stagingBuffer.byteSize);
 
     cb.copyBufferToImage(
         stagingBuffer.handle, m_image.handle,
-        vk::ImageLayout::eTransferDstOptimal,
-        asserted_cast<uint32_t>(regions.size()), regions.data());
-
-    if (options.initialState != gfx::ImageState::Unknown)
-        m_image.transition(cb, options.initialState);
-}
-
-vk::DescriptorImageInfo Texture2D::imageInfo() const
-{
-    return vk::DescriptorImageInfo{
-        .imageView = m_image.view,
-        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-    };
+        vk::ImageLayout::eTransferDstOptimal, levelCount, regions.data());
 }
 
 void Texture3D::init(
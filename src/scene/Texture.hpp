@@ -6,7 +6,9 @@
 #include "utils/Fwd.hpp"
 
 #include <filesystem>
+#include <string>
 #include <wheels/allocators/scoped_scratch.hpp>
+#include <wheels/containers/static_array.hpp>
 
 namespace scene
 {
@@ -37,13 +39,102 @@ enum class TextureColorSpace : uint8_t
     Linear,
 };
 
+// What the materials read from a texture, picks the block format
+enum class TextureChannelUsage : uint8_t
+{
+    // BC7
+    Color,
+    // Tangent space xy as BC5, shaders reconstruct z
+    NormalMap,
+    // r as BC4
+    Occlusion,
+    // Roughness in g and metalness in b, stored as rg of BC5 and swizzled back
+    // by the image view
+    RoughnessMetalness,
+};
+
 struct Texture2DOptions
 {
     bool generateMipMaps{false};
     TextureColorSpace colorSpace{TextureColorSpace::sRgb};
+    TextureChannelUsage channelUsage{TextureChannelUsage::Color};
+    // Levels larger than this on either axis are left out of the image. The
+    // smallest level is always included.
+    uint32_t maxResidentExtent{0xFFFF'FFFF};
     gfx::ImageState initialState{gfx::ImageState::Unknown};
 };
 
+// Trades BC6H and BC7 encoding speed for quality
+enum class TextureCacheQuality : uint8_t
+{
+    UltraFast,
+    Fast,
+    Basic,
+    Slow,
+};
+
+// Throws if name isn't one of "ultrafast", "fast", "basic" or "slow"
+[[nodiscard]] TextureCacheQuality textureCacheQualityFromName(
+    const std::string &name);
+
+// Caches compressed with a different quality are invalid. Debug builds default
+// to UltraFast and release builds to Basic. Should be called before any caches
+// are updated.
+void setTextureCacheQuality(TextureCacheQuality quality);
+
+// Compressed textures are cached in directory by the contents of the source
+// instead of next to it when it's not empty. Least recently used caches are
+// removed when the directory grows past maxByteCount, zero means no limit.
+// Should be called before any caches are updated.
+void setSharedTextureCache(
+    const std::filesystem::path &directory, uintmax_t maxByteCount);
+
+// Makes sure the compressed cache for the texture is up to date and returns the
+// path to it. This doesn't need the device so it's also used to fill the caches
+// offline.
+std::filesystem::path updateTextureCache(
+    wheels::ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    const Texture2DOptions &options);
+
+// Returns the most scratch that updateTextureCache() needs for path, or 0 if
+// it can't be read. Only the image header is read.
+[[nodiscard]] size_t textureCacheScratchByteCount(
+    const std::filesystem::path &path);
+
+// Block compression of all the textures goes through a shared queue. This
+// compresses the queued stripes until it's empty so that texture workers that
+// are out of textures can help finish the last ones.
+void helpCompressTextures();
+
+// Full mip chain of a cached texture and the part of it that is in the image
+struct Texture2DLevels
+{
+    static const uint32_t sMaxMipCount = 16;
+
+    std::filesystem::path cachePath;
+    vk::Format format{vk::Format::eUndefined};
+    // Of the full resolution level
+    vk::Extent2D extent{.width = 0, .height = 0};
+    uint32_t mipCount{0};
+    // Levels before this aren't resident
+    uint32_t firstMip{0};
+    wheels::StaticArray<uint32_t, sMaxMipCount> levelByteCounts{0};
+    // Picks the view swizzle. This isn't in the cache so it's set from the
+    // options by whoever stages the levels.
+    TextureChannelUsage channelUsage{TextureChannelUsage::Color};
+
+    // Returns the byte count of the levels from mip on
+    [[nodiscard]] size_t byteCountFrom(uint32_t mip) const;
+};
+
+// Reads the cached texture and copies its levels from firstMip on to the
+// beginning of stagingBuffer, which should be mapped. This doesn't touch the
+// device so it can be called from any thread. channelUsage of the returned
+// levels is left as Color.
+Texture2DLevels stageTexture2DLevels(
+    wheels::ScopedScratch scopeAlloc, const std::filesystem::path &cachePath,
+    uint32_t firstMip, const gfx::Buffer &stagingBuffer);
+
 class Texture2D : public Texture
 {
   public:
@@ -53,8 +144,25 @@ class Texture2D : public Texture
         wheels::ScopedScratch scopeAlloc, const std::filesystem::path &path,
         vk::CommandBuffer cb, const gfx::Buffer &stagingBuffer,
         const Texture2DOptions &options = Texture2DOptions{});
+    // Same as above but for levels from stageTexture2DLevels()
+    void init(
+        const Texture2DLevels &levels, vk::CommandBuffer cb,
+        const gfx::Buffer &stagingBuffer, gfx::ImageState initialState);
+    // Copies the levels of source from firstMip on. source should be in the
+    // shader read layout and it's left as a transfer source.
+    void init(
+        Texture2D &source, uint32_t firstMip, vk::CommandBuffer cb,
+        gfx::ImageState initialState);
 
     [[nodiscard]] vk::DescriptorImageInfo imageInfo() const override;
+    [[nodiscard]] const Texture2DLevels &levels() const;
+
+  private:
+    void createImage(const char *debugName);
+    void copyFromStaging(
+        vk::CommandBuffer cb, const gfx::Buffer &stagingBuffer);
+
+    Texture2DLevels m_levels;
 };
 
 class Texture3D : public Texture
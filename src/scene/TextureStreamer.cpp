@@ -0,0 +1,487 @@
+#include "TextureStreamer.hpp"
+
+#include "gfx/Device.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <wheels/allocators/linear_allocator.hpp>
+#include <wheels/allocators/scoped_scratch.hpp>
+
+using namespace wheels;
+
+namespace scene
+{
+
+namespace
+{
+
+const gfx::ImageState sSampledState =
+    gfx::ImageState::FragmentShaderRead | gfx::ImageState::RayTracingRead;
+
+// Returns the coarsest level that still has a texel for each drawn pixel. This
+// assumes that the texture is mapped over the drawn extent once.
+uint32_t neededMip(const Texture2DLevels &levels, float drawnExtent)
+{
+    const uint32_t lastMip = levels.mipCount - 1;
+    if (drawnExtent <= 0.f)
+        return lastMip;
+
+    const auto fullExtent = static_cast<float>(
+        std::max(levels.extent.width, levels.extent.height));
+    const float mip = floorf(log2f(fullExtent / drawnExtent));
+    if (mip <= 0.f)
+        return 0;
+
+    return std::min(static_cast<uint32_t>(mip), lastMip);
+}
+
+uint32_t baseMip(const Texture2DLevels &levels)
+{
+    uint32_t ret = 0;
+    while (ret + 1 < levels.mipCount &&
+           std::max(levels.extent.width >> ret, levels.extent.height >> ret) >
+               TextureStreamer::sBaseResidentExtent)
+        ret++;
+
+    return ret;
+}
+
+} // namespace
+
+TextureStreamer::~TextureStreamer()
+{
+    // Don't check for m_initialized as we might be cleaning up after a failed
+    // init.
+
+    if (m_worker.has_value())
+    {
+        {
+            const std::lock_guard lock{m_requestMutex};
+            m_interruptWorker = true;
+        }
+        m_requestCondition.notify_all();
+        m_worker->join();
+    }
+
+    if (m_request.has_value())
+        gfx::gDevice.destroy(m_request->stagingBuffer);
+    for (PendingRelease &pending : m_pendingReleases)
+        gfx::gDevice.destroy(pending.stagingBuffer);
+}
+
+uint32_t TextureStreamer::descriptorCount(uint32_t imageCount)
+{
+    return 1 + (2 * imageCount);
+}
+
+void TextureStreamer::init(
+    uint32_t imageCount, size_t budgetByteCount,
+    vk::DescriptorSet descriptorSet, uint32_t binding)
+{
+    WHEELS_ASSERT(!m_initialized);
+
+    m_descriptorSet = descriptorSet;
+    m_binding = binding;
+    m_budgetByteCount = budgetByteCount;
+    m_textures.resize(imageCount);
+
+    if (imageCount > 0)
+        m_worker = std::thread{&TextureStreamer::worker, this};
+
+    m_initialized = true;
+}
+
+void TextureStreamer::addTexture(uint32_t imageIndex, Texture2D &&texture)
+{
+    WHEELS_ASSERT(m_initialized);
+    WHEELS_ASSERT(imageIndex < m_textures.size());
+
+    StreamedTexture &streamed = m_textures[imageIndex];
+    WHEELS_ASSERT(!streamed.added);
+
+    const Texture2DLevels &levels = texture.levels();
+    streamed.texture = WHEELS_MOV(texture);
+    streamed.baseMip = baseMip(levels);
+    streamed.neededMip = streamed.baseMip;
+    streamed.added = true;
+    m_residentByteCount += levels.byteCountFrom(levels.firstMip);
+    // Not drawn yet so it's the least recently drawn
+    lruPushFront(imageIndex);
+
+    writeDescriptor(imageIndex);
+}
+
+uint32_t TextureStreamer::imageCount() const
+{
+    return asserted_cast<uint32_t>(m_textures.size());
+}
+
+uint32_t TextureStreamer::descriptorIndex(uint32_t imageIndex) const
+{
+    WHEELS_ASSERT(imageIndex < m_textures.size());
+
+    return 1 + (m_textures[imageIndex].slot * imageCount()) + imageIndex;
+}
+
+size_t TextureStreamer::residentByteCount() const
+{
+    return m_residentByteCount;
+}
+
+bool TextureStreamer::update(
+    vk::CommandBuffer cb, Span<const float> drawnExtents)
+{
+    WHEELS_ASSERT(m_initialized);
+    WHEELS_ASSERT(drawnExtents.size() == m_textures.size());
+
+    m_frameIndex++;
+
+    releaseRetired();
+
+    bool descriptorsChanged = finishRequest(cb);
+
+    const uint32_t textureCount = imageCount();
+    for (uint32_t i = 0; i < textureCount; ++i)
+    {
+        StreamedTexture &streamed = m_textures[i];
+        if (!streamed.added)
+            continue;
+
+        // Base levels are always resident so they are the coarsest we need
+        streamed.neededMip = std::min(
+            neededMip(streamed.texture.levels(), drawnExtents[i]),
+            streamed.baseMip);
+        if (drawnExtents[i] > 0.f)
+        {
+            streamed.lastDrawnFrame = m_frameIndex;
+            // This frame is the latest so the list stays ordered
+            if (m_lruLast != i)
+            {
+                lruRemove(i);
+                lruPushBack(i);
+            }
+        }
+    }
+
+    {
+        const std::lock_guard lock{m_requestMutex};
+        if (m_request.has_value())
+            return descriptorsChanged;
+    }
+
+    // Stream in the texture that is the most levels short of what it needs
+    Optional<uint32_t> nextImage;
+    uint32_t nextMissingMips = 0;
+    for (uint32_t i = 0; i < textureCount; ++i)
+    {
+        const StreamedTexture &streamed = m_textures[i];
+        if (!streamed.added || streamed.busy || streamed.failed)
+            continue;
+
+        const uint32_t firstMip = streamed.texture.levels().firstMip;
+        if (streamed.neededMip >= firstMip)
+            continue;
+
+        const uint32_t missingMips = firstMip - streamed.neededMip;
+        if (missingMips > nextMissingMips ||
+            (missingMips == nextMissingMips && nextImage.has_value() &&
+             drawnExtents[i] > drawnExtents[*nextImage]))
+        {
+            nextImage = i;
+            nextMissingMips = missingMips;
+        }
+    }
+    if (!nextImage.has_value())
+        return descriptorsChanged;
+
+    const StreamedTexture &next = m_textures[*nextImage];
+    const Texture2DLevels &levels = next.texture.levels();
+    const size_t residentByteCount = levels.byteCountFrom(levels.firstMip);
+    uint32_t firstMip = next.neededMip;
+
+    descriptorsChanged |= evict(
+        cb, levels.byteCountFrom(firstMip) - residentByteCount, *nextImage);
+
+    // Take what fits if eviction didn't free enough
+    while (firstMip < levels.firstMip &&
+           m_residentByteCount + levels.byteCountFrom(firstMip) -
+                   residentByteCount >
+               m_budgetByteCount)
+        firstMip++;
+
+    if (firstMip < levels.firstMip)
+        request(*nextImage, firstMip);
+
+    return descriptorsChanged;
+}
+
+void TextureStreamer::worker()
+{
+    setCurrentThreadName("prosper stream");
+
+    // Malloc backed as the global allocators aren't thread-safe
+    LinearAllocator scopeBacking{Allocators::sLoadingScratchSize};
+
+    while (true)
+    {
+        std::filesystem::path cachePath;
+        uint32_t firstMip = 0;
+        const gfx::Buffer *stagingBuffer = nullptr;
+        {
+            std::unique_lock lock{m_requestMutex};
+            m_requestCondition.wait(
+                lock,
+                [this]
+                {
+                    return m_interruptWorker ||
+                           (m_request.has_value() && !m_request->staged);
+                });
+            if (m_interruptWorker)
+                return;
+
+            cachePath = m_request->cachePath;
+            firstMip = m_request->firstMip;
+            // The main thread doesn't touch the request until it's staged
+            stagingBuffer = &m_request->stagingBuffer;
+        }
+
+        Optional<Texture2DLevels> levels;
+        try
+        {
+            levels.emplace(stageTexture2DLevels(
+                ScopedScratch{scopeBacking}, cachePath, firstMip,
+                *stagingBuffer));
+        }
+        catch (std::exception &e)
+        {
+            LOG_ERR(
+                "Streaming '{}' failed: {}", cachePath.string().c_str(),
+                e.what());
+        }
+
+        {
+            const std::lock_guard lock{m_requestMutex};
+            m_request->levels = WHEELS_MOV(levels);
+            m_request->staged = true;
+        }
+    }
+}
+
+void TextureStreamer::releaseRetired()
+{
+    // The frames that sampled an old texture might still be in flight so it's
+    // released only after they are guaranteed to have finished
+    for (size_t i = 0; i < m_pendingReleases.size();)
+    {
+        PendingRelease &pending = m_pendingReleases[i];
+        if (pending.framesLeft > 0)
+        {
+            pending.framesLeft--;
+            ++i;
+            continue;
+        }
+
+        m_textures[pending.imageIndex].busy = false;
+        gfx::gDevice.destroy(pending.stagingBuffer);
+        m_pendingReleases.erase(i);
+    }
+}
+
+bool TextureStreamer::finishRequest(vk::CommandBuffer cb)
+{
+    Optional<StreamingRequest> request;
+    {
+        const std::lock_guard lock{m_requestMutex};
+        if (!m_request.has_value() || !m_request->staged)
+            return false;
+
+        request = WHEELS_MOV(m_request);
+        m_request.reset();
+    }
+
+    if (!request->levels.has_value())
+    {
+        // The base levels stay resident so the texture is still usable
+        StreamedTexture &streamed = m_textures[request->imageIndex];
+        streamed.busy = false;
+        streamed.failed = true;
+        gfx::gDevice.destroy(request->stagingBuffer);
+        return false;
+    }
+
+    // The cache doesn't know how the levels are used but the resident texture
+    // does
+    request->levels->channelUsage =
+        m_textures[request->imageIndex].texture.levels().channelUsage;
+
+    Texture2D texture;
+    texture.init(*request->levels, cb, request->stagingBuffer, sSampledState);
+    swapTexture(
+        request->imageIndex, WHEELS_MOV(texture),
+        WHEELS_MOV(request->stagingBuffer));
+
+    return true;
+}
+
+bool TextureStreamer::evict(
+    vk::CommandBuffer cb, size_t byteCount, uint32_t keptImageIndex)
+{
+    bool evicted = false;
+    // Evicted textures keep their place in the list but are busy and don't
+    // have levels to give up after the swap so one pass is enough
+    uint32_t lruImage = m_lruFirst;
+    while (lruImage != sNoTexture &&
+           m_residentByteCount + byteCount > m_budgetByteCount)
+    {
+        StreamedTexture &lru = m_textures[lruImage];
+        const uint32_t imageIndex = lruImage;
+        lruImage = lru.lruNext;
+
+        // Textures drawn this frame only give up levels they don't need
+        if (imageIndex == keptImageIndex || lru.busy ||
+            lru.neededMip <= lru.texture.levels().firstMip)
+            continue;
+
+        // The kept levels are already on the gpu so they are copied instead
+        // of streamed from the cache
+        Texture2D texture;
+        texture.init(lru.texture, lru.neededMip, cb, sSampledState);
+        swapTexture(imageIndex, WHEELS_MOV(texture), gfx::Buffer{});
+
+        evicted = true;
+    }
+
+    return evicted;
+}
+
+void TextureStreamer::request(uint32_t imageIndex, uint32_t firstMip)
+{
+    StreamedTexture &streamed = m_textures[imageIndex];
+    WHEELS_ASSERT(!streamed.busy);
+
+    const Texture2DLevels &levels = streamed.texture.levels();
+    gfx::Buffer stagingBuffer = gfx::gDevice.createBuffer(
+        gfx::BufferCreateInfo{
+            .desc =
+                gfx::BufferDescription{
+                    .byteSize = levels.byteCountFrom(firstMip),
+                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
+                    .properties = vk::MemoryPropertyFlagBits::eHostVisible |
+                                  vk::MemoryPropertyFlagBits::eHostCoherent,
+                },
+            .debugName = "TextureStreamingStaging",
+        });
+
+    streamed.busy = true;
+
+    {
+        const std::lock_guard lock{m_requestMutex};
+        WHEELS_ASSERT(!m_request.has_value());
+        m_request.emplace(
+            StreamingRequest{
+                .imageIndex = imageIndex,
+                .firstMip = firstMip,
+                .cachePath = levels.cachePath,
+                .stagingBuffer = WHEELS_MOV(stagingBuffer),
+            });
+    }
+    m_requestCondition.notify_one();
+}
+
+void TextureStreamer::swapTexture(
+    uint32_t imageIndex, Texture2D &&texture, gfx::Buffer &&stagingBuffer)
+{
+    StreamedTexture &streamed = m_textures[imageIndex];
+    WHEELS_ASSERT(streamed.added);
+
+    const Texture2DLevels &oldLevels = streamed.texture.levels();
+    const Texture2DLevels &newLevels = texture.levels();
+    m_residentByteCount -= oldLevels.byteCountFrom(oldLevels.firstMip);
+    m_residentByteCount += newLevels.byteCountFrom(newLevels.firstMip);
+
+    m_pendingReleases.push_back(
+        PendingRelease{
+            .texture = WHEELS_MOV(streamed.texture),
+            .stagingBuffer = WHEELS_MOV(stagingBuffer),
+            .imageIndex = imageIndex,
+            .framesLeft = MAX_FRAMES_IN_FLIGHT,
+        });
+
+    streamed.texture = WHEELS_MOV(texture);
+    streamed.slot = 1 - streamed.slot;
+    streamed.busy = true;
+
+    writeDescriptor(imageIndex);
+}
+
+void TextureStreamer::lruRemove(uint32_t imageIndex)
+{
+    StreamedTexture &streamed = m_textures[imageIndex];
+
+    if (streamed.lruPrev != sNoTexture)
+        m_textures[streamed.lruPrev].lruNext = streamed.lruNext;
+    else
+    {
+        WHEELS_ASSERT(m_lruFirst == imageIndex);
+        m_lruFirst = streamed.lruNext;
+    }
+
+    if (streamed.lruNext != sNoTexture)
+        m_textures[streamed.lruNext].lruPrev = streamed.lruPrev;
+    else
+    {
+        WHEELS_ASSERT(m_lruLast == imageIndex);
+        m_lruLast = streamed.lruPrev;
+    }
+
+    streamed.lruPrev = sNoTexture;
+    streamed.lruNext = sNoTexture;
+}
+
+void TextureStreamer::lruPushFront(uint32_t imageIndex)
+{
+    StreamedTexture &streamed = m_textures[imageIndex];
+    WHEELS_ASSERT(streamed.lruPrev == sNoTexture);
+    WHEELS_ASSERT(streamed.lruNext == sNoTexture);
+
+    streamed.lruNext = m_lruFirst;
+    if (m_lruFirst != sNoTexture)
+        m_textures[m_lruFirst].lruPrev = imageIndex;
+    else
+        m_lruLast = imageIndex;
+    m_lruFirst = imageIndex;
+}
+
+void TextureStreamer::lruPushBack(uint32_t imageIndex)
+{
+    StreamedTexture &streamed = m_textures[imageIndex];
+    WHEELS_ASSERT(streamed.lruPrev == sNoTexture);
+    WHEELS_ASSERT(streamed.lruNext == sNoTexture);
+
+    streamed.lruPrev = m_lruLast;
+    if (m_lruLast != sNoTexture)
+        m_textures[m_lruLast].lruNext = imageIndex;
+    else
+        m_lruFirst = imageIndex;
+    m_lruLast = imageIndex;
+}
+
+void TextureStreamer::writeDescriptor(uint32_t imageIndex)
+{
+    const vk::DescriptorImageInfo imageInfo =
+        m_textures[imageIndex].texture.imageInfo();
+    const vk::WriteDescriptorSet descriptorWrite{
+        .dstSet = m_descriptorSet,
+        .dstBinding = m_binding,
+        .dstArrayElement = descriptorIndex(imageIndex),
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eSampledImage,
+        .pImageInfo = &imageInfo,
+    };
+    gfx::gDevice.logical().updateDescriptorSets(
+        1, &descriptorWrite, 0, nullptr);
+}
+
+} // namespace scene
@@ -0,0 +1,156 @@
+#ifndef PROSPER_SCENE_TEXTURE_STREAMER_HPP
+#define PROSPER_SCENE_TEXTURE_STREAMER_HPP
+
+#include "Allocators.hpp"
+#include "gfx/Resources.hpp"
+#include "scene/Texture.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <wheels/containers/array.hpp>
+#include <wheels/containers/optional.hpp>
+#include <wheels/containers/span.hpp>
+
+namespace scene
+{
+
+// Streams the finer mips of the glTF textures in and out based on how large
+// they are drawn. Textures are added with only their coarse mips resident and
+// the finer ones are read from the texture caches on a worker thread. When a
+// texture needs more levels than fit in the budget, the finer levels that the
+// least recently drawn textures don't need are dropped first.
+//
+// Each image has two descriptor slots so that a new image can be written into
+// the one that the frames in flight don't read. Materials have to point to
+// descriptorIndex() and be updated when update() returns true.
+class TextureStreamer
+{
+  public:
+    // Textures are added with the levels up to this extent resident and those
+    // are never dropped
+    static const uint32_t sBaseResidentExtent = 256;
+
+    TextureStreamer() noexcept = default;
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &other) = delete;
+    TextureStreamer(TextureStreamer &&other) = delete;
+    TextureStreamer &operator=(const TextureStreamer &other) = delete;
+    TextureStreamer &operator=(TextureStreamer &&other) = delete;
+
+    // Returns the size of the texture array for imageCount images. The first
+    // descriptor is left for the default texture.
+    [[nodiscard]] static uint32_t descriptorCount(uint32_t imageCount);
+
+    // binding in descriptorSet should have descriptorCount(imageCount)
+    // descriptors. The budget covers all resident levels but the base levels
+    // are kept even if they don't fit.
+    void init(
+        uint32_t imageCount, size_t budgetByteCount,
+        vk::DescriptorSet descriptorSet, uint32_t binding);
+
+    // texture should be ready for sampling by the next frame. Its descriptor
+    // is written into the first slot of the image.
+    void addTexture(uint32_t imageIndex, Texture2D &&texture);
+
+    [[nodiscard]] uint32_t imageCount() const;
+    [[nodiscard]] uint32_t descriptorIndex(uint32_t imageIndex) const;
+    [[nodiscard]] size_t residentByteCount() const;
+
+    // drawnExtents should have the largest extent in pixels that each image
+    // was drawn at this frame, zero if it wasn't drawn. Uploads and copies are
+    // recorded into cb after everything that samples the textures this frame.
+    // Returns true if any of the descriptor indices changed.
+    [[nodiscard]] bool update(
+        vk::CommandBuffer cb, wheels::Span<const float> drawnExtents);
+
+  private:
+    static const uint32_t sNoTexture = 0xFFFF'FFFF;
+
+    struct StreamedTexture
+    {
+        Texture2D texture;
+        // Coarsest level that's never dropped
+        uint32_t baseMip{0};
+        // Finest level that's needed for the current drawn extent
+        uint32_t neededMip{0};
+        uint64_t lastDrawnFrame{0};
+        // Neighbors in the list of added textures that is ordered by
+        // lastDrawnFrame
+        uint32_t lruPrev{sNoTexture};
+        uint32_t lruNext{sNoTexture};
+        uint32_t slot{0};
+        // Set while a new image is streaming in or the previous one might
+        // still be read by frames in flight. The other slot can't be written
+        // to until this is cleared.
+        bool busy{false};
+        bool added{false};
+        // Streaming isn't retried if reading the cache failed
+        bool failed{false};
+    };
+
+    struct StreamingRequest
+    {
+        uint32_t imageIndex{0};
+        uint32_t firstMip{0};
+        std::filesystem::path cachePath;
+        gfx::Buffer stagingBuffer;
+        // Set by the worker when it's done with the request, levels are empty
+        // if the staging failed
+        bool staged{false};
+        wheels::Optional<Texture2DLevels> levels;
+    };
+
+    struct PendingRelease
+    {
+        Texture2D texture;
+        gfx::Buffer stagingBuffer;
+        uint32_t imageIndex{0};
+        uint32_t framesLeft{0};
+    };
+
+    void worker();
+    void releaseRetired();
+    // Returns true if a staged request was swapped in
+    [[nodiscard]] bool finishRequest(vk::CommandBuffer cb);
+    // Returns true if any textures were swapped for smaller ones
+    [[nodiscard]] bool evict(
+        vk::CommandBuffer cb, size_t byteCount, uint32_t keptImageIndex);
+    void request(uint32_t imageIndex, uint32_t firstMip);
+    // stagingBuffer is released with the previous texture
+    void swapTexture(
+        uint32_t imageIndex, Texture2D &&texture, gfx::Buffer &&stagingBuffer);
+    void writeDescriptor(uint32_t imageIndex);
+    void lruRemove(uint32_t imageIndex);
+    void lruPushFront(uint32_t imageIndex);
+    void lruPushBack(uint32_t imageIndex);
+
+    bool m_initialized{false};
+    vk::DescriptorSet m_descriptorSet;
+    uint32_t m_binding{0};
+    size_t m_budgetByteCount{0};
+    // Old textures that are waiting for release aren't included
+    size_t m_residentByteCount{0};
+    uint64_t m_frameIndex{0};
+    wheels::Array<StreamedTexture> m_textures{gAllocators.general};
+    // Least recently drawn texture first so that eviction walks the list from
+    // the front instead of searching all textures
+    uint32_t m_lruFirst{sNoTexture};
+    uint32_t m_lruLast{sNoTexture};
+    wheels::Array<PendingRelease> m_pendingReleases{gAllocators.general};
+
+    // Only one request is in flight at a time. The main thread sets it and the
+    // worker marks it staged.
+    wheels::Optional<std::thread> m_worker;
+    std::mutex m_requestMutex;
+    std::condition_variable m_requestCondition;
+    wheels::Optional<StreamingRequest> m_request;
+    bool m_interruptWorker{false};
+};
+
+} // namespace scene
+
+#endif // PROSPER_SCENE_TEXTURE_STREAMER_HPP
@@ -15,11 +15,10 @@
 #include "utils/Ui.hpp"
 #include "utils/Utils.hpp"
 
-#include <glm/gtc/matrix_access.hpp>
+#include <algorithm>
 #include <imgui.h>
-#include <shader_structs/scene/draw_instance.h>
 #include <wheels/allocators/utils.hpp>
-#include <wheels/containers/hash_set.hpp>
+#include <wyhash.h>
 
 using namespace glm;
 using namespace wheels;
@@ -30,13 +29,60 @@ namespace scene
 namespace
 {
 
-// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-bool relativeEq(float a, float b, float maxRelativeDiff)
+struct BlasGeometryKey
 {
-    const float diff = std::abs(a - b);
-    const float maxMagnitude = std::max(std::abs(a), std::abs(b));
-    const float scaledEpsilon = maxRelativeDiff * maxMagnitude;
-    return diff < scaledEpsilon;
+    uint32_t bufferIndex{0};
+    uint32_t indicesOffset{0};
+    uint32_t opaque{0};
+};
+
+// Deduplicated meshes share geometry ranges so models made of the same
+// ranges can share the BLAS too. Opaque flags come from the materials so
+// those have to match as well.
+BlasGeometryKey blasGeometryKey(const WorldData &data, uint32_t meshIndex)
+{
+    const shader_structs::GeometryMetadata &metadata =
+        data.m_geometryMetadatas[meshIndex];
+    const shader_structs::MaterialData &material =
+        data.m_materials[data.m_meshInfos[meshIndex].materialIndex];
+
+    return BlasGeometryKey{
+        .bufferIndex = metadata.bufferIndex,
+        .indicesOffset = metadata.indicesOffset,
+        .opaque =
+            material.alphaMode == shader_structs::AlphaMode_Opaque ? 1u : 0u,
+    };
+}
+
+uint64_t hashBlasGeometry(const WorldData &data, const Model &model)
+{
+    uint64_t ret = model.subModels.size();
+    for (const Model::SubModel &sm : model.subModels)
+    {
+        const BlasGeometryKey key = blasGeometryKey(data, sm.meshIndex);
+        ret = wyhash(&key, sizeof(key), ret, (uint64_t const *)_wyp);
+    }
+    return ret;
+}
+
+bool sameBlasGeometry(
+    const WorldData &data, const Model &model, const Model &other)
+{
+    if (model.subModels.size() != other.subModels.size())
+        return false;
+
+    for (size_t i = 0; i < model.subModels.size(); ++i)
+    {
+        const BlasGeometryKey key =
+            blasGeometryKey(data, model.subModels[i].meshIndex);
+        const BlasGeometryKey otherKey =
+            blasGeometryKey(data, other.subModels[i].meshIndex);
+        if (key.bufferIndex != otherKey.bufferIndex ||
+            key.indicesOffset != otherKey.indicesOffset ||
+            key.opaque != otherKey.opaque)
+            return false;
+    }
+    return true;
 }
 
 gfx::AccelerationStructure createTlas(
@@ -107,6 +153,28 @@ gfx::AccelerationStructure createTlas(
     return tlas;
 }
 
+// Writes elements starting from firstElement. vkCmdUpdateBuffer takes at most
+// 64KiB at a time so larger spans are split.
+template <typename T>
+void updateElements(
+    vk::CommandBuffer cb, const gfx::Buffer &buffer, uint32_t firstElement,
+    const Array<T> &elements)
+{
+    static_assert(sizeof(T) % 4 == 0);
+    const size_t maxElementsPerUpdate = 65536 / sizeof(T);
+
+    for (size_t i = 0; i < elements.size(); i += maxElementsPerUpdate)
+    {
+        const size_t count =
+            std::min(elements.size() - i, maxElementsPerUpdate);
+        WHEELS_ASSERT(
+            (firstElement + i + count) * sizeof(T) <= buffer.byteSize);
+        cb.updateBuffer(
+            buffer.handle, (firstElement + i) * sizeof(T), count * sizeof(T),
+            elements.data() + i);
+    }
+}
+
 } // namespace
 
 class World::Impl
@@ -122,7 +190,7 @@ class World::Impl
 
     void init(
         ScopedScratch scopeAlloc, gfx::RingBuffer &constantsRing,
-        const std::filesystem::path &scene);
+        const std::filesystem::path &scene, size_t textureBudgetByteCount);
 
     void startFrame();
     void endFrame();
@@ -142,7 +210,7 @@ class World::Impl
     void updateScene(
         ScopedScratch scopeAlloc, CameraTransform &cameraTransform,
         utils::SceneStats &sceneStats);
-    void updateBuffers(ScopedScratch scopeAlloc);
+    void updateBuffers(ScopedScratch scopeAlloc, vk::CommandBuffer cb);
     // Has to be called after updateBuffers(). Returns true if new BLASes were
     // added.
     bool buildAccelerationStructures(
@@ -154,6 +222,8 @@ class World::Impl
     // Returns true if a blas build was queued
     bool buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb);
     void buildCurrentTlas(vk::CommandBuffer cb);
+    void uploadStaticTransforms(
+        ScopedScratch scopeAlloc, vk::CommandBuffer cb, Scene &scene);
     void reserveTlasInstances(uint32_t instanceCount);
     void updateTlasInstances(ScopedScratch scopeAlloc, const Scene &scene);
     void createTlasBuildInfos(
@@ -183,7 +253,16 @@ class World::Impl
     Array<ScratchBuffer> m_scratchBuffers{gAllocators.general};
     gfx::Buffer m_tlasInstancesBuffer;
     OwningPtr<gfx::RingBuffer> m_tlasInstancesUploadRing;
-    uint32_t m_tlasInstancesUploadOffset{0};
+    // From the upload ring into the instance buffer, recorded by the TLAS
+    // build
+    Array<vk::BufferCopy> m_tlasInstanceCopies{gAllocators.general};
+    // The instance buffer keeps the instances between frames so only the
+    // dynamic and moved ones are rewritten while the scene and the built
+    // BLASes stay the same
+    Optional<size_t> m_tlasInstancesScene;
+    size_t m_tlasInstancesBlasCount{0};
+    // Custom index of each TLAS instance in m_tlasInstancesScene
+    Array<uint32_t> m_tlasInstanceCustomIndices{gAllocators.general};
 };
 
 World::Impl::~Impl()
@@ -197,7 +276,7 @@ World::Impl::~Impl()
 
 void World::Impl::init(
     ScopedScratch scopeAlloc, gfx::RingBuffer &constantsRing,
-    const std::filesystem::path &scene)
+    const std::filesystem::path &scene, size_t textureBudgetByteCount)
 {
     m_constantsRing = &constantsRing;
 
@@ -216,7 +295,7 @@ void World::Impl::init(
             .constantsRing = &constantsRing,
             .lightDataRing = &m_lightDataRing,
         },
-        scene);
+        scene, textureBudgetByteCount);
 
     // This creates the instance ring and startFrame() assumes it exists
     reserveTlasInstances(1);
@@ -350,10 +429,7 @@ void World::Impl::updateAnimations(float timeS)
 {
     PROFILER_CPU_SCOPE("World::updateAnimations");
 
-    for (Animation<vec3> &animation : m_data.m_animations.vec3)
-        animation.update(timeS);
-    for (Animation<quat> &animation : m_data.m_animations.quat)
-        animation.update(timeS);
+    m_data.m_animations.update(timeS);
 }
 
 void World::Impl::updateScene(
@@ -363,168 +439,71 @@ void World::Impl::updateScene(
     PROFILER_CPU_SCOPE("World::updateScene");
 
     Scene &scene = currentScene();
+    const Scene::Nodes &nodes = scene.nodes;
 
-    Array<uint32_t> nodeStack{scopeAlloc, scene.nodes.size()};
-    Array<mat4> parentTransforms{scopeAlloc, scene.nodes.size()};
-    HashSet<uint32_t> visited{scopeAlloc, scene.nodes.size()};
-    for (uint32_t rootIndex : scene.rootNodes)
-    {
-        nodeStack.clear();
-        parentTransforms.clear();
-        visited.clear();
+    scene.updateTransforms(scopeAlloc.child_scope());
 
-        nodeStack.push_back(rootIndex);
-        parentTransforms.push_back(mat4{1.f});
-        while (!nodeStack.empty())
-        {
-            const uint32_t nodeIndex = nodeStack.back();
-            if (visited.contains(nodeIndex))
-            {
-                nodeStack.pop_back();
-                parentTransforms.pop_back();
-            }
-            else
-            {
-                visited.insert(nodeIndex);
-                Scene::Node &node = scene.nodes[nodeIndex];
-
-                const uint32_t first_child = node.firstChild;
-                const uint32_t last_child = node.lastChild;
-                for (uint32_t child = first_child; child <= last_child; ++child)
-                    nodeStack.push_back(child);
-
-                mat4 modelToWorld4x4 = parentTransforms.back();
-                if (node.translation.has_value())
-                    modelToWorld4x4 =
-                        translate(modelToWorld4x4, *node.translation);
-                if (node.rotation.has_value())
-                    modelToWorld4x4 *= mat4_cast(*node.rotation);
-                if (node.scale.has_value())
-                    modelToWorld4x4 = scale(modelToWorld4x4, *node.scale);
-
-                const mat3x4 modelToWorld = transpose(modelToWorld4x4);
-                // No transpose as mat4->mat3x4 effectively does it
-                const mat3x4 normalToWorld = inverse(modelToWorld4x4);
-
-                if (node.modelInstance.has_value())
-                    scene.modelInstances[*node.modelInstance].transforms =
-                        shader_structs::ModelInstanceTransforms{
-                            .modelToWorld = modelToWorld,
-                            .normalToWorld = normalToWorld,
-                        };
-
-                if (node.camera.has_value() && *node.camera == m_currentCamera)
-                {
-                    cameraTransform.eye =
-                        vec3{modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f}};
-                    // TODO: Halfway from camera to scene bb end if inside
-                    // bb / halfway of bb if outside of bb?
-                    cameraTransform.target =
-                        vec3{modelToWorld4x4 * vec4{0.f, 0.f, -1.f, 1.f}};
-                    cameraTransform.up =
-                        mat3{modelToWorld4x4} * vec3{0.f, 1.f, 0.f};
-                }
-
-                if (node.directionalLight)
-                {
-                    auto &parameters = scene.lights.directionalLight.parameters;
-                    parameters.direction =
-                        vec4{mat3{modelToWorld4x4} * vec3{0.f, 0.f, -1.f}, 0.f};
-                }
-
-                if (node.pointLight.has_value())
-                {
-                    shader_structs::PointLight &sceneLight =
-                        scene.lights.pointLights.data[*node.pointLight];
-
-                    sceneLight.position =
-                        modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f};
-                }
-
-                if (node.spotLight.has_value())
-                {
-                    shader_structs::SpotLight &sceneLight =
-                        scene.lights.spotLights.data[*node.spotLight];
-
-                    const vec3 position =
-                        vec3{modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f}};
-                    sceneLight.positionAndAngleOffset.x = position.x;
-                    sceneLight.positionAndAngleOffset.y = position.y;
-                    sceneLight.positionAndAngleOffset.z = position.z;
-
-                    sceneLight.direction =
-                        vec4{mat3{modelToWorld4x4} * vec3{0.f, 0.f, -1.f}, 0.f};
-                }
-                parentTransforms.emplace_back(modelToWorld4x4);
-
-                sceneStats.totalNodeCount++;
-                if (node.dynamicTransform)
-                    sceneStats.animatedNodeCount++;
-            }
-        }
+    // The current camera can change between updates so it's always updated
+    // from the cached transform
+    for (const Scene::CameraNode &cameraNode : scene.cameraNodes)
+    {
+        if (cameraNode.camera != m_currentCamera)
+            continue;
+
+        const mat4 &modelToWorld4x4 = nodes.worldTransforms[cameraNode.node];
+        cameraTransform.eye = vec3{modelToWorld4x4 * vec4{0.f, 0.f, 0.f, 1.f}};
+        // TODO: Halfway from camera to scene bb end if inside
+        // bb / halfway of bb if outside of bb?
+        cameraTransform.target =
+            vec3{modelToWorld4x4 * vec4{0.f, 0.f, -1.f, 1.f}};
+        cameraTransform.up = mat3{modelToWorld4x4} * vec3{0.f, 1.f, 0.f};
     }
+
+    sceneStats.totalNodeCount = nodes.size();
+    sceneStats.animatedNodeCount =
+        asserted_cast<uint32_t>(scene.dynamicNodes.size());
 }
 
-void World::Impl::updateBuffers(ScopedScratch scopeAlloc)
+void World::Impl::updateBuffers(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
 {
     auto &scene = currentScene();
 
+    if (!scene.dirtyStaticModelInstances.empty() ||
+        !scene.movedStaticModelInstances.empty())
+        uploadStaticTransforms(scopeAlloc.child_scope(), cb, scene);
+
     {
-        scene.drawInstances.clear();
+        // Static instances were uploaded at load so only the dynamic ones are
+        // written here
+        const size_t dynamicInstanceCount = scene.dynamicModelInstances.size();
         Array<shader_structs::ModelInstanceTransforms> transforms{
-            scopeAlloc, scene.modelInstances.size()};
-        Array<float> scales{scopeAlloc, scene.modelInstances.size()};
-
-        // The DrawInstances generated here have to match the indices that get
-        // assigned to tlas instances
-        for (auto mi = 0u; mi < scene.modelInstances.size(); ++mi)
+            scopeAlloc, dynamicInstanceCount};
+        Array<float> scales{scopeAlloc, dynamicInstanceCount};
+        for (const uint32_t mi : scene.dynamicModelInstances)
         {
-            const auto &instance = scene.modelInstances[mi];
+            const ModelInstance &instance = scene.modelInstances[mi];
             transforms.push_back(instance.transforms);
-
-            const mat3x4 &modelToWorld = instance.transforms.modelToWorld;
-            // lengths of rows instead of columns because of the transposed 3x4
-            const vec3 scale{
-                length(row(modelToWorld, 0)), length(row(modelToWorld, 1)),
-                length(row(modelToWorld, 2))};
-
-            // Zero scale indicates that the scale is non-uniform
-            float uniformScale = 0.f;
-            // 0.1mm precision should be plenty
-            const float tolerance = 0.0001f;
-            if (relativeEq(scale.x, scale.y, tolerance) &&
-                relativeEq(scale.x, scale.z, tolerance))
-                uniformScale = scale.x;
-            scales.push_back(uniformScale);
-
-            // Submodels are pushed one after another and TLAS instance update
-            // assumes this as it uses the flattened index of the first submodel
-            // as the custom index for each instance. RT shaders then access
-            // each submodel from that using the geometry index of the hit.
-            for (const auto &model :
-                 m_data.m_models[instance.modelIndex].subModels)
-            {
-                scene.drawInstances.push_back(
-                    shader_structs::DrawInstance{
-                        .modelInstanceIndex = mi,
-                        .meshIndex = model.meshIndex,
-                        .materialIndex = model.materialIndex,
-                    });
-            }
+            scales.push_back(instance.uniformScale());
         }
 
         // This is valid to offset (0) even on the first frame and we'll skip
         // reads anyway
         m_byteOffsets.previousModelInstanceTransforms =
             m_byteOffsets.modelInstanceTransforms;
-        m_byteOffsets.modelInstanceTransforms =
-            m_data.m_modelInstanceTransformsRing.write_elements(transforms);
-        m_byteOffsets.modelInstanceScales =
-            m_data.m_modelInstanceTransformsRing.write_elements(scales);
-
-        memcpy(
-            scene.drawInstancesBuffer.mapped, scene.drawInstances.data(),
-            sizeof(shader_structs::DrawInstance) * scene.drawInstances.size());
+        if (transforms.empty())
+        {
+            // Nothing reads the ring but the descriptors still need valid
+            // offsets
+            m_byteOffsets.modelInstanceTransforms = 0;
+            m_byteOffsets.modelInstanceScales = 0;
+        }
+        else
+        {
+            m_byteOffsets.modelInstanceTransforms =
+                m_data.m_modelInstanceTransformsRing.write_elements(transforms);
+            m_byteOffsets.modelInstanceScales =
+                m_data.m_modelInstanceTransformsRing.write_elements(scales);
+        }
     }
 
     updateTlasInstances(scopeAlloc.child_scope(), scene);
@@ -551,11 +530,11 @@ bool World::Impl::buildAccelerationStructures(
         m_framesSinceFinalBlasBuilds++;
 
     bool blasAdded = false;
-    if (m_data.m_models.size() > m_data.m_blases.size())
+    if (m_data.m_models.size() > m_data.m_modelBlasIndices.size())
     {
         const size_t maxBlasBuildsPerFrame = 10;
         const size_t unbuiltBlasCount =
-            m_data.m_models.size() - m_data.m_blases.size();
+            m_data.m_models.size() - m_data.m_modelBlasIndices.size();
         const size_t blasBuildCount =
             std::min(unbuiltBlasCount, maxBlasBuildsPerFrame);
         size_t blasesBuilt = 0;
@@ -584,9 +563,9 @@ void World::Impl::drawSkybox(vk::CommandBuffer cb) const
 
 bool World::Impl::buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
 {
-    WHEELS_ASSERT(m_data.m_models.size() > m_data.m_blases.size());
+    WHEELS_ASSERT(m_data.m_models.size() > m_data.m_modelBlasIndices.size());
 
-    const size_t modelIndex = m_data.m_blases.size();
+    const size_t modelIndex = m_data.m_modelBlasIndices.size();
     if (modelIndex == 0)
         // TODO: This will continue to reset until the first blas is built.
         // Reset at the start of the first frame instead? Same for the material
@@ -605,6 +584,23 @@ bool World::Impl::buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
             return false;
     }
 
+    // Hash collisions just build a separate BLAS
+    const uint64_t geometryHash = hashBlasGeometry(m_data, model);
+    const uint32_t *sharingModel =
+        m_data.m_blasGeometryModels.find(geometryHash);
+    if (sharingModel != nullptr)
+    {
+        if (sameBlasGeometry(m_data, model, m_data.m_models[*sharingModel]))
+        {
+            m_data.m_modelBlasIndices.push_back(
+                m_data.m_modelBlasIndices[*sharingModel]);
+            return true;
+        }
+    }
+    else
+        m_data.m_blasGeometryModels.insert_or_assign(
+            geometryHash, asserted_cast<uint32_t>(modelIndex));
+
     // Basics from RT Gems II chapter 16
 
     Array<vk::AccelerationStructureGeometryKHR> geometries{scopeAlloc};
@@ -632,6 +628,30 @@ bool World::Impl::buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
                                           ? sizeof(uint16_t)
                                           : sizeof(uint32_t));
 
+        // The build applies this to the snorm positions. Mesh data doesn't
+        // change so rewriting this while an earlier build reads it is fine.
+        const gfx::Buffer &transformsBuffer = m_data.m_blasPositionTransforms;
+        WHEELS_ASSERT(transformsBuffer.deviceAddress != 0);
+        WHEELS_ASSERT(transformsBuffer.mapped != nullptr);
+        // mat3x4 has the same memory layout as vk::TransformMatrixKHR
+        const mat3x4 positionsTransform{
+            vec4{
+                metadata.positionsHalfExtentX, 0.f, 0.f,
+                metadata.positionsCenterX},
+            vec4{
+                0.f, metadata.positionsHalfExtentY, 0.f,
+                metadata.positionsCenterY},
+            vec4{
+                0.f, 0.f, metadata.positionsHalfExtentZ,
+                metadata.positionsCenterZ},
+        };
+        static_assert(
+            sizeof(positionsTransform) == sizeof(vk::TransformMatrixKHR));
+        memcpy(
+            static_cast<vk::TransformMatrixKHR *>(transformsBuffer.mapped) +
+                sm.meshIndex,
+            &positionsTransform, sizeof(positionsTransform));
+
         const vk::AccelerationStructureGeometryTrianglesDataKHR triangles{
             .vertexFormat = sVertexPositionFormat,
             .vertexData = dataBuffer.deviceAddress + positionsOffset,
@@ -641,6 +661,8 @@ bool World::Impl::buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
                              ? vk::IndexType::eUint16
                              : vk::IndexType::eUint32,
             .indexData = dataBuffer.deviceAddress + indicesOffset,
+            .transformData = transformsBuffer.deviceAddress +
+                             (sm.meshIndex * sizeof(vk::TransformMatrixKHR)),
         };
 
         const shader_structs::MaterialData &material =
@@ -680,6 +702,8 @@ bool World::Impl::buildNextBlas(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
             {asserted_cast<uint32_t>(maxPrimitiveCounts.size()),
              maxPrimitiveCounts.data()});
 
+    m_data.m_modelBlasIndices.push_back(
+        asserted_cast<uint32_t>(m_data.m_blases.size()));
     m_data.m_blases.push_back(gfx::AccelerationStructure{});
     gfx::AccelerationStructure &blas = m_data.m_blases.back();
 
@@ -771,14 +795,14 @@ void World::Impl::buildCurrentTlas(vk::CommandBuffer cb)
 
     buildInfo.scratchData = scratchBuffer.deviceAddress;
 
-    const vk::BufferCopy copyRegion{
-        .srcOffset = m_tlasInstancesUploadOffset,
-        .dstOffset = 0,
-        .size = m_tlasInstancesBuffer.byteSize,
-    };
-    cb.copyBuffer(
-        m_tlasInstancesUploadRing->buffer(), m_tlasInstancesBuffer.handle, 1,
-        &copyRegion);
+    if (!m_tlasInstanceCopies.empty())
+    {
+        cb.copyBuffer(
+            m_tlasInstancesUploadRing->buffer(), m_tlasInstancesBuffer.handle,
+            asserted_cast<uint32_t>(m_tlasInstanceCopies.size()),
+            m_tlasInstanceCopies.data());
+        m_tlasInstanceCopies.clear();
+    }
 
     const StaticArray barriers{{
         *scratchBuffer.transitionBarrier(
@@ -801,6 +825,140 @@ void World::Impl::buildCurrentTlas(vk::CommandBuffer cb)
     // RayTracingAccelerationStructureRead
 }
 
+void World::Impl::uploadStaticTransforms(
+    ScopedScratch scopeAlloc, vk::CommandBuffer cb, Scene &scene)
+{
+    PROFILER_CPU_SCOPE("World::uploadStaticTransforms");
+
+    const vk::PipelineStageFlags2 readStages =
+        vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eTaskShaderEXT |
+        vk::PipelineStageFlagBits2::eMeshShaderEXT |
+        vk::PipelineStageFlagBits2::eFragmentShader |
+        vk::PipelineStageFlagBits2::eComputeShader |
+        vk::PipelineStageFlagBits2::eRayTracingShaderKHR;
+
+    // Frames in flight might still read the old transforms
+    const vk::MemoryBarrier2 readBarrier{
+        .srcStageMask = readStages,
+        .srcAccessMask = vk::AccessFlagBits2::eNone,
+        .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    };
+    cb.pipelineBarrier2(
+        vk::DependencyInfo{
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &readBarrier,
+        });
+
+    // The current transforms are still the ones from the previous frame so
+    // they are copied over the previous ones of the instances that move now
+    // and the ones that moved on the previous frame. The latter stop moving
+    // after this.
+    Array<uint32_t> syncedIndices{
+        scopeAlloc, scene.dirtyStaticModelInstances.size() +
+                        scene.movedStaticModelInstances.size()};
+    for (const uint32_t mi : scene.dirtyStaticModelInstances)
+        syncedIndices.push_back(scene.modelInstanceTransformIndices[mi]);
+    for (const uint32_t mi : scene.movedStaticModelInstances)
+        syncedIndices.push_back(scene.modelInstanceTransformIndices[mi]);
+    // Copy regions can't overlap
+    std::sort(syncedIndices.begin(), syncedIndices.end());
+    const uint32_t *syncedEnd =
+        std::unique(syncedIndices.begin(), syncedIndices.end());
+    syncedIndices.resize(
+        asserted_cast<size_t>(syncedEnd - syncedIndices.begin()));
+
+    Array<vk::BufferCopy> syncRegions{scopeAlloc, syncedIndices.size()};
+    const vk::DeviceSize transformsByteCount =
+        sizeof(shader_structs::ModelInstanceTransforms);
+    for (const uint32_t index : syncedIndices)
+    {
+        WHEELS_ASSERT((index & shader_structs::DynamicTransformBit) == 0);
+
+        const vk::DeviceSize offset = index * transformsByteCount;
+        if (!syncRegions.empty() &&
+            syncRegions.back().srcOffset + syncRegions.back().size == offset)
+            syncRegions.back().size += transformsByteCount;
+        else
+            syncRegions.push_back(
+                vk::BufferCopy{
+                    .srcOffset = offset,
+                    .dstOffset = offset,
+                    .size = transformsByteCount,
+                });
+    }
+    cb.copyBuffer(
+        scene.staticModelInstanceTransformsBuffer.handle,
+        scene.previousStaticModelInstanceTransformsBuffer.handle,
+        asserted_cast<uint32_t>(syncRegions.size()), syncRegions.data());
+
+    // The copies have to read the current transforms before they are
+    // overwritten
+    const vk::MemoryBarrier2 syncBarrier{
+        .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eNone,
+        .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    };
+    cb.pipelineBarrier2(
+        vk::DependencyInfo{
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &syncBarrier,
+        });
+
+    // Moves are rare and usually touch a handful of instances so the data is
+    // recorded inline instead of going through a staging ring. Consecutive
+    // static indices are written together.
+    const size_t dirtyCount = scene.dirtyStaticModelInstances.size();
+    Array<shader_structs::ModelInstanceTransforms> transforms{
+        scopeAlloc, dirtyCount};
+    Array<float> scales{scopeAlloc, dirtyCount};
+    uint32_t firstIndex = 0;
+    const auto flush = [&]
+    {
+        updateElements(
+            cb, scene.staticModelInstanceTransformsBuffer, firstIndex,
+            transforms);
+        updateElements(
+            cb, scene.staticModelInstanceScalesBuffer, firstIndex, scales);
+        transforms.clear();
+        scales.clear();
+    };
+    for (const uint32_t mi : scene.dirtyStaticModelInstances)
+    {
+        const uint32_t index = scene.modelInstanceTransformIndices[mi];
+        WHEELS_ASSERT((index & shader_structs::DynamicTransformBit) == 0);
+
+        if (!transforms.empty() && index != firstIndex + transforms.size())
+            flush();
+        if (transforms.empty())
+            firstIndex = index;
+
+        const ModelInstance &instance = scene.modelInstances[mi];
+        transforms.push_back(instance.transforms);
+        scales.push_back(instance.uniformScale());
+    }
+    flush();
+
+    scene.movedStaticModelInstances.clear();
+    for (const uint32_t mi : scene.dirtyStaticModelInstances)
+        scene.movedStaticModelInstances.push_back(mi);
+    scene.dirtyStaticModelInstances.clear();
+
+    const vk::MemoryBarrier2 writeBarrier{
+        .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = readStages,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+    };
+    cb.pipelineBarrier2(
+        vk::DependencyInfo{
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &writeBarrier,
+        });
+}
+
 gfx::Buffer &World::Impl::reserveScratch(vk::DeviceSize byteSize)
 {
     for (ScratchBuffer &sb : m_scratchBuffers)
@@ -848,6 +1006,9 @@ void World::Impl::reserveTlasInstances(uint32_t instanceCount)
         // finished
         m_tlasInstancesUploadRing.reset();
 
+        // The new buffer has to be filled from scratch
+        m_tlasInstancesScene.reset();
+
         m_tlasInstancesBuffer = gfx::gDevice.createBuffer(
             gfx::BufferCreateInfo{
                 .desc =
@@ -878,6 +1039,67 @@ void World::Impl::reserveTlasInstances(uint32_t instanceCount)
 void World::Impl::updateTlasInstances(
     ScopedScratch scopeAlloc, const Scene &scene)
 {
+    const uint32_t instanceCount =
+        asserted_cast<uint32_t>(scene.modelInstances.size());
+    reserveTlasInstances(instanceCount);
+
+    // Copies that the TLAS build didn't record mean that the buffer missed
+    // those writes
+    const bool fullUpdate =
+        !m_tlasInstancesScene.has_value() ||
+        *m_tlasInstancesScene != m_data.m_currentScene ||
+        m_tlasInstancesBlasCount != m_data.m_modelBlasIndices.size() ||
+        !m_tlasInstanceCopies.empty();
+    m_tlasInstanceCopies.clear();
+
+    if (fullUpdate)
+    {
+        // Draw instances pack all submodels of a model instance tightly so
+        // let's use the index of the first one as the TLAS instance index. RT
+        // shaders can then access each submodel from that using the geometry
+        // index of the hit.
+        m_tlasInstanceCustomIndices.clear();
+        m_tlasInstanceCustomIndices.reserve(instanceCount);
+        uint32_t rti = 0;
+        for (const ModelInstance &mi : scene.modelInstances)
+        {
+            m_tlasInstanceCustomIndices.push_back(rti);
+            rti += asserted_cast<uint32_t>(
+                m_data.m_models[mi.modelIndex].subModels.size());
+        }
+
+        m_tlasInstancesScene = m_data.m_currentScene;
+        m_tlasInstancesBlasCount = m_data.m_modelBlasIndices.size();
+    }
+
+    // Static instances only change when they are moved
+    Array<uint32_t> updatedInstances{scopeAlloc};
+    if (fullUpdate)
+    {
+        updatedInstances.resize(instanceCount);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+            updatedInstances[i] = i;
+    }
+    else
+    {
+        updatedInstances.reserve(
+            scene.dynamicModelInstances.size() +
+            scene.movedStaticModelInstances.size());
+        for (const uint32_t mi : scene.dynamicModelInstances)
+            updatedInstances.push_back(mi);
+        for (const uint32_t mi : scene.movedStaticModelInstances)
+            updatedInstances.push_back(mi);
+        // Sorted to merge the copies of neighboring instances. A static
+        // instance can be marked as moved more than once.
+        std::sort(updatedInstances.begin(), updatedInstances.end());
+        const uint32_t *uniqueEnd =
+            std::unique(updatedInstances.begin(), updatedInstances.end());
+        updatedInstances.resize(
+            asserted_cast<size_t>(uniqueEnd - updatedInstances.begin()));
+    }
+    if (updatedInstances.empty())
+        return;
+
     // TODO:
     // Is it faster to poke instances directly into a mapped buffer instead
     // of collecting first and then passing them in one blob as initial
@@ -885,11 +1107,10 @@ void World::Impl::updateTlasInstances(
     // Need to be careful to not cause read ops by accident, probably still use
     // memcpy for the write into the buffer.
     Array<vk::AccelerationStructureInstanceKHR> instances{
-        scopeAlloc, scene.modelInstances.size()};
-    uint32_t rti = 0;
-    for (const auto &mi : scene.modelInstances)
+        scopeAlloc, updatedInstances.size()};
+    for (const uint32_t i : updatedInstances)
     {
-        const auto &model = m_data.m_models[mi.modelIndex];
+        const ModelInstance &mi = scene.modelInstances[i];
 
         // This has to be mat3x4 because we assume the transform already has
         // the same memory layout as vk::TransformationMatrixKHR
@@ -900,31 +1121,49 @@ void World::Impl::updateTlasInstances(
         // Zero as accelerationStructureReference marks an inactive instance
         // according to the vk spec
         uint64_t asReference = 0;
-        if (m_data.m_blases.size() > mi.modelIndex)
+        if (m_data.m_modelBlasIndices.size() > mi.modelIndex)
         {
-            const auto &blas = m_data.m_blases[mi.modelIndex];
+            const auto &blas =
+                m_data.m_blases[m_data.m_modelBlasIndices[mi.modelIndex]];
             asReference = blas.address;
         }
 
         instances.push_back(
             vk::AccelerationStructureInstanceKHR{
                 .transform = *trfn_cast,
-                .instanceCustomIndex = rti,
+                .instanceCustomIndex = m_tlasInstanceCustomIndices[i],
                 .mask = 0xFF,
                 .accelerationStructureReference = asReference,
             });
-        // Draw instances pack all submodels of a model instance tightly so
-        // let's use the index of the first one as the TLAS instance index. RT
-        // shaders can then access each submodel from that using the geometry
-        // index of the hit.
-        rti += asserted_cast<uint32_t>(model.subModels.size());
     }
-    WHEELS_ASSERT(instances.size() == scene.modelInstances.size());
-
-    reserveTlasInstances(asserted_cast<uint32_t>(scene.modelInstances.size()));
 
-    m_tlasInstancesUploadOffset =
+    const uint32_t uploadOffset =
         m_tlasInstancesUploadRing->write_elements(instances);
+
+    const vk::DeviceSize instanceByteCount =
+        sizeof(vk::AccelerationStructureInstanceKHR);
+    for (size_t j = 0; j < updatedInstances.size(); ++j)
+    {
+        const vk::DeviceSize srcOffset = uploadOffset + (j * instanceByteCount);
+        const vk::DeviceSize dstOffset =
+            updatedInstances[j] * instanceByteCount;
+        if (!m_tlasInstanceCopies.empty())
+        {
+            vk::BufferCopy &previous = m_tlasInstanceCopies.back();
+            if (previous.srcOffset + previous.size == srcOffset &&
+                previous.dstOffset + previous.size == dstOffset)
+            {
+                previous.size += instanceByteCount;
+                continue;
+            }
+        }
+        m_tlasInstanceCopies.push_back(
+            vk::BufferCopy{
+                .srcOffset = srcOffset,
+                .dstOffset = dstOffset,
+                .size = instanceByteCount,
+            });
+    }
 }
 
 void World::Impl::createTlasBuildInfos(
@@ -970,10 +1209,11 @@ World::~World() = default;
 
 void World::init(
     wheels::ScopedScratch scopeAlloc, gfx::RingBuffer &constantsRing,
-    const std::filesystem::path &scene)
+    const std::filesystem::path &scene, size_t textureBudgetByteCount)
 {
     WHEELS_ASSERT(!m_initialized);
-    m_impl->init(WHEELS_MOV(scopeAlloc), constantsRing, scene);
+    m_impl->init(
+        WHEELS_MOV(scopeAlloc), constantsRing, scene, textureBudgetByteCount);
     m_initialized = true;
 }
 
@@ -989,16 +1229,17 @@ void World::endFrame()
     m_impl->endFrame();
 }
 
-bool World::handleDeferredLoading(vk::CommandBuffer cb)
+bool World::handleDeferredLoading(vk::CommandBuffer cb, const Camera &cam)
 {
     WHEELS_ASSERT(m_initialized);
-    return m_impl->m_data.handleDeferredLoading(cb);
+    return m_impl->m_data.handleDeferredLoading(cb, cam);
 }
 
 bool World::unbuiltBlases() const
 {
     WHEELS_ASSERT(m_initialized);
-    return m_impl->m_data.m_blases.size() < m_impl->m_data.m_models.size();
+    return m_impl->m_data.m_modelBlasIndices.size() <
+           m_impl->m_data.m_models.size();
 }
 
 void World::drawDeferredLoadingUi() const
@@ -1079,10 +1320,10 @@ void World::updateScene(
     m_impl->updateScene(WHEELS_MOV(scopeAlloc), cameraTransform, sceneStats);
 }
 
-void World::updateBuffers(ScopedScratch scopeAlloc)
+void World::updateBuffers(ScopedScratch scopeAlloc, vk::CommandBuffer cb)
 {
     WHEELS_ASSERT(m_initialized);
-    m_impl->updateBuffers(WHEELS_MOV(scopeAlloc));
+    m_impl->updateBuffers(WHEELS_MOV(scopeAlloc), cb);
 }
 
 bool World::buildAccelerationStructures(
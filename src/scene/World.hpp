@@ -26,15 +26,19 @@ class World
     World &operator=(const World &other) = delete;
     World &operator=(World &&other) = delete;
 
+    // glTF textures are streamed to keep their resident data within
+    // textureBudgetByteCount
     void init(
         wheels::ScopedScratch scopeAlloc, gfx::RingBuffer &constantsRing,
-        const std::filesystem::path &scene);
+        const std::filesystem::path &scene, size_t textureBudgetByteCount);
 
     void startFrame();
     void endFrame();
 
     // Returns true if the visible scene was changed.
-    [[nodiscard]] bool handleDeferredLoading(vk::CommandBuffer cb);
+    // Loading is prioritized by what is visible from cam
+    [[nodiscard]] bool handleDeferredLoading(
+        vk::CommandBuffer cb, const Camera &cam);
     [[nodiscard]] bool unbuiltBlases() const;
 
     void drawDeferredLoadingUi() const;
@@ -58,7 +62,8 @@ class World
     void updateScene(
         wheels::ScopedScratch scopeAlloc, CameraTransform &cameraTransform,
         utils::SceneStats &sceneStats);
-    void updateBuffers(wheels::ScopedScratch scopeAlloc);
+    // Records uploads for static instances moved by dirty nodes into cb
+    void updateBuffers(wheels::ScopedScratch scopeAlloc, vk::CommandBuffer cb);
     // Has to be called after updateBuffers(). Returns true if new BLASes were
     // added.
     [[nodiscard]] bool buildAccelerationStructures(
@@ -4,9 +4,8 @@
 #include "utils/Logger.hpp"
 #include "utils/Profiler.hpp"
 
+#include <algorithm>
 #include <cstdio>
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/matrix_decompose.hpp>
 #include <imgui.h>
 #include <shader_structs/scene/draw_instance.h>
 
@@ -30,112 +29,13 @@ constexpr uint32_t sSkyboxReflectionSet = 0;
 // Need to know the limit up front to create the ds layout
 constexpr size_t sMaxGeometryBuffersCount = 100;
 
-constexpr int s_gl_nearest = 0x2600;
-constexpr int s_gl_linear = 0x2601;
-constexpr int s_gl_nearest_mipmap_nearest = 0x2700;
-constexpr int s_gl_linear_mipmap_nearest = 0x2701;
-constexpr int s_gl_nearest_mipmap_linear = 0x2702;
-constexpr int s_gl_linear_mimpap_linear = 0x2703;
-constexpr int s_gl_clamp_to_edge = 0x812F;
-constexpr int s_gl_mirrored_repeat = 0x8370;
-constexpr int s_gl_repeat = 0x2901;
-
-void *cgltf_alloc_func(void *user, cgltf_size size)
-{
-    Allocator *alloc = static_cast<Allocator *>(user);
-    return alloc->allocate(size);
-}
-
-// NOLINTNEXTLINE(bugprone-easily-swappable-parameters) lib interface
-void cgltf_free_func(void *user, void *ptr)
-{
-    Allocator *alloc = static_cast<Allocator *>(user);
-    alloc->deallocate(ptr);
-}
-
-const StaticArray sCgltfResultStr{{
-    "cgltf_result_success",
-    "cgltf_result_data_too_short",
-    "cgltf_result_unknown_format",
-    "cgltf_result_invalid_json",
-    "cgltf_result_invalid_gltf",
-    "cgltf_result_invalid_options",
-    "cgltf_result_file_not_found",
-    "cgltf_result_io_error",
-    "cgltf_result_out_of_memory",
-    "cgltf_result_legacy_gltf",
-}};
-// TODO:
-// StaticArray<const char*, cgltf_result_max_enum> ctor should also complain at
-// compile time
-static_assert(
-    sCgltfResultStr.size() == cgltf_result_max_enum,
-    "Missing cgltf_result strings");
-
-const StaticArray sCgltfAlphaModeStr{{
-    "cgltf_alpha_mode_opaque",
-    "cgltf_alpha_mode_mask",
-    "cgltf_alpha_mode_blend",
-}};
-static_assert(
-    sCgltfAlphaModeStr.size() == cgltf_alpha_mode_max_enum,
-    "Missing cgltf_alpha_mode strings");
-
-const StaticArray sCgltfLightTypeStr{{
-    "cgltf_light_type_invalid",
-    "cgltf_light_type_directional",
-    "cgltf_light_type_point",
-    "cgltf_light_type_spot",
-}};
-static_assert(
-    sCgltfLightTypeStr.size() == cgltf_light_type_max_enum,
-    "Missing cgltf_light_type strings");
-
-const StaticArray sCgltfCameraTypeStr{{
-    "cgltf_camera_type_invalid",
-    "cgltf_camera_type_perspective",
-    "cgltf_camera_type_orthographic",
-}};
-static_assert(
-    sCgltfCameraTypeStr.size() == cgltf_camera_type_max_enum,
-    "Missing cgltf_camera_type strings");
-
-cgltf_data *loadGltf(const std::filesystem::path &path)
-{
-    cgltf_file_type gltfType = cgltf_file_type_invalid;
-    if (path.extension() == ".gltf")
-        gltfType = cgltf_file_type_gltf;
-    else if (path.extension() == ".glb")
-        gltfType = cgltf_file_type_glb;
-    else
-        throw std::runtime_error(
-            "Unknown extension '" + path.extension().string() + "'");
-
-    static_assert(std::is_same_v<decltype(gAllocators.general), TlsfAllocator>);
-    const cgltf_options options{
-        .type = gltfType,
-        .memory = cgltf_memory_options{
-            .alloc_func = cgltf_alloc_func,
-            .free_func = cgltf_free_func,
-            .user_data = &gAllocators.general,
-        }};
-
-    cgltf_data *data = nullptr;
-    cgltf_result result =
-        cgltf_parse_file(&options, path.string().c_str(), &data);
-    if (result != cgltf_result_success)
-        throw std::runtime_error(
-            "Failed to parse gltf '" + path.string() +
-            "': " + sCgltfResultStr[result]);
+// Meshes and images only seen by instances outside the view are loaded after
+// the ones in it unless they are much larger on screen
+constexpr float sOutOfViewLoadingPriorityScale = 0.01f;
 
-    result = cgltf_load_buffers(&options, data, path.string().c_str());
-    if (result != cgltf_result_success)
-        throw std::runtime_error(
-            std::string("Failed to load glTF buffers: ") +
-            sCgltfResultStr[result]);
-
-    return data;
-}
+// Keep the per frame copies light, compaction isn't urgent
+constexpr uint32_t sMaxGeometryCompactionByteCountPerFrame =
+    asserted_cast<uint32_t>(megabytes(16));
 
 gfx::Buffer createSkyboxVertexBuffer()
 {
@@ -180,61 +80,172 @@ gfx::Buffer createSkyboxVertexBuffer()
         });
 }
 
-vk::Filter getVkFilterMode(cgltf_int glEnum)
+uint32_t rebaseGeometryOffset(
+    uint32_t offset, int64_t byteDelta, uint32_t elementByteCount)
 {
-    switch (glEnum)
-    {
-    case s_gl_nearest:
-    case s_gl_nearest_mipmap_nearest:
-    case s_gl_nearest_mipmap_linear:
-        return vk::Filter::eNearest;
-    case s_gl_linear:
-    case s_gl_linear_mipmap_nearest:
-    case s_gl_linear_mimpap_linear:
-        return vk::Filter::eLinear;
-    default:
-        LOG_ERR("Invalid gl filter {}", glEnum);
-    }
+    if (offset == 0xFFFF'FFFF)
+        return offset;
 
-    return vk::Filter::eLinear;
+    WHEELS_ASSERT(byteDelta % elementByteCount == 0);
+    return asserted_cast<uint32_t>(
+        static_cast<int64_t>(offset) +
+        byteDelta / static_cast<int64_t>(elementByteCount));
 }
 
-vk::SamplerAddressMode getVkAddressMode(cgltf_int glEnum)
+// Returns metadata that points to dst instead of src
+shader_structs::GeometryMetadata rebaseGeometryMetadata(
+    const shader_structs::GeometryMetadata &metadata, const GeometryRange &src,
+    const GeometryRange &dst)
 {
-    switch (glEnum)
-    {
-    case s_gl_clamp_to_edge:
-        return vk::SamplerAddressMode::eClampToEdge;
-    case s_gl_mirrored_repeat:
-        return vk::SamplerAddressMode::eMirroredRepeat;
-    case s_gl_repeat:
-        return vk::SamplerAddressMode::eRepeat;
-    default:
-        LOG_ERR("Invalid gl wrapping mode {}", glEnum);
-    }
+    WHEELS_ASSERT(metadata.bufferIndex == src.bufferIndex);
+    WHEELS_ASSERT(src.byteCount == dst.byteCount);
+
+    const int64_t byteDelta = static_cast<int64_t>(dst.byteOffset) -
+                              static_cast<int64_t>(src.byteOffset);
+    const uint32_t u32ByteCount = sizeof(uint32_t);
+    const uint32_t indexByteCount =
+        metadata.usesShortIndices == 1 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    shader_structs::GeometryMetadata ret = metadata;
+    ret.bufferIndex = dst.bufferIndex;
+    ret.indicesOffset =
+        rebaseGeometryOffset(metadata.indicesOffset, byteDelta, indexByteCount);
+    ret.positionsOffset =
+        rebaseGeometryOffset(metadata.positionsOffset, byteDelta, u32ByteCount);
+    ret.normalsOffset =
+        rebaseGeometryOffset(metadata.normalsOffset, byteDelta, u32ByteCount);
+    ret.tangentsOffset =
+        rebaseGeometryOffset(metadata.tangentsOffset, byteDelta, u32ByteCount);
+    ret.texCoord0sOffset = rebaseGeometryOffset(
+        metadata.texCoord0sOffset, byteDelta, u32ByteCount);
+    ret.meshletsOffset =
+        rebaseGeometryOffset(metadata.meshletsOffset, byteDelta, u32ByteCount);
+    ret.meshletBoundsOffset = rebaseGeometryOffset(
+        metadata.meshletBoundsOffset, byteDelta, u32ByteCount);
+    ret.meshletVerticesOffset = rebaseGeometryOffset(
+        metadata.meshletVerticesOffset, byteDelta, indexByteCount);
+    ret.meshletTrianglesByteOffset =
+        rebaseGeometryOffset(metadata.meshletTrianglesByteOffset, byteDelta, 1);
+    ret.lodsOffset =
+        rebaseGeometryOffset(metadata.lodsOffset, byteDelta, u32ByteCount);
 
-    return vk::SamplerAddressMode::eClampToEdge;
+    return ret;
 }
 
-// Appends data used by accessor to rawData and returns the pointer to it
-const void *appendAccessorData(
-    Array<uint8_t> &rawData, const cgltf_accessor &accessor)
+bool isSameGeometryRange(const GeometryRange &lhs, const GeometryRange &rhs)
 {
-    WHEELS_ASSERT(accessor.buffer_view != nullptr);
-    const cgltf_buffer_view &view = *accessor.buffer_view;
-    const uint32_t offset =
-        asserted_cast<uint32_t>(accessor.offset + view.offset);
+    return lhs.bufferIndex == rhs.bufferIndex &&
+           lhs.byteOffset == rhs.byteOffset;
+}
 
-    WHEELS_ASSERT(accessor.buffer_view->buffer != nullptr);
-    const cgltf_buffer &buffer = *view.buffer;
+struct LoadingView
+{
+    vec3 eye{0.f};
+    vec3 forward{0.f, 0.f, -1.f};
+    // Half angle of a cone that bounds the frustum. This is loose around the
+    // corners but close enough for prioritization.
+    float coneHalfAngle{0.f};
+    // Projected radius in pixels for a unit radius at unit distance
+    float pixelsPerUnit{0.f};
+    float maxPixelArea{0.f};
+    float maxPixelExtent{0.f};
+};
+
+LoadingView loadingView(const Camera &cam)
+{
+    const CameraTransform &transform = cam.transform();
+    const CameraParameters &parameters = cam.parameters();
+    const vec2 resolution{cam.resolution()};
+    const float tanHalfFov = tanf(parameters.fov * 0.5f);
+    const float aspectRatio = resolution.x / resolution.y;
+
+    return LoadingView{
+        .eye = transform.eye,
+        .forward = normalize(transform.target - transform.eye),
+        .coneHalfAngle =
+            atanf(tanHalfFov * sqrtf(1.f + aspectRatio * aspectRatio)),
+        .pixelsPerUnit = 0.5f * resolution.y / tanHalfFov,
+        .maxPixelArea = resolution.x * resolution.y,
+        .maxPixelExtent = std::max(resolution.x, resolution.y),
+    };
+}
+
+bool outsideView(
+    const LoadingView &view, const vec3 &toCenter, float centerDistance,
+    float radius)
+{
+    const float centerAngle =
+        acosf(clamp(dot(toCenter / centerDistance, view.forward), -1.f, 1.f));
+    const float sphereHalfAngle = asinf(radius / centerDistance);
 
-    const void *ret = rawData.data() + rawData.size();
+    return centerAngle - sphereHalfAngle > view.coneHalfAngle;
+}
 
-    WHEELS_ASSERT(offset < buffer.size && view.size <= buffer.size - offset);
-    const uint8_t *source = static_cast<const uint8_t *>(buffer.data) + offset;
-    rawData.extend(Span<const uint8_t>{source, view.size});
+// Returns the approximate pixel area covered by the sphere
+float loadingPriority(const LoadingView &view, const vec3 &center, float radius)
+{
+    const vec3 toCenter = center - view.eye;
+    const float centerDistance = length(toCenter);
+    if (centerDistance <= radius)
+        return view.maxPixelArea;
 
-    return ret;
+    const float pixelRadius = radius / centerDistance * view.pixelsPerUnit;
+    const float pixelArea = std::min(
+        glm::pi<float>() * pixelRadius * pixelRadius, view.maxPixelArea);
+
+    if (outsideView(view, toCenter, centerDistance, radius))
+        return pixelArea * sOutOfViewLoadingPriorityScale;
+
+    return pixelArea;
+}
+
+// Returns the approximate extent of the sphere on screen in pixels or 0 if it's
+// outside the view
+float drawnExtent(const LoadingView &view, const vec3 &center, float radius)
+{
+    const vec3 toCenter = center - view.eye;
+    const float centerDistance = length(toCenter);
+    if (centerDistance <= radius)
+        return view.maxPixelExtent;
+
+    if (outsideView(view, toCenter, centerDistance, radius))
+        return 0.f;
+
+    return std::min(
+        2.f * radius / centerDistance * view.pixelsPerUnit,
+        view.maxPixelExtent);
+}
+
+TimeAccessor timeAccessor(
+    const Array<uint8_t> &rawData,
+    const SceneSnapshot::AnimationSampler &sampler)
+{
+    WHEELS_ASSERT(
+        sampler.timesByteOffset + (sampler.timeCount * sizeof(float)) <=
+        rawData.size());
+    return TimeAccessor{
+        reinterpret_cast<const float *>(
+            rawData.data() + sampler.timesByteOffset),
+        sampler.timeCount,
+        TimeAccessor::Interval{
+            .startTimeS = sampler.startTimeS,
+            .endTimeS = sampler.endTimeS,
+        }};
+}
+
+// Returns the largest scale the transform applies along any axis
+float maxScale(const mat3x4 &modelToWorld)
+{
+    // Rows of the affine transform are stored so columns have to be gathered
+    float maxSquared = 0.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        const vec3 column{
+            modelToWorld[0][i], modelToWorld[1][i], modelToWorld[2][i]};
+        maxSquared = std::max(maxSquared, dot(column, column));
+    }
+
+    return sqrtf(maxSquared);
 }
 
 } // namespace
@@ -285,15 +296,24 @@ WorldData::~WorldData()
         gfx::gDevice.logical().destroy(blas.handle);
         gfx::gDevice.destroy(blas.buffer);
     }
+    gfx::gDevice.destroy(m_blasPositionTransforms);
     for (gfx::AccelerationStructure &tlas : m_tlases)
     {
         gfx::gDevice.logical().destroy(tlas.handle);
         gfx::gDevice.destroy(tlas.buffer);
     }
     for (Scene &scene : m_scenes)
+    {
         gfx::gDevice.destroy(scene.drawInstancesBuffer);
+        gfx::gDevice.destroy(scene.staticModelInstanceTransformsBuffer);
+        gfx::gDevice.destroy(scene.previousStaticModelInstanceTransformsBuffer);
+        gfx::gDevice.destroy(scene.staticModelInstanceScalesBuffer);
+    }
     for (gfx::Buffer &buffer : m_geometryBuffers)
         gfx::gDevice.destroy(buffer);
+    for (PendingGeometryBufferDestroy &pending :
+         m_pendingGeometryBufferDestroys)
+        gfx::gDevice.destroy(pending.buffer);
     for (gfx::Buffer &buffer : m_geometryMetadatasBuffers)
         gfx::gDevice.destroy(buffer);
     for (gfx::Buffer &buffer : m_meshletCountsBuffers)
@@ -306,7 +326,7 @@ WorldData::~WorldData()
 
 void WorldData::init(
     ScopedScratch scopeAlloc, const RingBuffers &ringBuffers,
-    const std::filesystem::path &scene)
+    const std::filesystem::path &scene, size_t textureBudgetByteCount)
 {
     WHEELS_ASSERT(!m_initialized);
 
@@ -428,19 +448,39 @@ void WorldData::init(
         throw std::runtime_error(
             "Couldn't find '" + fullScenePath.string() + "'");
 
-    const std::filesystem::file_time_type sourceWriteTime =
-        std::filesystem::last_write_time(fullScenePath);
-
+    // The world is set up from the scene snapshot if there's a valid one. The
+    // loading worker then only parses the glTF in the background if some mesh
+    // caches have to be generated.
     utils::Timer t;
-    cgltf_data *gltfData = loadGltf(fullScenePath);
-    WHEELS_ASSERT(gltfData != nullptr);
-    LOG_INFO("glTF model loading took {:.2f}s", t.getSeconds());
+    SceneSnapshot snapshot{gAllocators.general};
+    cgltf_data *gltfData = nullptr;
+    if (readSceneSnapshot(fullScenePath, snapshot))
+        LOG_INFO("Scene snapshot loading took {:.2f}s", t.getSeconds());
+    else
+    {
+        gltfData = loadGltf(fullScenePath, &gAllocators.general);
+        WHEELS_ASSERT(gltfData != nullptr);
+        LOG_INFO("glTF model loading took {:.2f}s", t.getSeconds());
+
+        t.reset();
+        gatherSceneSnapshot(scopeAlloc.child_scope(), *gltfData, snapshot);
+        try
+        {
+            writeSceneSnapshot(fullScenePath, *gltfData, snapshot);
+        }
+        catch (std::exception &e)
+        {
+            LOG_WARN("Failed to write scene snapshot: {}", e.what());
+        }
+        LOG_INFO("Scene snapshot gathering took {:.2f}s", t.getSeconds());
+    }
 
     m_deferredLoadingContext.emplace();
-    // Deferred context is responsible for freeing gltfData. Dispatch happens
-    // after other loading finishes and WorldData will then always go through
-    // the deferred context when it needs gltfData.
-    m_deferredLoadingContext->init(m_sceneDir, sourceWriteTime, *gltfData);
+    // Deferred context is responsible for freeing gltfData and parses the glTF
+    // on its worker if it needs it and it wasn't loaded here. WorldData only
+    // reads the counts from the context after this.
+    m_deferredLoadingContext->init(
+        fullScenePath, gltfData, snapshot, m_geometryAllocator);
 
     const auto &tl = [&](const char *stage, std::function<void()> const &fn)
     {
@@ -449,30 +489,25 @@ void WorldData::init(
         LOG_INFO("{} took {:.2f}s", stage, t.getSeconds());
     };
 
-    Array<shader_structs::Texture2DSampler> texture2DSamplers{
-        gAllocators.general, gltfData->images_count + 1};
     tl("Texture loading",
-       [&]()
-       {
-           loadTextures(scopeAlloc.child_scope(), *gltfData, texture2DSamplers);
-       });
-    tl("Material loading",
-       [&]() { loadMaterials(*gltfData, texture2DSamplers); });
+       [&]() { loadTextures(scopeAlloc.child_scope(), snapshot); });
+    tl("Material loading", [&]() { loadMaterials(snapshot); });
     tl("Model loading ",
-       [&]() { loadModels(scopeAlloc.child_scope(), *gltfData); });
+       [&]() { loadModels(scopeAlloc.child_scope(), snapshot); });
     tl("Animation and scene loading ",
        [&]()
        {
-           const HashMap<uint32_t, NodeAnimations> nodeAnimations =
-               loadAnimations(scopeAlloc.child_scope(), *gltfData);
-           loadScenes(scopeAlloc.child_scope(), *gltfData, nodeAnimations);
+           loadAnimations(snapshot);
+           loadScenes(scopeAlloc.child_scope(), snapshot);
        });
-    tl("Buffer creation", [&]() { createBuffers(); });
+    tl("Buffer creation",
+       [&]() { createBuffers(scopeAlloc.child_scope()); });
 
     m_tlases.resize(m_scenes.size());
 
     reflectBindings(scopeAlloc.child_scope());
-    createDescriptorSets(scopeAlloc.child_scope(), ringBuffers);
+    createDescriptorSets(
+        scopeAlloc.child_scope(), ringBuffers, textureBudgetByteCount);
 
     m_deferredLoadingContext->launch();
     m_initialized = true;
@@ -480,11 +515,8 @@ void WorldData::init(
 
 void WorldData::uploadMeshDatas(ScopedScratch scopeAlloc, uint32_t nextFrame)
 {
-    if (!m_deferredLoadingContext.has_value())
-        return;
-
-    if (m_geometryGenerations[nextFrame] ==
-        m_deferredLoadingContext->geometryGeneration)
+    // Compaction also updates geometry after loading has finished
+    if (m_geometryGenerations[nextFrame] == m_geometryGeneration)
         return;
 
     {
@@ -510,8 +542,7 @@ void WorldData::uploadMeshDatas(ScopedScratch scopeAlloc, uint32_t nextFrame)
             meshletCounts.size() * sizeof(meshletCounts[0]));
     }
 
-    m_geometryGenerations[nextFrame] =
-        m_deferredLoadingContext->geometryGeneration;
+    m_geometryGenerations[nextFrame] = m_geometryGeneration;
 
     Array<vk::DescriptorBufferInfo> bufferInfos{
         scopeAlloc, 2 + m_geometryBuffers.size()};
@@ -528,24 +559,24 @@ void WorldData::uploadMeshDatas(ScopedScratch scopeAlloc, uint32_t nextFrame)
         });
 
     WHEELS_ASSERT(
-        m_geometryBuffers.size() == m_geometryBufferAllocatedByteCounts.size());
+        m_geometryBuffers.size() == m_geometryBufferBoundByteCounts.size());
     const size_t bufferCount = m_geometryBuffers.size();
     for (size_t i = 0; i < bufferCount; ++i)
     {
-        if (m_geometryBufferAllocatedByteCounts[i] == 0)
+        if (m_geometryBufferBoundByteCounts[i] == 0)
         {
             // We might push a new buffer before the mesh it got created for
             // gets copied over. Let's just skip in that case. Just make sure we
             // won't leave other already used buffers hanging.
             for (size_t j = i + 1; j < bufferCount; ++j)
-                WHEELS_ASSERT(m_geometryBufferAllocatedByteCounts[j] == 0);
+                WHEELS_ASSERT(m_geometryBufferBoundByteCounts[j] == 0);
             break;
         }
 
         bufferInfos.push_back(
             vk::DescriptorBufferInfo{
                 .buffer = m_geometryBuffers[i].handle,
-                .range = m_geometryBufferAllocatedByteCounts[i],
+                .range = m_geometryBufferBoundByteCounts[i],
             });
     }
 
@@ -567,32 +598,60 @@ void WorldData::uploadMeshDatas(ScopedScratch scopeAlloc, uint32_t nextFrame)
 
 void WorldData::uploadMaterialDatas(uint32_t nextFrame)
 {
-    if (!m_deferredLoadingContext.has_value())
+    if (m_materialsGenerations[nextFrame] == m_materialsGeneration)
         return;
 
-    if (m_materialsGenerations[nextFrame] ==
-        m_deferredLoadingContext->materialsGeneration)
-        return;
+    // Materials refer to glTF images so they are pointed to the descriptors of
+    // the currently resident textures here
+    const auto residentTexture =
+        [this](shader_structs::Texture2DSampler textureSampler)
+    {
+        const uint32_t texture = textureSampler.texture();
+        // Texture 0 is our default texture, the rest are gltf images
+        if (texture == 0)
+            return textureSampler;
+        return shader_structs::Texture2DSampler{
+            m_textureStreamer.descriptorIndex(texture - 1),
+            textureSampler.sampler()};
+    };
 
     shader_structs::MaterialData *mapped =
         static_cast<shader_structs::MaterialData *>(
             m_materialsBuffers[nextFrame].mapped);
-    memcpy(
-        mapped, m_materials.data(),
-        m_materials.size() * sizeof(m_materials[0]));
+    const size_t materialCount = m_materials.size();
+    for (size_t i = 0; i < materialCount; ++i)
+    {
+        shader_structs::MaterialData material = m_materials[i];
+        material.baseColorTextureSampler =
+            residentTexture(material.baseColorTextureSampler);
+        material.metallicRoughnessTextureSampler =
+            residentTexture(material.metallicRoughnessTextureSampler);
+        material.normalTextureSampler =
+            residentTexture(material.normalTextureSampler);
+        mapped[i] = material;
+    }
 
-    m_materialsGenerations[nextFrame] =
-        m_deferredLoadingContext->materialsGeneration;
+    m_materialsGenerations[nextFrame] = m_materialsGeneration;
 }
 
-bool WorldData::handleDeferredLoading(vk::CommandBuffer cb)
+bool WorldData::handleDeferredLoading(vk::CommandBuffer cb, const Camera &cam)
 {
+    // Textures that are already in are streamed while the rest are loading
+    const bool texturesStreamed = updateTextureStreaming(cb, cam);
+    if (texturesStreamed)
+        m_materialsGeneration++;
+
     if (!m_deferredLoadingContext.has_value())
-        return false;
+    {
+        // Data is only moved after loading so that the ranges don't change
+        // under the loading worker
+        compactGeometry(cb);
+        return texturesStreamed;
+    }
 
     DeferredLoadingContext &ctx = *m_deferredLoadingContext;
 
-    const bool allMeshesLoaded = ctx.loadedMeshCount == ctx.meshes.size();
+    const bool allMeshesLoaded = ctx.loadedMeshCount == ctx.meshCount;
     const bool allMaterialsLoaded =
         ctx.loadedMaterialCount == ctx.materials.size();
 
@@ -611,7 +670,7 @@ bool WorldData::handleDeferredLoading(vk::CommandBuffer cb)
 
             m_deferredLoadingContext.reset();
         }
-        return false;
+        return texturesStreamed;
     }
 
     // No gpu as timestamps are flaky for this work
@@ -620,42 +679,38 @@ bool WorldData::handleDeferredLoading(vk::CommandBuffer cb)
     if (ctx.loadedImageCount == 0)
         m_materialStreamingTimer.reset();
 
+    updateLoadingPriorities(cam);
+
     bool newMeshAvailable = false;
     if (!allMeshesLoaded)
         newMeshAvailable = pollMeshWorker(cb);
 
-    size_t newTexturesAvailable = 0;
     bool shouldUpdateMaterials = false;
     if (allMeshesLoaded)
     {
         // All materials loaded implies all images loaded
         WHEELS_ASSERT(!allMaterialsLoaded);
 
-        if (ctx.loadedImageCount < ctx.gltfData->images_count)
-        {
-            newTexturesAvailable = pollTextureWorker(cb);
-        }
+        if (ctx.loadedImageCount < ctx.imageCount)
+            pollTextureWorker(cb);
         else
             // We should not get here if the model has any images
             WHEELS_ASSERT(
-                ctx.gltfData->images_count == 0 &&
-                ctx.loadedMaterialCount < ctx.gltfData->materials_count);
+                ctx.imageCount == 0 &&
+                ctx.loadedMaterialCount < ctx.materials.size());
         shouldUpdateMaterials = true;
     }
 
-    if (newTexturesAvailable > 0)
-        updateDescriptorsWithNewTextures(newTexturesAvailable);
-
     const bool newMaterialsAvailable =
         shouldUpdateMaterials ? updateMaterials() : false;
 
-    return newMeshAvailable || newMaterialsAvailable;
+    return newMeshAvailable || newMaterialsAvailable || texturesStreamed;
 }
 
 void WorldData::drawDeferredLoadingUi() const
 {
     if (m_deferredLoadingContext.has_value() ||
-        m_blases.size() < m_models.size())
+        m_modelBlasIndices.size() < m_models.size())
     {
         ImGui::SetNextWindowPos(ImVec2{400, 50}, ImGuiCond_Appearing);
         ImGui::Begin(
@@ -671,16 +726,14 @@ void WorldData::drawDeferredLoadingUi() const
             ImGui::Text(
                 "Images loaded: %u/%u",
                 m_deferredLoadingContext->loadedImageCount,
-                asserted_cast<uint32_t>(
-                    m_deferredLoadingContext->gltfData->textures_count));
+                m_deferredLoadingContext->imageCount);
         }
         ImGui::End();
     }
 }
 
 void WorldData::loadTextures(
-    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-    Array<shader_structs::Texture2DSampler> &texture2DSamplers)
+    ScopedScratch scopeAlloc, const SceneSnapshot &snapshot)
 {
     {
         const vk::SamplerCreateInfo info{
@@ -697,18 +750,14 @@ void WorldData::loadTextures(
         };
         m_samplers.push_back(gfx::gDevice.logical().createSampler(info));
     }
-    WHEELS_ASSERT(
-        gltfData.samplers_count < 0xFE &&
-        "Too many samplers to pack in u32 texture index");
-    for (const cgltf_sampler &sampler :
-         Span{gltfData.samplers, gltfData.samplers_count})
+    for (const SceneSnapshot::Sampler &sampler : snapshot.samplers)
     {
         const vk::SamplerCreateInfo info{
-            .magFilter = getVkFilterMode(sampler.mag_filter),
-            .minFilter = getVkFilterMode(sampler.min_filter),
+            .magFilter = sampler.magFilter,
+            .minFilter = sampler.minFilter,
             .mipmapMode = vk::SamplerMipmapMode::eLinear, // TODO
-            .addressModeU = getVkAddressMode(sampler.wrap_s),
-            .addressModeV = getVkAddressMode(sampler.wrap_t),
+            .addressModeU = sampler.addressModeU,
+            .addressModeV = sampler.addressModeV,
             .addressModeW = vk::SamplerAddressMode::eClampToEdge,
             .anisotropyEnable = VK_TRUE, // TODO: Is there a gltf flag?
             .maxAnisotropy = 16,
@@ -718,14 +767,13 @@ void WorldData::loadTextures(
         m_samplers.push_back(gfx::gDevice.logical().createSampler(info));
     }
 
-    gfx::Buffer stagingBuffer = createTextureStaging();
+    // The default texture is a single texel
+    gfx::Buffer stagingBuffer = createTextureStaging(1);
     defer { gfx::gDevice.destroy(stagingBuffer); };
 
-    m_texture2Ds.reserve(gltfData.images_count + 1);
     {
         const vk::CommandBuffer cb = gfx::gDevice.beginGraphicsCommands();
-        m_texture2Ds.emplace_back();
-        m_texture2Ds.back().init(
+        m_defaultTexture.init(
             scopeAlloc.child_scope(), resPath("texture/empty.png"), cb,
             stagingBuffer,
             Texture2DOptions{
@@ -733,188 +781,64 @@ void WorldData::loadTextures(
                                 gfx::ImageState::RayTracingRead,
             });
         gfx::gDevice.endGraphicsCommands(cb);
-
-        texture2DSamplers.emplace_back();
-    }
-
-    for (const cgltf_texture &texture :
-         Span{gltfData.textures, gltfData.textures_count})
-    {
-        WHEELS_ASSERT(texture.image != nullptr);
-
-        const uint32_t imageIndex = asserted_cast<uint32_t>(
-            cgltf_image_index(&gltfData, texture.image) + 1);
-        const uint32_t samplerIndex =
-            texture.sampler == nullptr
-                ? 0
-                : asserted_cast<uint32_t>(
-                      cgltf_sampler_index(&gltfData, texture.sampler) + 1);
-        texture2DSamplers.emplace_back(imageIndex, samplerIndex);
     }
 }
 
-void WorldData::loadMaterials(
-    const cgltf_data &gltfData,
-    const Array<shader_structs::Texture2DSampler> &texture2DSamplers)
+void WorldData::loadMaterials(const SceneSnapshot &snapshot)
 {
-    m_materials.push_back(shader_structs::MaterialData{});
-
-    for (const cgltf_material &material :
-         Span{gltfData.materials, gltfData.materials_count})
-    {
-        shader_structs::MaterialData mat;
-        if (material.has_pbr_metallic_roughness == 0)
-        {
-            LOG_WARN(
-                "'{}' doesn't have pbr metallic roughness components",
-                material.name);
-            continue;
-        }
-
-        auto const getTexture2dSampler =
-            [&](cgltf_texture_view const &tv,
-                const char *channelName) -> shader_structs::Texture2DSampler
-        {
-            if (tv.texture != nullptr)
-            {
-                if (tv.has_transform == 1)
-                    LOG_WARN(
-                        "{}: {} has a transform", material.name, channelName);
-                if (tv.scale != 1.f)
-                    LOG_WARN(
-                        "{}: {} Scale isn't 1", material.name, channelName);
-                if (tv.texcoord != 0)
-                    LOG_WARN(
-                        "{}: {} TexCoord isn't 0", material.name, channelName);
-
-                const cgltf_size index =
-                    cgltf_texture_index(&gltfData, tv.texture);
-                return texture2DSamplers[index + 1];
-            }
-            return shader_structs::Texture2DSampler{};
-        };
+    WHEELS_ASSERT(m_deferredLoadingContext.has_value());
+    DeferredLoadingContext &ctx = *m_deferredLoadingContext;
 
-        const cgltf_pbr_metallic_roughness &pbrParams =
-            material.pbr_metallic_roughness;
-
-        mat.baseColorTextureSampler =
-            getTexture2dSampler(pbrParams.base_color_texture, "base color");
-        mat.baseColorFactor = make_vec4(&pbrParams.base_color_factor[0]);
-        mat.metallicRoughnessTextureSampler = getTexture2dSampler(
-            pbrParams.metallic_roughness_texture, "metallic roughness");
-        mat.metallicFactor = pbrParams.metallic_factor;
-        mat.roughnessFactor = pbrParams.roughness_factor;
-        mat.normalTextureSampler =
-            getTexture2dSampler(material.normal_texture, "normal");
-        if (material.alpha_mode == cgltf_alpha_mode_mask)
-            mat.alphaMode = shader_structs::AlphaMode_Mask;
-        else if (material.alpha_mode == cgltf_alpha_mode_blend)
-            mat.alphaMode = shader_structs::AlphaMode_Blend;
-        else if (material.alpha_mode != cgltf_alpha_mode_opaque)
-            LOG_ERR(
-                "%s: Unsupported alpha mode '{}'", material.name,
-                sCgltfAlphaModeStr[material.alpha_mode]);
-        mat.alphaCutoff = material.alpha_cutoff;
+    m_materials.reserve(snapshot.materials.size() + 1);
+    ctx.materials.reserve(snapshot.materials.size());
 
+    m_materials.push_back(shader_structs::MaterialData{});
+    for (const shader_structs::MaterialData &mat : snapshot.materials)
+    {
         // Copy the alpha mode of the real material because that's used to
         // set opaque flag in rt
         m_materials.push_back(
             shader_structs::MaterialData{
                 .alphaMode = mat.alphaMode,
             });
-        WHEELS_ASSERT(m_deferredLoadingContext.has_value());
-        m_deferredLoadingContext->materials.push_back(mat);
+        ctx.materials.push_back(mat);
     }
 }
 
-void WorldData::loadModels(ScopedScratch scopeAlloc, const cgltf_data &gltfData)
+void WorldData::loadModels(
+    ScopedScratch scopeAlloc, const SceneSnapshot &snapshot)
 {
-    m_models.reserve(gltfData.meshes_count);
+    m_models.reserve(snapshot.modelMeshCounts.size());
 
-    size_t totalPrimitiveCount = 0;
-    for (const cgltf_mesh &mesh : Span{gltfData.meshes, gltfData.meshes_count})
-        totalPrimitiveCount += mesh.primitives_count;
+    const size_t totalPrimitiveCount = snapshot.meshMaterialIndices.size();
     m_geometryMetadatas.resize(totalPrimitiveCount);
+    m_meshGeometryRanges.resize(totalPrimitiveCount);
     m_meshInfos.resize(totalPrimitiveCount);
+    m_meshBoundingSpheres.extend(snapshot.meshBoundingSpheres.span());
+    WHEELS_ASSERT(m_meshBoundingSpheres.size() == totalPrimitiveCount);
 
     uint32_t meshIndex = 0;
-    for (cgltf_size mi = 0; mi < gltfData.meshes_count; ++mi)
+    for (const uint32_t meshCount : snapshot.modelMeshCounts)
     {
-        const cgltf_mesh &mesh = gltfData.meshes[mi];
-
         m_models.emplace_back(gAllocators.world);
         Model &model = m_models.back();
 
-        model.subModels.reserve(mesh.primitives_count);
-        for (cgltf_size pi = 0; pi < mesh.primitives_count; ++pi)
+        model.subModels.reserve(meshCount);
+        for (uint32_t i = 0; i < meshCount; ++i)
         {
-            const cgltf_primitive &primitive = mesh.primitives[pi];
-            WHEELS_ASSERT(primitive.indices != nullptr);
-
-            InputGeometryMetadata inputMetadata{
-                .indices = primitive.indices,
-                .sourceMeshIndex = asserted_cast<uint32_t>(mi),
-                .sourcePrimitiveIndex = asserted_cast<uint32_t>(pi),
-            };
-
-            for (cgltf_size ai = 0; ai < primitive.attributes_count; ++ai)
-            {
-                const cgltf_attribute &attr = primitive.attributes[ai];
-                WHEELS_ASSERT(attr.data != nullptr);
-
-                if (strcmp("POSITION", attr.name) == 0)
-                    inputMetadata.positions = attr.data;
-                else if (strcmp("NORMAL", attr.name) == 0)
-                    inputMetadata.normals = attr.data;
-                else if (strcmp("TANGENT", attr.name) == 0)
-                    inputMetadata.tangents = attr.data;
-                else if (strcmp("TEXCOORD_0", attr.name) == 0)
-                    inputMetadata.texCoord0s = attr.data;
-            }
-            WHEELS_ASSERT(inputMetadata.positions != nullptr);
-            WHEELS_ASSERT(inputMetadata.normals != nullptr);
-            WHEELS_ASSERT(
-                inputMetadata.positions->count == inputMetadata.normals->count);
-            WHEELS_ASSERT(
-                inputMetadata.tangents == nullptr ||
-                inputMetadata.tangents->count ==
-                    inputMetadata.positions->count);
-            WHEELS_ASSERT(
-                inputMetadata.texCoord0s == nullptr ||
-                inputMetadata.texCoord0s->count ==
-                    inputMetadata.positions->count);
-
-            const uint32_t material =
-                primitive.material != nullptr
-                    ? asserted_cast<uint32_t>(
-                          cgltf_material_index(&gltfData, primitive.material) +
-                          1)
-                    : 0;
-
-            const MeshInfo meshInfo = MeshInfo{
-                .vertexCount =
-                    asserted_cast<uint32_t>(inputMetadata.positions->count),
-                .indexCount =
-                    asserted_cast<uint32_t>(inputMetadata.indices->count),
-                .materialIndex = material,
-            };
-
-            WHEELS_ASSERT(
-                m_deferredLoadingContext.has_value() &&
-                !m_deferredLoadingContext->worker.has_value() &&
-                "Loading worker is running while input data is being set "
-                "up");
-            m_deferredLoadingContext->meshes.emplace_back(
-                inputMetadata, meshInfo);
+            // Meshes are loaded in priority order so the names are filled in
+            // as they arrive
+            m_meshNames.emplace_back(gAllocators.general);
             // Don't set metadata or info for the mesh index as default
             // values signal invalid or not yet loaded for other parts. Tangents
             // generation might also change the number of unique vertices.
 
             model.subModels.push_back(
                 Model::SubModel{
-                    .meshIndex = meshIndex++,
-                    .materialIndex = material,
+                    .meshIndex = meshIndex,
+                    .materialIndex = snapshot.meshMaterialIndices[meshIndex],
                 });
+            meshIndex++;
         }
     }
 
@@ -955,370 +879,122 @@ void WorldData::loadModels(ScopedScratch scopeAlloc, const cgltf_data &gltfData)
                 .initialData = zeroMeshletCounts.data(),
                 .debugName = "MeshletCounts",
             });
+
+    // These are written as the BLASes are built as the transforms come from
+    // the mesh caches
+    m_blasPositionTransforms = gfx::gDevice.createBuffer(
+        gfx::BufferCreateInfo{
+            .desc =
+                gfx::BufferDescription{
+                    .byteSize = asserted_cast<uint32_t>(
+                        m_meshInfos.size() * sizeof(vk::TransformMatrixKHR)),
+                    .usage = vk::BufferUsageFlagBits::
+                                 eAccelerationStructureBuildInputReadOnlyKHR |
+                             vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                    .properties = vk::MemoryPropertyFlagBits::eHostVisible |
+                                  vk::MemoryPropertyFlagBits::eHostCoherent,
+                },
+            .cacheDeviceAddress = true,
+            .debugName = "BlasPositionTransforms",
+        });
 }
 
-HashMap<uint32_t, WorldData::NodeAnimations> WorldData::loadAnimations(
-    ScopedScratch scopeAlloc, const cgltf_data &gltfData)
+void WorldData::loadAnimations(const SceneSnapshot &snapshot)
 {
-    // First find out the amount of memory we need to copy over all the
-    // animation data. We need to do that before parsing animations because
-    // we'll store pointers to the raw data and it can't be resized during/after
-    // the gather.
-    // Also gather sizes for the animation arrays because we'll store pointers
-    // to them in the map.
-    uint32_t totalAnimationBytes = 0;
-    uint32_t totalVec3Animations = 0;
-    uint32_t totalQuatAnimations = 0;
-    for (const cgltf_animation &animation :
-         Span{gltfData.animations, gltfData.animations_count})
-    {
-        for (const cgltf_animation_sampler &sampler :
-             Span{animation.samplers, animation.samplers_count})
-        {
-            {
-                WHEELS_ASSERT(sampler.input != nullptr);
-                const cgltf_accessor &accessor = *sampler.input;
-                WHEELS_ASSERT(accessor.buffer_view != nullptr);
-                const cgltf_buffer_view &view = *accessor.buffer_view;
-                totalAnimationBytes += asserted_cast<uint32_t>(view.size);
-            }
-            {
-                WHEELS_ASSERT(sampler.output != nullptr);
-                const cgltf_accessor &accessor = *sampler.output;
-                WHEELS_ASSERT(accessor.buffer_view != nullptr);
-                const cgltf_buffer_view &view = *accessor.buffer_view;
-                totalAnimationBytes += asserted_cast<uint32_t>(view.size);
-                if (accessor.type == cgltf_type_vec3)
-                    totalVec3Animations++;
-                else if (accessor.type == cgltf_type_vec4)
-                    // Only quaternion animations are currently sampled from
-                    // vec4 outputs
-                    totalQuatAnimations++;
-            }
-        }
-    }
-
-    // Init empty animations for all nodes and avoid resizes by safe upper bound
-    // TODO: Why is this a map and not a vector?
-    HashMap<uint32_t, NodeAnimations> ret{
-        gAllocators.general, gltfData.nodes_count * 2};
-    for (uint32_t i = 0; i < gltfData.nodes_count; ++i)
-        ret.insert_or_assign(i, NodeAnimations{});
-
-    // Now reserve the data so that our pointers are stable when we push the
-    // data
-    m_rawAnimationData.reserve(totalAnimationBytes);
-    m_animations.vec3.reserve(totalVec3Animations);
-    m_animations.quat.reserve(totalQuatAnimations);
-    for (const cgltf_animation &animation :
-         Span{gltfData.animations, gltfData.animations_count})
-    {
-        // Map loaded animations to indices in gltf samplers
-        // We know the types of these based on the target property so let's do
-        // the dirty casts to void and back to store them
-        Array<void *> concreteAnimations{scopeAlloc, animation.channels_count};
-        for (cgltf_size si = 0; si < animation.samplers_count; ++si)
-        {
-            const cgltf_animation_sampler &sampler = animation.samplers[si];
-
-            InterpolationType interpolation{InterpolationType::Step};
-            if (sampler.interpolation == cgltf_interpolation_type_step)
-                interpolation = InterpolationType::Step;
-            else if (sampler.interpolation == cgltf_interpolation_type_linear)
-                interpolation = InterpolationType::Linear;
-            else if (
-                sampler.interpolation == cgltf_interpolation_type_cubic_spline)
-                interpolation = InterpolationType::CubicSpline;
-            else
-                WHEELS_ASSERT(!"Unsupported interpolation type");
-
-            WHEELS_ASSERT(sampler.input != nullptr);
-            const cgltf_accessor &inputAccessor = *sampler.input;
-            WHEELS_ASSERT(!inputAccessor.is_sparse);
-            WHEELS_ASSERT(
-                inputAccessor.component_type == cgltf_component_type_r_32f);
-            WHEELS_ASSERT(inputAccessor.type == cgltf_type_scalar);
-
-            // TODO:
-            // Share data for accessors that use the same bytes?
-            const float *timesPtr = static_cast<const float *>(
-                appendAccessorData(m_rawAnimationData, inputAccessor));
-
-            WHEELS_ASSERT(inputAccessor.has_min);
-            WHEELS_ASSERT(inputAccessor.has_max);
-            TimeAccessor timeFrames{
-                timesPtr, asserted_cast<uint32_t>(inputAccessor.count),
-                TimeAccessor::Interval{
-                    .startTimeS = static_cast<float>(inputAccessor.min[0]),
-                    .endTimeS = static_cast<float>(inputAccessor.max[0]),
-                }};
-
-            WHEELS_ASSERT(sampler.output != nullptr);
-            const cgltf_accessor &outputAccessor = *sampler.output;
-            WHEELS_ASSERT(!outputAccessor.is_sparse);
-            WHEELS_ASSERT(
-                outputAccessor.component_type == cgltf_component_type_r_32f);
-
-            // TODO:
-            // Share data for accessors that use the same bytes?
-            const uint8_t *valuesPtr = static_cast<const uint8_t *>(
-                appendAccessorData(m_rawAnimationData, outputAccessor));
-
-            if (outputAccessor.type == cgltf_type_vec3)
-            {
-                ValueAccessor<vec3> valueFrames{
-                    valuesPtr, asserted_cast<uint32_t>(outputAccessor.count)};
-
-                m_animations.vec3.emplace_back(
-                    interpolation, WHEELS_MOV(timeFrames),
-                    WHEELS_MOV(valueFrames));
-
-                concreteAnimations.push_back(
-                    static_cast<void *>(&m_animations.vec3.back()));
-            }
-            else if (outputAccessor.type == cgltf_type_vec4)
-            {
-                ValueAccessor<quat> valueFrames{
-                    valuesPtr, asserted_cast<uint32_t>(outputAccessor.count)};
-
-                m_animations.quat.emplace_back(
-                    interpolation, WHEELS_MOV(timeFrames),
-                    WHEELS_MOV(valueFrames));
-
-                concreteAnimations.push_back(
-                    static_cast<void *>(&m_animations.quat.back()));
-            }
-            else
-                WHEELS_ASSERT(!"Unsupported animation output type");
-        }
-
-        for (const cgltf_animation_channel &channel :
-             Span{animation.channels, animation.channels_count})
-        {
-            WHEELS_ASSERT(channel.target_node != nullptr);
-            const uint32_t nodeIndex = asserted_cast<uint32_t>(
-                cgltf_node_index(&gltfData, channel.target_node));
-
-            WHEELS_ASSERT(channel.sampler != nullptr);
-            const uint32_t samplerIndex = asserted_cast<uint32_t>(
-                cgltf_animation_sampler_index(&animation, channel.sampler));
-
-            NodeAnimations *targetAnimations = ret.find(nodeIndex);
-            // These should have been initialized earlier
-            WHEELS_ASSERT(targetAnimations != nullptr);
-            if (channel.target_path == cgltf_animation_path_type_translation)
-                targetAnimations->translation = static_cast<Animation<vec3> *>(
-                    concreteAnimations[samplerIndex]);
-            else if (channel.target_path == cgltf_animation_path_type_rotation)
-                targetAnimations->rotation = static_cast<Animation<quat> *>(
-                    concreteAnimations[samplerIndex]);
-            else if (channel.target_path == cgltf_animation_path_type_scale)
-                targetAnimations->scale = static_cast<Animation<vec3> *>(
-                    concreteAnimations[samplerIndex]);
-        }
-    }
-
-    return ret;
+    // Animations point to the raw data and nodes to the animations so none of
+    // these can be resized after this
+    m_rawAnimationData.reserve(snapshot.rawAnimationData.size());
+    m_rawAnimationData.extend(snapshot.rawAnimationData.span());
+    m_animations.vec3.reserve(snapshot.vec3Animations.size());
+    m_animations.quat.reserve(snapshot.quatAnimations.size());
+
+    for (const SceneSnapshot::AnimationSampler &sampler :
+         snapshot.vec3Animations)
+        m_animations.vec3.emplace_back(
+            sampler.interpolation, timeAccessor(m_rawAnimationData, sampler),
+            ValueAccessor<vec3>{
+                m_rawAnimationData.data() + sampler.valuesByteOffset,
+                sampler.valueCount});
+
+    for (const SceneSnapshot::AnimationSampler &sampler :
+         snapshot.quatAnimations)
+        m_animations.quat.emplace_back(
+            sampler.interpolation, timeAccessor(m_rawAnimationData, sampler),
+            ValueAccessor<quat>{
+                m_rawAnimationData.data() + sampler.valuesByteOffset,
+                sampler.valueCount});
+
+    m_animations.createBatches();
 }
 
 void WorldData::loadScenes(
-    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-    const HashMap<uint32_t, NodeAnimations> &nodeAnimations)
+    ScopedScratch scopeAlloc, const SceneSnapshot &snapshot)
 {
-    // Parse raw nodes first so conversion to internal format happens only once
-    // for potential instances
-    Array<TmpNode> nodes{scopeAlloc, gltfData.nodes_count};
-    for (const cgltf_node &gltfNode :
-         Span{gltfData.nodes, gltfData.nodes_count})
-    {
-        nodes.emplace_back(gltfNode.name != nullptr ? gltfNode.name : "");
-        TmpNode &node = nodes.back();
-
-        node.children.reserve(gltfNode.children_count);
-        for (const cgltf_node *child :
-             Span{gltfNode.children, gltfNode.children_count})
-        {
-            WHEELS_ASSERT(child != nullptr);
-            const cgltf_size index = cgltf_node_index(&gltfData, child);
-            node.children.push_back(asserted_cast<uint32_t>(index));
-        }
-
-        if (gltfNode.mesh != nullptr)
-            node.modelIndex = asserted_cast<uint32_t>(
-                cgltf_mesh_index(&gltfData, gltfNode.mesh));
-        if (gltfNode.camera != nullptr)
-        {
-            const uint32_t cameraIndex = asserted_cast<uint32_t>(
-                cgltf_camera_index(&gltfData, gltfNode.camera));
-            const cgltf_camera &cam = *gltfNode.camera;
-            if (cam.type == cgltf_camera_type_perspective)
-            {
-                if (m_cameras.size() <= cameraIndex)
-                {
-                    m_cameras.resize(cameraIndex + 1);
-                    m_cameraDynamic.resize(cameraIndex + 1);
-                }
-
-                m_cameras[cameraIndex] = CameraParameters{
-                    .fov = static_cast<float>(cam.data.perspective.yfov),
-                    .zN = static_cast<float>(cam.data.perspective.znear),
-                    .zF = static_cast<float>(cam.data.perspective.zfar),
-                };
-
-                node.camera = cameraIndex;
-            }
-            else
-                LOG_ERR(
-                    "Unsupported camera type '{}'",
-                    sCgltfCameraTypeStr[cam.type]);
-        }
-        if (gltfNode.light != nullptr)
-            node.light = asserted_cast<uint32_t>(
-                cgltf_light_index(&gltfData, gltfNode.light));
-
-        vec3 translation{0.f};
-        vec3 scale{1.f};
-        quat rotation{1.f, 0.f, 0.f, 0.f};
-        if (gltfNode.has_matrix == 1)
-        {
-            // Spec defines the matrix to be decomposeable to T * R * S
-            const mat4 matrix = make_mat4(&gltfNode.matrix[0]);
-            vec3 skew;
-            vec4 perspective;
-            decompose(matrix, scale, rotation, translation, skew, perspective);
-        }
-        if (gltfNode.has_translation == 1)
-            translation = make_vec3(&gltfNode.translation[0]);
-        if (gltfNode.has_rotation == 1)
-            rotation = make_quat(&gltfNode.rotation[0]);
-        if (gltfNode.has_scale == 1)
-            scale = make_vec3(&gltfNode.scale[0]);
-
-        // Skip transform components that are close to identity
-        const float srtThreshold = 0.001f;
-
-        if (any(lessThan(translation, vec3{-srtThreshold})) ||
-            any(greaterThan(translation, vec3{srtThreshold})))
-            node.translation = translation;
-
-        const vec3 eulers = eulerAngles(rotation);
-        if (any(lessThan(eulers, vec3{-srtThreshold})) ||
-            any(greaterThan(eulers, vec3{srtThreshold})))
-            node.rotation = rotation;
-
-        if (any(lessThan(scale, vec3{1.f - srtThreshold})) ||
-            any(greaterThan(scale, vec3{1.f + srtThreshold})))
-            node.scale = scale;
-    }
+    m_cameras.extend(snapshot.cameras.span());
+    m_cameraDynamic.resize(m_cameras.size());
 
-    const cgltf_size defaultScene =
-        cgltf_scene_index(&gltfData, gltfData.scene);
-    m_currentScene = std::max(defaultScene, (size_t)0);
+    m_currentScene = snapshot.defaultScene;
 
     // Traverse scene trees and generate actual scene datas
-    m_scenes.reserve(gltfData.scenes_count);
-    for (const cgltf_scene &gltfScene :
-         Span{gltfData.scenes, gltfData.scenes_count})
+    m_scenes.reserve(snapshot.sceneRootCounts.size());
+    uint32_t firstRoot = 0;
+    for (const uint32_t rootCount : snapshot.sceneRootCounts)
     {
         m_scenes.emplace_back();
 
-        gatherScene(scopeAlloc.child_scope(), gltfData, gltfScene, nodes);
+        gatherScene(
+            scopeAlloc.child_scope(), snapshot,
+            Span{snapshot.sceneRoots.data() + firstRoot, rootCount});
+        firstRoot += rootCount;
 
         Scene &scene = m_scenes.back();
 
         // Nodes won't move in memory anymore so we can register the
         // animation targets
-        for (Scene::Node &node : scene.nodes)
+        Scene::Nodes &nodes = scene.nodes;
+        for (uint32_t i = 0; i < nodes.size(); ++i)
         {
-            const NodeAnimations *animations =
-                nodeAnimations.find(node.gltfSourceNode);
-            if (animations != nullptr)
+            const SceneSnapshot::Node &sourceNode =
+                snapshot.nodes[nodes.gltfSourceNodes[i]];
+            if (sourceNode.translationAnimation != SceneSnapshot::sNone)
             {
-                if (animations->translation.has_value())
-                {
-                    node.dynamicTransform = true;
-
-                    Animation<vec3> *animation = *animations->translation;
-                    scene.endTimeS =
-                        std::max(scene.endTimeS, animation->endTimeS());
-
-                    if (!node.translation.has_value())
-                        node.translation = vec3{0.f};
-                    animation->registerTarget(*node.translation);
-                }
-                if (animations->rotation.has_value())
-                {
-                    node.dynamicTransform = true;
-
-                    Animation<quat> *animation = *animations->rotation;
-                    scene.endTimeS =
-                        std::max(scene.endTimeS, animation->endTimeS());
+                nodes.flags[i] |= Scene::NodeFlags_Translation |
+                                  Scene::NodeFlags_DynamicTransform;
 
-                    if (!node.rotation.has_value())
-                        node.rotation = quat{1.f, 0.f, 0.f, 0.f};
-                    animation->registerTarget(*node.rotation);
-                }
-                if (animations->scale.has_value())
-                {
-                    node.dynamicTransform = true;
-
-                    Animation<vec3> *animation = *animations->scale;
-                    scene.endTimeS =
-                        std::max(scene.endTimeS, animation->endTimeS());
-
-                    if (!node.scale.has_value())
-                        node.scale = vec3{1.f};
-                    animation->registerTarget(*node.scale);
-                }
+                Animation<vec3> &animation =
+                    m_animations.vec3[sourceNode.translationAnimation];
+                scene.endTimeS = std::max(scene.endTimeS, animation.endTimeS());
+                animation.registerTarget(nodes.translations[i]);
             }
-            else
-                // Non-animated nodes should be mapped too
-                WHEELS_ASSERT(!"Node not found in animation data");
-        }
-
-        // Propagate dynamic flags
-        {
-            ScopedScratch scratch = scopeAlloc.child_scope();
-            Array<uint32_t> nodeStack{scratch, scene.nodes.size()};
-            Array<bool> parentDynamics{scratch, scene.nodes.size()};
-            HashSet<uint32_t> visited{scratch, scene.nodes.size()};
-            for (uint32_t rootIndex : scene.rootNodes)
+            if (sourceNode.rotationAnimation != SceneSnapshot::sNone)
             {
-                nodeStack.clear();
-                parentDynamics.clear();
-                visited.clear();
+                nodes.flags[i] |= Scene::NodeFlags_Rotation |
+                                  Scene::NodeFlags_DynamicTransform;
 
-                nodeStack.push_back(rootIndex);
-                parentDynamics.push_back(false);
-                while (!nodeStack.empty())
-                {
-                    const uint32_t nodeIndex = nodeStack.back();
-                    if (visited.contains(nodeIndex))
-                    {
-                        nodeStack.pop_back();
-                        parentDynamics.pop_back();
-                    }
-                    else
-                    {
-                        visited.insert(nodeIndex);
-                        Scene::Node &node = scene.nodes[nodeIndex];
-
-                        const uint32_t first_child = node.firstChild;
-                        const uint32_t last_child = node.lastChild;
-                        for (uint32_t child = first_child; child <= last_child;
-                             ++child)
-                            nodeStack.push_back(child);
+                Animation<quat> &animation =
+                    m_animations.quat[sourceNode.rotationAnimation];
+                scene.endTimeS = std::max(scene.endTimeS, animation.endTimeS());
+                animation.registerTarget(nodes.rotations[i]);
+            }
+            if (sourceNode.scaleAnimation != SceneSnapshot::sNone)
+            {
+                nodes.flags[i] |=
+                    Scene::NodeFlags_Scale | Scene::NodeFlags_DynamicTransform;
 
-                        const bool parentDynamic = parentDynamics.back();
-                        node.dynamicTransform |= parentDynamic;
+                Animation<vec3> &animation =
+                    m_animations.vec3[sourceNode.scaleAnimation];
+                scene.endTimeS = std::max(scene.endTimeS, animation.endTimeS());
+                animation.registerTarget(nodes.scales[i]);
+            }
+        }
 
-                        if (node.dynamicTransform && node.camera.has_value())
-                            m_cameraDynamic[*node.camera] = true;
+        scene.initTransforms();
 
-                        parentDynamics.emplace_back(node.dynamicTransform);
-                    }
-                }
-            }
+        for (const Scene::CameraNode &cameraNode : scene.cameraNodes)
+        {
+            if ((nodes.flags[cameraNode.node] &
+                 Scene::NodeFlags_DynamicTransform) != 0)
+                m_cameraDynamic[cameraNode.camera] = true;
         }
 
         // Scatter random lights in the scene
@@ -1362,100 +1038,107 @@ void WorldData::loadScenes(
 }
 
 void WorldData::gatherScene(
-    ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-    const cgltf_scene &gltfScene, const Array<TmpNode> &nodes)
+    ScopedScratch scopeAlloc, const SceneSnapshot &snapshot,
+    Span<const uint32_t> rootNodes)
 {
     struct NodePair
     {
-        uint32_t tmpNode{0xFFFF'FFFF};
+        uint32_t sourceNode{0xFFFF'FFFF};
         uint32_t sceneNode{0xFFFF'FFFF};
     };
-    Array<NodePair> nodeStack{scopeAlloc, nodes.size()};
+    Array<NodePair> nodeStack{scopeAlloc, snapshot.nodes.size()};
 
     Scene &scene = m_scenes.back();
+    Scene::Nodes &nodes = scene.nodes;
+    // glTF nodes have at most one parent so a scene can't have more nodes
+    nodes.reserve(snapshot.nodes.size());
 
     bool directionalLightFound = false;
 
-    for (const cgltf_node *node : Span{gltfScene.nodes, gltfScene.nodes_count})
+    for (const uint32_t nodeIndex : rootNodes)
     {
-        WHEELS_ASSERT(node != nullptr);
-        const cgltf_size nodeIndex = cgltf_node_index(&gltfData, node);
-
         // Our node indices don't match gltf's anymore, push index of the
         // new node into roots
-        scene.rootNodes.push_back(asserted_cast<uint32_t>(scene.nodes.size()));
-        scene.nodes.emplace_back();
-        scene.fullNodeNames.emplace_back(gAllocators.general);
+        const uint32_t rootIndex = nodes.push_back(
+            Scene::sNoNode, nodeIndex, String{gAllocators.general});
+        scene.rootNodes.push_back(rootIndex);
 
         // Start adding nodes from the new root
         nodeStack.clear();
-        nodeStack.emplace_back(
-            asserted_cast<uint32_t>(nodeIndex),
-            asserted_cast<uint32_t>(scene.nodes.size() - 1));
+        nodeStack.emplace_back(nodeIndex, rootIndex);
         while (!nodeStack.empty())
         {
             const NodePair indices = nodeStack.pop_back();
-            const TmpNode &tmpNode = nodes[indices.tmpNode];
-
-            // Push children to the back of nodes before getting the current
-            // node's reference to avoid it invalidating
-            const uint32_t childCount =
-                asserted_cast<uint32_t>(tmpNode.children.size());
-            const uint32_t firstChild =
-                asserted_cast<uint32_t>(scene.nodes.size());
-            // If no children, firstChild <= lastChild false as intended.
-            const uint32_t lastChild = firstChild + childCount - 1;
-            scene.nodes.resize(
-                scene.nodes.size() + asserted_cast<size_t>(childCount));
-
-            Scene::Node &sceneNode = scene.nodes[indices.sceneNode];
-            sceneNode.gltfSourceNode = indices.tmpNode;
-            sceneNode.firstChild = firstChild;
-            sceneNode.lastChild = lastChild;
+            const SceneSnapshot::Node &sourceNode =
+                snapshot.nodes[indices.sourceNode];
+            const uint32_t sceneNode = indices.sceneNode;
 
             // Parent initialized this with the parent 'path'
-            scene.fullNodeNames[indices.sceneNode].extend(
-                StrSpan{tmpNode.gltfName.data(), tmpNode.gltfName.size()});
-            // This span is stable now even though the array of names is not
-            sceneNode.fullName = scene.fullNodeNames[indices.sceneNode];
-
-            for (uint32_t i = 0; i < childCount; ++i)
+            nodes.fullNames[sceneNode].extend(
+                StrSpan{
+                    snapshot.nodeNames.data() + sourceNode.nameOffset,
+                    sourceNode.nameLength});
+            // Names don't move as the node arrays were reserved up front
+            const StrSpan fullName = nodes.fullNames[sceneNode];
+
+            // Children are added after their parent, which keeps the nodes in
+            // parent-before-child order
+            for (uint32_t i = 0; i < sourceNode.childCount; ++i)
             {
-                const uint32_t childIndex = sceneNode.firstChild + i;
-                scene.nodes[childIndex].parent = indices.sceneNode;
-                nodeStack.emplace_back(tmpNode.children[i], childIndex);
-
-                scene.fullNodeNames.emplace_back(
-                    gAllocators.general, sceneNode.fullName);
-                scene.fullNodeNames.back().push_back('/');
+                const uint32_t sourceChild =
+                    snapshot.nodeChildren[sourceNode.firstChild + i];
+
+                String childName{gAllocators.general, fullName};
+                childName.push_back('/');
+                const uint32_t childIndex = nodes.push_back(
+                    sceneNode, sourceChild, WHEELS_MOV(childName));
+                nodeStack.emplace_back(sourceChild, childIndex);
             }
 
-            sceneNode.translation = tmpNode.translation;
-            sceneNode.rotation = tmpNode.rotation;
-            sceneNode.scale = tmpNode.scale;
-            sceneNode.modelIndex = tmpNode.modelIndex;
-            sceneNode.camera = tmpNode.camera;
+            if ((sourceNode.flags & SceneSnapshot::NodeFlags_Translation) != 0)
+            {
+                nodes.translations[sceneNode] = sourceNode.translation;
+                nodes.flags[sceneNode] |= Scene::NodeFlags_Translation;
+            }
+            if ((sourceNode.flags & SceneSnapshot::NodeFlags_Rotation) != 0)
+            {
+                nodes.rotations[sceneNode] = sourceNode.rotation;
+                nodes.flags[sceneNode] |= Scene::NodeFlags_Rotation;
+            }
+            if ((sourceNode.flags & SceneSnapshot::NodeFlags_Scale) != 0)
+            {
+                nodes.scales[sceneNode] = sourceNode.scale;
+                nodes.flags[sceneNode] |= Scene::NodeFlags_Scale;
+            }
+            if (sourceNode.camera != SceneSnapshot::sNone)
+                scene.cameraNodes.push_back(
+                    Scene::CameraNode{
+                        .camera = sourceNode.camera,
+                        .node = sceneNode,
+                    });
 
-            if (sceneNode.modelIndex.has_value())
+            if (sourceNode.modelIndex != SceneSnapshot::sNone)
             {
-                sceneNode.modelInstance =
+                const uint32_t modelInstance =
                     asserted_cast<uint32_t>(scene.modelInstances.size());
                 // TODO:
                 // Why is id needed here? It's just the index in the array
                 scene.modelInstances.push_back(
                     ModelInstance{
-                        .id = *sceneNode.modelInstance,
-                        .modelIndex = *sceneNode.modelIndex,
-                        .fullName = sceneNode.fullName,
+                        .id = modelInstance,
+                        .modelIndex = sourceNode.modelIndex,
+                        .fullName = fullName,
                     });
+                scene.modelInstanceNodes.push_back(sceneNode);
                 scene.drawInstanceCount += asserted_cast<uint32_t>(
-                    m_models[*sceneNode.modelIndex].subModels.size());
+                    m_models[sourceNode.modelIndex].subModels.size());
             }
 
-            if (tmpNode.light.has_value())
+            if (sourceNode.light != SceneSnapshot::sNone)
             {
-                const cgltf_light &light = gltfData.lights[*tmpNode.light];
-                if (light.type == cgltf_light_type_directional)
+                const SceneSnapshot::Light &light =
+                    snapshot.lights[sourceNode.light];
+                if (light.type == SceneSnapshot::LightType::Directional)
                 {
                     if (directionalLightFound)
                     {
@@ -1466,25 +1149,17 @@ void WorldData::gatherScene(
                     auto &parameters = scene.lights.directionalLight.parameters;
                     // gltf blender exporter puts W/m^2 into intensity
                     parameters.irradiance =
-                        vec4{
-                            static_cast<float>(light.color[0]),
-                            static_cast<float>(light.color[1]),
-                            static_cast<float>(light.color[2]), 0.f} *
-                        static_cast<float>(light.intensity);
+                        vec4{light.color, 0.f} * light.intensity;
 
-                    sceneNode.directionalLight = true;
+                    scene.directionalLightNode = sceneNode;
                     directionalLightFound = true;
                 }
-                else if (light.type == cgltf_light_type_point)
+                else if (light.type == SceneSnapshot::LightType::Point)
                 {
-                    auto radiance =
-                        vec3{
-                            static_cast<float>(light.color[0]),
-                            static_cast<float>(light.color[1]),
-                            static_cast<float>(light.color[2])} *
-                        static_cast<float>(light.intensity)
-                        // gltf blender exporter puts W into intensity
-                        / (4.f * glm::pi<float>());
+                    auto radiance = light.color * light.intensity
+                                    // gltf blender exporter puts W into
+                                    // intensity
+                                    / (4.f * glm::pi<float>());
                     const auto luminance =
                         dot(radiance, vec3{0.2126, 0.7152, 0.0722});
                     const auto minLuminance = 0.01f;
@@ -1492,43 +1167,35 @@ void WorldData::gatherScene(
                                             ? light.range
                                             : sqrt(luminance / minLuminance);
 
-                    sceneNode.pointLight = asserted_cast<uint32_t>(
-                        scene.lights.pointLights.data.size());
+                    scene.pointLightNodes.push_back(sceneNode);
                     scene.lights.pointLights.data.emplace_back();
                     auto &sceneLight = scene.lights.pointLights.data.back();
 
                     sceneLight.radianceAndRadius = vec4{radiance, radius};
                 }
-                else if (light.type == cgltf_light_type_spot)
+                else
                 {
-                    sceneNode.spotLight = asserted_cast<uint32_t>(
-                        scene.lights.spotLights.data.size());
+                    WHEELS_ASSERT(light.type == SceneSnapshot::LightType::Spot);
+
+                    scene.spotLightNodes.push_back(sceneNode);
                     scene.lights.spotLights.data.emplace_back();
                     auto &sceneLight = scene.lights.spotLights.data.back();
 
                     // Angular attenuation rom gltf spec
                     const auto angleScale =
-                        1.f / max(0.001f, cos(light.spot_inner_cone_angle) -
-                                              cos(light.spot_outer_cone_angle));
+                        1.f / max(0.001f, cos(light.spotInnerConeAngle) -
+                                              cos(light.spotOuterConeAngle));
                     const auto angleOffset =
-                        -cos(light.spot_outer_cone_angle) * angleScale;
+                        -cos(light.spotOuterConeAngle) * angleScale;
 
                     sceneLight.radianceAndAngleScale =
-                        vec4{
-                            static_cast<float>(light.color[0]),
-                            static_cast<float>(light.color[1]),
-                            static_cast<float>(light.color[2]), 0.f} *
-                        static_cast<float>(light.intensity);
+                        vec4{light.color, 0.f} * light.intensity;
                     // gltf blender exporter puts W into intensity
                     sceneLight.radianceAndAngleScale /= 4.f * glm::pi<float>();
                     sceneLight.radianceAndAngleScale.w = angleScale;
 
                     sceneLight.positionAndAngleOffset.w = angleOffset;
                 }
-                else
-                    LOG_ERR(
-                        "Unsupported light type '{}'",
-                        sCgltfLightTypeStr[light.type]);
             }
         }
     }
@@ -1542,7 +1209,7 @@ void WorldData::gatherScene(
     }
 }
 
-void WorldData::createBuffers()
+void WorldData::createBuffers(ScopedScratch scopeAlloc)
 {
     for (size_t i = 0; i < m_materialsBuffers.capacity(); ++i)
         m_materialsBuffers[i] = gfx::gDevice.createBuffer(
@@ -1560,34 +1227,138 @@ void WorldData::createBuffers()
             });
 
     {
-        size_t maxModelInstanceTransforms = 0;
+        size_t maxDynamicModelInstances = 0;
         for (auto &scene : m_scenes)
         {
-            maxModelInstanceTransforms = std::max(
-                maxModelInstanceTransforms, scene.modelInstances.size());
+            maxDynamicModelInstances = std::max(
+                maxDynamicModelInstances, scene.dynamicModelInstances.size());
+
+            const size_t staticInstanceCount =
+                scene.modelInstances.size() -
+                scene.dynamicModelInstances.size();
+            Array<shader_structs::ModelInstanceTransforms> staticTransforms{
+                scopeAlloc, staticInstanceCount};
+            Array<float> staticScales{scopeAlloc, staticInstanceCount};
+
+            // The DrawInstances generated here have to match the indices that
+            // get assigned to tlas instances
+            for (uint32_t mi = 0; mi < scene.modelInstances.size(); ++mi)
+            {
+                const ModelInstance &instance = scene.modelInstances[mi];
+
+                const uint32_t transformIndex =
+                    scene.modelInstanceTransformIndices[mi];
+                if ((transformIndex & shader_structs::DynamicTransformBit) == 0)
+                {
+                    WHEELS_ASSERT(transformIndex == staticTransforms.size());
+                    staticTransforms.push_back(instance.transforms);
+                    staticScales.push_back(instance.uniformScale());
+                }
+
+                // Submodels are pushed one after another and TLAS instance
+                // update assumes this as it uses the flattened index of the
+                // first submodel as the custom index for each instance. RT
+                // shaders then access each submodel from that using the
+                // geometry index of the hit.
+                for (const auto &model :
+                     m_models[instance.modelIndex].subModels)
+                {
+                    scene.drawInstances.push_back(
+                        shader_structs::DrawInstance{
+                            .modelInstanceIndex = mi,
+                            .meshIndex = model.meshIndex,
+                            .materialIndex = model.materialIndex,
+                            .transformIndex = transformIndex,
+                        });
+                }
+            }
+            WHEELS_ASSERT(
+                scene.drawInstances.size() == scene.drawInstanceCount);
+
+            // Empty buffers aren't valid so let's pad with an unused instance
+            if (staticTransforms.empty())
+            {
+                staticTransforms.emplace_back();
+                staticScales.push_back(0.f);
+            }
 
             scene.drawInstancesBuffer = gfx::gDevice.createBuffer(
                 gfx::BufferCreateInfo{
                     .desc =
                         gfx::BufferDescription{
                             .byteSize = sizeof(shader_structs::DrawInstance) *
-                                        scene.drawInstanceCount,
-                            .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+                                        scene.drawInstances.size(),
+                            .usage = vk::BufferUsageFlagBits::eStorageBuffer |
+                                     vk::BufferUsageFlagBits::eTransferDst,
                             .properties =
-                                vk::MemoryPropertyFlagBits::eHostVisible |
-                                vk::MemoryPropertyFlagBits::eHostCoherent,
+                                vk::MemoryPropertyFlagBits::eDeviceLocal,
                         },
+                    .initialData = scene.drawInstances.data(),
                     .debugName = "DrawInstances",
                 });
+
+            scene.staticModelInstanceTransformsBuffer =
+                gfx::gDevice.createBuffer(
+                    gfx::BufferCreateInfo{
+                        .desc =
+                            gfx::BufferDescription{
+                                .byteSize = staticTransforms.size() *
+                                            sizeof(staticTransforms[0]),
+                                .usage =
+                                    vk::BufferUsageFlagBits::eStorageBuffer |
+                                    vk::BufferUsageFlagBits::eTransferDst,
+                                .properties =
+                                    vk::MemoryPropertyFlagBits::eDeviceLocal,
+                            },
+                        .initialData = staticTransforms.data(),
+                        .debugName = "StaticModelInstanceTransforms",
+                    });
+
+            scene.previousStaticModelInstanceTransformsBuffer =
+                gfx::gDevice.createBuffer(
+                    gfx::BufferCreateInfo{
+                        .desc =
+                            gfx::BufferDescription{
+                                .byteSize = staticTransforms.size() *
+                                            sizeof(staticTransforms[0]),
+                                .usage =
+                                    vk::BufferUsageFlagBits::eStorageBuffer |
+                                    vk::BufferUsageFlagBits::eTransferDst,
+                                .properties =
+                                    vk::MemoryPropertyFlagBits::eDeviceLocal,
+                            },
+                        .initialData = staticTransforms.data(),
+                        .debugName = "PreviousStaticModelInstanceTransforms",
+                    });
+
+            scene.staticModelInstanceScalesBuffer = gfx::gDevice.createBuffer(
+                gfx::BufferCreateInfo{
+                    .desc =
+                        gfx::BufferDescription{
+                            .byteSize =
+                                staticScales.size() * sizeof(staticScales[0]),
+                            .usage = vk::BufferUsageFlagBits::eStorageBuffer |
+                                     vk::BufferUsageFlagBits::eTransferDst,
+                            .properties =
+                                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                        },
+                    .initialData = staticScales.data(),
+                    .debugName = "StaticModelInstanceScales",
+                });
         }
 
+        // Descriptor ranges can't be empty even when there are no dynamic
+        // instances
+        maxDynamicModelInstances =
+            std::max(maxDynamicModelInstances, size_t{1});
+
         // Make room for one extra frame because the previous frame's transforms
         // are read for motion
         const uint32_t bufferSize = asserted_cast<uint32_t>(
-            ((maxModelInstanceTransforms *
+            ((maxDynamicModelInstances *
                   sizeof(shader_structs::ModelInstanceTransforms) +
               static_cast<size_t>(gfx::RingBuffer::sAlignment)) +
-             (maxModelInstanceTransforms * sizeof(float) +
+             (maxDynamicModelInstances * sizeof(float) +
               static_cast<size_t>(gfx::RingBuffer::sAlignment))) *
             (MAX_FRAMES_IN_FLIGHT + 1));
         m_modelInstanceTransformsRing.init(
@@ -1680,7 +1451,8 @@ void WorldData::reflectBindings(ScopedScratch scopeAlloc)
 }
 
 void WorldData::createDescriptorSets(
-    ScopedScratch scopeAlloc, const RingBuffers &ringBuffers)
+    ScopedScratch scopeAlloc, const RingBuffers &ringBuffers,
+    size_t textureBudgetByteCount)
 {
     WHEELS_ASSERT(ringBuffers.constantsRing != nullptr);
     WHEELS_ASSERT(ringBuffers.lightDataRing != nullptr);
@@ -1738,14 +1510,16 @@ void WorldData::createDescriptorSets(
             asserted_cast<uint32_t>(materialSamplerInfos.size());
         m_dsLayouts.materialSamplerCount = samplerInfoCount;
 
-        // Use capacity instead of size so that this allocates descriptors for
-        // textures that are loaded later
+        // Allocate descriptors for the textures that are loaded and streamed
+        // later
+        WHEELS_ASSERT(m_deferredLoadingContext.has_value());
+        const uint32_t imageCount = m_deferredLoadingContext->imageCount;
         Array<vk::DescriptorImageInfo> materialImageInfos{
-            scopeAlloc, m_texture2Ds.capacity()};
+            scopeAlloc, TextureStreamer::descriptorCount(imageCount)};
         // Fill missing textures with the default info so potential reads
         // are still to valid descriptors
-        WHEELS_ASSERT(m_texture2Ds.size() == 1);
-        const vk::DescriptorImageInfo defaultInfo = m_texture2Ds[0].imageInfo();
+        const vk::DescriptorImageInfo defaultInfo =
+            m_defaultTexture.imageInfo();
         for (size_t i = 0; i < materialImageInfos.capacity(); ++i)
             materialImageInfos.push_back(defaultInfo);
 
@@ -1756,9 +1530,9 @@ void WorldData::createDescriptorSets(
             vk::DescriptorBindingFlags{},
             vk::DescriptorBindingFlags{
                 vk::DescriptorBindingFlagBits::eVariableDescriptorCount |
-                // Texture bindings for deferred loads are updated before frame
-                // cb submission, for textures that aren't accessed by any frame
-                // in flight
+                // Texture bindings for deferred loads and streaming are updated
+                // before frame cb submission, for textures that aren't accessed
+                // by any frame in flight
                 vk::DescriptorBindingFlagBits::ePartiallyBound |
                 vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending},
         }};
@@ -1788,8 +1562,10 @@ void WorldData::createDescriptorSets(
             asserted_cast<uint32_t>(descriptorWrites.size()),
             descriptorWrites.data(), 0, nullptr);
 
-        m_deferredLoadingContext->textureArrayBinding =
-            asserted_cast<uint32_t>(materialSamplerInfos.size());
+        m_textureStreamer.init(
+            imageCount, textureBudgetByteCount,
+            m_descriptorSets.materialTextures,
+            asserted_cast<uint32_t>(materialSamplerInfos.size()));
     }
 
     {
@@ -1931,25 +1707,42 @@ void WorldData::createDescriptorSets(
             scene.sceneInstancesDescriptorSet = m_descriptorAllocator.allocate(
                 m_dsLayouts.sceneInstances, "SceneInstances");
 
+            // Ranges can't be empty even when there are no dynamic instances
+            const size_t dynamicInstanceCount =
+                std::max(scene.dynamicModelInstances.size(), size_t{1});
             const StaticArray descriptorInfos{{
                 gfx::DescriptorInfo{vk::DescriptorBufferInfo{
                     .buffer = m_modelInstanceTransformsRing.buffer(),
-                    .range = scene.modelInstances.size() *
+                    .range = dynamicInstanceCount *
                              sizeof(shader_structs::ModelInstanceTransforms),
                 }},
                 gfx::DescriptorInfo{vk::DescriptorBufferInfo{
                     .buffer = m_modelInstanceTransformsRing.buffer(),
-                    .range = scene.modelInstances.size() *
+                    .range = dynamicInstanceCount *
                              sizeof(shader_structs::ModelInstanceTransforms),
                 }},
                 gfx::DescriptorInfo{vk::DescriptorBufferInfo{
                     .buffer = m_modelInstanceTransformsRing.buffer(),
-                    .range = scene.modelInstances.size() * sizeof(float),
+                    .range = dynamicInstanceCount * sizeof(float),
                 }},
                 gfx::DescriptorInfo{vk::DescriptorBufferInfo{
                     .buffer = scene.drawInstancesBuffer.handle,
                     .range = VK_WHOLE_SIZE,
                 }},
+                gfx::DescriptorInfo{vk::DescriptorBufferInfo{
+                    .buffer = scene.staticModelInstanceTransformsBuffer.handle,
+                    .range = VK_WHOLE_SIZE,
+                }},
+                gfx::DescriptorInfo{vk::DescriptorBufferInfo{
+                    .buffer = scene.staticModelInstanceScalesBuffer.handle,
+                    .range = VK_WHOLE_SIZE,
+                }},
+                gfx::DescriptorInfo{vk::DescriptorBufferInfo{
+                    .buffer =
+                        scene.previousStaticModelInstanceTransformsBuffer
+                            .handle,
+                    .range = VK_WHOLE_SIZE,
+                }},
             }};
             const Array descriptorWrites =
                 m_sceneInstancesReflection->generateDescriptorWrites(
@@ -2013,7 +1806,7 @@ bool WorldData::pollMeshWorker(vk::CommandBuffer cb)
     WHEELS_ASSERT(m_deferredLoadingContext.has_value());
 
     DeferredLoadingContext &ctx = *m_deferredLoadingContext;
-    WHEELS_ASSERT(ctx.loadedMeshCount < ctx.meshes.size());
+    WHEELS_ASSERT(ctx.loadedMeshCount < ctx.meshCount);
 
     bool newMeshLoaded = false;
     const size_t maxMeshesPerFrame = 10;
@@ -2045,25 +1838,36 @@ bool WorldData::pollMeshWorker(vk::CommandBuffer cb)
                         m_geometryBuffers.size() <= sMaxGeometryBuffersCount &&
                         "The layout requires a hard limit on the max number of "
                         "geometry buffers");
-                    m_geometryBufferAllocatedByteCounts.push_back(0u);
+                    m_geometryBufferBoundByteCounts.push_back(0u);
                 }
             }
 
             const UploadedGeometryData &uploadedData = loaded->first;
             const MeshInfo &info = loaded->second;
+            const uint32_t meshIndex = uploadedData.meshIndex;
             const uint32_t targetBufferI = uploadedData.metadata.bufferIndex;
             WHEELS_ASSERT(uploadedData.byteCount > 0);
-
-            const uint32_t previousAllocatedByteCount =
-                m_geometryBufferAllocatedByteCounts[targetBufferI];
+            WHEELS_ASSERT(meshIndex < m_meshInfos.size());
             WHEELS_ASSERT(
-                ((uploadedData.metadata.usesShortIndices &&
-                  previousAllocatedByteCount ==
-                      uploadedData.metadata.indicesOffset * sizeof(uint16_t)) ||
-                 (previousAllocatedByteCount ==
-                  uploadedData.metadata.indicesOffset * sizeof(uint32_t))) &&
-                "Uploaded data ranges have to be tight for valid ownership "
-                "transfer");
+                m_geometryMetadatas[meshIndex].bufferIndex == 0xFFFF'FFFF &&
+                "Mesh was uploaded twice");
+
+            m_geometryMetadatas[meshIndex] = uploadedData.metadata;
+            m_meshGeometryRanges[meshIndex] = GeometryRange{
+                .bufferIndex = targetBufferI,
+                .byteOffset = uploadedData.byteOffset,
+                .byteCount = uploadedData.byteCount,
+            };
+            m_meshInfos[meshIndex] = info;
+            m_meshNames[meshIndex] =
+                String{gAllocators.general, uploadedData.meshName};
+
+            ctx.loadedMeshCount++;
+            m_geometryGeneration++;
+
+            // Range was already acquired for an earlier mesh
+            if (uploadedData.sharesEarlierRange)
+                continue;
 
             const gfx::QueueFamilies &families = gfx::gDevice.queueFamilies();
             WHEELS_ASSERT(families.graphicsFamily.has_value());
@@ -2096,34 +1900,30 @@ bool WorldData::pollMeshWorker(vk::CommandBuffer cb)
                     });
             }
 
-            m_geometryMetadatas[ctx.loadedMeshCount] = uploadedData.metadata;
-            m_meshInfos[ctx.loadedMeshCount] = info;
-            m_meshNames.emplace_back(
-                gAllocators.general, uploadedData.meshName);
-            // Track the used (and ownership transferred) range
-            m_geometryBufferAllocatedByteCounts[targetBufferI] +=
-                uploadedData.byteCount;
-
-            ctx.loadedMeshCount++;
-            ctx.geometryGeneration++;
+            // Ranges can be placed into holes so only grow the bound range.
+            // Anything below the end is either ownership transferred or free.
+            m_geometryBufferBoundByteCounts[targetBufferI] = std::max(
+                m_geometryBufferBoundByteCounts[targetBufferI],
+                uploadedData.byteOffset + uploadedData.byteCount);
         }
     }
 
     return newMeshLoaded;
 }
 
-size_t WorldData::pollTextureWorker(vk::CommandBuffer cb)
+void WorldData::pollTextureWorker(vk::CommandBuffer cb)
 {
     WHEELS_ASSERT(m_deferredLoadingContext.has_value());
 
     DeferredLoadingContext &ctx = *m_deferredLoadingContext;
-    WHEELS_ASSERT(ctx.loadedImageCount < ctx.gltfData->images_count);
+    WHEELS_ASSERT(ctx.loadedImageCount < ctx.imageCount);
 
-    size_t newTexturesLoaded = 0;
     const size_t maxTexturesPerFrame = 10;
     for (size_t i = 0; i < maxTexturesPerFrame; ++i)
     {
         bool newTextureLoaded = false;
+        Texture2D texture;
+        uint32_t imageIndex = 0xFFFF'FFFF;
         {
             // Let's pop textures one by one to potentially let the async worker
             // push new ones to fill the quota while we're in this loop
@@ -2131,15 +1931,15 @@ size_t WorldData::pollTextureWorker(vk::CommandBuffer cb)
             if (ctx.loadedTextures.empty())
                 break;
 
-            m_texture2Ds.emplace_back(WHEELS_MOV(ctx.loadedTextures.front()));
+            LoadedTexture &loaded = ctx.loadedTextures.front();
+            texture = WHEELS_MOV(loaded.texture);
+            imageIndex = loaded.imageIndex;
             ctx.loadedTextures.erase(0);
             newTextureLoaded = true;
         }
 
         if (newTextureLoaded)
         {
-            newTexturesLoaded++;
-
             const gfx::QueueFamilies &families = gfx::gDevice.queueFamilies();
             WHEELS_ASSERT(families.graphicsFamily.has_value());
             WHEELS_ASSERT(families.transferFamily.has_value());
@@ -2157,7 +1957,7 @@ size_t WorldData::pollTextureWorker(vk::CommandBuffer cb)
                     .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
                     .srcQueueFamilyIndex = *families.transferFamily,
                     .dstQueueFamilyIndex = *families.graphicsFamily,
-                    .image = m_texture2Ds.back().nativeHandle(),
+                    .image = texture.nativeHandle(),
                     .subresourceRange =
                         vk::ImageSubresourceRange{
                             .aspectMask = vk::ImageAspectFlagBits::eColor,
@@ -2173,70 +1973,421 @@ size_t WorldData::pollTextureWorker(vk::CommandBuffer cb)
                         .pImageMemoryBarriers = &acquireBarrier,
                     });
             }
+
+            m_textureStreamer.addTexture(imageIndex, WHEELS_MOV(texture));
+
+            WHEELS_ASSERT(imageIndex < ctx.loadedImages.size());
+            WHEELS_ASSERT(ctx.loadedImages[imageIndex] == 0);
+            ctx.loadedImages[imageIndex] = 1;
+            ctx.loadedImageCount++;
         }
     }
+}
+
+void WorldData::compactGeometry(vk::CommandBuffer cb)
+{
+    WHEELS_ASSERT(!m_deferredLoadingContext.has_value());
+
+    for (size_t i = 0; i < m_pendingGeometryBufferDestroys.size();)
+    {
+        PendingGeometryBufferDestroy &pending =
+            m_pendingGeometryBufferDestroys[i];
+        if (pending.framesLeft > 0)
+        {
+            pending.framesLeft--;
+            ++i;
+            continue;
+        }
+
+        gfx::gDevice.destroy(pending.buffer);
+        m_pendingGeometryBufferDestroys.erase(i);
+    }
 
-    return newTexturesLoaded;
+    // The frame that moved a range might still read it so it's released only
+    // after that frame is guaranteed to have finished
+    bool rangesReleased = false;
+    for (size_t i = 0; i < m_pendingGeometryReleases.size();)
+    {
+        PendingGeometryRelease &pending = m_pendingGeometryReleases[i];
+        if (pending.framesLeft > 0)
+        {
+            pending.framesLeft--;
+            ++i;
+            continue;
+        }
+
+        m_geometryAllocator.release(pending.range);
+        m_pendingGeometryReleases.erase(i);
+        rangesReleased = true;
+        // Released space might let other ranges move
+        m_geometryCompacted = false;
+    }
+
+    if (rangesReleased)
+        trimGeometryBuffers();
+
+    if (m_geometryCompacted)
+        return;
+
+    PROFILER_CPU_SCOPE("CompactGeometry");
+
+    // Move ranges from the end of the last buffer first so that data settles
+    // towards the beginning of the first buffer
+    Array<GeometryRange> ranges{
+        gAllocators.general, m_meshGeometryRanges.size()};
+    for (const GeometryRange &range : m_meshGeometryRanges)
+    {
+        if (range.byteCount > 0)
+            ranges.push_back(range);
+    }
+    std::sort(
+        ranges.begin(), ranges.end(),
+        [](const GeometryRange &lhs, const GeometryRange &rhs)
+        {
+            return lhs.bufferIndex > rhs.bufferIndex ||
+                   (lhs.bufferIndex == rhs.bufferIndex &&
+                    lhs.byteOffset > rhs.byteOffset);
+        });
+
+    uint32_t movedByteCount = 0;
+    bool budgetExhausted = false;
+    const size_t rangeCount = ranges.size();
+    for (size_t i = 0; i < rangeCount; ++i)
+    {
+        const GeometryRange &src = ranges[i];
+        // Meshes with identical data share ranges
+        if (i > 0 && isSameGeometryRange(src, ranges[i - 1]))
+            continue;
+
+        if (movedByteCount > 0 &&
+            movedByteCount + src.byteCount >
+                sMaxGeometryCompactionByteCountPerFrame)
+        {
+            budgetExhausted = true;
+            break;
+        }
+
+        const Optional<GeometryRange> dst =
+            m_geometryAllocator.allocateBefore(src, sGeometryAlignment);
+        if (!dst.has_value())
+            continue;
+
+        // Data is only read through the old range and the new range is free so
+        // no barrier is needed before the copy
+        const vk::BufferCopy copyRegion{
+            .srcOffset = src.byteOffset,
+            .dstOffset = dst->byteOffset,
+            .size = src.byteCount,
+        };
+        cb.copyBuffer(
+            m_geometryBuffers[src.bufferIndex].handle,
+            m_geometryBuffers[dst->bufferIndex].handle, 1, &copyRegion);
+
+        const size_t meshCount = m_meshGeometryRanges.size();
+        for (size_t mi = 0; mi < meshCount; ++mi)
+        {
+            GeometryRange &meshRange = m_meshGeometryRanges[mi];
+            if (meshRange.byteCount > 0 && isSameGeometryRange(meshRange, src))
+            {
+                m_geometryMetadatas[mi] =
+                    rebaseGeometryMetadata(m_geometryMetadatas[mi], src, *dst);
+                meshRange = *dst;
+            }
+        }
+
+        m_geometryBufferBoundByteCounts[dst->bufferIndex] = std::max(
+            m_geometryBufferBoundByteCounts[dst->bufferIndex],
+            dst->byteOffset + dst->byteCount);
+        m_pendingGeometryReleases.push_back(
+            PendingGeometryRelease{
+                .range = src,
+                .framesLeft = MAX_FRAMES_IN_FLIGHT,
+            });
+
+        movedByteCount += src.byteCount;
+    }
+
+    if (movedByteCount > 0)
+    {
+        const vk::MemoryBarrier2 barrier{
+            .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask =
+                vk::PipelineStageFlagBits2::eVertexShader |
+                vk::PipelineStageFlagBits2::eMeshShaderEXT |
+                vk::PipelineStageFlagBits2::eComputeShader |
+                vk::PipelineStageFlagBits2::eRayTracingShaderKHR |
+                vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR |
+                // Later compactions copy from the moved ranges
+                vk::PipelineStageFlagBits2::eCopy,
+            .dstAccessMask = vk::AccessFlagBits2::eShaderRead |
+                             vk::AccessFlagBits2::eTransferRead,
+        };
+        cb.pipelineBarrier2(
+            vk::DependencyInfo{
+                .memoryBarrierCount = 1,
+                .pMemoryBarriers = &barrier,
+            });
+
+        // Metadata and descriptors get updated for the following frames
+        m_geometryGeneration++;
+    }
+
+    if (!budgetExhausted)
+        m_geometryCompacted = true;
+}
+
+void WorldData::trimGeometryBuffers()
+{
+    WHEELS_ASSERT(!m_deferredLoadingContext.has_value());
+    WHEELS_ASSERT(
+        m_geometryBuffers.size() == m_geometryBufferBoundByteCounts.size());
+
+    // Compaction moves data towards the first buffer so the last ones are the
+    // ones that get emptied
+    const uint32_t bufferCount =
+        m_geometryAllocator.removeEmptyTrailingBuffers();
+    WHEELS_ASSERT(bufferCount <= m_geometryBuffers.size());
+    while (m_geometryBuffers.size() > bufferCount)
+    {
+        // Descriptors of the in flight frames still point to the buffer
+        m_pendingGeometryBufferDestroys.push_back(
+            PendingGeometryBufferDestroy{
+                .buffer = m_geometryBuffers.pop_back(),
+                .framesLeft = MAX_FRAMES_IN_FLIGHT,
+            });
+        m_geometryBufferBoundByteCounts.pop_back();
+    }
+
+    for (uint32_t i = 0; i < bufferCount; ++i)
+    {
+        // Nothing reads past the last range that's in use. Empty buffers
+        // before used ones stay bound with a minimal range as a zero range
+        // isn't valid.
+        const uint32_t usedByteCount = m_geometryAllocator.usedByteCount(i);
+        m_geometryBufferBoundByteCounts[i] =
+            std::max(usedByteCount, sGeometryAlignment);
+    }
+
+    // Descriptors get updated for the following frames
+    m_geometryGeneration++;
+}
+
+void WorldData::unloadMesh(uint32_t meshIndex)
+{
+    WHEELS_ASSERT(
+        !m_deferredLoadingContext.has_value() &&
+        "Ranges might still be shared with meshes that are being loaded");
+    WHEELS_ASSERT(meshIndex < m_meshGeometryRanges.size());
+
+    GeometryRange &range = m_meshGeometryRanges[meshIndex];
+    if (range.byteCount == 0)
+        return;
+
+    // Meshes with identical data share ranges so the range is released with
+    // the last mesh that points to it
+    bool rangeShared = false;
+    const size_t meshCount = m_meshGeometryRanges.size();
+    for (size_t i = 0; i < meshCount; ++i)
+    {
+        const GeometryRange &other = m_meshGeometryRanges[i];
+        if (i != meshIndex && other.byteCount > 0 &&
+            isSameGeometryRange(other, range))
+        {
+            rangeShared = true;
+            break;
+        }
+    }
+
+    // In flight frames might still read the range
+    if (!rangeShared)
+        m_pendingGeometryReleases.push_back(
+            PendingGeometryRelease{
+                .range = range,
+                .framesLeft = MAX_FRAMES_IN_FLIGHT,
+            });
+
+    range = GeometryRange{};
+    m_geometryMetadatas[meshIndex] = shader_structs::GeometryMetadata{};
+    // Material is a property of the glTF primitive, not of the loaded data
+    MeshInfo &info = m_meshInfos[meshIndex];
+    info.vertexCount = 0;
+    info.indexCount = 0;
+    info.meshletCount = 0;
+
+    m_geometryGeneration++;
 }
 
-void WorldData::updateDescriptorsWithNewTextures(size_t newTextureCount)
+void WorldData::updateLoadingPriorities(const Camera &cam)
 {
     WHEELS_ASSERT(m_deferredLoadingContext.has_value());
 
     DeferredLoadingContext &ctx = *m_deferredLoadingContext;
-    const size_t textureCount = m_texture2Ds.size();
-    for (size_t i = 0; i < newTextureCount; ++i)
+    const size_t meshCount = ctx.meshCount;
+    const size_t imageCount = ctx.imageCount;
+    if (ctx.loadedMeshCount == meshCount && ctx.loadedImageCount == imageCount)
+        return;
+
+    PROFILER_CPU_SCOPE("UpdateLoadingPriorities");
+
+    const LoadingView view = loadingView(cam);
+
+    // Gather first so that the worker isn't blocked while we go through the
+    // instances
+    Array<float> meshPriorities{gAllocators.general};
+    Array<float> imagePriorities{gAllocators.general};
+    meshPriorities.resize(meshCount);
+    imagePriorities.resize(imageCount);
+    memset(meshPriorities.data(), 0, meshPriorities.size() * sizeof(float));
+    memset(imagePriorities.data(), 0, imagePriorities.size() * sizeof(float));
+
+    const auto updateImagePriority =
+        [&](uint32_t textureIndex, float priority)
     {
-        const vk::DescriptorImageInfo imageInfo =
-            m_texture2Ds[textureCount - newTextureCount + i].imageInfo();
-        const vk::WriteDescriptorSet descriptorWrite{
-            .dstSet = m_descriptorSets.materialTextures,
-            .dstBinding = ctx.textureArrayBinding,
-            // loadedImageCount is gltf images so bump by one to take our
-            // default texture into account
-            .dstArrayElement = ctx.loadedImageCount + 1,
-            .descriptorCount = 1,
-            .descriptorType = vk::DescriptorType::eSampledImage,
-            .pImageInfo = &imageInfo,
-        };
-        gfx::gDevice.logical().updateDescriptorSets(
-            1, &descriptorWrite, 0, nullptr);
+        // Texture 0 is our default texture, the rest are gltf images
+        if (textureIndex == 0)
+            return;
+        float &imagePriority = imagePriorities[textureIndex - 1];
+        imagePriority = std::max(imagePriority, priority);
+    };
+
+    const Scene &scene = m_scenes[m_currentScene];
+    for (const ModelInstance &instance : scene.modelInstances)
+    {
+        const Model &model = m_models[instance.modelIndex];
+        const mat3x4 &modelToWorld = instance.transforms.modelToWorld;
+        const float radiusScale = maxScale(modelToWorld);
+        for (const Model::SubModel &sm : model.subModels)
+        {
+            const vec4 &bounds = m_meshBoundingSpheres[sm.meshIndex];
+            const vec3 center = vec4{vec3{bounds}, 1.f} * modelToWorld;
+            const float priority =
+                loadingPriority(view, center, bounds.w * radiusScale);
+
+            float &meshPriority = meshPriorities[sm.meshIndex];
+            meshPriority = std::max(meshPriority, priority);
+
+            // Material 0 is our default material, the rest are gltf materials
+            if (sm.materialIndex == 0)
+                continue;
+            const shader_structs::MaterialData &material =
+                ctx.materials[sm.materialIndex - 1];
+            updateImagePriority(
+                material.baseColorTextureSampler.texture(), priority);
+            updateImagePriority(
+                material.normalTextureSampler.texture(), priority);
+            updateImagePriority(
+                material.metallicRoughnessTextureSampler.texture(), priority);
+        }
+    }
 
-        ctx.loadedImageCount++;
+    {
+        const std::lock_guard lock{ctx.loadingPrioritiesMutex};
+
+        WHEELS_ASSERT(ctx.meshPriorities.size() == meshCount);
+        WHEELS_ASSERT(ctx.imagePriorities.size() == imageCount);
+        // The workers reorder their queues when the generation changes so
+        // let's not bump it for a static view
+        const bool changed =
+            memcmp(
+                ctx.meshPriorities.data(), meshPriorities.data(),
+                meshCount * sizeof(float)) != 0 ||
+            memcmp(
+                ctx.imagePriorities.data(), imagePriorities.data(),
+                imageCount * sizeof(float)) != 0;
+        if (changed)
+        {
+            memcpy(
+                ctx.meshPriorities.data(), meshPriorities.data(),
+                meshCount * sizeof(float));
+            memcpy(
+                ctx.imagePriorities.data(), imagePriorities.data(),
+                imageCount * sizeof(float));
+            ctx.loadingPrioritiesGeneration++;
+        }
     }
 }
 
+bool WorldData::updateTextureStreaming(vk::CommandBuffer cb, const Camera &cam)
+{
+    PROFILER_CPU_SCOPE("TextureStreaming");
+
+    const LoadingView view = loadingView(cam);
+
+    // Texture 0 is our default texture, the rest are gltf images
+    Array<float> drawnExtents{gAllocators.general};
+    drawnExtents.resize(m_textureStreamer.imageCount());
+    memset(drawnExtents.data(), 0, drawnExtents.size() * sizeof(float));
+    const auto updateDrawnExtent = [&](uint32_t textureIndex, float extent)
+    {
+        if (textureIndex == 0)
+            return;
+        float &drawnExtent = drawnExtents[textureIndex - 1];
+        drawnExtent = std::max(drawnExtent, extent);
+    };
+
+    const Scene &scene = m_scenes[m_currentScene];
+    for (const ModelInstance &instance : scene.modelInstances)
+    {
+        const Model &model = m_models[instance.modelIndex];
+        const mat3x4 &modelToWorld = instance.transforms.modelToWorld;
+        const float radiusScale = maxScale(modelToWorld);
+        for (const Model::SubModel &sm : model.subModels)
+        {
+            const vec4 &bounds = m_meshBoundingSpheres[sm.meshIndex];
+            const vec3 center = vec4{vec3{bounds}, 1.f} * modelToWorld;
+            const float extent =
+                drawnExtent(view, center, bounds.w * radiusScale);
+            if (extent <= 0.f)
+                continue;
+
+            // Materials only point to textures once those have been loaded
+            const shader_structs::MaterialData &material =
+                m_materials[sm.materialIndex];
+            updateDrawnExtent(
+                material.baseColorTextureSampler.texture(), extent);
+            updateDrawnExtent(material.normalTextureSampler.texture(), extent);
+            updateDrawnExtent(
+                material.metallicRoughnessTextureSampler.texture(), extent);
+        }
+    }
+
+    return m_textureStreamer.update(cb, drawnExtents.span());
+}
+
 bool WorldData::updateMaterials()
 {
     DeferredLoadingContext &ctx = *m_deferredLoadingContext;
-    // Update next material(s) in line if the required textures are
-    // loaded
+    // Images are loaded in priority order so any material whose textures
+    // are in can be updated
+    const auto imageLoaded = [&ctx](uint32_t textureIndex)
+    {
+        // 0 is our default, gltf indices start from 1
+        return textureIndex == 0 || ctx.loadedImages[textureIndex - 1] == 1;
+    };
+
     bool materialsUpdated = false;
-    for (size_t i = ctx.loadedMaterialCount; i < ctx.materials.size(); ++i)
+    for (size_t i = 0; i < ctx.materials.size(); ++i)
     {
+        if (ctx.loadedMaterials[i] == 1)
+            continue;
+
         const shader_structs::MaterialData &material = ctx.materials[i];
-        const uint32_t baseColorIndex =
-            material.baseColorTextureSampler.texture();
-        const uint32_t normalIndex = material.normalTextureSampler.texture();
-        const uint32_t metallicRoughnessIndex =
-            material.metallicRoughnessTextureSampler.texture();
-        // Inclusive as 0 is our default, starting gltf indices from 1
-        if (baseColorIndex <= ctx.loadedImageCount &&
-            normalIndex <= ctx.loadedImageCount &&
-            metallicRoughnessIndex <= ctx.loadedImageCount)
+        if (imageLoaded(material.baseColorTextureSampler.texture()) &&
+            imageLoaded(material.normalTextureSampler.texture()) &&
+            imageLoaded(material.metallicRoughnessTextureSampler.texture()))
         {
             // These are gltf material indices so we have to take our
             // default material into account
             m_materials[i + 1] = material;
+            ctx.loadedMaterials[i] = 1;
             ctx.loadedMaterialCount++;
             materialsUpdated = true;
         }
-        else
-            break;
     }
 
     if (materialsUpdated)
-        ctx.materialsGeneration++;
+        m_materialsGeneration++;
 
     return materialsUpdated;
 }
@@ -8,10 +8,13 @@
 #include "scene/Animations.hpp"
 #include "scene/Camera.hpp"
 #include "scene/DeferredLoadingContext.hpp"
+#include "scene/GeometryAllocator.hpp"
 #include "scene/Material.hpp"
 #include "scene/Mesh.hpp"
 #include "scene/Model.hpp"
 #include "scene/Scene.hpp"
+#include "scene/SceneSnapshot.hpp"
+#include "scene/TextureStreamer.hpp"
 #include "scene/WorldRenderStructs.hpp"
 
 #include <cstdint>
@@ -21,6 +24,7 @@
 #include <wheels/containers/array.hpp>
 #include <wheels/containers/hash_map.hpp>
 #include <wheels/containers/optional.hpp>
+#include <wheels/containers/span.hpp>
 #include <wheels/containers/static_array.hpp>
 
 namespace scene
@@ -47,15 +51,21 @@ class WorldData
 
     void init(
         wheels::ScopedScratch scopeAlloc, const RingBuffers &ringBuffers,
-        const std::filesystem::path &scene);
+        const std::filesystem::path &scene, size_t textureBudgetByteCount);
 
     void uploadMeshDatas(wheels::ScopedScratch scopeAlloc, uint32_t nextFrame);
     void uploadMaterialDatas(uint32_t nextFrame);
     // Returns true if the visible scene was changed.
-    bool handleDeferredLoading(vk::CommandBuffer cb);
+    bool handleDeferredLoading(vk::CommandBuffer cb, const Camera &cam);
 
     void drawDeferredLoadingUi() const;
 
+    // Releases the geometry of the mesh once in flight frames are done with
+    // it. The mesh is treated as not loaded afterwards so it isn't drawn, but
+    // the caller is expected to drop any BLAS instances that use it. Only valid
+    // after loading has finished.
+    void unloadMesh(uint32_t meshIndex);
+
   private:
     bool m_initialized{false};
     // Use general for descriptors because because we don't know the required
@@ -67,22 +77,54 @@ class WorldData
     std::filesystem::path m_sceneDir;
 
     wheels::Array<vk::Sampler> m_samplers{gAllocators.general};
-    wheels::Array<Texture2D> m_texture2Ds{gAllocators.general};
+    Texture2D m_defaultTexture;
+    // Owns the glTF textures
+    TextureStreamer m_textureStreamer;
     wheels::StaticArray<gfx::Buffer, MAX_FRAMES_IN_FLIGHT>
         m_geometryMetadatasBuffers;
     wheels::StaticArray<gfx::Buffer, MAX_FRAMES_IN_FLIGHT>
         m_meshletCountsBuffers;
-    wheels::Array<uint32_t> m_geometryBufferAllocatedByteCounts{
+    // End of the last range in use in each buffer. This is what is bound and
+    // it's trimmed when moved or unloaded ranges get released.
+    wheels::Array<uint32_t> m_geometryBufferBoundByteCounts{
+        gAllocators.general};
+    // Range of the uploaded data for each mesh, shared by meshes that point to
+    // the same data
+    wheels::Array<GeometryRange> m_meshGeometryRanges{gAllocators.general};
+    struct PendingGeometryRelease
+    {
+        GeometryRange range;
+        uint32_t framesLeft{0};
+    };
+    wheels::Array<PendingGeometryRelease> m_pendingGeometryReleases{
         gAllocators.general};
+    // Trailing buffers that were left empty, destroyed once the descriptors of
+    // in flight frames no longer point to them
+    struct PendingGeometryBufferDestroy
+    {
+        gfx::Buffer buffer;
+        uint32_t framesLeft{0};
+    };
+    wheels::Array<PendingGeometryBufferDestroy>
+        m_pendingGeometryBufferDestroys{gAllocators.general};
+    bool m_geometryCompacted{false};
+    uint32_t m_geometryGeneration{0};
     wheels::StaticArray<uint32_t, MAX_FRAMES_IN_FLIGHT> m_geometryGenerations{
         0};
 
     wheels::StaticArray<gfx::Buffer, MAX_FRAMES_IN_FLIGHT> m_materialsBuffers;
+    // Bumped when materials are loaded or their textures move to different
+    // descriptors
+    uint32_t m_materialsGeneration{0};
     wheels::StaticArray<uint32_t, MAX_FRAMES_IN_FLIGHT> m_materialsGenerations{
         0};
 
     wheels::Array<uint8_t> m_rawAnimationData{gAllocators.general};
 
+    // Model space bounding sphere for each mesh, used for the loading
+    // priorities and texture streaming
+    wheels::Array<glm::vec4> m_meshBoundingSpheres{gAllocators.general};
+
     wheels::Optional<gfx::ShaderReflection> m_materialsReflection;
     wheels::Optional<gfx::ShaderReflection> m_geometryReflection;
     wheels::Optional<gfx::ShaderReflection> m_sceneInstancesReflection;
@@ -105,6 +147,16 @@ class WorldData
     wheels::Array<MeshInfo> m_meshInfos{gAllocators.general};
     wheels::Array<wheels::String> m_meshNames{gAllocators.general};
     wheels::Array<gfx::AccelerationStructure> m_blases{gAllocators.general};
+    // Transforms from the packed snorm positions into object space for BLAS
+    // builds, one for each mesh
+    gfx::Buffer m_blasPositionTransforms;
+    // Index into m_blases for each model whose BLAS is built. Models with
+    // identical geometry share a BLAS.
+    wheels::Array<uint32_t> m_modelBlasIndices{gAllocators.general};
+    // First model that built a BLAS for each geometry key, filled as the
+    // BLASes are built
+    wheels::HashMap<uint64_t, uint32_t> m_blasGeometryModels{
+        gAllocators.general};
     wheels::Array<gfx::AccelerationStructure> m_tlases{gAllocators.general};
     wheels::Array<Model> m_models{gAllocators.general};
     Animations m_animations;
@@ -116,67 +168,50 @@ class WorldData
 
     gfx::RingBuffer m_modelInstanceTransformsRing;
 
+    // Has to be declared before the deferred loading context as the context
+    // allocates from it
+    GeometryAllocator m_geometryAllocator;
     wheels::Optional<DeferredLoadingContext> m_deferredLoadingContext;
 
   private:
     void loadTextures(
-        wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-        wheels::Array<shader_structs::Texture2DSampler> &texture2DSamplers);
-    void loadMaterials(
-        const cgltf_data &gltfData,
-        const wheels::Array<shader_structs::Texture2DSampler>
-            &texture2DSamplers);
+        wheels::ScopedScratch scopeAlloc, const SceneSnapshot &snapshot);
+    void loadMaterials(const SceneSnapshot &snapshot);
     void loadModels(
-        wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData);
-
-    struct NodeAnimations
-    {
-        wheels::Optional<Animation<glm::vec3> *> translation;
-        wheels::Optional<Animation<glm::quat> *> rotation;
-        wheels::Optional<Animation<glm::vec3> *> scale;
-        // TODO:
-        // Dynamic light parameters. glTF doesn't have an official extension
-        // that supports this so requires a custom exporter plugin fork.
-    };
-    wheels::HashMap<uint32_t, NodeAnimations> loadAnimations(
-        wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData);
-
+        wheels::ScopedScratch scopeAlloc, const SceneSnapshot &snapshot);
+    void loadAnimations(const SceneSnapshot &snapshot);
     void loadScenes(
-        wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-        const wheels::HashMap<uint32_t, NodeAnimations> &nodeAnimations);
-
-    struct TmpNode
-    {
-        wheels::String gltfName;
-        wheels::Array<uint32_t> children;
-        wheels::Optional<glm::vec3> translation;
-        wheels::Optional<glm::quat> rotation;
-        wheels::Optional<glm::vec3> scale;
-        wheels::Optional<uint32_t> modelIndex;
-        wheels::Optional<uint32_t> camera;
-        wheels::Optional<uint32_t> light;
-
-        TmpNode(const char *gltfName)
-        : gltfName{gAllocators.general, gltfName}
-        , children{gAllocators.general}
-        {
-        }
-    };
+        wheels::ScopedScratch scopeAlloc, const SceneSnapshot &snapshot);
     void gatherScene(
-        wheels::ScopedScratch scopeAlloc, const cgltf_data &gltfData,
-        const cgltf_scene &gltfScene, const wheels::Array<TmpNode> &nodes);
+        wheels::ScopedScratch scopeAlloc, const SceneSnapshot &snapshot,
+        wheels::Span<const uint32_t> rootNodes);
 
     void createBlases();
-    void createBuffers();
+    void createBuffers(wheels::ScopedScratch scopeAlloc);
     void reflectBindings(wheels::ScopedScratch scopeAlloc);
     void createDescriptorSets(
-        wheels::ScopedScratch scopeAlloc, const RingBuffers &ringBuffers);
+        wheels::ScopedScratch scopeAlloc, const RingBuffers &ringBuffers,
+        size_t textureBudgetByteCount);
 
     [[nodiscard]] bool pollMeshWorker(vk::CommandBuffer cb);
-    // Returns the count of newly loaded textures
-    [[nodiscard]] size_t pollTextureWorker(vk::CommandBuffer cb);
+    // Hands the newly loaded textures over to the texture streamer, which
+    // updates their descriptors
+    void pollTextureWorker(vk::CommandBuffer cb);
+    // Publishes the loading priorities of meshes and images based on how
+    // large they are on screen from cam
+    void updateLoadingPriorities(const Camera &cam);
+    // Streams texture mips based on how large the textures are on screen from
+    // cam. Returns true if materials point to new textures.
+    [[nodiscard]] bool updateTextureStreaming(
+        vk::CommandBuffer cb, const Camera &cam);
+    // Moves geometry data towards the beginning of the geometry buffers once
+    // loading has finished. Old ranges are released when they are no longer in
+    // use by in flight frames.
+    void compactGeometry(vk::CommandBuffer cb);
+    // Trims the bound ranges to the data that's still in use and unbinds the
+    // trailing buffers that were left empty
+    void trimGeometryBuffers();
 
-    void updateDescriptorsWithNewTextures(size_t newTextureCount);
     bool updateMaterials();
 };
 
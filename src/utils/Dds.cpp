@@ -73,7 +73,11 @@ bool isFormatCompressed(DxgiFormat format)
     switch (format)
     {
     case DxgiFormat::R8G8B8A8Unorm:
+    case DxgiFormat::R9G9B9E5SharedExp:
         return false;
+    case DxgiFormat::BC4Unorm:
+    case DxgiFormat::BC5Unorm:
+    case DxgiFormat::BC6HUf16:
     case DxgiFormat::BC7Unorm:
         return true;
     default:
@@ -111,22 +115,31 @@ Dds::Dds(
             switch (format)
             {
             case DxgiFormat::R8G8B8A8Unorm:
+            case DxgiFormat::R9G9B9E5SharedExp:
                 levelWidth = std::max(width >> i, 1u);
                 levelHeight = std::max(height >> i, 1u);
                 levelByteSize = levelWidth * levelHeight * 4;
                 break;
+            case DxgiFormat::BC4Unorm:
+            case DxgiFormat::BC5Unorm:
+            case DxgiFormat::BC6HUf16:
             case DxgiFormat::BC7Unorm:
-                // Each 4x4 block is 16bytes
+            {
+                // Each 4x4 block is 8bytes for BC4 and 16bytes for the rest
+                const uint32_t blockByteSize =
+                    format == DxgiFormat::BC4Unorm ? 8 : 16;
                 levelWidth = std::max(width >> i, 1u);
                 levelHeight = std::max(height >> i, 1u);
                 WHEELS_ASSERT(
                     levelWidth % 4 == 0 && levelHeight % 4 == 0 &&
-                    "BC7 mips should be divide evenly by 4x4");
+                    "BC mips should be divide evenly by 4x4");
                 WHEELS_ASSERT(
                     levelWidth >= 4 && levelHeight >= 4 &&
-                    "BC7 mip dimensions should be at least 4x4");
-                levelByteSize = levelWidth / 4 * levelHeight / 4 * 16;
+                    "BC mip dimensions should be at least 4x4");
+                levelByteSize =
+                    levelWidth / 4 * levelHeight / 4 * blockByteSize;
                 break;
+            }
             default:
                 throw std::runtime_error("Unknown DxgiFormat");
             }
@@ -153,12 +166,9 @@ Dds::Dds(
 
 void writeDds(const Dds &dds, const std::filesystem::path &path)
 {
-    std::filesystem::remove(path);
-
-    // Write into a tmp file and rename when done to minimize the potential for
-    // corrupted files
-    std::filesystem::path tmpPath = path;
-    tmpPath.replace_extension("dds_TMP");
+    // Write into a tmp file and rename over the old one when done to minimize
+    // the potential for corrupted files
+    const std::filesystem::path tmpPath = uniqueTmpPath(path);
     // NOTE:
     // Caches aren't supposed to be portable so this doesn't pay attention to
     // endianness.
@@ -298,8 +308,12 @@ Dds readDds(Allocator &alloc, const std::filesystem::path &path)
     WHEELS_ASSERT(
         (ddsHeaderDxt10.dxgiFormat == DxgiFormat::R8G8B8A8Unorm ||
          ddsHeaderDxt10.dxgiFormat == DxgiFormat::R9G9B9E5SharedExp ||
+         ddsHeaderDxt10.dxgiFormat == DxgiFormat::BC4Unorm ||
+         ddsHeaderDxt10.dxgiFormat == DxgiFormat::BC5Unorm ||
+         ddsHeaderDxt10.dxgiFormat == DxgiFormat::BC6HUf16 ||
          ddsHeaderDxt10.dxgiFormat == DxgiFormat::BC7Unorm) &&
-        "Only R8G8B8A8Unorm and BC7Unorm DDS textures are supported");
+        "Only R8G8B8A8Unorm, R9G9B9E5SharedExp and BC4-7 DDS textures are "
+        "supported");
     WHEELS_ASSERT(
         (ddsHeaderDxt10.resourceDimension ==
              D3d10ResourceDimension::Texture2d ||
@@ -16,6 +16,9 @@ enum class DxgiFormat
     Unknown = 0,
     R8G8B8A8Unorm = 28,
     R9G9B9E5SharedExp = 67,
+    BC4Unorm = 80,
+    BC5Unorm = 83,
+    BC6HUf16 = 95,
     BC7Unorm = 98,
 };
 
@@ -0,0 +1,320 @@
+#include "Downsample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <wheels/containers/static_array.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROSPER_DOWNSAMPLE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// vdivq_f32 and the laneq variants are AArch64 only
+#include <arm_neon.h>
+#define PROSPER_DOWNSAMPLE_NEON
+#endif
+
+using namespace wheels;
+
+namespace utils
+{
+
+namespace
+{
+
+// Linear values are quantized to this many steps before the sRGB lookup. That
+// keeps the encoded values within a step of the exact ones even at the steepest
+// part of the curve.
+constexpr uint32_t sLinearToSRgbSize = 1 << 14;
+
+struct Tables
+{
+    // Indexed by the 8bit value
+    StaticArray<float, 256> sRgbToLinear;
+    StaticArray<float, 256> unormToFloat;
+    // Indexed by the linear value scaled to [0, sLinearToSRgbSize - 1]
+    StaticArray<uint8_t, sLinearToSRgbSize> linearToSRgb;
+};
+
+Tables createTables()
+{
+    Tables ret;
+
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        const float v = static_cast<float>(i) / 255.f;
+        ret.unormToFloat[i] = v;
+        ret.sRgbToLinear[i] = v <= 0.04045f
+                                  ? v / 12.92f
+                                  : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (uint32_t i = 0; i < sLinearToSRgbSize; ++i)
+    {
+        const float v =
+            static_cast<float>(i) / static_cast<float>(sLinearToSRgbSize - 1);
+        const float encoded = v <= 0.0031308f
+                                  ? v * 12.92f
+                                  : (1.055f * std::pow(v, 1.f / 2.4f)) - 0.055f;
+        ret.linearToSRgb[i] =
+            static_cast<uint8_t>(std::lround(encoded * 255.f));
+    }
+
+    return ret;
+}
+
+const Tables &tables()
+{
+    static const Tables sTables = createTables();
+    return sTables;
+}
+
+#if defined(PROSPER_DOWNSAMPLE_SSE2)
+using Texel = __m128;
+#elif defined(PROSPER_DOWNSAMPLE_NEON)
+using Texel = float32x4_t;
+#else
+using Texel = StaticArray<float, 4>;
+#endif
+
+// Returns the texel as linear RGBA. Only sRGB colors go through the table,
+// everything else is converted in SIMD registers.
+template <bool SRgb> Texel decodeTexel(const Tables &t, const uint8_t *texel)
+{
+#if defined(PROSPER_DOWNSAMPLE_SSE2)
+    if constexpr (SRgb)
+        return _mm_setr_ps(
+            t.sRgbToLinear[texel[0]], t.sRgbToLinear[texel[1]],
+            t.sRgbToLinear[texel[2]], t.unormToFloat[texel[3]]);
+    else
+    {
+        int32_t packed = 0;
+        memcpy(&packed, texel, sizeof(packed));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wide = _mm_unpacklo_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+        // Division to match the tables exactly
+        return _mm_div_ps(_mm_cvtepi32_ps(wide), _mm_set1_ps(255.f));
+    }
+#elif defined(PROSPER_DOWNSAMPLE_NEON)
+    if constexpr (SRgb)
+    {
+        float32x4_t ret = vdupq_n_f32(t.unormToFloat[texel[3]]);
+        ret = vsetq_lane_f32(t.sRgbToLinear[texel[0]], ret, 0);
+        ret = vsetq_lane_f32(t.sRgbToLinear[texel[1]], ret, 1);
+        ret = vsetq_lane_f32(t.sRgbToLinear[texel[2]], ret, 2);
+        return ret;
+    }
+    else
+    {
+        uint32_t packed = 0;
+        memcpy(&packed, texel, sizeof(packed));
+        const uint16x8_t wide =
+            vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed)));
+        // Division to match the tables exactly
+        return vdivq_f32(
+            vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide))), vdupq_n_f32(255.f));
+    }
+#else
+    const float *colorToLinear =
+        SRgb ? t.sRgbToLinear.data() : t.unormToFloat.data();
+    return Texel{{
+        colorToLinear[texel[0]],
+        colorToLinear[texel[1]],
+        colorToLinear[texel[2]],
+        t.unormToFloat[texel[3]],
+    }};
+#endif
+}
+
+// Box filters the texels with the colors weighted by alpha like in stbir's
+// RGBA layout. Returns the result clamped to [0, 1].
+Texel filterTexels(Texel t0, Texel t1, Texel t2, Texel t3)
+{
+#if defined(PROSPER_DOWNSAMPLE_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 quarter = _mm_set1_ps(0.25f);
+
+    const __m128 a0 = _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 a1 = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 a2 = _mm_shuffle_ps(t2, t2, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 a3 = _mm_shuffle_ps(t3, t3, _MM_SHUFFLE(3, 3, 3, 3));
+
+    const __m128 weighted = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(t0, a0), _mm_mul_ps(t1, a1)),
+        _mm_add_ps(_mm_mul_ps(t2, a2), _mm_mul_ps(t3, a3)));
+    const __m128 unweighted =
+        _mm_add_ps(_mm_add_ps(t0, t1), _mm_add_ps(t2, t3));
+    const __m128 alphaSum =
+        _mm_shuffle_ps(unweighted, unweighted, _MM_SHUFFLE(3, 3, 3, 3));
+
+    // Fully transparent blocks keep their unweighted color. The division by
+    // zero is masked out.
+    const __m128 weigh = _mm_cmpgt_ps(alphaSum, zero);
+    const __m128 colorSum = _mm_or_ps(
+        _mm_and_ps(weigh, weighted), _mm_andnot_ps(weigh, unweighted));
+    const __m128 colorScale = _mm_or_ps(
+        _mm_and_ps(weigh, _mm_div_ps(one, alphaSum)),
+        _mm_andnot_ps(weigh, quarter));
+    const __m128 color = _mm_mul_ps(colorSum, colorScale);
+    const __m128 alpha = _mm_mul_ps(unweighted, quarter);
+
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    const __m128 ret = _mm_or_ps(
+        _mm_and_ps(alphaMask, alpha), _mm_andnot_ps(alphaMask, color));
+    return _mm_min_ps(_mm_max_ps(ret, zero), one);
+#elif defined(PROSPER_DOWNSAMPLE_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    const float32x4_t quarter = vdupq_n_f32(0.25f);
+
+    float32x4_t weighted = vmulq_laneq_f32(t0, t0, 3);
+    weighted = vfmaq_laneq_f32(weighted, t1, t1, 3);
+    weighted = vfmaq_laneq_f32(weighted, t2, t2, 3);
+    weighted = vfmaq_laneq_f32(weighted, t3, t3, 3);
+    const float32x4_t unweighted =
+        vaddq_f32(vaddq_f32(t0, t1), vaddq_f32(t2, t3));
+    const float32x4_t alphaSum = vdupq_laneq_f32(unweighted, 3);
+
+    // Fully transparent blocks keep their unweighted color. The division by
+    // zero is masked out.
+    const uint32x4_t weigh = vcgtq_f32(alphaSum, zero);
+    const float32x4_t colorSum = vbslq_f32(weigh, weighted, unweighted);
+    const float32x4_t colorScale =
+        vbslq_f32(weigh, vdivq_f32(one, alphaSum), quarter);
+    const float32x4_t color = vmulq_f32(colorSum, colorScale);
+    const float32x4_t alpha = vmulq_f32(unweighted, quarter);
+
+    const float32x4_t ret = vsetq_lane_f32(vgetq_lane_f32(alpha, 3), color, 3);
+    return vminq_f32(vmaxq_f32(ret, zero), one);
+#else
+    // Summed pairwise like the SIMD paths to get matching results
+    const float alphaSum = (t0[3] + t1[3]) + (t2[3] + t3[3]);
+    // Fully transparent blocks keep their unweighted color
+    const bool weigh = alphaSum > 0.f;
+    const float colorScale = weigh ? 1.f / alphaSum : 0.25f;
+
+    Texel ret;
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        const float colorSum =
+            weigh ? ((t0[c] * t0[3]) + (t1[c] * t1[3])) +
+                        ((t2[c] * t2[3]) + (t3[c] * t3[3]))
+                  : (t0[c] + t1[c]) + (t2[c] + t3[c]);
+        ret[c] = std::clamp(colorSum * colorScale, 0.f, 1.f);
+    }
+    ret[3] = std::clamp(alphaSum * 0.25f, 0.f, 1.f);
+    return ret;
+#endif
+}
+
+// Writes the filtered texel as RGBA8. Only sRGB colors go through the table.
+template <bool SRgb>
+void encodeTexel(const Tables &t, Texel texel, uint8_t *dst)
+{
+    const auto tableScale = static_cast<float>(sLinearToSRgbSize - 1);
+#if defined(PROSPER_DOWNSAMPLE_SSE2)
+    const __m128 half = _mm_set1_ps(0.5f);
+    if constexpr (SRgb)
+    {
+        const __m128 scale =
+            _mm_setr_ps(tableScale, tableScale, tableScale, 255.f);
+        alignas(16) StaticArray<int32_t, 4> encoded;
+        _mm_store_si128(
+            reinterpret_cast<__m128i *>(encoded.data()),
+            _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(texel, scale), half)));
+        dst[0] = t.linearToSRgb[encoded[0]];
+        dst[1] = t.linearToSRgb[encoded[1]];
+        dst[2] = t.linearToSRgb[encoded[2]];
+        dst[3] = static_cast<uint8_t>(encoded[3]);
+    }
+    else
+    {
+        const __m128i encoded = _mm_cvttps_epi32(
+            _mm_add_ps(_mm_mul_ps(texel, _mm_set1_ps(255.f)), half));
+        const __m128i packed =
+            _mm_packus_epi16(_mm_packs_epi32(encoded, encoded), encoded);
+        const int32_t rgba = _mm_cvtsi128_si32(packed);
+        memcpy(dst, &rgba, sizeof(rgba));
+    }
+#elif defined(PROSPER_DOWNSAMPLE_NEON)
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    if constexpr (SRgb)
+    {
+        const float32x4_t scale = vsetq_lane_f32(
+            255.f, vdupq_n_f32(tableScale), 3);
+        alignas(16) StaticArray<uint32_t, 4> encoded;
+        vst1q_u32(encoded.data(), vcvtq_u32_f32(vmlaq_f32(half, texel, scale)));
+        dst[0] = t.linearToSRgb[encoded[0]];
+        dst[1] = t.linearToSRgb[encoded[1]];
+        dst[2] = t.linearToSRgb[encoded[2]];
+        dst[3] = static_cast<uint8_t>(encoded[3]);
+    }
+    else
+    {
+        const uint16x4_t encoded =
+            vmovn_u32(vcvtq_u32_f32(vmlaq_n_f32(half, texel, 255.f)));
+        const uint8x8_t packed = vmovn_u16(vcombine_u16(encoded, encoded));
+        const uint32_t rgba = vget_lane_u32(vreinterpret_u32_u8(packed), 0);
+        memcpy(dst, &rgba, sizeof(rgba));
+    }
+#else
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        if constexpr (SRgb)
+            dst[c] = t.linearToSRgb[static_cast<uint32_t>(
+                (texel[c] * tableScale) + 0.5f)];
+        else
+            dst[c] = static_cast<uint8_t>((texel[c] * 255.f) + 0.5f);
+    }
+    dst[3] = static_cast<uint8_t>((texel[3] * 255.f) + 0.5f);
+#endif
+}
+
+template <bool SRgb>
+void downsample2x(
+    const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst)
+{
+    const Tables &t = tables();
+
+    const uint32_t width = srcWidth / 2;
+    const uint32_t height = srcHeight / 2;
+    const size_t srcRowStride = static_cast<size_t>(srcWidth) * 4;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t *row0 = src + (static_cast<size_t>(y) * 2 * srcRowStride);
+        const uint8_t *row1 = row0 + srcRowStride;
+        uint8_t *dstRow = dst + (static_cast<size_t>(y) * width * 4);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const size_t srcX = static_cast<size_t>(x) * 8;
+            const Texel filtered = filterTexels(
+                decodeTexel<SRgb>(t, row0 + srcX),
+                decodeTexel<SRgb>(t, row0 + srcX + 4),
+                decodeTexel<SRgb>(t, row1 + srcX),
+                decodeTexel<SRgb>(t, row1 + srcX + 4));
+            encodeTexel<SRgb>(
+                t, filtered, dstRow + (static_cast<size_t>(x) * 4));
+        }
+    }
+}
+
+} // namespace
+
+bool canDownsample2x(uint32_t width, uint32_t height)
+{
+    return width >= 2 && height >= 2 && width % 2 == 0 && height % 2 == 0;
+}
+
+void downsample2xRgba8(
+    const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst,
+    bool sRgb)
+{
+    if (sRgb)
+        downsample2x<true>(src, srcWidth, srcHeight, dst);
+    else
+        downsample2x<false>(src, srcWidth, srcHeight, dst);
+}
+
+} // namespace utils
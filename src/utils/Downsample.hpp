@@ -0,0 +1,21 @@
+#ifndef PROSPER_UTILS_DOWNSAMPLE_HPP
+#define PROSPER_UTILS_DOWNSAMPLE_HPP
+
+#include <cstdint>
+
+namespace utils
+{
+
+// Returns true if a level of this size can be halved with downsample2xRgba8
+[[nodiscard]] bool canDownsample2x(uint32_t width, uint32_t height);
+
+// Box filters tightly packed RGBA8 src into dst at half the width and height.
+// Colors are weighted by alpha like in stbir's RGBA layout and sRGB colors are
+// filtered in linear space. Alpha is always linear.
+void downsample2xRgba8(
+    const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst,
+    bool sRgb);
+
+} // namespace utils
+
+#endif // PROSPER_UTILS_DOWNSAMPLE_HPP
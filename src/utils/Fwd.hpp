@@ -15,6 +15,9 @@ struct MouseGesture;
 // Ktx.hpp
 struct Ktx;
 
+// MappedFile.hpp
+class MappedFile;
+
 // Profiler.hpp
 class CpuFrameProfiler;
 class GpuFrameProfiler;
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <wheels/assert.hpp>
 #include <wheels/containers/static_array.hpp>
+#include <zstd.h>
 
 using namespace wheels;
 
@@ -45,6 +46,188 @@ struct Ktx10Header
     uint32_t bytesOfKeyValueData{0};
 };
 
+struct Ktx20Header
+{
+    uint32_t vkFormat{0};
+    uint32_t typeSize{0};
+    uint32_t pixelWidth{0};
+    uint32_t pixelHeight{0};
+    uint32_t pixelDepth{0};
+    uint32_t layerCount{0};
+    uint32_t faceCount{0};
+    uint32_t levelCount{0};
+    uint32_t supercompressionScheme{0};
+};
+
+struct Ktx20Index
+{
+    uint32_t dfdByteOffset{0};
+    uint32_t dfdByteLength{0};
+    uint32_t kvdByteOffset{0};
+    uint32_t kvdByteLength{0};
+    uint64_t sgdByteOffset{0};
+    uint64_t sgdByteLength{0};
+};
+
+const uint32_t sSupercompressionNone = 0;
+const uint32_t sSupercompressionZstd = 2;
+
+// The cache is written once at bake time and read every launch so let's spend
+// a bit more time to read less
+const int sZstdLevel = 12;
+
+// Khronos Data Format Specification 1.3, section 5
+const uint32_t sDfModelRgbsda = 1;
+const uint32_t sDfModelBc4 = 131;
+const uint32_t sDfModelBc5 = 132;
+const uint32_t sDfModelBc6h = 133;
+const uint32_t sDfModelBc7 = 134;
+const uint32_t sDfPrimariesBt709 = 1;
+const uint32_t sDfTransferLinear = 1;
+const uint32_t sDfTransferSrgb = 2;
+const uint32_t sDfSampleExponent = 0x20;
+const uint32_t sDfSampleFloat = 0x80;
+const uint32_t sDfChannelAlpha = 15;
+
+struct DfdSample
+{
+    uint32_t bitOffset{0};
+    uint32_t bitLength{0};
+    uint32_t channelType{0};
+    uint32_t lower{0};
+    uint32_t upper{0};
+};
+
+size_t alignedByteCount(size_t byteCount)
+{
+    return roundedUpQuotient(byteCount, sizeof(uint32_t)) * sizeof(uint32_t);
+}
+
+// Writes a basic data format descriptor for the formats that the texture cache
+// uses
+void appendDfd(Array<uint32_t> &dfd, vk::Format format)
+{
+    uint32_t model = sDfModelRgbsda;
+    uint32_t transfer = sDfTransferLinear;
+    uint32_t blockExtent = 1;
+    StaticArray<DfdSample, 6> samples;
+    uint32_t sampleCount = 0;
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Srgb:
+        transfer = sDfTransferSrgb;
+        [[fallthrough]];
+    case vk::Format::eR8G8B8A8Unorm:
+        for (uint32_t i = 0; i < 4; ++i)
+            samples[sampleCount++] = DfdSample{
+                .bitOffset = i * 8,
+                .bitLength = 8,
+                .channelType = i < 3 ? i : sDfChannelAlpha,
+                .upper = 255,
+            };
+        break;
+    case vk::Format::eE5B9G9R9UfloatPack32:
+        // Mantissas with implicit 1s and the shared exponent for each of them
+        for (uint32_t i = 0; i < 3; ++i)
+            samples[sampleCount++] = DfdSample{
+                .bitOffset = i * 9,
+                .bitLength = 9,
+                .channelType = i,
+                .upper = 8448,
+            };
+        for (uint32_t i = 0; i < 3; ++i)
+            samples[sampleCount++] = DfdSample{
+                .bitOffset = 27,
+                .bitLength = 5,
+                .channelType = i | sDfSampleExponent,
+                .lower = 15,
+                .upper = 31,
+            };
+        break;
+    case vk::Format::eBc4UnormBlock:
+        model = sDfModelBc4;
+        blockExtent = 4;
+        samples[sampleCount++] = DfdSample{
+            .bitLength = 64,
+            .upper = 0xFFFF'FFFF,
+        };
+        break;
+    case vk::Format::eBc5UnormBlock:
+        model = sDfModelBc5;
+        blockExtent = 4;
+        for (uint32_t i = 0; i < 2; ++i)
+            samples[sampleCount++] = DfdSample{
+                .bitOffset = i * 64,
+                .bitLength = 64,
+                .channelType = i,
+                .upper = 0xFFFF'FFFF,
+            };
+        break;
+    case vk::Format::eBc6HUfloatBlock:
+        model = sDfModelBc6h;
+        blockExtent = 4;
+        samples[sampleCount++] = DfdSample{
+            .bitLength = 128,
+            .channelType = sDfSampleFloat,
+            // 1.f
+            .upper = 0x3F80'0000,
+        };
+        break;
+    case vk::Format::eBc7SrgbBlock:
+        transfer = sDfTransferSrgb;
+        [[fallthrough]];
+    case vk::Format::eBc7UnormBlock:
+        model = sDfModelBc7;
+        blockExtent = 4;
+        samples[sampleCount++] = DfdSample{
+            .bitLength = 128,
+            .upper = 0xFFFF'FFFF,
+        };
+        break;
+    default:
+        throw std::runtime_error("Unsupported KTX2 format");
+    }
+
+    const uint32_t blockSize = 24 + (16 * sampleCount);
+    // Total size, descriptor type 0 and vendor 0, version 2
+    dfd.push_back(sizeof(uint32_t) + blockSize);
+    dfd.push_back(0);
+    dfd.push_back(2 | (blockSize << 16));
+    dfd.push_back(model | (sDfPrimariesBt709 << 8) | (transfer << 16));
+    // Dimensions are stored minus one
+    dfd.push_back((blockExtent - 1) | ((blockExtent - 1) << 8));
+    // Plane sizes are left zero as the levels are supercompressed
+    dfd.push_back(0);
+    dfd.push_back(0);
+    for (uint32_t i = 0; i < sampleCount; ++i)
+    {
+        const DfdSample &sample = samples[i];
+        dfd.push_back(
+            sample.bitOffset | ((sample.bitLength - 1) << 16) |
+            (sample.channelType << 24));
+        dfd.push_back(0);
+        dfd.push_back(sample.lower);
+        dfd.push_back(sample.upper);
+    }
+}
+
+void appendKeyValue(Array<uint8_t> &kvd, const Ktx2KeyValue &keyValue)
+{
+    // Key is null terminated
+    const size_t keyLength = strlen(keyValue.key);
+    const uint32_t byteCount =
+        asserted_cast<uint32_t>(keyLength + 1 + keyValue.value.size());
+    const size_t start = kvd.size();
+    kvd.resize(start + sizeof(byteCount) + alignedByteCount(byteCount), 0);
+
+    uint8_t *dst = kvd.data() + start;
+    memcpy(dst, &byteCount, sizeof(byteCount));
+    dst += sizeof(byteCount);
+    memcpy(dst, keyValue.key, keyLength);
+    dst += keyLength + 1;
+    memcpy(dst, keyValue.value.data(), keyValue.value.size());
+}
+
 } // namespace
 
 Ktx readKtx(Allocator &alloc, const std::filesystem::path &path)
@@ -165,4 +348,256 @@ Ktx readKtx(Allocator &alloc, const std::filesystem::path &path)
     return ret;
 }
 
+void writeKtx2(
+    ScopedScratch scopeAlloc, const Ktx &ktx,
+    Span<const Ktx2KeyValue> keyValues, const std::filesystem::path &path)
+{
+    WHEELS_ASSERT(ktx.depth == 1);
+    WHEELS_ASSERT(ktx.arrayLayerCount == 1);
+    WHEELS_ASSERT(ktx.faceCount == 1);
+    WHEELS_ASSERT(ktx.levelByteOffsets.size() == ktx.mipLevelCount);
+
+    Array<uint32_t> dfd{scopeAlloc};
+    appendDfd(dfd, ktx.format);
+
+    Array<uint8_t> kvd{scopeAlloc};
+    for (size_t i = 0; i < keyValues.size(); ++i)
+    {
+        WHEELS_ASSERT(
+            (i == 0 || strcmp(keyValues[i - 1].key, keyValues[i].key) < 0) &&
+            "KTX2 keys should be sorted");
+        appendKeyValue(kvd, keyValues[i]);
+    }
+
+    // Compress all levels first as the index needs the sizes
+    Array<uint8_t> compressedData{scopeAlloc};
+    compressedData.resize(
+        ZSTD_compressBound(ktx.data.size()) +
+        (ZSTD_compressBound(0) * ktx.mipLevelCount));
+    Array<Ktx2Level> levels{scopeAlloc};
+    levels.resize(ktx.mipLevelCount);
+
+    const size_t levelIndexOffset = sizeof(sFileIdentifier20) +
+                                    sizeof(Ktx20Header) + sizeof(Ktx20Index);
+    const size_t dfdOffset =
+        levelIndexOffset + (sizeof(Ktx2Level) * ktx.mipLevelCount);
+    const size_t kvdOffset = dfdOffset + (sizeof(uint32_t) * dfd.size());
+    // Supercompressed levels don't need alignment
+    const size_t dataOffset = kvdOffset + kvd.size();
+
+    // Levels are stored from the smallest to the largest
+    size_t compressedByteCount = 0;
+    for (uint32_t i = ktx.mipLevelCount; i > 0; --i)
+    {
+        const uint32_t mip = i - 1;
+        const size_t levelStart = ktx.levelByteOffsets[mip];
+        const size_t levelEnd = mip + 1 < ktx.mipLevelCount
+                                    ? ktx.levelByteOffsets[mip + 1]
+                                    : ktx.data.size();
+
+        const size_t byteCount = ZSTD_compress(
+            compressedData.data() + compressedByteCount,
+            compressedData.size() - compressedByteCount,
+            ktx.data.data() + levelStart, levelEnd - levelStart, sZstdLevel);
+        if (ZSTD_isError(byteCount) != 0)
+            throw std::runtime_error(
+                std::string{"Failed to compress KTX2 level: "} +
+                ZSTD_getErrorName(byteCount));
+
+        levels[mip] = Ktx2Level{
+            .byteOffset = dataOffset + compressedByteCount,
+            .byteCount = byteCount,
+            .uncompressedByteCount = levelEnd - levelStart,
+        };
+        compressedByteCount += byteCount;
+    }
+
+    const Ktx20Header header{
+        .vkFormat = static_cast<uint32_t>(ktx.format),
+        .typeSize =
+            ktx.format == vk::Format::eE5B9G9R9UfloatPack32 ? 4u : 1u,
+        .pixelWidth = ktx.width,
+        .pixelHeight = ktx.height,
+        .faceCount = 1,
+        .levelCount = ktx.mipLevelCount,
+        .supercompressionScheme = sSupercompressionZstd,
+    };
+    const Ktx20Index index{
+        .dfdByteOffset = asserted_cast<uint32_t>(dfdOffset),
+        .dfdByteLength = asserted_cast<uint32_t>(sizeof(uint32_t) * dfd.size()),
+        .kvdByteOffset = kvd.empty() ? 0u : asserted_cast<uint32_t>(kvdOffset),
+        .kvdByteLength = asserted_cast<uint32_t>(kvd.size()),
+    };
+
+    // Write into a tmp file and rename when done to minimize the potential for
+    // corrupted files
+    const std::filesystem::path tmpPath = uniqueTmpPath(path);
+    {
+        std::ofstream outFile{tmpPath, std::ios_base::binary};
+        writeRawSpan(outFile, sFileIdentifier20.span());
+        writeRaw(outFile, header);
+        writeRaw(outFile, index);
+        writeRawSpan(outFile, levels.span());
+        writeRawSpan(outFile, dfd.span());
+        writeRawSpan(outFile, kvd.span());
+        writeRawSpan(
+            outFile,
+            Span<const uint8_t>{compressedData.data(), compressedByteCount});
+    }
+
+    // Make sure we have rw permissions for the user to be nice
+    const std::filesystem::perms initialPerms =
+        std::filesystem::status(tmpPath).permissions();
+    std::filesystem::permissions(
+        tmpPath, initialPerms | std::filesystem::perms::owner_read |
+                     std::filesystem::perms::owner_write);
+
+    std::filesystem::rename(tmpPath, path);
+}
+
+Ktx2Header readKtx2Header(Allocator &alloc, const std::filesystem::path &path)
+{
+    std::ifstream inFile{path, std::ios_base::binary};
+    if (!inFile)
+        throw std::runtime_error("Failed to open '" + path.string() + "'");
+
+    StaticArray<uint8_t, 12> identifier;
+    static_assert(sizeof(identifier) == sizeof(sFileIdentifier20));
+    readRawSpan(inFile, identifier.mut_span());
+    if (memcmp(
+            identifier.data(), sFileIdentifier20.data(),
+            identifier.size() * sizeof(uint8_t)) != 0)
+        throw std::runtime_error(
+            "'" + path.string() + "' doesn't appear to be a KTX2");
+
+    Ktx20Header header;
+    readRaw(inFile, header);
+    Ktx20Index index;
+    readRaw(inFile, index);
+
+    if (header.pixelDepth > 1 || header.layerCount > 1 ||
+        header.faceCount != 1)
+        throw std::runtime_error(
+            "Only 2D KTX2 textures with a single layer are supported");
+    if (header.supercompressionScheme != sSupercompressionNone &&
+        header.supercompressionScheme != sSupercompressionZstd)
+        throw std::runtime_error(
+            "Only zstd supercompression is supported for KTX2");
+
+    Ktx2Header ret{
+        .width = header.pixelWidth,
+        .height = std::max(header.pixelHeight, 1u),
+        .format = static_cast<vk::Format>(header.vkFormat),
+        .mipLevelCount = std::max(header.levelCount, 1u),
+        .zstdSupercompressed =
+            header.supercompressionScheme == sSupercompressionZstd,
+        .levels = Array<Ktx2Level>{alloc},
+        .keyValueData = Array<uint8_t>{alloc},
+    };
+    WHEELS_ASSERT(ret.width > 0);
+
+    ret.levels.resize(ret.mipLevelCount);
+    readRawSpan(inFile, ret.levels.mut_span());
+
+    if (index.kvdByteLength > 0)
+    {
+        ret.keyValueData.resize(index.kvdByteLength);
+        inFile.seekg(index.kvdByteOffset);
+        readRawSpan(inFile, ret.keyValueData.mut_span());
+    }
+
+    if (!inFile)
+        throw std::runtime_error(
+            "Failed to read KTX2 header from '" + path.string() + "'");
+
+    return ret;
+}
+
+Span<const uint8_t> findKtx2Value(const Ktx2Header &header, const char *key)
+{
+    const Array<uint8_t> &kvd = header.keyValueData;
+
+    size_t offset = 0;
+    while (offset + sizeof(uint32_t) <= kvd.size())
+    {
+        uint32_t byteCount = 0;
+        memcpy(&byteCount, kvd.data() + offset, sizeof(byteCount));
+        offset += sizeof(byteCount);
+        if (offset + byteCount > kvd.size())
+            break;
+
+        const char *keyValue =
+            reinterpret_cast<const char *>(kvd.data() + offset);
+        const size_t keyLength = strnlen(keyValue, byteCount);
+        if (keyLength < byteCount && strcmp(keyValue, key) == 0)
+            return Span{
+                kvd.data() + offset + keyLength + 1,
+                byteCount - keyLength - 1};
+
+        offset += alignedByteCount(byteCount);
+    }
+
+    return Span<const uint8_t>{};
+}
+
+void readKtx2Levels(
+    ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    const Ktx2Header &header, uint32_t firstMip, Span<uint8_t> dst)
+{
+    WHEELS_ASSERT(firstMip < header.mipLevelCount);
+
+    // Levels are stored from the smallest to the largest so the requested ones
+    // are a contiguous range at the start of the level data
+    const Ktx2Level &coarsest = header.levels[header.mipLevelCount - 1];
+    const Ktx2Level &finest = header.levels[firstMip];
+    WHEELS_ASSERT(coarsest.byteOffset <= finest.byteOffset);
+    const uint64_t rangeStart = coarsest.byteOffset;
+    const uint64_t rangeByteCount =
+        finest.byteOffset + finest.byteCount - rangeStart;
+
+    Array<uint8_t> fileData{scopeAlloc};
+    fileData.resize(asserted_cast<size_t>(rangeByteCount));
+    {
+        std::ifstream inFile{path, std::ios_base::binary};
+        inFile.seekg(asserted_cast<std::streamoff>(rangeStart));
+        readRawSpan(inFile, fileData.mut_span());
+        if (!inFile)
+            throw std::runtime_error(
+                "Failed to read KTX2 levels from '" + path.string() + "'");
+    }
+
+    size_t dstOffset = 0;
+    for (uint32_t mip = firstMip; mip < header.mipLevelCount; ++mip)
+    {
+        const Ktx2Level &level = header.levels[mip];
+        const size_t srcOffset =
+            asserted_cast<size_t>(level.byteOffset - rangeStart);
+        const size_t byteCount =
+            asserted_cast<size_t>(level.uncompressedByteCount);
+        if (dstOffset + byteCount > dst.size())
+            throw std::runtime_error(
+                "KTX2 levels in '" + path.string() +
+                "' don't fit the destination");
+
+        if (header.zstdSupercompressed)
+        {
+            const size_t decompressedByteCount = ZSTD_decompress(
+                dst.data() + dstOffset, byteCount,
+                fileData.data() + srcOffset,
+                asserted_cast<size_t>(level.byteCount));
+            if (ZSTD_isError(decompressedByteCount) != 0 ||
+                decompressedByteCount != byteCount)
+                throw std::runtime_error(
+                    "Failed to decompress KTX2 level from '" + path.string() +
+                    "'");
+        }
+        else
+            memcpy(
+                dst.data() + dstOffset, fileData.data() + srcOffset,
+                byteCount);
+
+        dstOffset += byteCount;
+    }
+}
+
 } // namespace utils
@@ -5,7 +5,9 @@
 #include <filesystem>
 #include <vulkan/vulkan.hpp>
 #include <wheels/allocators/allocator.hpp>
+#include <wheels/allocators/scoped_scratch.hpp>
 #include <wheels/containers/array.hpp>
+#include <wheels/containers/span.hpp>
 
 namespace utils
 {
@@ -28,6 +30,54 @@ struct Ktx
 
 Ktx readKtx(wheels::Allocator &alloc, const std::filesystem::path &path);
 
+struct Ktx2KeyValue
+{
+    const char *key{nullptr};
+    wheels::Span<const uint8_t> value;
+};
+
+struct Ktx2Level
+{
+    uint64_t byteOffset{0};
+    uint64_t byteCount{0};
+    uint64_t uncompressedByteCount{0};
+};
+
+// Only 2D textures with a single layer and face are supported. The header is
+// read separately from the levels so that they can be decompressed straight
+// into their destination.
+struct Ktx2Header
+{
+    uint32_t width{0};
+    uint32_t height{0};
+    vk::Format format{vk::Format::eUndefined};
+    uint32_t mipLevelCount{0};
+    bool zstdSupercompressed{false};
+    // Indexed by mip
+    wheels::Array<Ktx2Level> levels;
+    wheels::Array<uint8_t> keyValueData;
+};
+
+// ktx should be a 2D texture with a single layer and face. The levels are
+// supercompressed with zstd. keyValues have to be sorted by key.
+void writeKtx2(
+    wheels::ScopedScratch scopeAlloc, const Ktx &ktx,
+    wheels::Span<const Ktx2KeyValue> keyValues,
+    const std::filesystem::path &path);
+
+Ktx2Header readKtx2Header(
+    wheels::Allocator &alloc, const std::filesystem::path &path);
+
+// Returns an empty span if the key is not found
+wheels::Span<const uint8_t> findKtx2Value(
+    const Ktx2Header &header, const char *key);
+
+// Decompresses levels [firstMip, mipLevelCount) into dst, tightly packed and
+// starting from firstMip
+void readKtx2Levels(
+    wheels::ScopedScratch scopeAlloc, const std::filesystem::path &path,
+    const Ktx2Header &header, uint32_t firstMip, wheels::Span<uint8_t> dst);
+
 } // namespace utils
 
 #endif // PROSPER_UTILS_KTX_HPP
@@ -0,0 +1,110 @@
+#include "MappedFile.hpp"
+
+#include <wheels/assert.hpp>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#else // !_WIN32
+
+// Assume Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif // _WIN32
+
+using namespace wheels;
+
+namespace utils
+{
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::filesystem::path &path)
+{
+    WHEELS_ASSERT(!isOpen());
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize{};
+    if (GetFileSizeEx(file, &fileSize) == 0 || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping =
+        CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // The view keeps the mapping alive so we don't need the handles after it
+    // has been created
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr)
+        return false;
+
+    m_data = static_cast<const uint8_t *>(view);
+    m_byteCount = static_cast<size_t>(fileSize.QuadPart);
+#else  // !_WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    const size_t byteCount = static_cast<size_t>(fileStat.st_size);
+
+    void *view = mmap(nullptr, byteCount, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const uint8_t *>(view);
+    m_byteCount = byteCount;
+#endif // _WIN32
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else  // !_WIN32
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    munmap(const_cast<uint8_t *>(m_data), m_byteCount);
+#endif // _WIN32
+
+    m_data = nullptr;
+    m_byteCount = 0;
+}
+
+bool MappedFile::isOpen() const { return m_data != nullptr; }
+
+Span<const uint8_t> MappedFile::data() const
+{
+    WHEELS_ASSERT(isOpen());
+    return Span{m_data, m_byteCount};
+}
+
+} // namespace utils
@@ -0,0 +1,37 @@
+#ifndef PROSPER_UTILS_MAPPED_FILE_HPP
+#define PROSPER_UTILS_MAPPED_FILE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <wheels/containers/span.hpp>
+
+namespace utils
+{
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+  public:
+    MappedFile() noexcept = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile(MappedFile &&other) = delete;
+    MappedFile &operator=(const MappedFile &other) = delete;
+    MappedFile &operator=(MappedFile &&other) = delete;
+
+    // Returns false if the file doesn't exist or couldn't be mapped
+    [[nodiscard]] bool open(const std::filesystem::path &path);
+    void close();
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] wheels::Span<const uint8_t> data() const;
+
+  private:
+    const uint8_t *m_data{nullptr};
+    size_t m_byteCount{0};
+};
+
+} // namespace utils
+
+#endif // PROSPER_UTILS_MAPPED_FILE_HPP
@@ -2,7 +2,10 @@
 
 #include "Logger.hpp"
 
+#include <cinttypes>
+#include <cstdio>
 #include <cstring>
+#include <random>
 #include <wheels/assert.hpp>
 #include <wheels/containers/static_array.hpp>
 
@@ -15,6 +18,7 @@
 
 // Assume Linux
 #include <sys/prctl.h>
+#include <unistd.h>
 
 #endif // _WIN32
 
@@ -48,6 +52,20 @@ std::filesystem::path binPath(const std::filesystem::path &path)
     return std::filesystem::path{BIN_PATH} / path;
 }
 
+std::filesystem::path uniqueTmpPath(const std::filesystem::path &path)
+{
+    // Seeded per thread so that writers in other processes get different
+    // sequences too
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+
+    StaticArray<char, (sizeof(uint64_t) * 2) + 1> suffix;
+    snprintf(suffix.data(), suffix.size(), "%016" PRIX64, generator());
+
+    std::filesystem::path ret = path;
+    ret += std::string{"."} + suffix.data() + "_TMP";
+    return ret;
+}
+
 String readFileString(Allocator &alloc, const std::filesystem::path &path)
 {
     std::ifstream file(path, std::ios::ate | std::ios::binary);
@@ -96,3 +114,23 @@ void setCurrentThreadName(const char *name)
 #endif // _WIN32
 
 } // namespace utils
+
+size_t systemMemoryByteCount()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status{};
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status) == 0)
+        return 0;
+    return asserted_cast<size_t>(status.ullTotalPhys);
+
+#else // !_WIN32
+
+    const long pageCount = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    if (pageCount <= 0 || pageSize <= 0)
+        return 0;
+    return asserted_cast<size_t>(pageCount) * asserted_cast<size_t>(pageSize);
+
+#endif // _WIN32
+}
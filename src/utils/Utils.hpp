@@ -65,6 +65,10 @@ std::filesystem::path resPath(const std::filesystem::path &path);
 // under it. Considers symlinks to be under the path like any other folder/file.
 std::filesystem::path relativePath(const std::filesystem::path &path);
 std::filesystem::path binPath(const std::filesystem::path &path);
+// Returns a tmp path next to path that is unique to the calling writer so that
+// concurrent writers of the same file, even in other processes, don't write
+// into the same tmp file. The finished file is meant to be renamed over path.
+std::filesystem::path uniqueTmpPath(const std::filesystem::path &path);
 
 wheels::String readFileString(
     wheels::Allocator &alloc, const std::filesystem::path &path);
@@ -197,4 +201,7 @@ template <class F> Deferrer<F> operator*(DeferDummy dummy, F f)
 
 void setCurrentThreadName(const char *name);
 
+// Returns the installed physical memory, or 0 if it couldn't be queried
+[[nodiscard]] size_t systemMemoryByteCount();
+
 #endif // PROSPER_UTILS_HPP